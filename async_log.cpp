@@ -0,0 +1,238 @@
+#include "async_log.h"
+
+#ifdef ESP_PLATFORM
+#include <freertos/FreeRTOS.h>
+#include <freertos/task.h>
+#else
+#include <chrono>
+#endif
+
+AsyncLog logger;
+
+static const char LEVEL_LETTERS[] = "?EWID";
+
+// Idle drain period; a burst of messages is written without waiting
+static constexpr uint32_t DRAIN_IDLE_MS = 10;
+
+AsyncLog::AsyncLog() {
+  for (size_t i = 0; i < SLOTS; i++) {
+    slots[i].sequence.store(i, std::memory_order_relaxed);
+  }
+}
+
+// A slot is free for position p when its sequence equals p and holds a
+// message for the reader when it equals p + 1
+AsyncLog::Slot* AsyncLog::reserve(uint32_t& position) {
+  position = writePosition.load(std::memory_order_relaxed);
+  for (;;) {
+    Slot& slot = slots[position % SLOTS];
+    const uint32_t sequence = slot.sequence.load(std::memory_order_acquire);
+    const int32_t difference = (int32_t)(sequence - position);
+    if (difference == 0) {
+      if (writePosition.compare_exchange_weak(position, position + 1,
+                                              std::memory_order_relaxed)) {
+        return &slot;
+      }
+    } else if (difference < 0) {
+      dropped.fetch_add(1, std::memory_order_relaxed);
+      return nullptr;
+    } else {
+      position = writePosition.load(std::memory_order_relaxed);
+    }
+  }
+}
+
+void AsyncLog::publish(Slot* slot, uint32_t position) {
+  written.fetch_add(1, std::memory_order_relaxed);
+  slot->sequence.store(position + 1, std::memory_order_release);
+}
+
+bool AsyncLog::vwrite(LogLevel level, const char* format, va_list args) {
+  uint32_t position;
+  Slot* slot = reserve(position);
+  if (slot == nullptr) {
+    return false;
+  }
+  slot->micros = micros();
+  slot->kind = (uint8_t)level;
+  const int length = vsnprintf(slot->payload, PAYLOAD, format, args);
+  if (length >= (int)PAYLOAD) {
+    truncated.fetch_add(1, std::memory_order_relaxed);
+  }
+  slot->length = length < 0 ? 0 : (length < (int)PAYLOAD ? length : PAYLOAD - 1);
+  publish(slot, position);
+  return true;
+}
+
+bool AsyncLog::write(LogLevel level, const char* format, ...) {
+  va_list args;
+  va_start(args, format);
+  const bool queued = vwrite(level, format, args);
+  va_end(args);
+  return queued;
+}
+
+bool AsyncLog::record(uint8_t type, const void* data, size_t length) {
+  if (length > PAYLOAD || type >= RECORD_KIND) {
+    return false;
+  }
+  uint32_t position;
+  Slot* slot = reserve(position);
+  if (slot == nullptr) {
+    return false;
+  }
+  slot->micros = micros();
+  slot->kind = RECORD_KIND + type;
+  slot->length = length;
+  memcpy(slot->payload, data, length);
+  publish(slot, position);
+  return true;
+}
+
+AsyncLog::Stats AsyncLog::stats() const {
+  return {written.load(), dropped.load(), truncated.load()};
+}
+
+// -=| Output |=-
+
+void AsyncLog::writeText(Print& out, const Slot& slot) {
+  char prefix[24];
+  const uint32_t ms = slot.micros / 1000;
+  const int length =
+      snprintf(prefix, sizeof(prefix), "[%6lu.%03lu] %c ",
+               (unsigned long)(ms / 1000), (unsigned long)(ms % 1000),
+               slot.kind >= RECORD_KIND ? 'R'
+               : slot.kind <= (uint8_t)LogLevel::Debug ? LEVEL_LETTERS[slot.kind]
+                                                       : '?');
+  out.write((const uint8_t*)prefix, length);
+
+  if (slot.kind < RECORD_KIND) {
+    out.write((const uint8_t*)slot.payload, slot.length);
+  } else {
+    static const char HEX_DIGITS[] = "0123456789abcdef";
+    // Type (up to 3 digits), two digits per byte, a space every 4 bytes
+    char hex[3 + 2 * PAYLOAD + (PAYLOAD + 3) / 4 + 1];
+    size_t n = snprintf(hex, sizeof(hex), "%u", (unsigned)(slot.kind - RECORD_KIND));
+    for (size_t i = 0; i < slot.length; i++) {
+      const uint8_t byte = slot.payload[i];
+      if (i % 4 == 0) {
+        hex[n++] = ' ';
+      }
+      hex[n++] = HEX_DIGITS[byte >> 4];
+      hex[n++] = HEX_DIGITS[byte & 0xF];
+    }
+    out.write((const uint8_t*)hex, n);
+  }
+  out.write((const uint8_t*)"\r\n", 2);
+}
+
+void AsyncLog::writeFrame(Print& out, const Slot& slot) {
+  uint8_t header[7] = {FRAME_SYNC,
+                       slot.kind,
+                       slot.length,
+                       (uint8_t)slot.micros,
+                       (uint8_t)(slot.micros >> 8),
+                       (uint8_t)(slot.micros >> 16),
+                       (uint8_t)(slot.micros >> 24)};
+  uint8_t checksum = 0;
+  for (size_t i = 1; i < sizeof(header); i++) {
+    checksum += header[i];
+  }
+  for (size_t i = 0; i < slot.length; i++) {
+    checksum += (uint8_t)slot.payload[i];
+  }
+  out.write(header, sizeof(header));
+  out.write((const uint8_t*)slot.payload, slot.length);
+  out.write(checksum);
+}
+
+bool AsyncLog::drainOne(Print& out) {
+  Slot& slot = slots[readPosition % SLOTS];
+  if (slot.sequence.load(std::memory_order_acquire) != readPosition + 1) {
+    return false;
+  }
+  if (binaryOutput) {
+    writeFrame(out, slot);
+  } else {
+    writeText(out, slot);
+  }
+  slot.sequence.store(readPosition + SLOTS, std::memory_order_release);
+  readPosition++;
+  return true;
+}
+
+size_t AsyncLog::flush(Print& out) {
+  size_t count = 0;
+  while (drainOne(out)) {
+    count++;
+  }
+  return count;
+}
+
+#ifdef ESP_PLATFORM
+
+void AsyncLog::taskMain(void* arg) {
+  AsyncLog* self = (AsyncLog*)arg;
+  while (self->running) {
+    if (!self->drainOne(*self->output)) {
+      vTaskDelay(pdMS_TO_TICKS(DRAIN_IDLE_MS));
+    }
+  }
+  self->task = nullptr;
+  vTaskDelete(nullptr);
+}
+
+bool AsyncLog::begin(Print& out, int core, int priority) {
+  if (running) {
+    return false;
+  }
+  output = &out;
+  running = true;
+
+  TaskHandle_t handle;
+  if (xTaskCreatePinnedToCore(taskMain, "log", 3072, this, priority, &handle,
+                              core) != pdPASS) {
+    running = false;
+    return false;
+  }
+  task = handle;
+  return true;
+}
+
+void AsyncLog::end() {
+  if (running) {
+    running = false;
+    while (task != nullptr) {
+      vTaskDelay(1);
+    }
+  }
+}
+
+#else
+
+bool AsyncLog::begin(Print& out, int core, int priority) {
+  (void)core;
+  (void)priority;
+  if (running) {
+    return false;
+  }
+  output = &out;
+  running = true;
+  thread = std::thread([this] {
+    while (running) {
+      if (!drainOne(*output)) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(DRAIN_IDLE_MS));
+      }
+    }
+  });
+  return true;
+}
+
+void AsyncLog::end() {
+  running = false;
+  if (thread.joinable()) {
+    thread.join();
+  }
+}
+
+#endif
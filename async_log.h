@@ -0,0 +1,166 @@
+#ifndef ASYNC_LOG_H
+#define ASYNC_LOG_H
+
+#include <Arduino.h>
+#include <stdarg.h>
+
+#include <atomic>
+
+#ifndef ESP_PLATFORM
+#include <thread>
+#endif
+
+// -=| Levels |=-
+// LOG_LEVEL selects what is compiled in; calls above it leave no code and
+// their arguments are not evaluated. Define it before including this
+// header, e.g. -DLOG_LEVEL=LOG_LEVEL_WARN. TRACE enables LOG_RECORD, the
+// binary records for high-rate dumps.
+#define LOG_LEVEL_NONE 0
+#define LOG_LEVEL_ERROR 1
+#define LOG_LEVEL_WARN 2
+#define LOG_LEVEL_INFO 3
+#define LOG_LEVEL_DEBUG 4
+#define LOG_LEVEL_TRACE 5
+
+#ifndef LOG_LEVEL
+#define LOG_LEVEL LOG_LEVEL_INFO
+#endif
+
+enum class LogLevel : uint8_t { Error = 1, Warn, Info, Debug };
+
+/**
+ * Log messages are formatted by the caller straight into a slot of a
+ * preallocated ring and written to the UART by a background task, so
+ * logging costs the formatting and a few atomic operations, never the
+ * time the bytes take on the wire. Any task may write (a bounded
+ * multi-producer queue with a sequence number per slot); when the ring is
+ * full the message is dropped and counted instead of waiting.
+ *
+ * Output is text ("[   12.345] I message"), or with setBinaryOutput() a
+ * framed binary stream for dumps at sample rate:
+ *
+ *   0xA5, kind, length, micros (uint32 LE), payload, checksum
+ *
+ * kind is the LogLevel for text messages and 0x80 + type for LOG_RECORD
+ * payloads; the checksum is the low byte of the sum of kind..payload.
+ * Text mode prints records as "R<type> <hex bytes>".
+ */
+class AsyncLog {
+ public:
+  static constexpr size_t SLOTS = 64;  // power of two
+  static constexpr size_t PAYLOAD = 120;
+  static constexpr uint8_t FRAME_SYNC = 0xA5;
+  static constexpr uint8_t RECORD_KIND = 0x80;
+
+  struct Stats {
+    uint32_t written;    // messages and records queued
+    uint32_t dropped;    // ring was full
+    uint32_t truncated;  // text longer than PAYLOAD
+  };
+
+  AsyncLog();
+  ~AsyncLog() { end(); }
+
+  // Starts draining into `out`; core and priority only apply to the ESP32
+  // task. Messages queued before begin() are kept until the ring is full.
+  bool begin(Print& out, int core, int priority);
+  void end();
+
+  bool write(LogLevel level, const char* format, ...)
+      __attribute__((format(printf, 3, 4)));
+  bool vwrite(LogLevel level, const char* format, va_list args);
+
+  // Binary payload of up to PAYLOAD bytes; `type` is 0..127
+  bool record(uint8_t type, const void* data, size_t length);
+
+  // Writes out what is queued, e.g. before deep sleep or a reset. Only
+  // one thread may drain at a time; call it after end() or instead of
+  // begin().
+  size_t flush(Print& out);
+
+  void setBinaryOutput(bool binary) { binaryOutput = binary; }
+  bool isBinaryOutput() const { return binaryOutput; }
+
+  Stats stats() const;
+
+ private:
+  struct Slot {
+    std::atomic<uint32_t> sequence;
+    uint32_t micros;
+    uint8_t kind;
+    uint8_t length;
+    char payload[PAYLOAD];
+  };
+
+  Slot slots[SLOTS];
+  std::atomic<uint32_t> writePosition{0};
+  uint32_t readPosition = 0;
+  std::atomic<bool> binaryOutput{false};
+  Print* output = nullptr;
+  std::atomic<bool> running{false};
+
+  std::atomic<uint32_t> written{0};
+  std::atomic<uint32_t> dropped{0};
+  std::atomic<uint32_t> truncated{0};
+
+#ifdef ESP_PLATFORM
+  void* task = nullptr;  // TaskHandle_t
+  static void taskMain(void* arg);
+#else
+  std::thread thread;
+#endif
+
+  Slot* reserve(uint32_t& position);
+  void publish(Slot* slot, uint32_t position);
+  bool drainOne(Print& out);
+  void writeText(Print& out, const Slot& slot);
+  void writeFrame(Print& out, const Slot& slot);
+};
+
+extern AsyncLog logger;
+
+// Disabled calls are still type-checked but never evaluated, so they leave
+// no code behind and arguments used only for logging stay "used"
+#define LOG_DISABLED(level, ...)         \
+  do {                                  \
+    if (false) {                        \
+      logger.write(level, __VA_ARGS__); \
+    }                                   \
+  } while (0)
+
+#if LOG_LEVEL >= LOG_LEVEL_ERROR
+#define LOG_ERROR(...) logger.write(LogLevel::Error, __VA_ARGS__)
+#else
+#define LOG_ERROR(...) LOG_DISABLED(LogLevel::Error, __VA_ARGS__)
+#endif
+
+#if LOG_LEVEL >= LOG_LEVEL_WARN
+#define LOG_WARN(...) logger.write(LogLevel::Warn, __VA_ARGS__)
+#else
+#define LOG_WARN(...) LOG_DISABLED(LogLevel::Warn, __VA_ARGS__)
+#endif
+
+#if LOG_LEVEL >= LOG_LEVEL_INFO
+#define LOG_INFO(...) logger.write(LogLevel::Info, __VA_ARGS__)
+#else
+#define LOG_INFO(...) LOG_DISABLED(LogLevel::Info, __VA_ARGS__)
+#endif
+
+#if LOG_LEVEL >= LOG_LEVEL_DEBUG
+#define LOG_DEBUG(...) logger.write(LogLevel::Debug, __VA_ARGS__)
+#else
+#define LOG_DEBUG(...) LOG_DISABLED(LogLevel::Debug, __VA_ARGS__)
+#endif
+
+#if LOG_LEVEL >= LOG_LEVEL_TRACE
+#define LOG_RECORD(type, data, length) logger.record(type, data, length)
+#else
+#define LOG_RECORD(type, data, length) \
+  do {                                   \
+    if (false) {                         \
+      logger.record(type, data, length); \
+    }                                    \
+  } while (0)
+#endif
+
+#endif  // ASYNC_LOG_H
@@ -0,0 +1,82 @@
+// bench_bus_access.cpp -- I2C transactions, payload bytes and bus time per
+// driver operation, counted by the simulated bus at 100 kHz and 400 kHz.
+//
+//   ./bench_bus_access
+#include <initializer_list>
+
+#include "bme280_sim.h"
+#include "bmx_280.h"
+#include "mpu6500_sim.h"
+#include "mpu_x.h"
+
+struct Cost {
+  uint32_t transactions;
+  uint64_t bytes;
+  uint64_t busMicros;
+};
+
+template <typename Operation>
+static Cost measure(Operation operation, int repeats) {
+  SimI2cBus& bus = Wire.simBus();
+  bus.resetStats();
+  for (int i = 0; i < repeats; i++) {
+    operation();
+  }
+  const SimI2cBus::Stats& stats = bus.stats();
+  return {stats.transactions / repeats,
+          (stats.bytesRead + stats.bytesWritten) / repeats,
+          stats.busMicros / repeats};
+}
+
+static void report(const char* name, uint32_t clockHz, const Cost& cost) {
+  printf("%-28s %7u Hz  %3u transactions  %5llu bytes  %7llu us\n", name,
+         clockHz, cost.transactions, (unsigned long long)cost.bytes,
+         (unsigned long long)cost.busMicros);
+}
+
+int main() {
+  host::setSerialQuiet(true);
+  Bme280Sim bmeSim;
+  Mpu6500Sim mpuSim;
+  Wire.simBus().attach(0x77, &bmeSim);
+  Wire.simBus().attach(0x68, &mpuSim);
+
+  for (uint32_t clockHz : {100000u, 400000u}) {
+    i2cScheduler.setDevice(0x77, {clockHz, I2cScheduler::PRIORITY_SENSOR, 0, 0});
+    i2cScheduler.setDevice(0x68, {clockHz, I2cScheduler::PRIORITY_REALTIME, 0, 0});
+
+    BMx280 normal(0x77, BMx280Config::highResolution());
+    report("BMx280::init (normal)", clockHz,
+           measure([&] { normal.init(); }, 1));
+    delay(200);
+    report("BMx280::readAll (normal)", clockHz,
+           measure([&] { normal.readAll(); }, 100));
+    report("BMx280 T+P+H getters", clockHz, measure([&] {
+             normal.readTemperature();
+             normal.readPressure();
+             normal.readHumidity();
+           }, 100));
+
+    BMx280 forced(0x77, BMx280Config::weatherMonitoring());
+    forced.init();
+    report("BMx280::readAll (forced)", clockHz,
+           measure([&] { forced.readAll(); }, 100));
+
+    MPUx mpu(0x68);
+    report("MPUx::init", clockHz, measure([&] { mpu.init(); }, 1));
+    report("MPUx::getAcclVals", clockHz,
+           measure([&] { mpu.getAcclVals(); }, 100));
+
+    // 20 ms of frames at 1 kHz, well within the 512-byte FIFO
+    mpu.beginFifo(0, 1);
+    report("MPUx::pollFifo (20 frames)", clockHz, measure([&] {
+             delay(20);
+             mpu.pollFifo();
+             MPUx::RawSample samples[128];
+             mpu.readSamples(samples, 128);
+           }, 10));
+    mpu.endFifo();
+    printf("\n");
+  }
+  return 0;
+}
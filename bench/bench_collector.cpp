@@ -0,0 +1,108 @@
+// bench_collector.cpp -- the collector's cost per row: ReadingParser alone
+// on /data rows, then one poll round of Collector over `stations` StationSim
+// stations with `backlog` readings each, served from a second thread. The
+// CPU time is the collector thread's own. Writes to bench_collector.stations/
+// (removed first).
+//
+//   ./bench_collector [stations] [backlog]
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/resource.h>
+#include <time.h>
+
+#include <atomic>
+#include <string>
+#include <thread>
+
+#include "collector.h"
+#include "station_sim.h"
+
+static const char* const DIRECTORY = "bench_collector.stations";
+
+static double seconds(clockid_t clock) {
+  timespec now;
+  clock_gettime(clock, &now);
+  return now.tv_sec + now.tv_nsec * 1e-9;
+}
+
+static void benchParser() {
+  std::string body;
+  for (int i = 0; body.size() < (1 << 20); i++) {
+    char row[300];
+    body.append(row, snprintf(row, sizeof(row),
+                              ",\n  {\n    \"seq\": %d,\n    \"sensor\": \"bus0/0x77\",\n"
+                              "    \"timestamp\": \"2025-10-09 08:%02d:%02d\",\n"
+                              "    \"temperature\": 21.%02d,\n    \"pressure\": 1003.25,\n"
+                              "    \"humidity\": 41.50\n  }",
+                              i, i / 60 % 60, i % 60, i % 100));
+  }
+  const int repeats = 200;
+  uint64_t rows = 0;
+  volatile float sink = 0;
+  const double start = seconds(CLOCK_MONOTONIC);
+  for (int r = 0; r < repeats; r++) {
+    const char* cursor = body.data();
+    StationObject object;
+    while (ReadingParser::next(cursor, body.data() + body.size(), object)) {
+      rows++;
+      sink = sink + object.temperature;
+    }
+  }
+  const double elapsed = seconds(CLOCK_MONOTONIC) - start;
+  printf("ReadingParser: %.0f MB/s, %.1fM rows/s\n", body.size() * repeats / elapsed / 1e6,
+         rows / elapsed / 1e6);
+}
+
+int main(int argc, char** argv) {
+  const size_t stations = argc > 1 ? atoi(argv[1]) : 500;
+  const size_t backlog = argc > 2 ? atoi(argv[2]) : 2000;
+  benchParser();
+
+  // Listeners and connections on both sides
+  rlimit limit;
+  getrlimit(RLIMIT_NOFILE, &limit);
+  limit.rlim_cur = limit.rlim_max;
+  setrlimit(RLIMIT_NOFILE, &limit);
+  if (system((std::string("rm -rf ") + DIRECTORY + " && mkdir " + DIRECTORY).c_str()) != 0) {
+    return 1;
+  }
+
+  StationSim sim;
+  if (!sim.begin(stations)) {
+    perror("StationSim::begin");
+    return 1;
+  }
+  for (size_t i = 0; i < stations; i++) {
+    for (size_t k = 0; k < backlog; k++) {
+      sim.addReading(i, 1760000000 + k * 5);
+    }
+  }
+  Collector collector(DIRECTORY, CollectMode::Poll, 1);
+  for (size_t i = 0; i < stations; i++) {
+    if (!collector.addStation({"s" + std::to_string(i), "127.0.0.1", sim.port(i), 0})) {
+      return 1;
+    }
+  }
+
+  std::atomic<bool> serving{true};
+  std::thread server([&] {
+    while (serving) sim.poll(10);
+  });
+  volatile sig_atomic_t stop = 0;
+  const double wallStart = seconds(CLOCK_MONOTONIC);
+  const double cpuStart = seconds(CLOCK_THREAD_CPUTIME_ID);
+  while (!collector.roundComplete()) {
+    collector.runFor(10, stop);
+  }
+  const double cpu = seconds(CLOCK_THREAD_CPUTIME_ID) - cpuStart;
+  const double wall = seconds(CLOCK_MONOTONIC) - wallStart;
+  serving = false;
+  server.join();
+
+  const Collector::Stats stats = collector.stats();
+  printf("poll round: %zu stations, %llu rows, %.1f MB in %.2f s, collector %.2f s CPU: "
+         "%.2fM rows per CPU-second, %llu errors\n",
+         stations, (unsigned long long)stats.rows, stats.bytes / 1e6, wall, cpu,
+         stats.rows / cpu / 1e6, (unsigned long long)stats.errors);
+  return 0;
+}
@@ -0,0 +1,102 @@
+// bench_compensation.cpp -- the BME280 pressure kernels against the INT64
+// reference: maximum error over a 200x200 grid of adc_T (-40..85 C) and
+// adc_P, using the points that give 30..110 kPa, and host time per sample.
+// x86-64 has native 64-bit arithmetic, so the timings only show relative
+// cost; on the ESP32 the INT64 kernel pays for the multiply and divide
+// helpers.
+//
+//   ./bench_compensation
+#include <chrono>
+
+#include "bme280_sim.h"
+#include "bmx_280.h"
+
+static constexpr int GRID = 200;
+static constexpr int REPEATS = 50;
+
+typedef float (BMx280::*Kernel)(int32_t, int32_t);
+
+struct GridPoint {
+  int32_t adcP;
+  int32_t tFine;
+};
+
+static double nanosPerSample(BMx280& bme, Kernel kernel,
+                             const GridPoint* points, size_t count) {
+  volatile float sink = 0;
+  const auto start = std::chrono::steady_clock::now();
+  for (int r = 0; r < REPEATS; r++) {
+    for (size_t i = 0; i < count; i++) {
+      sink = sink + (bme.*kernel)(points[i].adcP, points[i].tFine);
+    }
+  }
+  const auto end = std::chrono::steady_clock::now();
+  return std::chrono::duration<double, std::nano>(end - start).count() /
+         (REPEATS * count);
+}
+
+// 20-bit adc_T giving `celsius`; the temperature rises with adc_T
+static int32_t adcForTemperature(BMx280& bme, float celsius) {
+  int32_t low = 0, high = 0xFFFFF;
+  while (low < high) {
+    const int32_t mid = low + (high - low) / 2;
+    if (bme.compensateTemperature(bme.compensateTFine(mid << 4)) < celsius) {
+      low = mid + 1;
+    } else {
+      high = mid;
+    }
+  }
+  return low;
+}
+
+int main() {
+  host::setSerialQuiet(true);
+  Bme280Sim sim;
+  Wire.simBus().attach(0x77, &sim);
+  BMx280 bme(0x77);
+  if (!bme.init()) {
+    fprintf(stderr, "init failed\n");
+    return 1;
+  }
+
+  // adc_T over the operating range -40..85 C, adc_P over its 20-bit range
+  const int32_t adcTLow = adcForTemperature(bme, -40.0f);
+  const int32_t adcTHigh = adcForTemperature(bme, 85.0f);
+  static GridPoint points[GRID * GRID];
+  size_t count = 0;
+  for (int t = 0; t < GRID; t++) {
+    const int32_t adcT = adcTLow + (adcTHigh - adcTLow) * t / (GRID - 1);
+    const int32_t tFine = bme.compensateTFine(adcT << 4);
+    for (int p = 0; p < GRID; p++) {
+      const int32_t adcP = p * (0xFFFFF / (GRID - 1));
+      const float reference = bme.compensatePressureInt64(adcP, tFine);
+      if (reference >= 30000.0f && reference <= 110000.0f) {
+        points[count++] = {adcP, tFine};
+      }
+    }
+  }
+
+  const struct {
+    const char* name;
+    Kernel kernel;
+  } kernels[] = {
+      {"INT64", &BMx280::compensatePressureInt64},
+      {"INT32", &BMx280::compensatePressureInt32},
+      {"FLOAT", &BMx280::compensatePressureFloat},
+  };
+
+  printf("%zu grid points in 30..110 kPa\n", count);
+  printf("kernel  max |error| Pa  ns/sample\n");
+  for (const auto& k : kernels) {
+    double maxError = 0;
+    for (size_t i = 0; i < count; i++) {
+      const double error =
+          fabs((double)(bme.*k.kernel)(points[i].adcP, points[i].tFine) -
+               bme.compensatePressureInt64(points[i].adcP, points[i].tFine));
+      if (error > maxError) maxError = error;
+    }
+    printf("%-6s  %12.3f  %9.1f\n", k.name, maxError,
+           nanosPerSample(bme, k.kernel, points, count));
+  }
+  return 0;
+}
@@ -0,0 +1,130 @@
+// bench_data_export.cpp -- the /data body against the /data.bin body for
+// a week of readings at one per minute: payload size and the time the
+// device spends producing each, history decoding included. Both bodies go
+// through ChunkedWriter into a socket stand-in, as in the sketch; the rows
+// are formatted as writeReadingRow() does. Host figures; the ratio is what
+// carries over to the ESP32.
+//
+// With a directory argument the de-chunked bodies are also written there
+// as data.json and data.bin, for the client side in bench_data_export.py:
+//
+//   ./bench_data_export [dir] [readings]
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <chrono>
+#include <string>
+
+#include "chunked_writer.h"
+#include "history_store.h"
+
+// Counts what reaches the socket and keeps the body without the chunk
+// framing; ChunkedWriter sends every chunk in one write()
+struct BodyPrint : Print {
+  size_t bytes = 0;
+  bool keep = false;
+  std::string body;
+
+  size_t write(uint8_t c) override { return write(&c, 1); }
+  size_t write(const uint8_t* buffer, size_t size) override {
+    bytes += size;
+    const char* data = (const char*)memchr(buffer, '\n', size);
+    if (keep && data != nullptr && size >= 4) {
+      body.append(data + 1, size - (data + 1 - (const char*)buffer) - 2);
+    }
+    return size;
+  }
+};
+
+static void writeJson(Print& client, const HistoryStore& history) {
+  ChunkedWriter out(client);
+  HistoryStore::Reader reader(history);
+  reader.seek(history.firstSequence());
+  out.write("[\n");
+  HistoryRecord record;
+  bool first = true;
+  while (reader.next(record)) {
+    const HistorySample reading = historyDecode(record);
+    char timestamp[24];
+    historyFormatTimestamp(timestamp, sizeof(timestamp), reading.timestamp);
+    out.write(first ? "  {\n    \"seq\": " : ",\n  {\n    \"seq\": ");
+    out.writeUnsigned(reader.sequence() - 1);
+    out.write(",\n    \"timestamp\": \"");
+    out.write(timestamp);
+    out.write("\",\n    \"temperature\": ");
+    out.writeFixed(reading.temperature, 2);
+    out.write(",\n    \"pressure\": ");
+    out.writeFixed(reading.pressure, 2);
+    out.write(",\n    \"humidity\": ");
+    out.writeFixed(reading.humidity, 2);
+    out.write("\n  }");
+    first = false;
+  }
+  out.write("\n]");
+  out.finish();
+}
+
+static void writeBinary(Print& client, const HistoryStore& history) {
+  ChunkedWriter out(client);
+  HistoryStore::Reader reader(history);
+  reader.seek(history.firstSequence());
+  const HistoryExportHeader header = historyExportHeader(reader.sequence());
+  out.write((const char*)&header, sizeof(header));
+  HistoryRecord record;
+  while (reader.next(record)) {
+    out.write((const char*)&record, sizeof(record));
+  }
+  out.finish();
+}
+
+template <typename Serializer>
+static double measure(const char* name, Serializer serializer, const HistoryStore& history,
+                      const char* dir, const char* file) {
+  const int repeats = 50;
+  BodyPrint out;
+  const auto start = std::chrono::steady_clock::now();
+  for (int r = 0; r < repeats; r++) {
+    serializer(out, history);
+  }
+  const double seconds =
+      std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+  printf("%-10s %9zu bytes  %7.3f ms per request  %6.1f ns/reading\n", name, out.bytes / repeats,
+         seconds * 1e3 / repeats, seconds * 1e9 / (repeats * history.size()));
+
+  if (dir != nullptr) {
+    out.keep = true;
+    serializer(out, history);
+    const std::string path = std::string(dir) + "/" + file;
+    FILE* body = fopen(path.c_str(), "wb");
+    if (body == nullptr || fwrite(out.body.data(), 1, out.body.size(), body) != out.body.size()) {
+      perror(path.c_str());
+    }
+    if (body != nullptr) {
+      fclose(body);
+    }
+  }
+  return seconds;
+}
+
+int main(int argc, char** argv) {
+  const char* dir = argc > 1 ? argv[1] : nullptr;
+  const size_t count = argc > 2 ? atoi(argv[2]) : 10080;
+  HistoryStore history;
+  if (!history.begin(count * sizeof(HistoryRecord), 0)) {
+    return 1;
+  }
+  srand(1);
+  for (size_t i = 0; i < count; i++) {
+    history.append(HistorySample{1760000000 + (uint32_t)i * 60, 15.0f + rand() % 1500 / 100.0f,
+                                 990.0f + rand() % 3000 / 100.0f,
+                                 i % 97 == 0 ? NAN : 30.0f + rand() % 4000 / 100.0f});
+  }
+
+  printf("%zu readings\n", history.size());
+  const double json = measure("/data", writeJson, history, dir, "data.json");
+  const double binary = measure("/data.bin", writeBinary, history, dir, "data.bin");
+  printf("binary takes %.1fx less device time\n", json / binary);
+  return 0;
+}
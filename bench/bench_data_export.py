@@ -0,0 +1,60 @@
+# bench_data_export.py -- client side of bench_data_export: the time
+# fetch_and_plot.py needs to turn each body into plot arrays, json.loads
+# plus parse_timestamp() per row for /data against decode_binary() for
+# /data.bin, and a check that both give the same values.
+#
+#   ./build/bench_data_export /tmp
+#   python3 bench/bench_data_export.py /tmp
+
+import json
+import math
+import os
+import sys
+import time
+
+import numpy as np
+
+os.environ.setdefault("MPLBACKEND", "Agg")
+sys.path.insert(0, os.path.join(os.path.dirname(os.path.abspath(__file__)), ".."))
+import fetch_and_plot  # noqa: E402
+
+
+def parse_json(payload):
+    rows = json.loads(payload)
+    stamps = [fetch_and_plot.parse_timestamp(row["timestamp"]) for row in rows]
+    values = [[row[name] if row[name] is not None else math.nan for row in rows]
+              for name in fetch_and_plot.CHANNELS]
+    return stamps, values
+
+
+def parse_binary(payload):
+    _, stamps, values = fetch_and_plot.decode_binary(payload)
+    return stamps, values
+
+
+def measure(name, parse, payload, repeats=5):
+    start = time.perf_counter()
+    for _ in range(repeats):
+        result = parse(payload)
+    elapsed = (time.perf_counter() - start) / repeats
+    print(f"{name:10} {len(payload):9} bytes  {elapsed * 1e3:8.2f} ms per body")
+    return result, elapsed
+
+
+directory = sys.argv[1] if len(sys.argv) > 1 else "."
+with open(os.path.join(directory, "data.json"), "rb") as f:
+    text = f.read()
+with open(os.path.join(directory, "data.bin"), "rb") as f:
+    binary = f.read()
+
+(json_stamps, json_values), json_time = measure("/data", parse_json, text)
+(bin_stamps, bin_values), bin_time = measure("/data.bin", parse_binary, binary)
+print(f"binary parses {json_time / bin_time:.0f}x faster")
+
+# parse_timestamp() is relative to the first reading, the records are not
+same = len(json_stamps) == len(bin_stamps) and \
+    np.array_equal(np.asarray(json_stamps), bin_stamps.astype(np.float64) - bin_stamps[0])
+for expected, decoded in zip(json_values, bin_values):
+    same = same and np.allclose(expected, decoded, atol=0.005, equal_nan=True)
+print("values match" if same else "VALUES DIFFER")
+sys.exit(0 if same else 1)
@@ -0,0 +1,66 @@
+// bench_fft.cpp -- VibrationAnalyzer throughput: windows analyzed per
+// second (three axes each, Hann window, real FFT, RMS, peak and bands) and
+// the bare real FFT, against the 7.8 windows/s that 1 kHz data produces.
+//
+//   ./bench_fft [windows]
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <chrono>
+
+#include "vibration.h"
+
+typedef std::chrono::steady_clock Clock;
+
+static VibrationAnalyzer analyzer;
+
+static double secondsSince(Clock::time_point start) {
+  return std::chrono::duration<double>(Clock::now() - start).count();
+}
+
+int main(int argc, char** argv) {
+  const int windows = argc > 1 ? atoi(argv[1]) : 20000;
+  const float sampleRate = 1000.0f;
+  analyzer.begin(sampleRate);
+
+  static float x[VibrationAnalyzer::HOP], y[VibrationAnalyzer::HOP], z[VibrationAnalyzer::HOP];
+  for (size_t i = 0; i < VibrationAnalyzer::HOP; i++) {
+    x[i] = 0.1f * sinf(2 * M_PI * 62.5f * i / sampleRate);
+    y[i] = 0.02f * sinf(2 * M_PI * 140.0f * i / sampleRate);
+    z[i] = 1.0f;
+  }
+
+  // Every HOP samples complete a window once the first one is full
+  const float* const axes[3] = {x, y, z};
+  analyzer.feed(axes, VibrationAnalyzer::HOP);
+  volatile float sink = 0;
+  Clock::time_point start = Clock::now();
+  for (int i = 0; i < windows; i++) {
+    analyzer.feed(axes, VibrationAnalyzer::HOP);
+    sink = sink + analyzer.analyze().rms[0];
+  }
+  double seconds = secondsSince(start);
+  printf("analyze(): %.0f windows/s, %.1f us per window of %u samples x 3 axes\n",
+         windows / seconds, seconds / windows * 1e6, (unsigned)VibrationAnalyzer::WINDOW);
+  printf("1 kHz data needs %.1f windows/s, %.3f%% of one core here\n",
+         sampleRate / VibrationAnalyzer::HOP,
+         100.0 * sampleRate / VibrationAnalyzer::HOP * seconds / windows);
+
+  static float in[VibrationAnalyzer::WINDOW];
+  static float out[2 * VibrationAnalyzer::BINS];
+  for (size_t i = 0; i < VibrationAnalyzer::WINDOW; i++) {
+    in[i] = x[i % VibrationAnalyzer::HOP];
+  }
+  const int transforms = windows * 3;
+  start = Clock::now();
+  for (int i = 0; i < transforms; i++) {
+    in[0] = (float)i;
+    analyzer.realFft(in, out);
+    sink = sink + out[2];
+  }
+  seconds = secondsSince(start);
+  printf("realFft(): %.2f us per %u-point transform\n", seconds / transforms * 1e6,
+         (unsigned)VibrationAnalyzer::WINDOW);
+  return 0;
+}
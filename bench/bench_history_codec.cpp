@@ -0,0 +1,166 @@
+// bench_history_codec.cpp -- compression ratio and encode/decode
+// throughput of the history block codec on synthetic series of 200k
+// readings 60 s apart, and on a recorded one when a CSV file is given
+// (epoch seconds,temperature,pressure,humidity per line; empty fields are
+// missing values). Blocks are 256 bytes as in HistoryStore. Every series
+// must round-trip bit-exactly. Throughput is in MB/s of 10-byte records.
+//
+//   ./bench_history_codec [recorded.csv]
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <chrono>
+#include <random>
+#include <vector>
+
+#include "history_codec.h"
+
+static constexpr size_t READINGS = 200000;
+static constexpr size_t BLOCK_SIZE = 256;
+static constexpr int REPEATS = 10;
+
+struct Block {
+  uint8_t data[BLOCK_SIZE];
+  size_t size;
+};
+
+static std::vector<Block> encodeAll(const std::vector<HistoryRecord>& records) {
+  std::vector<Block> blocks;
+  HistoryEncoder encoder;
+  uint8_t encoded[HistoryEncoder::MAX_ENCODED_SIZE];
+  for (const HistoryRecord& record : records) {
+    size_t size = encoder.encode(record, encoded);
+    if (blocks.empty() || blocks.back().size + size > BLOCK_SIZE) {
+      blocks.push_back(Block());
+      blocks.back().size = 0;
+      encoder.reset();
+      size = encoder.encode(record, encoded);
+    }
+    Block& block = blocks.back();
+    memcpy(block.data + block.size, encoded, size);
+    block.size += size;
+  }
+  return blocks;
+}
+
+static size_t decodeAll(const std::vector<Block>& blocks, HistoryRecord* out) {
+  size_t count = 0;
+  for (const Block& block : blocks) {
+    HistoryDecoder decoder(block.data, block.size);
+    while (decoder.next(out[count])) {
+      count++;
+    }
+  }
+  return count;
+}
+
+static double seconds() {
+  return std::chrono::duration<double>(
+      std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+static void report(const char* name, const std::vector<HistoryRecord>& records) {
+  std::vector<Block> blocks;
+  double start = seconds();
+  for (int r = 0; r < REPEATS; r++) {
+    blocks = encodeAll(records);
+  }
+  const double encodeTime = (seconds() - start) / REPEATS;
+
+  std::vector<HistoryRecord> decoded(records.size());
+  size_t count = 0;
+  start = seconds();
+  for (int r = 0; r < REPEATS; r++) {
+    count = decodeAll(blocks, decoded.data());
+  }
+  const double decodeTime = (seconds() - start) / REPEATS;
+
+  size_t bytes = 0;
+  for (const Block& block : blocks) {
+    bytes += block.size;
+  }
+  const bool exact = count == records.size() &&
+                     memcmp(decoded.data(), records.data(), count * sizeof(HistoryRecord)) == 0;
+  const double megabytes = records.size() * sizeof(HistoryRecord) / 1e6;
+  printf("%-18s %7zu readings  %5.2f B/reading  enc %5.0f MB/s  dec %5.0f MB/s  %s\n", name,
+         records.size(), (double)bytes / records.size(), megabytes / encodeTime,
+         megabytes / decodeTime, exact ? "exact" : "MISMATCH");
+}
+
+template <typename Generator>
+static std::vector<HistoryRecord> series(Generator generator) {
+  std::vector<HistoryRecord> records(READINGS);
+  for (size_t i = 0; i < READINGS; i++) {
+    records[i] = historyEncode(generator(i));
+  }
+  return records;
+}
+
+static std::vector<HistoryRecord> readCsv(const char* path) {
+  std::vector<HistoryRecord> records;
+  FILE* file = fopen(path, "r");
+  if (file == nullptr) {
+    perror(path);
+    return records;
+  }
+  char line[256];
+  while (fgets(line, sizeof(line), file) != nullptr) {
+    char* field = line;
+    HistorySample sample;
+    float* channels[] = {&sample.temperature, &sample.pressure, &sample.humidity};
+    sample.timestamp = strtoul(field, &field, 10);
+    for (float* channel : channels) {
+      char* end = *field == ',' ? field + 1 : field;
+      *channel = strtof(end, &field);
+      if (field == end) {
+        *channel = NAN;
+      }
+    }
+    if (sample.timestamp != 0) {
+      records.push_back(historyEncode(sample));
+    }
+  }
+  fclose(file);
+  return records;
+}
+
+int main(int argc, char** argv) {
+  const uint32_t start = 1760000000;
+  std::mt19937 random(1);
+  std::normal_distribution<float> noise(0.0f, 1.0f);
+
+  report("steady", series([&](size_t i) {
+           return HistorySample{start + (uint32_t)i * 60, 21.5f, 1003.25f, 41.5f};
+         }));
+  report("diurnal + noise", series([&](size_t i) {
+           const float day = sinf(i * 60 * 2 * (float)M_PI / 86400);
+           return HistorySample{start + (uint32_t)i * 60, 21.0f + 3.0f * day + 0.03f * noise(random),
+                                1003.0f + 2.0f * day + 0.02f * noise(random),
+                                45.0f - 8.0f * day + 0.1f * noise(random)};
+         }));
+  float temperature = 21.0f, pressure = 1003.0f, humidity = 45.0f;
+  report("random walk", series([&](size_t i) {
+           temperature += 0.05f * noise(random);
+           pressure += 0.05f * noise(random);
+           humidity = fminf(100.0f, fmaxf(0.0f, humidity + 0.1f * noise(random)));
+           return HistorySample{start + (uint32_t)i * 60, temperature, pressure, humidity};
+         }));
+  uint32_t timestamp = start;
+  report("jittered + NaNs", series([&](size_t i) {
+           timestamp += 55 + random() % 11;
+           return HistorySample{timestamp, i % 97 == 0 ? NAN : 21.0f + 0.5f * noise(random),
+                                1003.0f + 0.5f * noise(random),
+                                i % 13 == 0 ? NAN : 45.0f + 2.0f * noise(random)};
+         }));
+
+  if (argc > 1) {
+    const std::vector<HistoryRecord> recorded = readCsv(argv[1]);
+    if (recorded.empty()) {
+      return 1;
+    }
+    report("recorded", recorded);
+  }
+  return 0;
+}
@@ -0,0 +1,100 @@
+// bench_history_store.cpp -- append and scan throughput of the history:
+// the RAM ring of compressed blocks and FlashHistoryLog on a file with NOR
+// semantics the size of the "history" partition, including the resume scan
+// of begin() after a reset. Host figures; on the ESP32 the flash log is
+// bound by program and erase times instead.
+//
+//   ./bench_history_store [readings]
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <chrono>
+#include <vector>
+
+#include "file_page_store.h"
+#include "history_store.h"
+
+static const char* const PATH = "bench_history_store.flash";
+// 0x1F0000 bytes in dmp_project/partitions.csv
+static constexpr size_t PARTITION_PAGES = 0x1F0000 / FlashPageStore::PAGE_SIZE;
+
+static double seconds() {
+  return std::chrono::duration<double>(
+      std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+static void report(const char* name, size_t records, double elapsed) {
+  printf("%-28s %8zu records  %8.1f ns/record  %7.1f MB/s\n", name, records,
+         elapsed * 1e9 / records, records * sizeof(HistoryRecord) / elapsed / 1e6);
+}
+
+int main(int argc, char** argv) {
+  const size_t count = argc > 1 ? atoi(argv[1]) : 100000;
+  std::vector<HistorySample> samples(count);
+  for (size_t i = 0; i < count; i++) {
+    samples[i] = {1760000000 + (uint32_t)i * 60, 21.0f + (i % 500) / 100.0f,
+                  1003.25f + (i % 300) / 100.0f, 41.5f + (i % 900) / 100.0f};
+  }
+
+  HistoryStore ring;
+  if (!ring.begin(count * sizeof(HistoryRecord), 0)) {
+    return 1;
+  }
+  double start = seconds();
+  for (const HistorySample& sample : samples) {
+    ring.append(sample);
+  }
+  report("HistoryStore::append", count, seconds() - start);
+  volatile int32_t sink = 0;
+  HistoryStore::Reader reader(ring);
+  HistoryRecord record;
+  size_t records = 0;
+  start = seconds();
+  reader.seek(ring.firstSequence());
+  while (reader.next(record)) {
+    sink = sink + record.temperature;
+    records++;
+  }
+  report("HistoryStore::Reader", records, seconds() - start);
+
+  remove(PATH);
+  size_t pages;
+  {
+    FilePageStore store;
+    FlashHistoryLog log;
+    if (!store.begin(PATH, PARTITION_PAGES) || !log.begin(&store)) {
+      perror(PATH);
+      return 1;
+    }
+    start = seconds();
+    for (const HistorySample& sample : samples) {
+      log.append(historyEncode(sample));
+    }
+    report("FlashHistoryLog::append", count, seconds() - start);
+    pages = log.pageCount();
+    printf("%zu of %zu pages used, %u erases\n", pages, PARTITION_PAGES,
+           (unsigned)store.erases());
+  }
+
+  // As after a reset: resume from the page headers, then read everything
+  FilePageStore store;
+  FlashHistoryLog log;
+  start = seconds();
+  if (!store.begin(PATH, PARTITION_PAGES) || !log.begin(&store)) {
+    return 1;
+  }
+  printf("FlashHistoryLog::begin       %8zu pages    %8.1f ms\n", log.pageCount(),
+         (seconds() - start) * 1e3);
+  std::vector<uint8_t> page(FlashHistoryLog::PAGE_DATA_SIZE);
+  records = 0;
+  start = seconds();
+  for (size_t i = 0; i < log.pageCount(); i++) {
+    HistoryDecoder decoder(page.data(), log.readPage(i, page.data()));
+    while (decoder.next(record)) {
+      records++;
+    }
+  }
+  report("readPage + decode", records, seconds() - start);
+  remove(PATH);
+  return pages == 0;
+}
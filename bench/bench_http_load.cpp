@@ -0,0 +1,166 @@
+// bench_http_load.cpp -- load test for HttpServer over loopback sockets.
+// The main thread polls the server like loop() does; client threads fetch
+// a 20 KB chunked body over and over, and idle clients connect without
+// sending anything so they hold a slot until the 408 timeout. Reports the
+// request rate, the client-side latency and the time spent in one poll().
+// The simulated clock follows the wall clock so timeouts work.
+//
+//   ./bench_http_load [clients] [requests per client] [idle clients]
+#include <stdlib.h>
+#include <sys/socket.h>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "chunked_writer.h"
+#include "http_server.h"
+
+static constexpr uint32_t BODY_CHUNKS = 40;
+
+typedef std::chrono::steady_clock Clock;
+
+static double secondsSince(Clock::time_point start) {
+  return std::chrono::duration<double>(Clock::now() - start).count();
+}
+
+// One ChunkedWriter chunk per step, like the /data handler
+static bool handler(WiFiClient& client, const HttpRequest& request,
+                    HttpResponseState& state) {
+  (void)request;
+  if (state.step == 0) {
+    ChunkedWriter::writeHeaders(client, "text/plain");
+  }
+  ChunkedWriter out(client);
+  char row[64];
+  const int length = snprintf(row, sizeof(row), "row %08u ", (unsigned)state.step);
+  while (out.buffered() + length < ChunkedWriter::CHUNK_SIZE - 16) {
+    out.write(row, length);
+  }
+  if (state.step + 1 < BODY_CHUNKS) {
+    out.flush();
+    return false;
+  }
+  out.finish();
+  return true;
+}
+
+// Blocking GET; returns false if the connection failed or closed early
+static bool fetch(uint16_t port) {
+  WiFiClient client;
+  if (!client.connect(port)) {
+    return false;
+  }
+  const int fd = client.fd();
+  static const char request[] = "GET /data HTTP/1.1\r\nHost: bench\r\n\r\n";
+  send(fd, request, sizeof(request) - 1, MSG_NOSIGNAL);
+
+  // The stand-in sockets are non-blocking; retry after a short sleep
+  char buffer[4096];
+  size_t received = 0;
+  const Clock::time_point start = Clock::now();
+  while (secondsSince(start) < 10.0) {
+    const ssize_t n = recv(fd, buffer, sizeof(buffer), 0);
+    if (n == 0) {
+      break;
+    }
+    if (n < 0) {
+      std::this_thread::sleep_for(std::chrono::microseconds(50));
+      continue;
+    }
+    received += n;
+  }
+  return received > BODY_CHUNKS * 400;
+}
+
+int main(int argc, char** argv) {
+  const int clients = argc > 1 ? atoi(argv[1]) : 3;
+  const int requests = argc > 2 ? atoi(argv[2]) : 200;
+  const int idleClients = argc > 3 ? atoi(argv[3]) : 1;
+  host::setSerialQuiet(true);
+
+  WiFiServer wifiServer(0);
+  HttpServer server(wifiServer, handler);
+  server.begin();
+  const uint16_t port = wifiServer.port();
+
+  std::atomic<bool> done{false};
+  std::atomic<int> failures{0};
+  std::vector<double> latencies;
+  std::mutex latencyMutex;
+
+  std::vector<std::thread> threads;
+  for (int c = 0; c < clients; c++) {
+    threads.emplace_back([&] {
+      for (int r = 0; r < requests; r++) {
+        const Clock::time_point start = Clock::now();
+        if (!fetch(port)) {
+          failures++;
+          continue;
+        }
+        const double ms = secondsSince(start) * 1000.0;
+        std::lock_guard<std::mutex> lock(latencyMutex);
+        latencies.push_back(ms);
+      }
+    });
+  }
+  std::vector<std::thread> idlers;
+  for (int i = 0; i < idleClients; i++) {
+    idlers.emplace_back([&] {
+      while (!done) {
+        WiFiClient client;
+        if (client.connect(port)) {
+          char byte;
+          // Returns once the server answers 408 and closes
+          while (!done && recv(client.fd(), &byte, 1, MSG_DONTWAIT) != 0) {
+            std::this_thread::sleep_for(std::chrono::milliseconds(10));
+          }
+        }
+      }
+    });
+  }
+
+  const Clock::time_point start = Clock::now();
+  uint64_t polls = 0;
+  double pollSeconds = 0;
+  double maxPollMicros = 0;
+  std::thread waiter([&] {
+    for (std::thread& t : threads) t.join();
+    done = true;
+  });
+  while (!done) {
+    const uint64_t wallMicros = (uint64_t)(secondsSince(start) * 1e6);
+    if (wallMicros > host::nowMicros()) {
+      host::advanceMicros(wallMicros - host::nowMicros());
+    }
+    const Clock::time_point pollStart = Clock::now();
+    server.poll();
+    const double seconds = secondsSince(pollStart);
+    pollSeconds += seconds;
+    maxPollMicros = std::max(maxPollMicros, seconds * 1e6);
+    polls++;
+  }
+  const double elapsed = secondsSince(start);
+  waiter.join();
+  for (std::thread& t : idlers) t.join();
+
+  std::sort(latencies.begin(), latencies.end());
+  const size_t count = latencies.size();
+  const HttpServer::Stats& stats = server.stats();
+  printf("%d clients x %d requests, %d idle clients, %u chunks per response\n",
+         clients, requests, idleClients, (unsigned)BODY_CHUNKS);
+  printf("%.0f requests/s, %d failed\n", count / elapsed, failures.load());
+  if (count > 0) {
+    printf("latency ms: p50 %.2f  p99 %.2f  max %.2f\n", latencies[count / 2],
+           latencies[count * 99 / 100], latencies[count - 1]);
+  }
+  printf("poll(): mean %.1f us, max %.0f us over %llu polls\n",
+         1e6 * pollSeconds / polls, maxPollMicros, (unsigned long long)polls);
+  printf("server: accepted %u served %u timeouts %u bad %u disconnects %u\n",
+         stats.accepted, stats.served, stats.timeouts, stats.badRequests,
+         stats.disconnects);
+  return 0;
+}
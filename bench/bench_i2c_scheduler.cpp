@@ -0,0 +1,181 @@
+// bench_i2c_scheduler.cpp -- worst latency of a BME280 data read (8 bytes)
+// and an MPU FIFO drain (84 bytes) that arrive while a full 1 KB OLED frame
+// is being sent, on the simulated bus with the simulated clock. The sensor
+// request arrives at every 37 us offset into the frame. Compares sending
+// the frame as one unit at the same priority, as display() did, with the
+// priorities and chunk sizes of the sketch, at 400 kHz and with the BME280
+// in Fast-mode Plus. Then runs OledView against the scheduler's worker with
+// a thread reading the BME280 the whole time, and checks the panel.
+//
+//   ./bench_i2c_scheduler
+#include <string.h>
+
+#include <atomic>
+#include <thread>
+
+#include "bme280_sim.h"
+#include "i2c_utils.h"
+#include "mpu6500_sim.h"
+#include "oled_view.h"
+#include "ssd1306_sim.h"
+
+static constexpr uint8_t OLED = 0x3C;
+static constexpr uint8_t BME = 0x77;
+static constexpr uint8_t IMU = 0x68;
+
+static uint8_t frame[1024];
+static const uint8_t windowCommands[6] = {0x21, 0, 127, 0x22, 0, 7};
+
+struct Result {
+  uint32_t frameMicros;
+  uint32_t worstBmeMicros;
+  uint32_t worstImuMicros;
+  uint32_t preemptions;
+};
+
+// Queues the frame like OledView: the address window, then one transfer
+// per page
+static void submitFrame(int tickets[9]) {
+  tickets[0] = i2cScheduler.submit({OLED, 0x00, false, nullptr, windowCommands, 6});
+  for (int page = 0; page < 8; page++) {
+    tickets[page + 1] =
+        i2cScheduler.submit({OLED, 0x40, false, nullptr, frame + 128 * page, 128});
+  }
+}
+
+static void waitFrame(int tickets[9]) {
+  for (int i = 0; i < 9; i++) {
+    i2cScheduler.wait(tickets[i]);
+  }
+}
+
+static Result run(const I2cDeviceConfig& oled, const I2cDeviceConfig& bme,
+                  const I2cDeviceConfig& imu) {
+  i2cScheduler.setDevice(OLED, oled);
+  i2cScheduler.setDevice(BME, bme);
+  i2cScheduler.setDevice(IMU, imu);
+  int tickets[9];
+  uint64_t start = host::nowMicros();
+  submitFrame(tickets);
+  waitFrame(tickets);
+  Result result = {(uint32_t)(host::nowMicros() - start), 0, 0, 0};
+
+  // Without the worker the queue runs here, one transaction per runOnce(),
+  // and the sensor read is issued between two of them
+  i2cScheduler.resetStats();
+  for (uint32_t offset = 0; offset < result.frameMicros; offset += 37) {
+    for (bool imuRead : {false, true}) {
+      start = host::nowMicros();
+      submitFrame(tickets);
+      const uint64_t arrival = start + offset;
+      bool read = false;
+      while (true) {
+        if (!read && host::nowMicros() >= arrival) {
+          uint8_t buffer[84];
+          if (imuRead) {
+            i2cReadFifo(IMU, 0x74, buffer, 84);
+          } else {
+            i2cReadBlock(BME, 0xF7, buffer, 8);
+          }
+          const uint32_t latency = host::nowMicros() - arrival;
+          uint32_t& worst = imuRead ? result.worstImuMicros : result.worstBmeMicros;
+          worst = latency > worst ? latency : worst;
+          read = true;
+        }
+        if (!i2cScheduler.runOnce()) {
+          if (read) {
+            break;
+          }
+          host::advanceMicros(arrival - host::nowMicros());
+        }
+      }
+      waitFrame(tickets);
+    }
+  }
+  result.preemptions = i2cScheduler.stats().preemptions;
+  return result;
+}
+
+static void runOledViewThreaded(Ssd1306Sim& panel) {
+  i2cScheduler.setDevice(OLED, {400000, I2cScheduler::PRIORITY_DISPLAY, 0, 32});
+  i2cScheduler.setDevice(BME, {400000, I2cScheduler::PRIORITY_SENSOR, 5000, 0});
+  Adafruit_SSD1306 display(128, 64, &Wire, -1);
+  display.begin(SSD1306_SWITCHCAPVCC, OLED);
+  OledView view(display, i2cScheduler, OLED);
+  const int header = view.addField(0, 0, 2);
+  const int value = view.addField(0, 16, 2);
+  view.setText(header, "Temp");
+
+  i2cScheduler.begin(0, 0);
+  std::atomic<bool> stop{false};
+  std::atomic<uint32_t> reads{0}, errors{0};
+  std::thread sensor([&] {
+    uint8_t buffer[8];
+    while (!stop) {
+      errors += i2cReadBlock(BME, 0xF7, buffer, 8) != I2cStatus::Ok;
+      reads++;
+    }
+  });
+  bool ok = true;
+  for (int i = 0; i < 2000; i++) {
+    view.setTextf(value, "%d.%dC", i / 10, i % 10);
+    if (i % 97 == 0) {
+      view.invalidate();
+    }
+    ok &= view.update();
+  }
+  ok &= view.update();  // collects the last frame
+  stop = true;
+  sensor.join();
+  i2cScheduler.end();
+
+  const I2cScheduler::Stats stats = i2cScheduler.stats();
+  printf("OledView on the worker: 2000 frames %s, panel %s, %u sensor reads with %u errors, "
+         "%u preemptions\n",
+         ok ? "ok" : "FAILED",
+         memcmp(panel.ram(), display.getBuffer(), 1024) == 0 ? "matches" : "DIFFERS",
+         (unsigned)reads, (unsigned)errors, stats.preemptions);
+}
+
+int main() {
+  host::setSerialQuiet(true);
+  Bme280Sim bme;
+  Mpu6500Sim mpu;
+  Ssd1306Sim panel;
+  Wire.simBus().attach(BME, &bme);
+  Wire.simBus().attach(IMU, &mpu);
+  Wire.simBus().attach(OLED, &panel);
+  for (int i = 0; i < 1024; i++) {
+    frame[i] = i * 7;
+  }
+
+  typedef I2cScheduler S;
+  const struct {
+    const char* name;
+    I2cDeviceConfig oled, bme, imu;
+  } cases[] = {
+      {"one unit, sensors at 100 kHz", {400000, 0, 0, 0}, {100000, 1, 0, 0}, {100000, 1, 0, 0}},
+      {"one unit, sensors at 400 kHz", {400000, 0, 0, 0}, {400000, 1, 0, 0}, {400000, 1, 0, 0}},
+      {"scheduled, 128-byte chunks  ",
+       {400000, S::PRIORITY_DISPLAY, 0, 0},
+       {400000, S::PRIORITY_SENSOR, 5000, 0},
+       {400000, S::PRIORITY_REALTIME, 2000, 0}},
+      {"scheduled, 32-byte chunks   ",
+       {400000, S::PRIORITY_DISPLAY, 0, 32},
+       {400000, S::PRIORITY_SENSOR, 5000, 0},
+       {400000, S::PRIORITY_REALTIME, 2000, 0}},
+      {"32-byte chunks, BME at 1 MHz",
+       {400000, S::PRIORITY_DISPLAY, 0, 32},
+       {1000000, S::PRIORITY_SENSOR, 5000, 0},
+       {400000, S::PRIORITY_REALTIME, 2000, 0}},
+  };
+  for (const auto& c : cases) {
+    const Result r = run(c.oled, c.bme, c.imu);
+    printf("%s: frame %5u us, worst BME read %5u us, worst FIFO drain %5u us, "
+           "%u preemptions\n",
+           c.name, r.frameMicros, r.worstBmeMicros, r.worstImuMicros, r.preemptions);
+  }
+
+  runOledViewThreaded(panel);
+  return 0;
+}
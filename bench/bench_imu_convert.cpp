@@ -0,0 +1,117 @@
+// bench_imu_convert.cpp -- MPUx::convertSamples() (structure of arrays,
+// one multiply-add per value) against converting sample by sample into
+// float triples with the offsets subtracted and the scale divided per
+// value, for batch sizes from 1 to 4096. First checks that readBlock()
+// gives the same values as getAcclVals() / getGyroVals() on the model.
+//
+//   ./bench_imu_convert
+#include <math.h>
+
+#include <chrono>
+#include <vector>
+
+#include "mpu6500_sim.h"
+#include "mpu_x.h"
+
+typedef std::chrono::steady_clock Clock;
+
+static constexpr size_t MAX_SAMPLES = 4096;
+
+struct Offsets {
+  float accl[3];
+  float gyro[3];
+};
+
+// What a caller of getAcclVals() / getGyroVals() per sample does
+__attribute__((noinline)) static void convertPerSample(const MPUx::RawSample* raw, size_t count,
+                                                       const Offsets& offsets,
+                                                       float* const out[MPUx::AXES]) {
+  for (size_t i = 0; i < count; i++) {
+    for (int axis = 0; axis < 3; axis++) {
+      out[axis][i] = (raw[i].accl[axis] - offsets.accl[axis]) / 16384.0f;
+      out[axis + 3][i] = (raw[i].gyro[axis] - offsets.gyro[axis]) * 250.0f / 16384.0f;
+    }
+  }
+}
+
+// Largest difference between a FIFO block and the register reads
+static double checkAgainstRegisters() {
+  Mpu6500Sim sim;
+  Wire.simBus().attach(0x68, &sim);
+  Wire.setClock(400000);
+  int16_t accl[3] = {120, -300, 16000};
+  int16_t gyro[3] = {5, -7, 9};
+  sim.setSample(accl, 0, gyro);
+  MPUx imu(0x68);
+  imu.init();
+
+  const int16_t acclMoved[3] = {2000, -1234, 17000};
+  const int16_t gyroMoved[3] = {300, -250, 42};
+  sim.setSample(acclMoved, 0, gyroMoved);
+  const MPUx::floatThreeVals a = imu.getAcclVals();
+  const MPUx::floatThreeVals g = imu.getGyroVals();
+
+  imu.beginFifo(0, 1);
+  host::advanceMicros(30500);
+  static MPUx::SampleBlock block;
+  const size_t count = imu.readBlock(block);
+  const float expected[MPUx::AXES] = {a.x, a.y, a.z, g.x, g.y, g.z};
+  double error = count > 0 ? 0 : INFINITY;
+  for (size_t i = 0; i < count; i++) {
+    for (int axis = 0; axis < MPUx::AXES; axis++) {
+      error = fmax(error, fabs(block.values[axis][i] - expected[axis]));
+    }
+  }
+  imu.endFifo();
+  return error;
+}
+
+int main() {
+  host::setSerialQuiet(true);
+  printf("readBlock() against register reads: max difference %g\n", checkAgainstRegisters());
+
+  std::vector<MPUx::RawSample> raw(MAX_SAMPLES);
+  for (size_t i = 0; i < MAX_SAMPLES; i++) {
+    for (int axis = 0; axis < 3; axis++) {
+      raw[i].accl[axis] = (int16_t)(i * 7 + axis);
+      raw[i].gyro[axis] = (int16_t)(i * 3 - axis);
+    }
+  }
+  std::vector<float> values(MPUx::AXES * MAX_SAMPLES);
+  float* out[MPUx::AXES];
+  for (int axis = 0; axis < MPUx::AXES; axis++) {
+    out[axis] = &values[axis * MAX_SAMPLES];
+  }
+
+  const Offsets offsets = {{10, 20, -30}, {1, 2, 3}};
+  MPUx::Conversion conversion;
+  for (int axis = 0; axis < 3; axis++) {
+    conversion.scale[axis] = 1 / 16384.0f;
+    conversion.bias[axis] = -offsets.accl[axis] / 16384.0f;
+    conversion.scale[axis + 3] = 250 / 16384.0f;
+    conversion.bias[axis + 3] = -offsets.gyro[axis] * 250 / 16384.0f;
+  }
+
+  for (size_t count : {1, 4, 16, 64, 256, 1024, 4096}) {
+    const int repeats = (int)(20000000 / count / MPUx::AXES) + 1;
+    const Clock::time_point start = Clock::now();
+    for (int r = 0; r < repeats; r++) {
+      MPUx::convertSamples(raw.data(), count, conversion, out);
+      asm volatile("" : : "r"(out[0]) : "memory");
+    }
+    const Clock::time_point middle = Clock::now();
+    for (int r = 0; r < repeats; r++) {
+      convertPerSample(raw.data(), count, offsets, out);
+      asm volatile("" : : "r"(out[0]) : "memory");
+    }
+    const Clock::time_point end = Clock::now();
+
+    const double batch =
+        std::chrono::duration<double, std::nano>(middle - start).count() / repeats / count;
+    const double perSample =
+        std::chrono::duration<double, std::nano>(end - middle).count() / repeats / count;
+    printf("%5zu samples: convertSamples %.2f ns/sample, per sample %.2f ns/sample, x%.1f\n",
+           count, batch, perSample, perSample / batch);
+  }
+  return 0;
+}
@@ -0,0 +1,80 @@
+// bench_imu_fifo.cpp -- MPU-6500 sample throughput on the simulated bus:
+// one accel + gyro register read per sample against draining the sensor
+// FIFO in bursts, for several sample rates, bus clocks and poll intervals.
+// Polling too rarely overflows the 512-byte FIFO. "bad" counts frames that
+// arrive out of order or misaligned.
+//
+//   ./bench_imu_fifo
+#include <initializer_list>
+
+#include "mpu6500_sim.h"
+#include "mpu_x.h"
+
+static constexpr uint64_t RUN_MICROS = 5000000;
+
+int main() {
+  host::setSerialQuiet(true);
+  Mpu6500Sim sim;
+  SimI2cBus& bus = Wire.simBus();
+  bus.attach(0x68, &sim);
+  Wire.setClock(400000);
+  MPUx imu(0x68);
+  imu.init();
+
+  bus.resetStats();
+  for (int i = 0; i < 1000; i++) {
+    imu.getAcclVals();
+    imu.getGyroVals();
+  }
+  const double registerMicros = bus.stats().busMicros / 1000.0;
+  printf("register reads at 400 kHz: %.1f us of bus time and %.1f transactions per sample, "
+         "at most %.0f samples/s\n",
+         registerMicros, bus.stats().transactions / 1000.0, 1e6 / registerMicros);
+
+  static MPUx::RawSample samples[512];
+  for (uint32_t clock : {100000, 400000}) {
+    for (uint8_t divider : {0, 1, 4}) {
+      for (uint32_t pollMs : {5, 20, 40, 60}) {
+        Wire.setClock(clock);
+        imu.beginFifo(divider, 1);
+        bus.resetStats();
+        const uint32_t framesBefore = sim.fifoFrames();
+        const uint64_t start = host::nowMicros();
+        uint64_t nextPoll = start + pollMs * 1000;
+        uint32_t received = 0;
+        uint32_t bad = 0;
+        int16_t value = 0;
+        int16_t last = -1;
+
+        // The model latches a new sample every 250 us; accel x counts up
+        while (host::nowMicros() < start + RUN_MICROS) {
+          const int16_t accl[3] = {value++, 0, 16384};
+          const int16_t gyro[3] = {0, 0, 0};
+          sim.setSample(accl, 0, gyro);
+          host::advanceMicros(250);
+          if (host::nowMicros() < nextPoll) {
+            continue;
+          }
+          nextPoll += pollMs * 1000;
+          const size_t count = imu.readSamples(samples, 512);
+          for (size_t i = 0; i < count; i++) {
+            bad += samples[i].accl[0] < last || samples[i].accl[2] != 16384;
+            last = samples[i].accl[0];
+          }
+          received += count;
+        }
+
+        const MPUx::FifoStats& stats = imu.getFifoStats();
+        const double seconds = (host::nowMicros() - start) / 1e6;
+        printf("%3u kHz, %4u Hz, poll %2u ms: %5u of %5u frames, %4.0f samples/s, "
+               "%3u overflows, %4u bursts, %5u transactions, bus %4.1f%%, bad %u\n",
+               (unsigned)(clock / 1000), (unsigned)(1000 / (1 + divider)), (unsigned)pollMs,
+               received, sim.fifoFrames() - framesBefore, received / seconds, stats.overflows,
+               stats.bursts, bus.stats().transactions,
+               100.0 * bus.stats().busMicros / (seconds * 1e6), bad);
+        imu.endFifo();
+      }
+    }
+  }
+  return 0;
+}
@@ -0,0 +1,106 @@
+// bench_json_serializer.cpp -- the /data body for a full readings buffer:
+// ChunkedWriter with formatFixed against the previous way, a growing
+// string with one printf("%.2f") per value. Host time per reading, body
+// size and the number of socket writes.
+//
+//   ./bench_json_serializer [readings]
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <chrono>
+#include <string>
+#include <vector>
+
+#include "chunked_writer.h"
+
+struct Reading {
+  char timestamp[20];
+  float temperature;
+  float pressure;
+  float humidity;
+};
+
+// Counts what reaches the socket
+struct NullPrint : Print {
+  size_t bytes = 0;
+  size_t writes = 0;
+  size_t write(uint8_t) override { return write(nullptr, 1); }
+  size_t write(const uint8_t*, size_t size) override {
+    bytes += size;
+    writes++;
+    return size;
+  }
+};
+
+static void writeChunked(Print& client, const std::vector<Reading>& readings) {
+  ChunkedWriter out(client);
+  out.write("[\n");
+  for (size_t i = 0; i < readings.size() && out.ok(); i++) {
+    const Reading& reading = readings[i];
+    out.write("  {\n    \"timestamp\": \"");
+    out.write(reading.timestamp);
+    out.write("\",\n    \"temperature\": ");
+    out.writeFixed(reading.temperature, 2);
+    out.write(",\n    \"pressure\": ");
+    out.writeFixed(reading.pressure, 2);
+    out.write(",\n    \"humidity\": ");
+    out.writeFixed(reading.humidity, 2);
+    out.write(i < readings.size() - 1 ? "\n  },\n" : "\n  }\n");
+  }
+  out.write("]");
+  out.finish();
+}
+
+static void writeString(Print& client, const std::vector<Reading>& readings) {
+  std::string json = "[\n";
+  char value[32];
+  for (size_t i = 0; i < readings.size(); i++) {
+    const Reading& reading = readings[i];
+    json += "  {\n    \"timestamp\": \"";
+    json += reading.timestamp;
+    json += "\",\n    \"temperature\": ";
+    snprintf(value, sizeof(value), "%.2f", reading.temperature);
+    json += value;
+    json += ",\n    \"pressure\": ";
+    snprintf(value, sizeof(value), "%.2f", reading.pressure);
+    json += value;
+    json += ",\n    \"humidity\": ";
+    snprintf(value, sizeof(value), "%.2f", reading.humidity);
+    json += value;
+    json += i < readings.size() - 1 ? "\n  },\n" : "\n  }\n";
+  }
+  json += "]";
+  client.write((const uint8_t*)json.data(), json.size());
+}
+
+template <typename Serializer>
+static void report(const char* name, Serializer serializer, const std::vector<Reading>& readings) {
+  const int repeats = 200;
+  NullPrint out;
+  const auto start = std::chrono::steady_clock::now();
+  for (int r = 0; r < repeats; r++) {
+    serializer(out, readings);
+  }
+  const double seconds =
+      std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+  printf("%-24s %7.1f ns/reading  %7zu bytes  %4zu writes\n", name,
+         seconds * 1e9 / (repeats * readings.size()), out.bytes / repeats, out.writes / repeats);
+}
+
+int main(int argc, char** argv) {
+  const size_t count = argc > 1 ? atoi(argv[1]) : 100;
+  std::vector<Reading> readings(count);
+  srand(1);
+  for (size_t i = 0; i < count; i++) {
+    Reading& reading = readings[i];
+    snprintf(reading.timestamp, sizeof(reading.timestamp), "2025-10-09 08:%02zu:%02zu",
+             i / 60 % 60, i % 60);
+    reading.temperature = 15.0f + rand() % 1500 / 100.0f;
+    reading.pressure = 990.0f + rand() % 3000 / 100.0f;
+    reading.humidity = 30.0f + rand() % 4000 / 100.0f;
+  }
+  printf("%zu readings\n", count);
+  report("ChunkedWriter", writeChunked, readings);
+  report("string + printf", writeString, readings);
+  return 0;
+}
@@ -0,0 +1,97 @@
+// bench_metrics.cpp -- cost of the instrumentation: metricsRecord() alone,
+// a METRICS_SCOPE with its two counter reads, and both with all threads
+// recording into the same stage at once. Then prints the /metrics text of
+// 100 BME280 reads on the simulated bus.
+//
+//   ./bench_metrics [threads]
+#include <stdlib.h>
+
+#include <chrono>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "bme280_sim.h"
+#include "bmx_280.h"
+#include "chunked_writer.h"
+#include "metrics.h"
+
+typedef std::chrono::steady_clock Clock;
+
+static constexpr int RECORDS = 10000000;
+
+struct StringPrint : Print {
+  std::string text;
+  size_t write(uint8_t c) override {
+    text += (char)c;
+    return 1;
+  }
+  size_t write(const uint8_t* buffer, size_t size) override {
+    text.append((const char*)buffer, size);
+    return size;
+  }
+};
+
+static double nanosPerRecord(int threadCount, bool scope) {
+  std::vector<std::thread> threads;
+  const Clock::time_point start = Clock::now();
+  for (int t = 0; t < threadCount; t++) {
+    threads.emplace_back([scope] {
+      for (int i = 0; i < RECORDS; i++) {
+        if (scope) {
+          METRICS_SCOPE(MetricsStage::ReadSensors);
+          asm volatile("");
+        } else {
+          metricsRecord(MetricsStage::LoopPeriod, (uint32_t)i * 37);
+        }
+      }
+    });
+  }
+  for (std::thread& thread : threads) {
+    thread.join();
+  }
+  return std::chrono::duration<double, std::nano>(Clock::now() - start).count() / RECORDS;
+}
+
+int main(int argc, char** argv) {
+  const int threads = argc > 1 ? atoi(argv[1]) : 4;
+  host::setSerialQuiet(true);
+  metricsReset();
+  printf("1 thread: metricsRecord %.1f ns, METRICS_SCOPE %.1f ns\n", nanosPerRecord(1, false),
+         nanosPerRecord(1, true));
+  printf("%d threads: metricsRecord %.1f ns, METRICS_SCOPE %.1f ns (wall time per record "
+         "of each thread)\n",
+         threads, nanosPerRecord(threads, false), nanosPerRecord(threads, true));
+  MetricsHistogram histogram;
+  metricsSnapshot(MetricsStage::LoopPeriod, histogram);
+  printf("recorded %llu of %llu\n\n", (unsigned long long)histogram.count,
+         (unsigned long long)RECORDS * (1 + threads));
+
+  metricsReset();
+  Bme280Sim bme;
+  Wire.simBus().attach(0x77, &bme);
+  BMx280 sensor(0x77, BMx280Config::weatherMonitoring());
+  if (!sensor.init()) {
+    printf("BME280 init failed\n");
+    return 1;
+  }
+  for (int i = 0; i < 100; i++) {
+    sensor.readAll();
+  }
+  StringPrint out;
+  ChunkedWriter writer(out);
+  for (size_t stage = 0; stage < (size_t)MetricsStage::COUNT; stage++) {
+    metricsWriteStage(writer, (MetricsStage)stage);
+  }
+  metricsWriteCounters(writer);
+  writer.finish();
+  // Without the chunk framing
+  size_t position = 0;
+  while (position < out.text.size()) {
+    const size_t length = strtoul(out.text.c_str() + position, nullptr, 16);
+    position = out.text.find("\r\n", position) + 2;
+    fwrite(out.text.data() + position, 1, length, stdout);
+    position += length + 2;
+  }
+  return 0;
+}
@@ -0,0 +1,136 @@
+// bench_oled_view.cpp -- I2C traffic of an OLED refresh on the simulated bus:
+// clearDisplay(), redraw and display() of the whole 1 KB buffer against
+// OledView sending only the columns that changed. "cycling" steps through
+// the temperature, pressure and humidity screens like loop() does, with a
+// humidity warning now and then; "single" updates one reading. Every frame
+// is checked against the panel RAM, and OledView's frames against the same
+// text drawn in immediate mode.
+//
+//   ./bench_oled_view [frames]
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <initializer_list>
+
+#include "oled_view.h"
+#include "ssd1306_sim.h"
+
+static constexpr uint8_t OLED_ADDRESS = 0x3C;
+static constexpr size_t BUFFER_BYTES = 128 * 64 / 8;
+
+struct Reading {
+  float temperature, pressure, humidity;
+  int screen;
+};
+
+static Reading readingAt(int frame, bool cycling) {
+  Reading r = {22.0f + 0.1f * (frame % 7), 1013.2f + 0.1f * (frame % 3),
+               55.0f + 0.3f * (frame % 5), cycling ? frame % 3 : 0};
+  if (cycling && frame % 40 == 39) {
+    r.humidity = 72.5f;
+  }
+  return r;
+}
+
+// What loop() did before OledView
+static void drawImmediate(Adafruit_SSD1306& display, const Reading& r) {
+  display.clearDisplay();
+  display.setTextSize(2);
+  display.setTextColor(WHITE);
+  if (r.humidity > 70) {
+    display.setCursor(0, 0);
+    display.print("WARNING");
+    display.setCursor(0, 16);
+    display.print("Hum:");
+    display.print(r.humidity, 1);
+    display.print("%");
+    return;
+  }
+  display.setCursor(0, 16);
+  if (r.screen == 0) {
+    display.print("Temp:");
+    display.print(r.temperature, 1);
+    display.print("C");
+  } else if (r.screen == 1) {
+    display.print("Pres:");
+    display.print(r.pressure, 1);
+    display.print("hPa");
+  } else {
+    display.print("Hum:");
+    display.print(r.humidity, 1);
+    display.print("%");
+  }
+}
+
+static void setView(OledView& view, int header, int value, const Reading& r) {
+  if (r.humidity > 70) {
+    view.setText(header, "WARNING");
+    view.setTextf(value, "Hum:%.1f%%", r.humidity);
+    return;
+  }
+  view.setText(header, "");
+  if (r.screen == 0) {
+    view.setTextf(value, "Temp:%.1fC", r.temperature);
+  } else if (r.screen == 1) {
+    view.setTextf(value, "Pres:%.1fhPa", r.pressure);
+  } else {
+    view.setTextf(value, "Hum:%.1f%%", r.humidity);
+  }
+}
+
+int main(int argc, char** argv) {
+  const int frames = argc > 1 ? atoi(argv[1]) : 200;
+  host::setSerialQuiet(true);
+  Ssd1306Sim panel;
+  SimI2cBus& bus = Wire.simBus();
+  bus.attach(OLED_ADDRESS, &panel);
+  Wire.setClock(400000);
+  i2cScheduler.setDevice(OLED_ADDRESS, {400000, I2cScheduler::PRIORITY_DISPLAY, 0, 32});
+
+  Adafruit_SSD1306 display(128, 64, &Wire, -1);
+  Adafruit_SSD1306 reference(128, 64, &Wire, -1);
+  display.begin(SSD1306_SWITCHCAPVCC, OLED_ADDRESS);
+  reference.begin(SSD1306_SWITCHCAPVCC, OLED_ADDRESS);
+
+  uint32_t mismatches = 0;
+  for (bool cycling : {true, false}) {
+    uint64_t fullBytes = 0, fullMicros = 0;
+    for (int i = 0; i < frames; i++) {
+      drawImmediate(display, readingAt(i, cycling));
+      bus.resetStats();
+      display.display();
+      fullBytes += bus.stats().bytesWritten;
+      fullMicros += bus.stats().busMicros;
+      mismatches += memcmp(panel.ram(), display.getBuffer(), BUFFER_BYTES) != 0;
+    }
+
+    OledView view(display, i2cScheduler, OLED_ADDRESS);
+    const int header = view.addField(0, 0, 2);
+    const int value = view.addField(0, 16, 2);
+    view.update();  // the first frame sends the whole screen
+    const uint32_t windowsBefore = view.stats().windows;
+    uint64_t viewBytes = 0, viewMicros = 0;
+    for (int i = 0; i < frames; i++) {
+      const Reading r = readingAt(i, cycling);
+      setView(view, header, value, r);
+      bus.resetStats();
+      if (!view.update()) {
+        printf("update() failed at frame %d\n", i);
+        return 1;
+      }
+      viewBytes += bus.stats().bytesWritten;
+      viewMicros += bus.stats().busMicros;
+      drawImmediate(reference, r);
+      mismatches += memcmp(panel.ram(), reference.getBuffer(), BUFFER_BYTES) != 0;
+    }
+
+    printf("%-7s: display() %6.1f B %5.0f us per frame, OledView %5.1f B %4.0f us per frame "
+           "(%.1f windows)\n",
+           cycling ? "cycling" : "single", fullBytes / (double)frames,
+           fullMicros / (double)frames, viewBytes / (double)frames, viewMicros / (double)frames,
+           (view.stats().windows - windowsBefore) / (double)frames);
+  }
+  printf("frames that differ from immediate mode: %u\n", mismatches);
+  return mismatches == 0 ? 0 : 1;
+}
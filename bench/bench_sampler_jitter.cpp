@@ -0,0 +1,146 @@
+// bench_sampler_jitter.cpp -- start delay of the samples against their
+// schedule, with the Sampler thread against reading the sensors inline
+// from a loop that also formats HTTP responses. Load threads format JSON
+// rows on the other cores; after one second the consumer stalls once for
+// `stall` ms to show that the ring bridges it. Wall-clock timing, so run it
+// on an otherwise idle machine.
+//
+//   ./bench_sampler_jitter [load threads] [period us] [stall ms]
+#include <stdlib.h>
+
+#include <algorithm>
+#include <chrono>
+#include <thread>
+#include <vector>
+
+#include "bme280_sim.h"
+#include "mpu6500_sim.h"
+#include "sampler.h"
+
+typedef std::chrono::steady_clock Clock;
+
+static constexpr uint64_t RUN_MICROS = 3000000;
+
+static std::atomic<bool> loadRunning{true};
+static volatile size_t sink;
+
+static uint64_t wallMicros() {
+  return std::chrono::duration_cast<std::chrono::microseconds>(
+             Clock::now().time_since_epoch()).count();
+}
+
+// Stands in for serving /data: formats `rows` readings as JSON
+static void formatRows(int rows) {
+  char row[128];
+  for (int i = 0; i < rows; i++) {
+    sink += snprintf(row, sizeof(row),
+                     "{\"seq\":%d,\"temperature\":%.2f,\"pressure\":%.2f,\"humidity\":%.2f},",
+                     i, 21.5 + i * 1e-3, 1013.2, 45.0);
+  }
+}
+
+static std::vector<std::thread> startLoad(int threads) {
+  loadRunning = true;
+  std::vector<std::thread> load;
+  for (int i = 0; i < threads; i++) {
+    load.emplace_back([] {
+      while (loadRunning) formatRows(1000);
+    });
+  }
+  return load;
+}
+
+static void stopLoad(std::vector<std::thread>& load) {
+  loadRunning = false;
+  for (std::thread& t : load) t.join();
+}
+
+int main(int argc, char** argv) {
+  const int loadThreads = argc > 1 ? atoi(argv[1]) : 2;
+  const uint32_t periodMicros = argc > 2 ? atoi(argv[2]) : 10000;
+  const int stallMs = argc > 3 ? atoi(argv[3]) : 200;
+  host::setSerialQuiet(true);
+
+  Bme280Sim bme;
+  Mpu6500Sim mpu;
+  Wire.simBus().attach(0x77, &bme);
+  Wire.simBus().attach(0x68, &mpu);
+  BMx280 env(0x77, BMx280Config::weatherMonitoring());
+  MPUx imu(0x68);
+  if (!env.init()) {
+    printf("BME280 init failed\n");
+    return 1;
+  }
+  imu.init();
+  printf("load threads %d, period %u us, one consumer stall of %d ms\n", loadThreads,
+         (unsigned)periodMicros, stallMs);
+
+  {
+    Sampler sampler(env, periodMicros);
+    sampler.setImu(&imu);
+    std::vector<std::thread> load = startLoad(loadThreads);
+    sampler.start(0, 5);
+
+    const uint64_t end = wallMicros() + RUN_MICROS;
+    uint64_t stallAt = wallMicros() + 1000000;
+    uint32_t consumed = 0;
+    uint32_t gaps = 0;
+    uint32_t lastSequence = 0;
+    SensorSample sample;
+    while (wallMicros() < end) {
+      while (sampler.pop(sample)) {
+        gaps += consumed > 0 && sample.sequence != lastSequence + 1;
+        lastSequence = sample.sequence;
+        consumed++;
+      }
+      formatRows(200);
+      if (stallMs > 0 && wallMicros() > stallAt) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(stallMs));
+        stallAt = UINT64_MAX;
+      }
+    }
+    sampler.stop();
+    stopLoad(load);
+
+    const Sampler::Stats stats = sampler.stats();
+    printf("sampler thread: %u samples, %u consumed, %u dropped, %u gaps, %u missed ticks\n",
+           stats.samples, consumed, stats.dropped, gaps, stats.missedTicks);
+    printf("  late mean %u us, max %u us; read max %u us\n", stats.meanLateMicros,
+           stats.maxLateMicros, stats.maxReadMicros);
+  }
+
+  // Baseline: the loop that formats responses also reads the sensors
+  std::vector<std::thread> load = startLoad(loadThreads);
+  std::vector<uint32_t> late;
+  uint32_t missed = 0;
+  uint64_t scheduled = wallMicros() + periodMicros;
+  const uint64_t end = wallMicros() + RUN_MICROS;
+  while (wallMicros() < end) {
+    formatRows(2000);
+    const uint64_t now = wallMicros();
+    if (now < scheduled) {
+      continue;
+    }
+    late.push_back(now - scheduled);
+    env.readAll();
+    imu.getAcclVals();
+    imu.getGyroVals();
+    scheduled += periodMicros;
+    while (wallMicros() >= scheduled + periodMicros) {
+      scheduled += periodMicros;
+      missed++;
+    }
+  }
+  stopLoad(load);
+
+  std::sort(late.begin(), late.end());
+  uint64_t sum = 0;
+  for (uint32_t micros : late) sum += micros;
+  if (!late.empty()) {
+    printf("inline in loop: %zu samples, %u missed ticks\n", late.size(), missed);
+    printf("  late mean %llu us, p99 %u us, max %u us\n",
+           (unsigned long long)(sum / late.size()), late[late.size() * 99 / 100],
+           late.back());
+  }
+  return 0;
+}
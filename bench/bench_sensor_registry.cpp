@@ -0,0 +1,132 @@
+// bench_sensor_registry.cpp -- BME280 readings per second with
+// SensorRegistry::sampleBatch() against readAll() on one sensor after
+// another, for 2 to 16 sensors on one or two buses: 0x77 on each trunk, the
+// others at 0x76 behind a TCA9548A at 0x70, one per channel, so up to nine
+// per bus. The buses run in parallel on the ESP32 but one after the other
+// on the simulated clock, so a batch is charged the conversion time plus
+// the bus time of the busier bus. Also prints the bus time of discover().
+//
+//   ./bench_sensor_registry [SCL Hz] [-v: list the sensors found]
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <memory>
+#include <vector>
+
+#include "bme280_sim.h"
+#include "sensor_registry.h"
+#include "tca9548a_sim.h"
+
+static constexpr int SERIAL_ROUNDS = 20;
+static constexpr int BATCHES = 40;
+
+// The sensors of one configuration; kept alive until the end, as the
+// buses point into it
+struct Rig {
+  std::vector<std::unique_ptr<Bme280Sim>> sensors;
+  Tca9548aSim muxes[I2C_BUSES];
+
+  void build(int count, int buses) {
+    TwoWire* wires[I2C_BUSES] = {&Wire, &Wire1};
+    for (TwoWire* wire : wires) {
+      wire->simBus().detach(0x76);
+      wire->simBus().detach(0x77);
+      wire->simBus().detach(0x70);
+    }
+    int perBus[I2C_BUSES] = {};
+    for (int i = 0; i < count; i++) {
+      const int bus = buses == 1 ? 0 : i % 2;
+      const int k = perBus[bus]++;
+      sensors.emplace_back(new Bme280Sim());
+      Bme280Sim* sensor = sensors.back().get();
+      sensor->setRawSample(519888 + i * 100, 415148, 30000);
+      if (k == 0) {
+        wires[bus]->simBus().attach(0x77, sensor);
+        continue;
+      }
+      if (k == 1) {
+        wires[bus]->simBus().attach(0x70, &muxes[bus]);
+      }
+      muxes[bus].attach(k - 1, 0x76, sensor);
+    }
+  }
+};
+
+static uint64_t busMicros(int bus) {
+  return (bus == 0 ? Wire : Wire1).simBus().stats().busMicros;
+}
+
+int main(int argc, char** argv) {
+  const uint32_t clock = argc > 1 ? atoi(argv[1]) : 400000;
+  const bool verbose = argc > 2 && strcmp(argv[2], "-v") == 0;
+  host::setSerialQuiet(true);
+  const BMx280Config config = BMx280Config::weatherMonitoring();
+  const I2cDeviceConfig busConfig = {clock, I2cScheduler::PRIORITY_SENSOR, 5000, 0};
+  printf("SCL %u Hz, conversion %u us\n", (unsigned)clock,
+         (unsigned)config.maxMeasurementMicros());
+  printf("sensors buses  found  one by one/s  batched/s  batch ms  discover bus ms  mux selects\n");
+
+  std::vector<std::unique_ptr<Rig>> rigs;
+  for (int buses = 1; buses <= I2C_BUSES; buses++) {
+    for (int count : {2, 4, 8, 16}) {
+      if (count > buses * (1 + I2C_MUX_CHANNELS)) {
+        continue;
+      }
+      rigs.emplace_back(new Rig());
+      rigs.back()->build(count, buses);
+      Wire.simBus().resetStats();
+      Wire1.simBus().resetStats();
+      Wire.setClock(clock);
+      Wire1.setClock(clock);
+      SensorRegistry registry(config, busConfig, 4);
+      registry.discover();
+      const uint64_t discoverMicros = busMicros(0) + busMicros(1);
+      const size_t sensors = registry.envCount();
+
+      uint32_t bad = 0;
+      uint64_t start = host::nowMicros();
+      for (int round = 0; round < SERIAL_ROUNDS; round++) {
+        for (size_t i = 0; i < registry.size(); i++) {
+          if (registry.env(i) != nullptr) {
+            bad += isnan(registry.env(i)->readAll().temperature);
+          }
+        }
+      }
+      const double serialRate =
+          (double)SERIAL_ROUNDS * sensors / ((host::nowMicros() - start) / 1e6);
+
+      SensorRegistry::Reading readings[SensorRegistry::MAX_BATCH];
+      uint64_t batchMicros = 0;
+      uint64_t total = 0;
+      for (int batch = 0; batch < BATCHES; batch++) {
+        const uint64_t before[I2C_BUSES] = {busMicros(0), busMicros(1)};
+        const size_t got = registry.sampleBatch(readings, SensorRegistry::MAX_BATCH);
+        const uint64_t bus0 = busMicros(0) - before[0];
+        const uint64_t bus1 = busMicros(1) - before[1];
+        batchMicros += config.maxMeasurementMicros() + (bus0 > bus1 ? bus0 : bus1);
+        total += got;
+        for (size_t i = 0; i < got; i++) {
+          bad += isnan(readings[i].env.temperature);
+        }
+      }
+
+      printf("%7d %5d %6zu %13.1f %10.1f %9.2f %16.2f %12u\n", count, buses, sensors, serialRate,
+             total / (batchMicros / 1e6), batchMicros / 1e3 / BATCHES, discoverMicros / 1e3,
+             i2cScheduler.stats().muxSelects + i2cScheduler1.stats().muxSelects);
+      if (bad != 0) {
+        printf("  %u readings were NAN\n", bad);
+      }
+      if (verbose) {
+        for (size_t i = 0; i < registry.size(); i++) {
+          char tag[SensorRegistry::TAG_LENGTH];
+          registry.formatTag(i, tag, sizeof(tag));
+          printf("  %s %s\n", tag, SensorRegistry::kindName(registry.info(i).kind));
+        }
+      }
+      i2cScheduler.resetStats();
+      i2cScheduler1.resetStats();
+    }
+  }
+  return 0;
+}
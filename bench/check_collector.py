@@ -0,0 +1,46 @@
+# check_collector.py -- verifies what dmp_collector wrote from fake_stations:
+# in every station directory (named s<N>) each reading is stored once, 5 s
+# after the previous one, with the values StationSim serves for it.
+#
+#   python3 bench/check_collector.py stations
+
+import os
+import sys
+import numpy as np
+
+
+def column(directory, name):
+    path = os.path.join(directory, name + ".col")
+    raw = np.fromfile(path, np.uint8, 64)
+    count = int(np.frombuffer(raw, "<u8", 1, 16)[0])
+    kind = bytes(raw[8:12]).rstrip(b"\0").decode()
+    return np.memmap(path, kind, "r", offset=64, shape=(count,))
+
+
+root = sys.argv[1] if len(sys.argv) > 1 else "stations"
+total = 0
+bad = 0
+names = sorted(os.listdir(root))
+for name in names:
+    directory = os.path.join(root, name)
+    # timestamp.col is published last, the other columns hold at least as many rows
+    ts = column(directory, "timestamp")
+    n = len(ts)
+    t = column(directory, "temperature")[:n]
+    p = column(directory, "pressure")[:n]
+    h = column(directory, "humidity")[:n]
+    station = int(name[1:])
+    total += n
+
+    ok = np.all(np.diff(ts.astype(np.int64)) == 5)
+    ok &= np.allclose(t, 15.0 + (ts % 1000) / 100.0 + station % 7, atol=0.006)
+    ok &= np.allclose(p, 990.0 + (ts % 3000) / 100.0, atol=0.006)
+    null = ts % 11 == 0
+    ok &= np.all(np.isnan(h[null]))
+    ok &= np.allclose(h[~null], 30.0 + (ts[~null] % 4000) / 100.0, atol=0.006)
+    if not ok:
+        bad += 1
+        print(f"{name}: {n} rows, duplicated, missing or wrong")
+
+print(f"{len(names)} stations, {total} rows, {bad} bad")
+sys.exit(1 if bad else 0)
@@ -0,0 +1,82 @@
+// fake_stations.cpp -- StationSim stations for running dmp_collector by
+// hand: `stations` stations on ports basePort.., each with `backlog`
+// readings 5 s apart, gaining one every `period` ms. SIGUSR1 restarts all
+// of them: a new boot id, and the newest half of the readings replayed
+// from 0. check_collector.py then verifies the collector's files.
+//
+//   ./fake_stations [stations] [base port] [backlog] [period ms]
+//   ./dmp_collector -d stations -i 5 s0=127.0.0.1:20000 s1=127.0.0.1:20001 ...
+//   kill -USR1 <fake_stations>; python3 bench/check_collector.py stations
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/resource.h>
+#include <time.h>
+
+#include <vector>
+
+#include "station_sim.h"
+
+static volatile sig_atomic_t restartRequested = 0;
+
+static void onSignal(int) { restartRequested = 1; }
+
+static uint64_t monotonicMs() {
+  timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return (uint64_t)now.tv_sec * 1000 + now.tv_nsec / 1000000;
+}
+
+int main(int argc, char** argv) {
+  const size_t count = argc > 1 ? atoi(argv[1]) : 100;
+  const uint16_t basePort = argc > 2 ? atoi(argv[2]) : 20000;
+  const size_t backlog = argc > 3 ? atoi(argv[3]) : 1000;
+  const uint32_t periodMs = argc > 4 ? atoi(argv[4]) : 1000;
+
+  rlimit limit;
+  getrlimit(RLIMIT_NOFILE, &limit);
+  limit.rlim_cur = limit.rlim_max;
+  setrlimit(RLIMIT_NOFILE, &limit);
+  signal(SIGPIPE, SIG_IGN);
+  signal(SIGUSR1, onSignal);
+
+  StationSim sim;
+  if (!sim.begin(count, basePort)) {
+    perror("StationSim::begin");
+    return 1;
+  }
+  std::vector<uint32_t> next(count, 1760000000);
+  for (size_t i = 0; i < count; i++) {
+    for (size_t k = 0; k < backlog; k++) {
+      sim.addReading(i, next[i]);
+      next[i] += 5;
+    }
+  }
+  fprintf(stderr, "%zu stations on ports %u.., backlog %zu, one reading every %u ms\n", count,
+          (unsigned)basePort, backlog, (unsigned)periodMs);
+
+  uint64_t nextTick = monotonicMs() + periodMs;
+  uint64_t nextReport = monotonicMs() + 10000;
+  for (;;) {
+    const uint64_t now = monotonicMs();
+    sim.poll(nextTick > now ? (int)(nextTick - now) : 0);
+    if (restartRequested) {
+      restartRequested = 0;
+      for (size_t i = 0; i < count; i++) {
+        sim.restart(i, sim.readings(i) / 2);
+      }
+      fprintf(stderr, "restarted\n");
+    }
+    if (monotonicMs() >= nextTick) {
+      nextTick += periodMs;
+      for (size_t i = 0; i < count; i++) {
+        sim.addReading(i, next[i]);
+        next[i] += 5;
+      }
+    }
+    if (monotonicMs() >= nextReport) {
+      nextReport += 10000;
+      fprintf(stderr, "served %llu rows\n", (unsigned long long)sim.rowsServed());
+    }
+  }
+}
@@ -0,0 +1,110 @@
+// sim_low_power.cpp -- steps through the LOW_POWER_MODE schedule of the
+// sketch on the simulated clock and compares the charge it adds up with
+// lowPowerEstimate(). Each wake boots, initializes the BME280 in forced
+// mode against bme280_sim and takes one sample into the RTC ring; the wake
+// that completes a batch pops the ring and keeps the AP up for the flush
+// window. The sample time is the one measured on the simulated bus.
+//
+//   ./sim_low_power [flush periods]
+#include <stdlib.h>
+
+#include "bme280_sim.h"
+#include "bmx_280.h"
+#include "low_power.h"
+
+// Keep in step with the LOW_POWER_MODE settings of dmp_project.ino
+static const uint32_t sampleInterval = 60;  // seconds
+static const uint16_t samplesPerFlush = 30;
+static const unsigned long flushWindow = 30000;  // ms
+static const LowPowerProfile profile = {40.0f, 120.0f, 12.0f, 3.7f,
+                                        70.0f, 15.0f, (float)flushWindow};
+
+struct Tally {
+  double activeMs = 0;
+  double wifiMs = 0;
+  double sleepMs = 0;
+  uint32_t samples = 0;
+  uint32_t flushes = 0;
+
+  double chargeMaMs() const {
+    return activeMs * profile.activeMilliamps + wifiMs * profile.wifiMilliamps +
+           sleepMs * profile.sleepMicroamps / 1000.0;
+  }
+  double totalMs() const { return activeMs + wifiMs + sleepMs; }
+};
+
+static double elapsedMs(uint64_t since) {
+  return (host::nowMicros() - since) / 1000.0;
+}
+
+// One pass through setup() up to the point where the sketch sleeps again
+// or the flush window ends; mirrors runLowPowerCycle()
+static void wake(Tally& tally) {
+  host::advanceMicros((uint64_t)(profile.wakeMillis * 1000));
+  tally.activeMs += profile.wakeMillis;
+
+  const uint64_t sampleStart = host::nowMicros();
+  BMx280 bme(0x77, BMx280Config::weatherMonitoring());
+  if (bme.init()) {
+    const BMx280::BMx280Sample sample = bme.readAll();
+    lowPowerAppend({(uint32_t)(host::nowMicros() / 1000000), sample.temperature,
+                    sample.pressure, sample.humidity});
+    tally.samples++;
+  }
+  tally.activeMs += elapsedMs(sampleStart);
+
+  if (!lowPowerWokeFromTimer() || lowPowerPending() >= samplesPerFlush) {
+    LowPowerSample sample;
+    while (lowPowerPop(sample)) {
+    }
+    // OLED, AP start and serving /data all happen inside the window
+    host::advanceMicros(flushWindow * 1000ULL);
+    tally.wifiMs += flushWindow;
+    tally.flushes++;
+  }
+
+  const uint64_t sleepStart = host::nowMicros();
+  lowPowerSleep(sampleInterval);
+  tally.sleepMs += elapsedMs(sleepStart);
+}
+
+int main(int argc, char** argv) {
+  const int periods = argc > 1 ? atoi(argv[1]) : 10;
+  host::setSerialQuiet(true);
+  Bme280Sim sim;
+  Wire.simBus().attach(0x77, &sim);
+  Wire.simBus().setClock(400000);
+
+  // The cold boot flushes at once; measure whole batches after it
+  Tally tally;
+  wake(tally);
+  tally = Tally();
+  while (tally.flushes < (uint32_t)periods) {
+    wake(tally);
+  }
+
+  const double sampleMs = tally.activeMs / tally.samples - profile.wakeMillis;
+  LowPowerProfile measured = profile;
+  measured.sampleMillis = (float)sampleMs;
+  const LowPowerEstimate model =
+      lowPowerEstimate(profile, sampleInterval, samplesPerFlush);
+  const LowPowerEstimate modelMeasured =
+      lowPowerEstimate(measured, sampleInterval, samplesPerFlush);
+
+  const double averageUa = 1000.0 * tally.chargeMaMs() / tally.totalMs();
+  const double awake = (tally.activeMs + tally.wifiMs) / tally.totalMs();
+  const double mjPerSample =
+      tally.chargeMaMs() * profile.supplyVolts / 1000.0 / tally.samples;
+
+  printf("%u samples, %u flushes, sample %.2f ms on the bus model\n",
+         tally.samples, tally.flushes, sampleMs);
+  printf("                   awake %%   average uA   mJ/sample\n");
+  printf("stepped            %7.3f   %10.1f   %9.2f\n", awake * 100, averageUa,
+         mjPerSample);
+  printf("model (profile)    %7.3f   %10.1f   %9.2f\n", model.dutyCycle * 100,
+         model.averageMicroamps, model.energyPerSampleMj);
+  printf("model (measured)   %7.3f   %10.1f   %9.2f\n",
+         modelMeasured.dutyCycle * 100, modelMeasured.averageMicroamps,
+         modelMeasured.energyPerSampleMj);
+  return 0;
+}
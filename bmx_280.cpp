@@ -1,87 +1,242 @@
 #include "bmx_280.h"
 #include <Wire.h>
+#include "metrics.h"
+
+#ifdef ESP_PLATFORM
+#include <freertos/FreeRTOS.h>
+#include <freertos/task.h>
+#endif
+
+void bmx280InvalidConfig(const char* reason) {
+  Serial.printf("Invalid BMx280Config: %s\n", reason);
+}
+
+void bmx280WaitConversion(uint32_t waitMicros) {
+#ifdef ESP_PLATFORM
+  // vTaskDelay() may return up to a tick early, so sleep again for what is
+  // left instead of spinning; the wait ends at most a tick late
+  const uint32_t tickMicros = 1000000 / configTICK_RATE_HZ;
+  const uint32_t start = micros();
+  uint32_t elapsed;
+  while ((elapsed = micros() - start) < waitMicros) {
+    vTaskDelay((waitMicros - elapsed + tickMicros - 1) / tickMicros);
+  }
+#else
+  delayMicroseconds(waitMicros);
+#endif
+}
 
 // Initialize the BME280 sensor
 bool BMx280::init() {
-  // Reset the device
+  const uint32_t startMicros = micros();
+  compFromCache = false;
+
+  // Reset the device and wait until the NVM trim data has been copied
   wakeUpDevice(deviceAddress, BME_REG_RESET, BME_VAL_RESET_SOFT);
-  delay(200);
+  if (!waitForStatus(BME_STATUS_IM_UPDATE, false, BME_STATUS_TIMEOUT_MS)) {
+    Serial.println("No response from BME280 sensor!");
+    return false;
+  }
 
-  // Read and set compensation values
-  setCompensationValues();
+  // Verify Sensor ID
+  uint8_t id = 0;
+  if (i2cReadRegister<uint8_t>(deviceAddress, BME_REG_ID, id) != I2cStatus::Ok) {
+    Serial.println("No response from BME280 sensor!");
+    return false;
+  }
+  Serial.print("BME280 ID: ");
+  Serial.println(id, HEX);
+  if (id != BME_VAL_CHIP_ID && id != BMP_VAL_CHIP_ID) {
+    Serial.println("BME280 sensor not found!");
+    return false;
+  }
 
-  // Configure Humidity Oversampling
-  uint8_t humCtrlRegVal = 0x05;  // humidity oversampling x16
-  i2cWriteToRegister(deviceAddress, BME_REG_CONTROLHUMID, humCtrlRegVal);
+  // Read and set compensation values, unless cached for this chip. Every
+  // BME280 reports the same ID, so the cache is only used when the first
+  // trim words of the part agree with it as well.
+  if (compChipId == id && compensationCacheMatches()) {
+    compFromCache = true;
+  } else {
+    if (!setCompensationValues()) {
+      Serial.println("Failed to read BME280 calibration data!");
+      return false;
+    }
+    compChipId = id;
+  }
 
-  // Configure Sensor Settings
-  uint8_t confRegVal = 0x00;     // Config Register (standby time, filter, etc.)
-  uint8_t ctrlRegVal = 0xB7;     // temp & press oversample x16, normal mode
-  i2cWriteToRegister(deviceAddress, BME_REG_CONFIG, confRegVal);
-  i2cWriteToRegister(deviceAddress, BME_REG_CONTROL, ctrlRegVal);
+  // Configure Humidity Oversampling, applied with the next ctrl_meas write
+  i2cWriteToRegister(deviceAddress, BME_REG_CONTROLHUMID, config.ctrlHumRegVal());
 
-  delay(200);
+  // Configure standby time, filter, oversampling and mode
+  i2cWriteToRegister(deviceAddress, BME_REG_CONFIG, config.configRegVal());
+  i2cWriteToRegister(deviceAddress, BME_REG_CONTROL, config.ctrlMeasRegVal(false));
 
-  // Verify Sensor ID
-  Wire.beginTransmission(deviceAddress);
-  Wire.write(BME_REG_ID);
-  Wire.endTransmission(false);
-  Wire.requestFrom(deviceAddress, (uint8_t)1);
-  if (Wire.available()) {
-    uint8_t id = Wire.read();
-    Serial.print("BME280 ID: ");
-    Serial.println(id, HEX);
-    if (id != 0x60) { // 0x60 is a common ID for BME280
-      Serial.println("BME280 sensor not found!");
-      return false;
+  // Wait for the first conversion so the data registers hold valid values
+  if (config.mode == BMx280Config::Mode::Normal) {
+    waitForStatus(BME_STATUS_MEASURING, true, BME_CONVERSION_START_TIMEOUT_MS);
+    waitForStatus(BME_STATUS_MEASURING, false, BME_STATUS_TIMEOUT_MS);
+  }
+
+  initTimeMicros = micros() - startMicros;
+
+  return true; // Initialization successful
+}
+
+// Polls the status register until the bits in mask are set or cleared
+bool BMx280::waitForStatus(uint8_t mask, bool set, unsigned long timeoutMs) {
+  const unsigned long start = millis();
+  do {
+    uint8_t status = 0;
+    if (i2cReadRegister<uint8_t>(deviceAddress, BME_REG_STATUS, status) == I2cStatus::Ok &&
+        ((status & mask) != 0) == set) {
+      return true;
     }
-  } else {
-    Serial.println("No response from BME280 sensor!");
+    delay(1);
+  } while (millis() - start < timeoutMs);
+
+  return false;
+}
+
+bool BMx280::setCompensationValues() {
+  uint8_t block1[BME_COMP_BLOCK1_LEN];
+  uint8_t block2[BME_COMP_BLOCK2_LEN];
+
+  if (i2cReadBlock(deviceAddress, BME_REG_COMP_T1, block1,
+                   BME_COMP_BLOCK1_LEN) != I2cStatus::Ok ||
+      i2cReadBlock(deviceAddress, BME_REG_COMP_H2, block2,
+                   BME_COMP_BLOCK2_LEN) != I2cStatus::Ok) {
     return false;
   }
 
-  // Optionally, you can add more verification steps here
+  populateTemperatureCompensationValues(block1);
+  populatePressureCompensationValues(block1);
+  populateHumidityCompensationValues(block1, block2);
+  return true;
+}
 
-  return true; // Initialization successful
+// Little-endian word at register reg of a block starting at register base
+static inline uint16_t compWordLE(const uint8_t* block, uint8_t base, uint8_t reg) {
+  return (uint16_t)block[reg - base] | ((uint16_t)block[reg - base + 1] << 8);
 }
 
-void BMx280::setCompensationValues() {
-  populateTemperatureCompensationValues();
-  populatePressureCompensationValues();
-  populateHumidityCompensationValues();
+// dig_T1..dig_T3 and dig_P1 (0x88..0x8F) in one 8-byte read: differ between
+// parts, so a sensor swapped with the same chip ID is caught
+bool BMx280::compensationCacheMatches() {
+  uint8_t head[BME_COMP_CHECK_LEN];
+  if (i2cReadBlock(deviceAddress, BME_REG_COMP_T1, head, BME_COMP_CHECK_LEN) !=
+      I2cStatus::Ok) {
+    return false;
+  }
+  const uint8_t base = BME_REG_COMP_T1;
+  return compWordLE(head, base, BME_REG_COMP_T1) == compVals.T1 &&
+         (int16_t)compWordLE(head, base, BME_REG_COMP_T2) == compVals.T2 &&
+         (int16_t)compWordLE(head, base, BME_REG_COMP_T3) == compVals.T3 &&
+         compWordLE(head, base, BME_REG_COMP_P1) == compVals.P1;
 }
 
-void BMx280::populateTemperatureCompensationValues() {
-  compVals.T1 = i2cReadWordFromRegisterLE(deviceAddress, BME_REG_COMP_T1);
-  compVals.T2 = (int16_t)i2cReadWordFromRegisterLE(deviceAddress, BME_REG_COMP_T2);
-  compVals.T3 = (int16_t)i2cReadWordFromRegisterLE(deviceAddress, BME_REG_COMP_T3);
+void BMx280::populateTemperatureCompensationValues(const uint8_t* block1) {
+  const uint8_t base = BME_REG_COMP_T1;
+  compVals.T1 = compWordLE(block1, base, BME_REG_COMP_T1);
+  compVals.T2 = (int16_t)compWordLE(block1, base, BME_REG_COMP_T2);
+  compVals.T3 = (int16_t)compWordLE(block1, base, BME_REG_COMP_T3);
 }
 
-void BMx280::populatePressureCompensationValues() {
-  compVals.P1 = i2cReadWordFromRegisterLE(deviceAddress, BME_REG_COMP_P1);
-  compVals.P2 = (int16_t)i2cReadWordFromRegisterLE(deviceAddress, BME_REG_COMP_P2);
-  compVals.P3 = (int16_t)i2cReadWordFromRegisterLE(deviceAddress, BME_REG_COMP_P3);
-  compVals.P4 = (int16_t)i2cReadWordFromRegisterLE(deviceAddress, BME_REG_COMP_P4);
-  compVals.P5 = (int16_t)i2cReadWordFromRegisterLE(deviceAddress, BME_REG_COMP_P5);
-  compVals.P6 = (int16_t)i2cReadWordFromRegisterLE(deviceAddress, BME_REG_COMP_P6);
-  compVals.P7 = (int16_t)i2cReadWordFromRegisterLE(deviceAddress, BME_REG_COMP_P7);
-  compVals.P8 = (int16_t)i2cReadWordFromRegisterLE(deviceAddress, BME_REG_COMP_P8);
-  compVals.P9 = (int16_t)i2cReadWordFromRegisterLE(deviceAddress, BME_REG_COMP_P9);
+void BMx280::populatePressureCompensationValues(const uint8_t* block1) {
+  const uint8_t base = BME_REG_COMP_T1;
+  compVals.P1 = compWordLE(block1, base, BME_REG_COMP_P1);
+  compVals.P2 = (int16_t)compWordLE(block1, base, BME_REG_COMP_P2);
+  compVals.P3 = (int16_t)compWordLE(block1, base, BME_REG_COMP_P3);
+  compVals.P4 = (int16_t)compWordLE(block1, base, BME_REG_COMP_P4);
+  compVals.P5 = (int16_t)compWordLE(block1, base, BME_REG_COMP_P5);
+  compVals.P6 = (int16_t)compWordLE(block1, base, BME_REG_COMP_P6);
+  compVals.P7 = (int16_t)compWordLE(block1, base, BME_REG_COMP_P7);
+  compVals.P8 = (int16_t)compWordLE(block1, base, BME_REG_COMP_P8);
+  compVals.P9 = (int16_t)compWordLE(block1, base, BME_REG_COMP_P9);
 }
 
-void BMx280::populateHumidityCompensationValues() {
-  compVals.H1 = i2cReadByteFromRegister(deviceAddress, BME_REG_COMP_H1);
-  compVals.H2 = (int16_t)i2cReadWordFromRegisterLE(deviceAddress, BME_REG_COMP_H2);
-  compVals.H3 = i2cReadByteFromRegister(deviceAddress, BME_REG_COMP_H3);
-  compVals.H4 = (int16_t)(((int8_t)i2cReadByteFromRegister(deviceAddress, BME_REG_COMP_H4) << 4) |
-               (i2cReadByteFromRegister(deviceAddress, BME_REG_COMP_H4 + 1) & 0xF));
-  compVals.H5 = (int16_t)(((int8_t)i2cReadByteFromRegister(deviceAddress, BME_REG_COMP_H5 + 1) << 4) |
-               (i2cReadByteFromRegister(deviceAddress, BME_REG_COMP_H5) >> 4));
-  compVals.H6 = (int8_t)i2cReadByteFromRegister(deviceAddress, BME_REG_COMP_H6);
+void BMx280::populateHumidityCompensationValues(const uint8_t* block1,
+                                                const uint8_t* block2) {
+  const uint8_t base = BME_REG_COMP_H2;
+  compVals.H1 = block1[BME_REG_COMP_H1 - BME_REG_COMP_T1];
+  compVals.H2 = (int16_t)compWordLE(block2, base, BME_REG_COMP_H2);
+  compVals.H3 = block2[BME_REG_COMP_H3 - base];
+  compVals.H4 = (int16_t)(((int8_t)block2[BME_REG_COMP_H4 - base] << 4) |
+               (block2[BME_REG_COMP_H4 + 1 - base] & 0xF));
+  compVals.H5 = (int16_t)(((int8_t)block2[BME_REG_COMP_H5 + 1 - base] << 4) |
+               (block2[BME_REG_COMP_H5 - base] >> 4));
+  compVals.H6 = (int8_t)block2[BME_REG_COMP_H6 - base];
 }
 
 int32_t BMx280::getTFine() {
   int32_t adcT = i2cReadThreeBytesFromRegister(deviceAddress, BME_REG_TEMPDATA);
+  return compensateTFine(adcT);
+}
+
+float BMx280::getTemperature() {
+  return compensateTemperature(getTFine());
+}
+
+float BMx280::getPressure() {
+  int32_t tFine = getTFine();
+  if (tFine == 0) {
+    return NAN; // Indicate failure
+  }
+  int32_t adcP = i2cReadThreeBytesFromRegister(deviceAddress, BME_REG_PRESSUREDATA);
+  return compensatePressure(adcP, tFine);
+}
+
+float BMx280::getHumidity() {
+  int32_t tFine = getTFine();
+  if (tFine == 0) {
+    return NAN; // Indicate failure
+  }
+  int32_t adcH = i2cReadWordFromRegister(deviceAddress, BME_REG_HUMIDDATA);
+  return compensateHumidity(adcH, tFine);
+}
+
+BMx280::BMx280Sample BMx280::readAll() {
+  const BMx280Sample failed{NAN, NAN, NAN};
+  uint8_t buffer[DATA_LENGTH];
+  I2cScheduler& bus = i2cSchedulerFor(deviceAddress);
+
+  // Trigger one conversion and wait for its worst-case duration
+  if (needsTrigger()) {
+    const uint8_t value = triggerValue();
+    if (bus.transfer(triggerTransfer(&value)) != I2cStatus::Ok) {
+      return failed;
+    }
+    bmx280WaitConversion(config.maxMeasurementMicros());
+  }
+
+  if (bus.transfer(dataTransfer(buffer)) != I2cStatus::Ok) {
+    return failed;
+  }
+  return decode(buffer);
+}
+
+// 0xF7..0xF9 pressure, 0xFA..0xFC temperature, 0xFD..0xFE humidity
+BMx280::BMx280Sample BMx280::decode(const uint8_t* buffer) {
+  BMx280Sample sample{NAN, NAN, NAN};
+  int32_t adcP = ((int32_t)buffer[0] << 16) | ((int32_t)buffer[1] << 8) | buffer[2];
+  int32_t adcT = ((int32_t)buffer[3] << 16) | ((int32_t)buffer[4] << 8) | buffer[5];
+  int32_t adcH = ((int32_t)buffer[6] << 8) | buffer[7];
+
+  METRICS_SCOPE(MetricsStage::BmeCompensation);
+  int32_t tFine = compensateTFine(adcT);
+  if (tFine == 0) {
+    return sample;
+  }
+
+  sample.temperature = compensateTemperature(tFine);
+  sample.pressure = compensatePressure(adcP, tFine) / 100.0F; // Convert to hPa
+  if (compChipId != BMP_VAL_CHIP_ID) {
+    sample.humidity = compensateHumidity(adcH, tFine);
+  }
+
+  return sample;
+}
+
+int32_t BMx280::compensateTFine(int32_t adcT) {
   if (adcT == 0x800000) {
     return 0;
   }
@@ -96,26 +251,31 @@ int32_t BMx280::getTFine() {
   return var1 + var2;
 }
 
-float BMx280::getTemperature() {
-  int32_t tempFine = getTFine();
-  if (tempFine == 0) {
+float BMx280::compensateTemperature(int32_t tFine) {
+  if (tFine == 0) {
     return NAN; // Indicate failure
   }
-  int32_t T = (tempFine * 5 + 128) / 256;
+  int32_t T = (tFine * 5 + 128) / 256;
   return (float)T / 100.0;
 }
 
-float BMx280::getPressure() {
-  int32_t tFine = getTFine();
-  if (tFine == 0) {
-    return NAN; // Indicate failure
-  }
-  int32_t adcP = i2cReadThreeBytesFromRegister(deviceAddress, BME_REG_PRESSUREDATA);
+float BMx280::compensatePressure(int32_t adcP, int32_t tFine) {
   if (adcP == 0x800000) {
     return NAN; // Indicate failure
   }
   adcP >>= 4;
 
+#if BMX280_PRESSURE_KERNEL == BMX280_KERNEL_INT32
+  return compensatePressureInt32(adcP, tFine);
+#elif BMX280_PRESSURE_KERNEL == BMX280_KERNEL_FLOAT
+  return compensatePressureFloat(adcP, tFine);
+#else
+  return compensatePressureInt64(adcP, tFine);
+#endif
+}
+
+// Bosch reference formula with 64-bit integers, Q24.8 result
+float BMx280::compensatePressureInt64(int32_t adcP, int32_t tFine) {
   int64_t var1, var2, P;
   var1 = ((int64_t)tFine) - 128000;
   var2 = var1 * var1 * (int64_t)compVals.P6;
@@ -138,13 +298,59 @@ float BMx280::getPressure() {
   return (float)P / 256.0;
 }
 
-float BMx280::getHumidity() {
-  int32_t tFine = getTFine();
-  if (tFine == 0) {
-    return NAN; // Indicate failure
+// Bosch 32-bit integer formula, resolution 1 Pa
+float BMx280::compensatePressureInt32(int32_t adcP, int32_t tFine) {
+  int32_t var1, var2;
+  uint32_t P;
+  var1 = (tFine >> 1) - (int32_t)64000;
+  var2 = (((var1 >> 2) * (var1 >> 2)) >> 11) * ((int32_t)compVals.P6);
+  var2 = var2 + ((var1 * ((int32_t)compVals.P5)) * 2);
+  var2 = (var2 >> 2) + (((int32_t)compVals.P4) * 65536);
+  var1 = ((((int32_t)compVals.P3 * (((var1 >> 2) * (var1 >> 2)) >> 13)) >> 3) +
+          ((((int32_t)compVals.P2) * var1) >> 1)) >> 18;
+  var1 = ((32768 + var1) * ((int32_t)compVals.P1)) >> 15;
+
+  if (var1 == 0) {
+    return NAN; // Avoid division by zero
   }
-  int32_t adcH = i2cReadWordFromRegister(deviceAddress, BME_REG_HUMIDDATA);
 
+  P = (((uint32_t)(((int32_t)1048576) - adcP)) - (uint32_t)(var2 >> 12)) * 3125;
+  if (P < 0x80000000) {
+    P = (P << 1) / ((uint32_t)var1);
+  } else {
+    P = (P / (uint32_t)var1) * 2;
+  }
+  var1 = (((int32_t)compVals.P9) * ((int32_t)(((P >> 3) * (P >> 3)) >> 13))) >> 12;
+  var2 = (((int32_t)(P >> 2)) * ((int32_t)compVals.P8)) >> 13;
+  P = (uint32_t)((int32_t)P + ((var1 + var2 + compVals.P7) >> 4));
+
+  return (float)P;
+}
+
+// Bosch floating point formula evaluated in single precision
+float BMx280::compensatePressureFloat(int32_t adcP, int32_t tFine) {
+  float var1, var2, P;
+  var1 = ((float)tFine / 2.0F) - 64000.0F;
+  var2 = var1 * var1 * ((float)compVals.P6) / 32768.0F;
+  var2 = var2 + var1 * ((float)compVals.P5) * 2.0F;
+  var2 = (var2 / 4.0F) + (((float)compVals.P4) * 65536.0F);
+  var1 = (((float)compVals.P3) * var1 * var1 / 524288.0F +
+          ((float)compVals.P2) * var1) / 524288.0F;
+  var1 = (1.0F + var1 / 32768.0F) * ((float)compVals.P1);
+
+  if (var1 == 0.0F) {
+    return NAN; // Avoid division by zero
+  }
+
+  P = 1048576.0F - (float)adcP;
+  P = (P - (var2 / 4096.0F)) * 6250.0F / var1;
+  var1 = ((float)compVals.P9) * P * P / 2147483648.0F;
+  var2 = P * ((float)compVals.P8) / 32768.0F;
+
+  return P + (var1 + var2 + ((float)compVals.P7)) / 16.0F;
+}
+
+float BMx280::compensateHumidity(int32_t adcH, int32_t tFine) {
   if (adcH == 0x8000) {
     return NAN; // Indicate failure
   }
@@ -168,8 +374,9 @@ float BMx280::getHumidity() {
 }
 
 void BMx280::printBMEData() {
+  const BMx280Sample sample = readAll();
   Serial.println("|--------= BME280 =--------|");
-  Serial.printf("| Temperature: %.2f ˚C    |\n", getTemperature());
-  Serial.printf("|    Pressure: %.2f hPa  |\n", getPressure());
-  Serial.printf("|    Humidity: %.2f %%     |\n", getHumidity());
+  Serial.printf("| Temperature: %.2f ˚C    |\n", sample.temperature);
+  Serial.printf("|    Pressure: %.2f hPa  |\n", sample.pressure);
+  Serial.printf("|    Humidity: %.2f %%     |\n", sample.humidity);
 }
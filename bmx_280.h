@@ -4,7 +4,143 @@
 #include "i2c_utils.h"
 #include <math.h> // Required for NAN
 
+// Pressure compensation kernel, selected at compile time with
+// -DBMX280_PRESSURE_KERNEL=BMX280_KERNEL_xxx
+//   INT64: Bosch reference formula, 1/256 Pa resolution (default)
+//   INT32: Bosch 32-bit formula, 1 Pa resolution, no 64-bit division
+//   FLOAT: single-precision formula, uses the ESP32 FPU
+#define BMX280_KERNEL_INT64 0
+#define BMX280_KERNEL_INT32 1
+#define BMX280_KERNEL_FLOAT 2
+
+#ifndef BMX280_PRESSURE_KERNEL
+#define BMX280_PRESSURE_KERNEL BMX280_KERNEL_INT64
+#endif
+
+// Reached only from the BMx280Config constructor when a setting is invalid.
+// It is deliberately not constexpr, so declaring an invalid configuration as
+// constexpr fails to compile.
+void bmx280InvalidConfig(const char* reason);
+
+// Waits at least micros for a forced-mode conversion. On the ESP32 the task
+// sleeps in whole RTOS ticks, so a 9-113 ms conversion leaves the core to
+// other tasks; on the host it advances the simulated clock.
+void bmx280WaitConversion(uint32_t micros);
+
+/**
+ * Oversampling, IIR filter, standby time and mode of a BME280. Declare it
+ * constexpr so invalid combinations are rejected at compile time; the
+ * register values and the maximum measurement time are derived from it.
+ */
+struct BMx280Config {
+  enum class Oversampling : uint8_t { Skip = 0, X1, X2, X4, X8, X16 };
+  enum class Filter : uint8_t { Off = 0, X2, X4, X8, X16 };
+  enum class Standby : uint8_t {
+    Ms0_5 = 0, Ms62_5, Ms125, Ms250, Ms500, Ms1000, Ms10, Ms20
+  };
+  enum class Mode : uint8_t { Forced = 0x01, Normal = 0x03 };
+
+  Oversampling osrsT;
+  Oversampling osrsP;
+  Oversampling osrsH;
+  Filter filter;
+  Standby standby;
+  Mode mode;
+
+  constexpr BMx280Config(Oversampling osrsT, Oversampling osrsP,
+                         Oversampling osrsH, Filter filter, Standby standby,
+                         Mode mode)
+      : osrsT(osrsT), osrsP(osrsP), osrsH(osrsH), filter(filter),
+        standby(standby), mode(mode) {
+    if (osrsT == Oversampling::Skip) {
+      // t_fine is needed to compensate pressure and humidity
+      bmx280InvalidConfig("temperature measurement cannot be skipped");
+    }
+    if (osrsT > Oversampling::X16 || osrsP > Oversampling::X16 ||
+        osrsH > Oversampling::X16 || filter > Filter::X16 ||
+        standby > Standby::Ms20 ||
+        (mode != Mode::Forced && mode != Mode::Normal)) {
+      bmx280InvalidConfig("setting out of range");
+    }
+  }
+
+  // x16 on every channel, no filter, continuous conversions
+  static constexpr BMx280Config highResolution() {
+    return BMx280Config(Oversampling::X16, Oversampling::X16, Oversampling::X16,
+                        Filter::Off, Standby::Ms0_5, Mode::Normal);
+  }
+
+  // Bosch "weather monitoring" recommendation: x1, no filter, forced mode
+  static constexpr BMx280Config weatherMonitoring() {
+    return BMx280Config(Oversampling::X1, Oversampling::X1, Oversampling::X1,
+                        Filter::Off, Standby::Ms1000, Mode::Forced);
+  }
+
+  constexpr uint8_t ctrlHumRegVal() const { return (uint8_t)osrsH; }
+
+  // In forced mode the sensor is left asleep until readAll() triggers it
+  constexpr uint8_t ctrlMeasRegVal(bool start) const {
+    return (uint8_t)((uint8_t)osrsT << 5 | (uint8_t)osrsP << 2 |
+                     (start || mode == Mode::Normal ? (uint8_t)mode : 0));
+  }
+
+  constexpr uint8_t configRegVal() const {
+    return (uint8_t)((uint8_t)standby << 5 | (uint8_t)filter << 2);
+  }
+
+  // Maximum measurement time, datasheet section 9.1
+  constexpr uint32_t maxMeasurementMicros() const {
+    return 1250 + 2300 * samples(osrsT) +
+           (osrsP == Oversampling::Skip ? 0 : 2300 * samples(osrsP) + 575) +
+           (osrsH == Oversampling::Skip ? 0 : 2300 * samples(osrsH) + 575);
+  }
+
+ private:
+  static constexpr uint32_t samples(Oversampling os) {
+    return os == Oversampling::Skip ? 0 : 1u << ((uint8_t)os - 1);
+  }
+};
+
 class BMx280 {
+ public:
+  // One consistent sample; all three channels come from the same conversion.
+  struct BMx280Sample {
+    float temperature;  // ˚C
+    float pressure;     // hPa
+    float humidity;     // %RH
+  };
+
+  // Compensation Values Structure
+  struct BMx280CompVals {
+    uint16_t T1;
+    int16_t T2;
+    int16_t T3;
+
+    uint16_t P1;
+    int16_t P2;
+    int16_t P3;
+    int16_t P4;
+    int16_t P5;
+    int16_t P6;
+    int16_t P7;
+    int16_t P8;
+    int16_t P9;
+
+    uint8_t H1;
+    int16_t H2;
+    uint8_t H3;
+    int16_t H4;
+    int16_t H5;
+    int8_t H6;
+  };
+
+  // Parsed trim values as they are persisted across resets. chipId is 0
+  // while nothing has been loaded yet.
+  struct BMx280CompCache {
+    uint8_t chipId;
+    BMx280CompVals compVals;
+  };
+
  private:
   // Register Addresses
   static constexpr uint8_t BME_REG_ID = 0xD0;
@@ -18,6 +154,15 @@ class BMx280 {
   static constexpr uint8_t BME_REG_HUMIDDATA = 0xFD;
 
   static constexpr uint8_t BME_VAL_RESET_SOFT = 0xB6;
+  static constexpr uint8_t BME_VAL_CHIP_ID = 0x60;
+  static constexpr uint8_t BMP_VAL_CHIP_ID = 0x58;  // BMP280, no humidity
+
+  // Status register bits
+  static constexpr uint8_t BME_STATUS_IM_UPDATE = 0x01;
+  static constexpr uint8_t BME_STATUS_MEASURING = 0x08;
+
+  static constexpr unsigned long BME_CONVERSION_START_TIMEOUT_MS = 5;
+  static constexpr unsigned long BME_STATUS_TIMEOUT_MS = 200;
 
   // Compensation Registers
   static constexpr uint8_t BME_REG_COMP_T1 = 0x88;
@@ -41,37 +186,28 @@ class BMx280 {
   static constexpr uint8_t BME_REG_COMP_H5 = 0xE5;
   static constexpr uint8_t BME_REG_COMP_H6 = 0xE7;
 
-  // Compensation Values Structure
-  struct BMx280CompVals {
-    uint16_t T1;
-    int16_t T2;
-    int16_t T3;
+  // Trim blocks 0x88..0xA1 (T1..P9, H1) and 0xE1..0xE7 (H2..H6)
+  static constexpr uint8_t BME_COMP_BLOCK1_LEN = BME_REG_COMP_H1 - BME_REG_COMP_T1 + 1;
+  static constexpr uint8_t BME_COMP_BLOCK2_LEN = BME_REG_COMP_H6 - BME_REG_COMP_H2 + 1;
+  // Trim bytes compared against a cached copy in init(), T1..P1
+  static constexpr uint8_t BME_COMP_CHECK_LEN = BME_REG_COMP_P2 - BME_REG_COMP_T1;
 
-    uint16_t P1;
-    int16_t P2;
-    int16_t P3;
-    int16_t P4;
-    int16_t P5;
-    int16_t P6;
-    int16_t P7;
-    int16_t P8;
-    int16_t P9;
+  BMx280CompVals compVals;
+  uint8_t compChipId = 0;  // Chip ID the trim values in compVals belong to
+  bool compFromCache = false;
+  uint32_t initTimeMicros = 0;
 
-    uint8_t H1;
-    int16_t H2;
-    uint8_t H3;
-    int16_t H4;
-    int16_t H5;
-    int8_t H6;
-  } compVals;
-
-  uint8_t deviceAddress;
+  I2cDeviceId deviceAddress;
+  const BMx280Config config;
 
   // Private Methods
-  void setCompensationValues();
-  void populateTemperatureCompensationValues();
-  void populatePressureCompensationValues();
-  void populateHumidityCompensationValues();
+  bool setCompensationValues();
+  bool compensationCacheMatches();
+  void populateTemperatureCompensationValues(const uint8_t* block1);
+  void populatePressureCompensationValues(const uint8_t* block1);
+  void populateHumidityCompensationValues(const uint8_t* block1,
+                                          const uint8_t* block2);
+  bool waitForStatus(uint8_t mask, bool set, unsigned long timeoutMs);
 
   int32_t getTFine();
   float getTemperature();
@@ -79,17 +215,83 @@ class BMx280 {
   float getHumidity();
 
  public:
-  BMx280(const uint8_t deviceAddress) : deviceAddress(deviceAddress) {}
+  // Compensation formulas working on already fetched ADC values, with the
+  // trim of the last init(); public so bench/bench_compensation.cpp can
+  // compare the pressure kernels side by side. compensateTFine() and
+  // compensatePressure() take the 24-bit register values, the kernels the
+  // 20-bit ADC value. Pressure is in Pa.
+  int32_t compensateTFine(int32_t adcT);
+  float compensateTemperature(int32_t tFine);
+  float compensatePressure(int32_t adcP, int32_t tFine);
+  float compensatePressureInt64(int32_t adcP, int32_t tFine);
+  float compensatePressureInt32(int32_t adcP, int32_t tFine);
+  float compensatePressureFloat(int32_t adcP, int32_t tFine);
+  float compensateHumidity(int32_t adcH, int32_t tFine);
+
+  // Pressure, temperature and humidity data registers 0xF7..0xFE
+  static constexpr uint8_t DATA_LENGTH = 8;
+
+  BMx280(const I2cDeviceId deviceAddress,
+         const BMx280Config& config = BMx280Config::highResolution())
+      : deviceAddress(deviceAddress), config(config) {}
   
   /**
    * Initializes the BME280 sensor.
    * @return true if initialization is successful, false otherwise.
    */
   bool init();
+
+  /**
+   * Provides trim values saved on a previous boot. If the chip ID and the
+   * first trim words read in init() match, the rest of the calibration
+   * registers is not read again.
+   * Must be called before init().
+   */
+  void setCompensationCache(const BMx280CompCache& cache) {
+    compChipId = cache.chipId;
+    compVals = cache.compVals;
+  }
+
+  // Trim values in use after init(), ready to be persisted
+  BMx280CompCache getCompensationCache() const { return {compChipId, compVals}; }
+  bool isCompensationFromCache() const { return compFromCache; }
+
+  // Duration of the last init() call
+  uint32_t getInitTimeMicros() const { return initTimeMicros; }
   
   void printBMEData();
 
-  // Public Getters
+  /**
+   * Reads temperature, pressure and humidity in one burst transaction and
+   * computes t_fine only once. Channels that could not be read or are
+   * skipped in the configuration are NAN. In forced mode a conversion is
+   * triggered first and waited for for maxMeasurementMicros(), see
+   * bmx280WaitConversion().
+   */
+  BMx280Sample readAll();
+
+  const BMx280Config& getConfig() const { return config; }
+  I2cDeviceId getDevice() const { return deviceAddress; }
+
+  // The two transfers of readAll(), for callers that queue the reads of
+  // several sensors on the scheduler and wait once for all conversions.
+  // The trigger writes `*value`, which must hold triggerValue().
+  bool needsTrigger() const {
+    return config.mode == BMx280Config::Mode::Forced;
+  }
+  uint8_t triggerValue() const { return config.ctrlMeasRegVal(true); }
+  I2cTransfer triggerTransfer(const uint8_t* value) const {
+    return {deviceAddress, BME_REG_CONTROL, true, nullptr, value, 1};
+  }
+  I2cTransfer dataTransfer(uint8_t* buffer) const {
+    return {deviceAddress, BME_REG_PRESSUREDATA, true, buffer, nullptr,
+            DATA_LENGTH};
+  }
+
+  // Compensates a DATA_LENGTH block read by dataTransfer()
+  BMx280Sample decode(const uint8_t* raw);
+
+  // Public Getters, return the latest conversion (normal mode only)
   float readTemperature() { return getTemperature(); }
   float readPressure()    { return getPressure() / 100.0F; } // Convert to hPa
   float readHumidity()    { return getHumidity(); }
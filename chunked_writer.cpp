@@ -0,0 +1,148 @@
+#include "chunked_writer.h"
+
+static const uint32_t POW10[] = {1, 10, 100, 1000, 10000, 100000, 1000000};
+
+// Writes the decimal digits of value backwards, ending at end
+static char* formatUnsignedReverse(char* end, uint32_t value) {
+  do {
+    *--end = '0' + value % 10;
+    value /= 10;
+  } while (value != 0);
+  return end;
+}
+
+size_t formatFixed(char* out, float value, uint8_t decimals) {
+  if (decimals > 6 || isnan(value) || isinf(value)) {
+    return 0;
+  }
+
+  const bool negative = value < 0.0f;
+  // Single precision on purpose: the ESP32 FPU has no double support
+  const float scaled = fabsf(value) * (float)POW10[decimals] + 0.5f;
+  if (scaled >= 4294967040.0f) {
+    return 0;
+  }
+  uint32_t fixed = (uint32_t)scaled;
+
+  char digits[16];
+  char* end = digits + sizeof(digits);
+  char* p = end;
+  for (uint8_t i = 0; i < decimals; i++) {
+    *--p = '0' + fixed % 10;
+    fixed /= 10;
+  }
+  if (decimals > 0) {
+    *--p = '.';
+  }
+  p = formatUnsignedReverse(p, fixed);
+
+  // "-0.00" would be misleading for values that round to zero
+  bool allZero = true;
+  for (char* q = p; q < end; q++) {
+    if (*q != '0' && *q != '.') {
+      allZero = false;
+      break;
+    }
+  }
+  if (negative && !allZero) {
+    *--p = '-';
+  }
+
+  const size_t len = end - p;
+  memcpy(out, p, len);
+  return len;
+}
+
+void ChunkedWriter::writeHeaders(Print& out, const char* contentType,
+                                 const char* extraHeaders) {
+  out.print("HTTP/1.1 200 OK\r\nContent-Type: ");
+  out.print(contentType);
+  out.print("\r\n");
+  if (extraHeaders != nullptr) {
+    out.print(extraHeaders);
+  }
+  out.print("Transfer-Encoding: chunked\r\nConnection: close\r\n\r\n");
+}
+
+void ChunkedWriter::write(const char* data, size_t len) {
+  if (failed) {
+    return;
+  }
+  while (len > 0) {
+    if (length == CHUNK_SIZE) {
+      flush();
+    }
+    size_t n = CHUNK_SIZE - length;
+    if (n > len) {
+      n = len;
+    }
+    memcpy(buffer + HEADER_SPACE + length, data, n);
+    length += n;
+    data += n;
+    len -= n;
+  }
+}
+
+void ChunkedWriter::write(char c) {
+  if (failed) {
+    return;
+  }
+  if (length == CHUNK_SIZE) {
+    flush();
+  }
+  buffer[HEADER_SPACE + length++] = c;
+}
+
+void ChunkedWriter::writeUnsigned(uint32_t value) {
+  char digits[10];
+  char* end = digits + sizeof(digits);
+  char* p = formatUnsignedReverse(end, value);
+  write(p, end - p);
+}
+
+void ChunkedWriter::writeFixed(float value, uint8_t decimals) {
+  char digits[16];
+  const size_t len = formatFixed(digits, value, decimals);
+  if (len == 0) {
+    write("null", 4);
+  } else {
+    write(digits, len);
+  }
+}
+
+void ChunkedWriter::flush() {
+  if (length == 0 || failed) {
+    length = 0;
+    return;
+  }
+
+  // Chunk size in hex, right-aligned against the payload
+  static const char hex[] = "0123456789ABCDEF";
+  char* start = buffer + HEADER_SPACE;
+  *--start = '\n';
+  *--start = '\r';
+  size_t n = length;
+  do {
+    *--start = hex[n & 0xF];
+    n >>= 4;
+  } while (n != 0);
+
+  buffer[HEADER_SPACE + length] = '\r';
+  buffer[HEADER_SPACE + length + 1] = '\n';
+
+  const size_t total = buffer + HEADER_SPACE + length + 2 - start;
+  const size_t written = out.write((const uint8_t*)start, total);
+  totalBytes += written;
+  failed = written != total;
+  length = 0;
+}
+
+void ChunkedWriter::finish() {
+  flush();
+  if (failed) {
+    return;
+  }
+  const size_t written = out.write((const uint8_t*)"0\r\n\r\n", 5);
+  totalBytes += written;
+  failed = written != 5;
+}
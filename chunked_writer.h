@@ -0,0 +1,63 @@
+#ifndef CHUNKED_WRITER_H
+#define CHUNKED_WRITER_H
+
+#include <Arduino.h>
+
+/**
+ * Streams an HTTP/1.1 body with chunked transfer encoding through a fixed
+ * buffer, without heap allocations. Each chunk is handed to the
+ * underlying Print in a single write() call.
+ */
+class ChunkedWriter {
+ public:
+  static constexpr size_t CHUNK_SIZE = 512;
+
+  explicit ChunkedWriter(Print& out) : out(out) {}
+
+  // Status line and headers, ending with the blank line. extraHeaders are
+  // whole lines, each ending in CRLF.
+  static void writeHeaders(Print& out, const char* contentType,
+                           const char* extraHeaders = nullptr);
+
+  void write(const char* data, size_t len);
+  void write(const char* str) { write(str, strlen(str)); }
+  void write(char c);
+
+  void writeUnsigned(uint32_t value);
+
+  // Fixed-point decimal, "null" for NaN/inf so the JSON stays valid
+  void writeFixed(float value, uint8_t decimals);
+
+  // Sends the buffered bytes as one chunk
+  void flush();
+
+  // Flushes and writes the terminating zero-length chunk
+  void finish();
+
+  // False once the client took fewer bytes than a chunk held. The body is
+  // broken from there on, so nothing more is written and the caller should
+  // close the connection.
+  bool ok() const { return !failed; }
+
+  size_t bytesWritten() const { return totalBytes; }
+  size_t buffered() const { return length; }
+
+ private:
+  // "1FF\r\n" fits into the reserved header area in front of the payload
+  static constexpr size_t HEADER_SPACE = 6;
+
+  Print& out;
+  char buffer[HEADER_SPACE + CHUNK_SIZE + 2];
+  size_t length = 0;
+  size_t totalBytes = 0;
+  bool failed = false;
+};
+
+/**
+ * Formats value with a fixed number of decimals (0..6) into out without
+ * going through printf. Returns the length, or 0 for NaN/inf and values
+ * that do not fit into 32 bits once scaled. out must hold 16 bytes.
+ */
+size_t formatFixed(char* out, float value, uint8_t decimals);
+
+#endif  // CHUNKED_WRITER_H
@@ -0,0 +1,581 @@
+#include "collector.h"
+
+#include <errno.h>
+#include <netdb.h>
+#include <netinet/tcp.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include <time.h>
+#include <unistd.h>
+
+static const int MAX_EVENTS = 64;
+
+Collector::Collector(const std::string& directory, CollectMode mode,
+                     uint32_t intervalMs)
+    : directory(directory), mode(mode), intervalMs(intervalMs) {
+  epollFd = epoll_create1(EPOLL_CLOEXEC);
+}
+
+Collector::~Collector() {
+  for (auto& station : stations) {
+    if (station->fd >= 0) {
+      close(station->fd);
+    }
+    station->store.commit();
+  }
+  if (epollFd >= 0) {
+    close(epollFd);
+  }
+}
+
+uint64_t Collector::nowMs() {
+  timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return (uint64_t)now.tv_sec * 1000 + now.tv_nsec / 1000000;
+}
+
+bool Collector::addStation(const StationConfig& config) {
+  std::unique_ptr<Station> station(new Station());
+  station->config = config;
+  station->index = stations.size();
+  station->stream = mode == CollectMode::Stream && config.sensor == 0;
+
+  addrinfo hints = {};
+  hints.ai_family = AF_INET;
+  hints.ai_socktype = SOCK_STREAM;
+  addrinfo* found = nullptr;
+  if (getaddrinfo(config.host.c_str(), nullptr, &hints, &found) != 0 ||
+      found == nullptr) {
+    fprintf(stderr, "%s: cannot resolve %s\n", config.name.c_str(),
+            config.host.c_str());
+    return false;
+  }
+  memcpy(&station->address, found->ai_addr, sizeof(station->address));
+  station->address.sin_port = htons(config.port);
+  freeaddrinfo(found);
+
+  if (!station->store.open(directory + "/" + config.name)) {
+    fprintf(stderr, "%s: cannot open the store in %s/%s: %s\n",
+            config.name.c_str(), directory.c_str(), config.name.c_str(),
+            strerror(errno));
+    return false;
+  }
+  // Resume after the newest stored reading, if it is of the boot the store
+  // knows; rows that were replayed from flash do not count
+  const StationStore& store = station->store;
+  const bool bootRows =
+      store.hasBoot() ? store.size() > store.bootRow() : !store.empty();
+  station->nextSequence = bootRows ? store.lastSequence() + 1 : 0;
+  station->buffer.reset(new char[BUFFER_SIZE]);
+  stations.push_back(std::move(station));
+  return true;
+}
+
+void Collector::sync(bool wait) {
+  for (auto& station : stations) {
+    station->store.sync(wait);
+  }
+}
+
+void Collector::schedule(uint32_t index, uint64_t due) {
+  timers.push({due, index, stations[index]->generation});
+}
+
+void Collector::runFor(uint32_t durationMs, volatile sig_atomic_t& stop) {
+  const uint64_t until = nowMs() + durationMs;
+  if (!started) {
+    started = true;
+    // Spread the requests over the interval instead of sending them at once
+    const uint64_t now = nowMs();
+    for (uint32_t i = 0; i < stations.size(); i++) {
+      stations[i]->nextPoll = now + (uint64_t)intervalMs * i / stations.size();
+      schedule(i, stations[i]->nextPoll);
+    }
+  }
+
+  epoll_event events[MAX_EVENTS];
+  while (!stop) {
+    uint64_t now = nowMs();
+    while (!timers.empty() && timers.top().due <= now) {
+      const Timer timer = timers.top();
+      timers.pop();
+      onTimer(timer);
+    }
+    if (now >= until) {
+      break;
+    }
+
+    uint64_t wake = until;
+    if (!timers.empty() && timers.top().due < wake) {
+      wake = timers.top().due;
+    }
+    const int count = epoll_wait(epollFd, events, MAX_EVENTS, (int)(wake - now));
+    if (count < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+      perror("epoll_wait");
+      break;
+    }
+    for (int i = 0; i < count; i++) {
+      onEvent(*stations[events[i].data.u32], events[i].events);
+    }
+  }
+}
+
+void Collector::onTimer(const Timer& timer) {
+  Station& station = *stations[timer.station];
+  if (timer.generation != station.generation) {
+    return;
+  }
+  if (station.state == State::Idle) {
+    start(timer.station);
+    return;
+  }
+
+  // Running request: time out when nothing arrived for too long
+  const uint32_t timeout =
+      station.stream ? STREAM_IDLE_TIMEOUT_MS : REQUEST_TIMEOUT_MS;
+  const uint64_t due = station.lastActivity + timeout;
+  if (nowMs() >= due) {
+    finish(station, false);
+  } else {
+    schedule(timer.station, due);
+  }
+}
+
+void Collector::start(uint32_t index) {
+  Station& station = *stations[index];
+  char sensor[24] = "";
+  if (station.config.sensor != 0) {
+    snprintf(sensor, sizeof(sensor), "&sensor=%lu",
+             (unsigned long)station.config.sensor);
+  }
+  const int length = snprintf(
+      station.request, sizeof(station.request),
+      "GET %s?since=%lu%s HTTP/1.1\r\nHost: %s\r\nConnection: close\r\n\r\n",
+      station.stream ? "/stream" : "/data", (unsigned long)station.nextSequence,
+      sensor, station.config.host.c_str());
+  station.requestLength = length;
+  station.requestSent = 0;
+  station.begin = 0;
+  station.end = 0;
+  station.status = 0;
+  station.chunked = false;
+  station.chunkRemaining = 0;
+  station.chunkTrailer = false;
+  station.hasLength = false;
+  station.lengthRemaining = 0;
+  station.requestSince = station.nextSequence;
+  station.bootSequence = 0;
+  station.carryLength = 0;
+  station.lastActivity = nowMs();
+  collectorStats.requests++;
+
+  if (length < 0 || (size_t)length >= sizeof(station.request)) {
+    fprintf(stderr, "%s: host name too long\n", station.config.name.c_str());
+    station.state = State::Connecting;
+    finish(station, false);
+    return;
+  }
+
+  station.fd =
+      socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, IPPROTO_TCP);
+  const int one = 1;
+  epoll_event event = {};
+  event.events = EPOLLOUT;
+  event.data.u32 = index;
+  station.state = State::Connecting;
+  if (station.fd < 0 ||
+      setsockopt(station.fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one)) != 0 ||
+      (connect(station.fd, (const sockaddr*)&station.address,
+               sizeof(station.address)) != 0 &&
+       errno != EINPROGRESS) ||
+      epoll_ctl(epollFd, EPOLL_CTL_ADD, station.fd, &event) != 0) {
+    finish(station, false);
+    return;
+  }
+  schedule(index, station.lastActivity + REQUEST_TIMEOUT_MS);
+}
+
+// Closes the connection, publishes what arrived and schedules the next
+// request: the next interval when polling, a growing delay when a stream
+// dropped
+void Collector::finish(Station& station, bool ok) {
+  if (station.fd >= 0) {
+    close(station.fd);  // also leaves the epoll set
+    station.fd = -1;
+  }
+  station.store.commit();
+  station.state = State::Idle;
+  station.generation++;
+  if (ok) {
+    collectorStats.responses++;
+  } else {
+    collectorStats.errors++;
+  }
+  if (!station.polledOnce) {
+    station.polledOnce = true;
+    roundsDone++;
+  }
+
+  const uint64_t now = nowMs();
+  uint64_t due;
+  if (station.resync) {
+    station.resync = false;
+    due = now;
+  } else if (station.stream) {
+    due = now + station.retryMs;
+    station.retryMs =
+        station.retryMs * 2 < RETRY_MAX_MS ? station.retryMs * 2 : RETRY_MAX_MS;
+  } else {
+    // Keep the cadence; a round that fell behind is not made up
+    station.nextPoll += intervalMs;
+    if (station.nextPoll < now) {
+      station.nextPoll = now;
+    }
+    due = station.nextPoll;
+  }
+  schedule(station.index, due);
+}
+
+void Collector::onEvent(Station& station, uint32_t events) {
+  if (station.state == State::Idle) {
+    return;  // finished earlier in this batch
+  }
+  station.lastActivity = nowMs();
+
+  if (station.state == State::Connecting) {
+    int error = 0;
+    socklen_t length = sizeof(error);
+    if (getsockopt(station.fd, SOL_SOCKET, SO_ERROR, &error, &length) != 0 ||
+        error != 0) {
+      finish(station, false);
+      return;
+    }
+    station.state = State::Sending;
+  }
+
+  if (station.state == State::Sending) {
+    if (!sendRequest(station)) {
+      finish(station, false);
+    }
+    return;
+  }
+
+  if ((events & (EPOLLIN | EPOLLHUP | EPOLLERR)) != 0) {
+    bool complete = false;
+    const bool ok = receive(station, complete);
+    // Rows become visible to readers once per received batch
+    station.store.commit();
+    if (!ok || complete) {
+      finish(station, ok);
+    }
+  }
+}
+
+bool Collector::sendRequest(Station& station) {
+  while (station.requestSent < station.requestLength) {
+    const ssize_t sent =
+        send(station.fd, station.request + station.requestSent,
+             station.requestLength - station.requestSent, MSG_NOSIGNAL);
+    if (sent < 0) {
+      return errno == EAGAIN || errno == EWOULDBLOCK;
+    }
+    station.requestSent += sent;
+  }
+  epoll_event event = {};
+  event.events = EPOLLIN;
+  event.data.u32 = station.index;
+  station.state = State::Headers;
+  return epoll_ctl(epollFd, EPOLL_CTL_MOD, station.fd, &event) == 0;
+}
+
+// Reads until the socket is drained, parsing after every read so the
+// buffer only ever holds an incomplete tail
+bool Collector::receive(Station& station, bool& complete) {
+  for (;;) {
+    if (station.begin > 0 && station.end > BUFFER_SIZE / 2) {
+      memmove(station.buffer.get(), station.buffer.get() + station.begin,
+              station.end - station.begin);
+      station.end -= station.begin;
+      station.begin = 0;
+    }
+    if (station.end == BUFFER_SIZE) {
+      if (station.begin == 0) {
+        fprintf(stderr, "%s: response line does not fit the buffer\n",
+                station.config.name.c_str());
+        return false;
+      }
+      continue;
+    }
+
+    const ssize_t received = recv(station.fd, station.buffer.get() + station.end,
+                                  BUFFER_SIZE - station.end, 0);
+    if (received < 0) {
+      return errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR;
+    }
+    if (received == 0) {
+      // Connection closed: the end of a response without length or chunks
+      complete = true;
+      return station.state == State::Body && !station.chunked &&
+             !station.hasLength;
+    }
+    collectorStats.bytes += received;
+    station.end += received;
+
+    if (station.state == State::Headers) {
+      bool done = false;
+      if (!parseHeaders(station, done)) {
+        return false;
+      }
+      if (!done) {
+        continue;
+      }
+    }
+    if (!station.resync && !parseBody(station, complete)) {
+      return false;
+    }
+    if (complete || station.resync) {
+      complete = true;
+      return true;
+    }
+  }
+}
+
+static bool headerIs(const char* line, const char* lineEnd, const char* name,
+                     const char*& value) {
+  const size_t length = strlen(name);
+  if ((size_t)(lineEnd - line) <= length || strncasecmp(line, name, length) != 0) {
+    return false;
+  }
+  value = line + length;
+  while (value < lineEnd && (*value == ' ' || *value == '\t')) {
+    value++;
+  }
+  return true;
+}
+
+bool Collector::parseHeaders(Station& station, bool& done) {
+  char* const data = station.buffer.get();
+  const char* begin = data + station.begin;
+  const char* end = data + station.end;
+  const char* terminator = (const char*)memmem(begin, end - begin, "\r\n\r\n", 4);
+  if (terminator == nullptr) {
+    done = false;
+    return true;
+  }
+
+  // HTTP/1.1 200 OK
+  const char* lineEnd = (const char*)memchr(begin, '\r', terminator + 2 - begin);
+  if (lineEnd - begin < 12 || memcmp(begin, "HTTP/1.", 7) != 0) {
+    return false;
+  }
+  station.status = atoi(begin + 9);
+  if (station.status != 200) {
+    fprintf(stderr, "%s: HTTP status %d\n", station.config.name.c_str(),
+            station.status);
+    return false;
+  }
+
+  bool hasBoot = false;
+  uint32_t boot = 0;
+  uint32_t bootSequence = 0;
+  for (const char* line = lineEnd + 2; line < terminator + 2;
+       line = lineEnd + 2) {
+    lineEnd = (const char*)memchr(line, '\r', terminator + 2 - line);
+    const char* value;
+    if (headerIs(line, lineEnd, "transfer-encoding:", value)) {
+      station.chunked = memmem(value, lineEnd - value, "chunked", 7) != nullptr;
+    } else if (headerIs(line, lineEnd, "content-length:", value)) {
+      station.hasLength = true;
+      station.lengthRemaining = strtoull(value, nullptr, 10);
+    } else if (headerIs(line, lineEnd, "x-boot-id:", value)) {
+      hasBoot = true;
+      boot = strtoul(value, nullptr, 10);
+    } else if (headerIs(line, lineEnd, "x-boot-sequence:", value)) {
+      bootSequence = strtoul(value, nullptr, 10);
+    }
+  }
+
+  station.begin = terminator + 4 - data;
+  station.state = State::Body;
+  done = true;
+  if (hasBoot) {
+    onBoot(station, boot, bootSequence);
+  }
+  return true;
+}
+
+bool Collector::parseBody(Station& station, bool& complete) {
+  char* const data = station.buffer.get();
+
+  if (!station.chunked) {
+    size_t available = station.end - station.begin;
+    if (station.hasLength && available > station.lengthRemaining) {
+      available = station.lengthRemaining;
+    }
+    const bool last = station.hasLength && available == station.lengthRemaining;
+    const size_t used =
+        consumeRows(station, data + station.begin, available, last);
+    station.begin += used;
+    if (station.hasLength) {
+      station.lengthRemaining -= used;
+      complete = station.lengthRemaining == 0;
+    }
+    return true;
+  }
+
+  for (;;) {
+    if (station.chunkTrailer) {
+      if (station.end - station.begin < 2) {
+        return true;
+      }
+      if (data[station.begin] != '\r' || data[station.begin + 1] != '\n') {
+        return false;
+      }
+      station.begin += 2;
+      station.chunkTrailer = false;
+    }
+
+    if (station.chunkRemaining == 0) {
+      // <hex size>[;extensions]\r\n
+      const char* line = data + station.begin;
+      const char* lineEnd =
+          (const char*)memchr(line, '\n', station.end - station.begin);
+      if (lineEnd == nullptr) {
+        return station.end - station.begin < 64;
+      }
+      char* sizeEnd;
+      station.chunkRemaining = strtoull(line, &sizeEnd, 16);
+      if (sizeEnd == line) {
+        return false;
+      }
+      station.begin = lineEnd + 1 - data;
+      if (station.chunkRemaining == 0) {
+        // Trailers are not used by the station
+        complete = true;
+        return true;
+      }
+    }
+
+    size_t available = station.end - station.begin;
+    const bool chunkEnds = available >= station.chunkRemaining;
+    if (chunkEnds) {
+      available = station.chunkRemaining;
+    }
+    const size_t used =
+        consumeRows(station, data + station.begin, available, chunkEnds);
+    station.begin += used;
+    station.chunkRemaining -= used;
+    if (station.chunkRemaining > 0) {
+      return true;  // the rest of the chunk is still to come
+    }
+    station.chunkTrailer = true;
+  }
+}
+
+// Parses the objects in [data, data + length) and returns the bytes used.
+// An incomplete object is left unused, unless its chunk ends here: then
+// it is kept in the carry buffer and completed from the next chunk.
+size_t Collector::consumeRows(Station& station, const char* data,
+                              size_t length, bool chunkEnds) {
+  const char* cursor = data;
+  const char* end = data + length;
+  StationObject object;
+
+  if (station.carryLength > 0) {
+    const char* close = (const char*)memchr(data, '}', length);
+    const size_t take = close != nullptr ? close + 1 - data : length;
+    if (station.carryLength + take > sizeof(station.carry)) {
+      // Too long for a row, drop it
+      station.carryLength = 0;
+    } else {
+      memcpy(station.carry + station.carryLength, data, take);
+      station.carryLength += take;
+      if (close != nullptr) {
+        const char* carried = station.carry;
+        if (ReadingParser::next(carried, station.carry + station.carryLength,
+                                object)) {
+          store(station, object);
+        }
+        station.carryLength = 0;
+      }
+    }
+    cursor += take;
+  }
+
+  while (ReadingParser::next(cursor, end, object)) {
+    store(station, object);
+  }
+  if (chunkEnds && cursor < end) {
+    const size_t tail = end - cursor;
+    if (tail <= sizeof(station.carry)) {
+      memcpy(station.carry, cursor, tail);
+      station.carryLength = tail;
+    }
+    cursor = end;
+  }
+  return cursor - data;
+}
+
+// A response from a station that restarted since the last one continues
+// at the wrong sequence number, unless it was asked from 0 anyway
+void Collector::onBoot(Station& station, uint32_t boot, uint32_t bootSequence) {
+  StationStore& store = station.store;
+  station.bootSequence = bootSequence;
+  if (store.hasBoot() && store.boot() == boot) {
+    return;
+  }
+  // Rows stored before there was a boot file count as this boot's
+  const uint64_t row = store.hasBoot() ? store.rows() : 0;
+  if (store.hasBoot()) {
+    collectorStats.restarts++;
+  }
+  if (!store.setBoot(boot, row)) {
+    fprintf(stderr, "%s: cannot write the boot file: %s\n",
+            station.config.name.c_str(), strerror(errno));
+  }
+  if (row > 0) {
+    station.nextSequence = 0;
+    station.resync = station.requestSince != 0;
+  }
+}
+
+void Collector::store(Station& station, const StationObject& object) {
+  if (object.isHello) {
+    // The stream is up, a later drop starts the back-off from the bottom
+    station.retryMs = RETRY_MIN_MS;
+    onBoot(station, object.boot, object.bootSequence);
+    return;
+  }
+  if (station.resync || !object.hasSequence || !object.hasTimestamp) {
+    return;
+  }
+
+  // Replayed from flash, see the class comment
+  const StationStore& stored = station.store;
+  const bool replayed = stored.bootRow() > 0 &&
+                        object.sequence < station.bootSequence;
+  if (object.sequence < station.nextSequence ||
+      (replayed && (object.timestamp < READING_EPOCH_2020 ||
+                    object.timestamp <= stored.lastTimestamp()))) {
+    collectorStats.skipped++;
+    station.nextSequence = object.sequence + 1 > station.nextSequence
+                               ? object.sequence + 1
+                               : station.nextSequence;
+    return;
+  }
+
+  if (!station.store.append(object)) {
+    fprintf(stderr, "%s: cannot grow the store: %s\n",
+            station.config.name.c_str(), strerror(errno));
+    return;
+  }
+  station.nextSequence = object.sequence + 1;
+  collectorStats.rows++;
+}
@@ -0,0 +1,165 @@
+#ifndef COLLECTOR_COLLECTOR_H
+#define COLLECTOR_COLLECTOR_H
+
+#include <netinet/in.h>
+#include <signal.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include <memory>
+#include <queue>
+#include <string>
+#include <vector>
+
+#include "column_store.h"
+#include "reading_parser.h"
+
+struct StationConfig {
+  std::string name;  // directory under the output directory
+  std::string host;
+  uint16_t port;
+  uint32_t sensor;   // SensorRegistry index, /data?sensor=
+};
+
+enum class CollectMode : uint8_t {
+  Poll,    // GET /data?since= every interval
+  Stream,  // one /stream?since= connection per station
+};
+
+/**
+ * Collects the readings of many stations on one epoll loop in one thread.
+ * Every station is a non-blocking HTTP/1.1 client: in Poll mode it asks for
+ * /data?since=<next sequence> once per interval (the stations' first polls
+ * are spread over the interval), in Stream mode it holds a /stream
+ * connection and reconnects with a growing back-off when it drops.
+ *
+ * Responses are parsed where they are received (ReadingParser), chunked
+ * transfer encoding included, and every row is appended to the station's
+ * StationStore, which is published once per received buffer. After a
+ * restart the next sequence number is taken from the store, so nothing is
+ * fetched twice.
+ *
+ * Sequence numbers are only unique within one boot of a station: every
+ * response names the boot (the X-Boot-Id header of /data, the /stream
+ * hello), and the store keeps the boot its newest rows came from. A new
+ * boot id ends the response, and the station is asked again from since=0
+ * at once. Its readings below the boot's first sequence number (X-Boot-
+ * Sequence, "boot_seq") were replayed from flash and are mostly stored
+ * already under the old numbers: of those, only rows with a calendar
+ * timestamp newer than the newest stored row are kept. Seconds since
+ * power-on cannot be compared across boots, so such replayed rows are
+ * skipped.
+ */
+class Collector {
+ public:
+  static constexpr size_t BUFFER_SIZE = 16 * 1024;
+  static constexpr uint32_t REQUEST_TIMEOUT_MS = 10000;
+  static constexpr uint32_t STREAM_IDLE_TIMEOUT_MS = 60000;  // 4 keep-alives
+  static constexpr uint32_t RETRY_MIN_MS = 1000;
+  static constexpr uint32_t RETRY_MAX_MS = 30000;
+
+  struct Stats {
+    uint64_t requests;
+    uint64_t responses;  // complete, status 200
+    uint64_t errors;     // connect, HTTP, parse or timeout
+    uint64_t rows;       // appended to the stores
+    uint64_t skipped;    // duplicates after a station restart
+    uint64_t restarts;   // new boot ids of known stations
+    uint64_t bytes;      // received, headers included
+  };
+
+  Collector(const std::string& directory, CollectMode mode,
+            uint32_t intervalMs);
+  ~Collector();
+
+  // Opens the station's store; host names are resolved here, once
+  bool addStation(const StationConfig& config);
+  size_t stationCount() const { return stations.size(); }
+
+  // Runs the event loop for durationMs or until `stop` is set. The first
+  // call spreads the stations' first requests over the interval.
+  void runFor(uint32_t durationMs, volatile sig_atomic_t& stop);
+  // Every station has completed (or failed) its first request
+  bool roundComplete() const { return roundsDone == stations.size(); }
+
+  Stats stats() const { return collectorStats; }
+  void sync(bool wait);
+
+ private:
+  enum class State : uint8_t { Idle, Connecting, Sending, Headers, Body };
+
+  struct Station {
+    StationConfig config;
+    uint32_t index;  // in stations, also the epoll data
+    sockaddr_in address;
+    StationStore store;
+    bool stream = false;  // /stream serves sensor 0 only, others are polled
+
+    State state = State::Idle;
+    int fd = -1;
+    uint32_t generation = 0;  // invalidates timers of earlier requests
+    uint64_t lastActivity = 0;
+    uint64_t nextPoll = 0;
+    uint32_t retryMs = RETRY_MIN_MS;
+    bool polledOnce = false;
+
+    char request[256];
+    size_t requestLength = 0;
+    size_t requestSent = 0;
+
+    // Unparsed bytes are buffer[begin, end)
+    std::unique_ptr<char[]> buffer;
+    size_t begin = 0;
+    size_t end = 0;
+
+    int status = 0;
+    bool chunked = false;
+    uint64_t chunkRemaining = 0;
+    bool chunkTrailer = false;  // CRLF after a chunk's data is due
+    bool hasLength = false;
+    uint64_t lengthRemaining = 0;  // Content-Length responses
+    uint32_t nextSequence = 0;
+    uint32_t requestSince = 0;
+    uint32_t bootSequence = 0;  // as reported with the current response
+    bool resync = false;        // new boot, ask again from since=0
+
+    // An object split across two chunks, rare with the station's chunking
+    char carry[256];
+    size_t carryLength = 0;
+  };
+
+  struct Timer {
+    uint64_t due;
+    uint32_t station;
+    uint32_t generation;
+    bool operator>(const Timer& other) const { return due > other.due; }
+  };
+
+  const std::string directory;
+  const CollectMode mode;
+  const uint32_t intervalMs;
+  int epollFd = -1;
+  std::vector<std::unique_ptr<Station>> stations;
+  std::priority_queue<Timer, std::vector<Timer>, std::greater<Timer>> timers;
+  Stats collectorStats = {};
+  size_t roundsDone = 0;
+  bool started = false;
+
+  static uint64_t nowMs();
+  void schedule(uint32_t index, uint64_t due);
+  void start(uint32_t index);
+  void finish(Station& station, bool ok);
+  void onTimer(const Timer& timer);
+  void onEvent(Station& station, uint32_t events);
+  bool sendRequest(Station& station);
+  // false on errors; complete is set when the response has ended
+  bool receive(Station& station, bool& complete);
+  bool parseHeaders(Station& station, bool& done);
+  bool parseBody(Station& station, bool& complete);
+  size_t consumeRows(Station& station, const char* data, size_t length,
+                     bool chunkEnds);
+  void onBoot(Station& station, uint32_t boot, uint32_t bootSequence);
+  void store(Station& station, const StationObject& object);
+};
+
+#endif  // COLLECTOR_COLLECTOR_H
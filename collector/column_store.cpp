@@ -0,0 +1,244 @@
+#include "column_store.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <atomic>
+
+static const char COLUMN_MAGIC[4] = {'D', 'M', 'P', 'C'};
+static const uint32_t VALUE_SIZE = 4;
+
+// Growth doubles up to this many rows, then continues in steps of it
+static const uint64_t GROWTH_LIMIT = 1 << 20;
+
+bool ColumnFile::open(const std::string& path, const char* name,
+                      const char* type) {
+  close();
+  fd = ::open(path.c_str(), O_RDWR | O_CREAT | O_CLOEXEC, 0644);
+  if (fd < 0) {
+    return false;
+  }
+  struct stat st;
+  if (fstat(fd, &st) != 0) {
+    close();
+    return false;
+  }
+
+  if (st.st_size == 0) {
+    ColumnHeader fresh = {};
+    memcpy(fresh.magic, COLUMN_MAGIC, 4);
+    fresh.version = VERSION;
+    fresh.headerSize = sizeof(ColumnHeader);
+    memcpy(fresh.type, type, strnlen(type, sizeof(fresh.type)));
+    fresh.valueSize = VALUE_SIZE;
+    strncpy(fresh.name, name, sizeof(fresh.name) - 1);
+    if (pwrite(fd, &fresh, sizeof(fresh), 0) != (ssize_t)sizeof(fresh) ||
+        !resize(INITIAL_CAPACITY)) {
+      close();
+      return false;
+    }
+    return true;
+  }
+
+  if ((size_t)st.st_size < sizeof(ColumnHeader)) {
+    close();
+    return false;
+  }
+  mappedBytes = st.st_size;
+  void* mapped =
+      mmap(nullptr, mappedBytes, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+  if (mapped == MAP_FAILED) {
+    mappedBytes = 0;
+    close();
+    return false;
+  }
+  mapping = (uint8_t*)mapped;
+  header = (ColumnHeader*)mapping;
+  if (memcmp(header->magic, COLUMN_MAGIC, 4) != 0 ||
+      header->version != VERSION || header->valueSize != VALUE_SIZE ||
+      strncmp(header->type, type, sizeof(header->type)) != 0 ||
+      sizeof(ColumnHeader) + header->capacity * VALUE_SIZE > mappedBytes ||
+      header->count > header->capacity) {
+    close();
+    return false;
+  }
+  return true;
+}
+
+void ColumnFile::close() {
+  if (mapping != nullptr) {
+    munmap(mapping, mappedBytes);
+    mapping = nullptr;
+    header = nullptr;
+    mappedBytes = 0;
+  }
+  if (fd >= 0) {
+    ::close(fd);
+    fd = -1;
+  }
+}
+
+// The file only ever grows, so readers holding an older, shorter mapping
+// stay valid
+bool ColumnFile::resize(uint64_t capacity) {
+  const size_t bytes = sizeof(ColumnHeader) + capacity * VALUE_SIZE;
+  if (ftruncate(fd, bytes) != 0) {
+    return false;
+  }
+  void* mapped = mapping == nullptr
+                     ? mmap(nullptr, bytes, PROT_READ | PROT_WRITE, MAP_SHARED,
+                            fd, 0)
+                     : mremap(mapping, mappedBytes, bytes, MREMAP_MAYMOVE);
+  if (mapped == MAP_FAILED) {
+    return false;
+  }
+  mapping = (uint8_t*)mapped;
+  mappedBytes = bytes;
+  header = (ColumnHeader*)mapping;
+  header->capacity = capacity;
+  return true;
+}
+
+bool ColumnFile::reserve(uint64_t rows) {
+  const uint64_t needed = header->count + rows;
+  if (needed <= header->capacity) {
+    return true;
+  }
+  uint64_t capacity = header->capacity;
+  while (capacity < needed) {
+    capacity += capacity < GROWTH_LIMIT ? capacity : GROWTH_LIMIT;
+  }
+  return resize(capacity);
+}
+
+void ColumnFile::sync(bool wait) {
+  if (mapping != nullptr) {
+    msync(mapping, mappedBytes, wait ? MS_SYNC : MS_ASYNC);
+  }
+}
+
+// -=| Station |=-
+
+static const struct {
+  const char* file;
+  const char* name;
+  const char* type;
+} COLUMN_INFO[StationStore::COLUMNS] = {
+    {"timestamp.col", "timestamp", "<u4"},
+    {"seq.col", "seq", "<u4"},
+    {"temperature.col", "temperature", "<f4"},
+    {"pressure.col", "pressure", "<f4"},
+    {"humidity.col", "humidity", "<f4"},
+};
+
+bool StationStore::open(const std::string& directory) {
+  close();
+  if (mkdir(directory.c_str(), 0755) != 0 && errno != EEXIST) {
+    return false;
+  }
+  uint64_t rows = UINT64_MAX;
+  for (int i = 0; i < COLUMNS; i++) {
+    if (!columns[i].open(directory + "/" + COLUMN_INFO[i].file,
+                         COLUMN_INFO[i].name, COLUMN_INFO[i].type)) {
+      close();
+      return false;
+    }
+    if (columns[i].count() < rows) {
+      rows = columns[i].count();
+    }
+  }
+  for (int i = 0; i < COLUMNS; i++) {
+    columns[i].setCount(rows);
+  }
+  if (rows > 0) {
+    lastTimestampValue = columns[Timestamp].values()[rows - 1];
+    lastSequenceValue = columns[Sequence].values()[rows - 1];
+  }
+
+  bootPath = directory + "/boot";
+  FILE* file = fopen(bootPath.c_str(), "r");
+  if (file != nullptr) {
+    unsigned long boot = 0;
+    unsigned long long row = 0;
+    bootKnown = fscanf(file, "%lu %llu", &boot, &row) == 2;
+    bootValue = boot;
+    // Rows past the published ones were lost in a crash
+    bootRowValue = row < rows ? row : rows;
+    fclose(file);
+  }
+  return true;
+}
+
+void StationStore::close() {
+  for (int i = 0; i < COLUMNS; i++) {
+    columns[i].close();
+  }
+  pending = 0;
+  lastSequenceValue = 0;
+  lastTimestampValue = 0;
+  bootKnown = false;
+  bootValue = 0;
+  bootRowValue = 0;
+}
+
+// Written to a temporary file and renamed, so it is always whole
+bool StationStore::setBoot(uint32_t boot, uint64_t row) {
+  const std::string temporary = bootPath + ".tmp";
+  FILE* file = fopen(temporary.c_str(), "w");
+  if (file == nullptr) {
+    return false;
+  }
+  const bool written =
+      fprintf(file, "%lu %llu\n", (unsigned long)boot, (unsigned long long)row) > 0;
+  if (fclose(file) != 0 || !written ||
+      rename(temporary.c_str(), bootPath.c_str()) != 0) {
+    return false;
+  }
+  bootKnown = true;
+  bootValue = boot;
+  bootRowValue = row;
+  return true;
+}
+
+bool StationStore::append(const StationObject& reading) {
+  for (int i = 0; i < COLUMNS; i++) {
+    if (!columns[i].reserve(pending + 1)) {
+      return false;
+    }
+  }
+  const uint64_t row = size() + pending;
+  columns[Timestamp].values()[row] = reading.timestamp;
+  columns[Sequence].values()[row] = reading.sequence;
+  memcpy(&columns[Temperature].values()[row], &reading.temperature, 4);
+  memcpy(&columns[Pressure].values()[row], &reading.pressure, 4);
+  memcpy(&columns[Humidity].values()[row], &reading.humidity, 4);
+  pending++;
+  lastTimestampValue = reading.timestamp;
+  lastSequenceValue = reading.sequence;
+  return true;
+}
+
+void StationStore::commit() {
+  if (pending == 0) {
+    return;
+  }
+  const uint64_t rows = size() + pending;
+  for (int i = COLUMNS - 1; i > Timestamp; i--) {
+    columns[i].setCount(rows);
+  }
+  // Values before the count readers go by
+  std::atomic_thread_fence(std::memory_order_release);
+  columns[Timestamp].setCount(rows);
+  pending = 0;
+}
+
+void StationStore::sync(bool wait) {
+  for (int i = 0; i < COLUMNS; i++) {
+    columns[i].sync(wait);
+  }
+}
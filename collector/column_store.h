@@ -0,0 +1,113 @@
+#ifndef COLLECTOR_COLUMN_STORE_H
+#define COLLECTOR_COLUMN_STORE_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <string>
+
+#include "reading_parser.h"
+
+/**
+ * First 64 bytes of every column file, followed by `capacity` values of
+ * which the first `count` are valid. `type` is the numpy type string
+ * ("<u4", "<f4"), so a reader maps the values without a copy:
+ *
+ *   count = int(np.frombuffer(raw, "<u8", 1, 16)[0])
+ *   values = np.memmap(path, type, "r", offset=64, shape=(count,))
+ */
+struct __attribute__((packed)) ColumnHeader {
+  char magic[4];  // "DMPC"
+  uint16_t version;
+  uint16_t headerSize;
+  char type[4];
+  uint32_t valueSize;
+  uint64_t count;
+  uint64_t capacity;
+  char name[32];
+};
+
+static_assert(sizeof(ColumnHeader) == 64, "ColumnHeader must stay 64 bytes");
+
+// One memory-mapped column of 4-byte values that grows by remapping
+class ColumnFile {
+ public:
+  static constexpr uint16_t VERSION = 1;
+  static constexpr uint64_t INITIAL_CAPACITY = 4096;
+
+  ColumnFile() {}
+  ~ColumnFile() { close(); }
+  ColumnFile(const ColumnFile&) = delete;
+  ColumnFile& operator=(const ColumnFile&) = delete;
+
+  // Opens or creates the file; an existing one must have the same type
+  bool open(const std::string& path, const char* name, const char* type);
+  void close();
+
+  uint64_t count() const { return header->count; }
+  // Makes room for `rows` values after count()
+  bool reserve(uint64_t rows);
+  // Values from index count() on are written here, then published by
+  // setCount()
+  uint32_t* values() { return (uint32_t*)(mapping + sizeof(ColumnHeader)); }
+  void setCount(uint64_t count) { header->count = count; }
+  void sync(bool wait);
+
+ private:
+  int fd = -1;
+  uint8_t* mapping = nullptr;
+  size_t mappedBytes = 0;
+  ColumnHeader* header = nullptr;
+
+  bool resize(uint64_t capacity);
+};
+
+/**
+ * The readings of one station as column files in one directory:
+ * timestamp.col, seq.col, temperature.col, pressure.col, humidity.col.
+ * Rows are published together: the value columns get their counts first and
+ * timestamp.col last, so a reader that takes timestamp's count always sees
+ * complete rows. A count that differs after a crash is cut back to the
+ * shortest column on open().
+ *
+ * The file "boot" holds the station's boot id and the first row stored
+ * under it: seq values only increase from that row on, as the station
+ * numbers its readings from 0 again after every restart.
+ */
+class StationStore {
+ public:
+  enum Column { Timestamp, Sequence, Temperature, Pressure, Humidity, COLUMNS };
+
+  bool open(const std::string& directory);
+  void close();
+
+  uint64_t size() const { return columns[Timestamp].count(); }
+  bool empty() const { return size() == 0; }
+  uint32_t lastSequence() const { return lastSequenceValue; }
+  uint32_t lastTimestamp() const { return lastTimestampValue; }
+  // Published and pending rows
+  uint64_t rows() const { return size() + pending; }
+
+  // false until setBoot() was called on this directory
+  bool hasBoot() const { return bootKnown; }
+  uint32_t boot() const { return bootValue; }
+  uint64_t bootRow() const { return bootRowValue; }
+  bool setBoot(uint32_t boot, uint64_t row);
+
+  // Writes a row after the published ones; commit() publishes them
+  bool append(const StationObject& reading);
+  void commit();
+  void sync(bool wait);
+
+ private:
+  ColumnFile columns[COLUMNS];
+  uint64_t pending = 0;  // rows written but not yet published
+  uint32_t lastSequenceValue = 0;
+  uint32_t lastTimestampValue = 0;
+  std::string bootPath;
+  bool bootKnown = false;
+  uint32_t bootValue = 0;
+  uint64_t bootRowValue = 0;
+};
+
+#endif  // COLLECTOR_COLUMN_STORE_H
@@ -0,0 +1,201 @@
+// dmp_collector: collects the readings of many stations into column files,
+// see Collector and StationStore.
+//
+//   dmp_collector [-d dir] [-i seconds] [-s] [-f file] [name=]host[:port][/sensor]...
+
+#include <errno.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/resource.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <string>
+#include <vector>
+
+#include "collector.h"
+
+static const uint32_t STATS_INTERVAL_MS = 10000;
+
+static volatile sig_atomic_t stopRequested = 0;
+
+static void onSignal(int) { stopRequested = 1; }
+
+static void usage(const char* program) {
+  fprintf(stderr,
+          "Usage: %s [-d dir] [-i seconds] [-s] [-f file] station...\n"
+          "  station     [name=]host[:port][/sensor], name defaults to host\n"
+          "  -d dir      output directory, one subdirectory per station "
+          "(./stations)\n"
+          "  -i seconds  poll interval of /data (5)\n"
+          "  -s          hold a /stream connection instead of polling "
+          "(sensor 0)\n"
+          "  -f file     more stations, one per line, # starts a comment\n",
+          program);
+}
+
+static bool parseStation(const std::string& spec, StationConfig& config) {
+  std::string rest = spec;
+  const size_t equals = rest.find('=');
+  config.name.clear();
+  if (equals != std::string::npos) {
+    config.name = rest.substr(0, equals);
+    rest = rest.substr(equals + 1);
+  }
+  config.sensor = 0;
+  const size_t slash = rest.find('/');
+  if (slash != std::string::npos) {
+    config.sensor = strtoul(rest.c_str() + slash + 1, nullptr, 10);
+    rest = rest.substr(0, slash);
+  }
+  config.port = 80;
+  const size_t colon = rest.find(':');
+  if (colon != std::string::npos) {
+    config.port = (uint16_t)strtoul(rest.c_str() + colon + 1, nullptr, 10);
+    rest = rest.substr(0, colon);
+  }
+  config.host = rest;
+  if (config.name.empty()) {
+    config.name = spec;
+    for (char& c : config.name) {
+      if (c == '/' || c == ':') {
+        c = '_';
+      }
+    }
+  }
+  return !config.host.empty() && config.port != 0 &&
+         config.name.find('/') == std::string::npos;
+}
+
+static bool readStationFile(const char* path, std::vector<std::string>& specs) {
+  FILE* file = fopen(path, "r");
+  if (file == nullptr) {
+    perror(path);
+    return false;
+  }
+  char line[512];
+  while (fgets(line, sizeof(line), file) != nullptr) {
+    char* comment = strchr(line, '#');
+    if (comment != nullptr) {
+      *comment = '\0';
+    }
+    char* token = strtok(line, " \t\r\n");
+    while (token != nullptr) {
+      specs.push_back(token);
+      token = strtok(nullptr, " \t\r\n");
+    }
+  }
+  fclose(file);
+  return true;
+}
+
+// Every station holds five column files and a socket
+static void raiseFileLimit() {
+  rlimit limit;
+  if (getrlimit(RLIMIT_NOFILE, &limit) == 0 && limit.rlim_cur < limit.rlim_max) {
+    limit.rlim_cur = limit.rlim_max;
+    setrlimit(RLIMIT_NOFILE, &limit);
+  }
+}
+
+static uint64_t monotonicMs() {
+  timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return (uint64_t)now.tv_sec * 1000 + now.tv_nsec / 1000000;
+}
+
+int main(int argc, char** argv) {
+  std::string directory = "stations";
+  double interval = 5.0;
+  CollectMode mode = CollectMode::Poll;
+  std::vector<std::string> specs;
+
+  int option;
+  while ((option = getopt(argc, argv, "d:i:sf:h")) != -1) {
+    switch (option) {
+      case 'd':
+        directory = optarg;
+        break;
+      case 'i':
+        interval = atof(optarg);
+        break;
+      case 's':
+        mode = CollectMode::Stream;
+        break;
+      case 'f':
+        if (!readStationFile(optarg, specs)) {
+          return 1;
+        }
+        break;
+      default:
+        usage(argv[0]);
+        return option == 'h' ? 0 : 1;
+    }
+  }
+  for (int i = optind; i < argc; i++) {
+    specs.push_back(argv[i]);
+  }
+  if (specs.empty() || interval <= 0.0) {
+    usage(argv[0]);
+    return 1;
+  }
+
+  raiseFileLimit();
+  if (mkdir(directory.c_str(), 0755) != 0 && errno != EEXIST) {
+    perror(directory.c_str());
+    return 1;
+  }
+
+  Collector collector(directory, mode, (uint32_t)(interval * 1000));
+  for (const std::string& spec : specs) {
+    StationConfig config;
+    if (!parseStation(spec, config)) {
+      fprintf(stderr, "Invalid station: %s\n", spec.c_str());
+      return 1;
+    }
+    if (!collector.addStation(config)) {
+      return 1;
+    }
+  }
+
+  struct sigaction action = {};
+  action.sa_handler = onSignal;
+  sigaction(SIGINT, &action, nullptr);
+  sigaction(SIGTERM, &action, nullptr);
+  signal(SIGPIPE, SIG_IGN);
+
+  fprintf(stderr, "Collecting %zu stations into %s/\n", collector.stationCount(),
+          directory.c_str());
+  Collector::Stats last = collector.stats();
+  uint64_t lastMs = monotonicMs();
+  while (!stopRequested) {
+    collector.runFor(STATS_INTERVAL_MS, stopRequested);
+
+    const Collector::Stats now = collector.stats();
+    const uint64_t nowMs = monotonicMs();
+    const double seconds = (nowMs - lastMs) / 1000.0;
+    fprintf(stderr,
+            "%.0f rows/s, %.0f KB/s, %llu responses, %llu errors, %llu skipped, "
+            "%llu restarts\n",
+            (now.rows - last.rows) / seconds,
+            (now.bytes - last.bytes) / seconds / 1024.0,
+            (unsigned long long)(now.responses - last.responses),
+            (unsigned long long)(now.errors - last.errors),
+            (unsigned long long)(now.skipped - last.skipped),
+            (unsigned long long)(now.restarts - last.restarts));
+    // Pages reach the disk in the background, readers see them right away
+    collector.sync(false);
+    last = now;
+    lastMs = nowMs;
+  }
+
+  collector.sync(true);
+  const Collector::Stats total = collector.stats();
+  fprintf(stderr, "Stopped: %llu rows from %llu responses, %llu errors\n",
+          (unsigned long long)total.rows, (unsigned long long)total.responses,
+          (unsigned long long)total.errors);
+  return 0;
+}
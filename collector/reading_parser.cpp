@@ -0,0 +1,223 @@
+#include "reading_parser.h"
+
+#include <math.h>
+#include <string.h>
+
+static const float POWERS_OF_TEN[] = {1e0f, 1e1f, 1e2f, 1e3f, 1e4f,
+                                      1e5f, 1e6f, 1e7f, 1e8f, 1e9f};
+
+static inline bool isSpace(char c) {
+  return c == ' ' || c == '\n' || c == '\r' || c == '\t';
+}
+
+static inline bool keyIs(const char* key, size_t length, const char* name) {
+  return length == strlen(name) && memcmp(key, name, length) == 0;
+}
+
+static bool parseUnsigned64(const char* begin, const char* end, uint64_t& value) {
+  // Up to 19 digits always fit
+  if (begin == end || end - begin > 19) {
+    return false;
+  }
+  uint64_t result = 0;
+  for (const char* p = begin; p < end; p++) {
+    if (*p < '0' || *p > '9') {
+      return false;
+    }
+    result = result * 10 + (*p - '0');
+  }
+  value = result;
+  return true;
+}
+
+static bool parseUnsigned(const char* begin, const char* end, uint32_t& value) {
+  uint64_t result;
+  if (!parseUnsigned64(begin, end, result) || result > UINT32_MAX) {
+    return false;
+  }
+  value = (uint32_t)result;
+  return true;
+}
+
+bool ReadingParser::parseNumber(const char* begin, const char* end,
+                                float& value) {
+  if (end - begin == 4 && memcmp(begin, "null", 4) == 0) {
+    value = NAN;
+    return true;
+  }
+  const char* p = begin;
+  const bool negative = p < end && *p == '-';
+  if (negative) {
+    p++;
+  }
+  uint64_t mantissa = 0;
+  int decimals = -1;
+  int digits = 0;
+  for (; p < end; p++) {
+    if (*p == '.' && decimals < 0) {
+      decimals = 0;
+    } else if (*p >= '0' && *p <= '9') {
+      if (digits++ < 18) {
+        mantissa = mantissa * 10 + (*p - '0');
+        if (decimals >= 0) {
+          decimals++;
+        }
+      }
+    } else {
+      return false;
+    }
+  }
+  if (digits == 0) {
+    return false;
+  }
+  float result = (float)mantissa;
+  if (decimals > 0) {
+    result = decimals < 10 ? result / POWERS_OF_TEN[decimals]
+                           : (float)(mantissa / pow(10.0, decimals));
+  }
+  value = negative ? -result : result;
+  return true;
+}
+
+// Days since 1970-01-01 of a proleptic Gregorian date
+static int64_t daysFromCivil(int64_t year, unsigned month, unsigned day) {
+  year -= month <= 2;
+  const int64_t era = (year >= 0 ? year : year - 399) / 400;
+  const unsigned yearOfEra = (unsigned)(year - era * 400);
+  const unsigned dayOfYear = (153 * (month + (month > 2 ? -3 : 9)) + 2) / 5 + day - 1;
+  const unsigned dayOfEra = yearOfEra * 365 + yearOfEra / 4 - yearOfEra / 100 + dayOfYear;
+  return era * 146097 + (int64_t)dayOfEra - 719468;
+}
+
+bool ReadingParser::parseTimestamp(const char* begin, const char* end,
+                                   uint32_t& timestamp) {
+  const size_t length = end - begin;
+  if (length > 3 && memcmp(begin, "ms:", 3) == 0) {
+    // Uptime in ms, beyond 32 bits after 49.7 days
+    uint64_t ms;
+    if (!parseUnsigned64(begin + 3, end, ms) || ms / 1000 > UINT32_MAX) {
+      return false;
+    }
+    timestamp = (uint32_t)(ms / 1000);
+    return true;
+  }
+
+  // YYYY-MM-DD HH:MM:SS
+  if (length != 19 || begin[4] != '-' || begin[7] != '-' || begin[10] != ' ' ||
+      begin[13] != ':' || begin[16] != ':') {
+    return false;
+  }
+  uint32_t year, month, day, hour, minute, second;
+  if (!parseUnsigned(begin, begin + 4, year) ||
+      !parseUnsigned(begin + 5, begin + 7, month) ||
+      !parseUnsigned(begin + 8, begin + 10, day) ||
+      !parseUnsigned(begin + 11, begin + 13, hour) ||
+      !parseUnsigned(begin + 14, begin + 16, minute) ||
+      !parseUnsigned(begin + 17, begin + 19, second) || month < 1 ||
+      month > 12 || day < 1 || day > 31) {
+    return false;
+  }
+  const int64_t seconds = daysFromCivil(year, month, day) * 86400 +
+                          hour * 3600 + minute * 60 + second;
+  if (seconds < 0 || seconds > UINT32_MAX) {
+    return false;
+  }
+  timestamp = (uint32_t)seconds;
+  return true;
+}
+
+bool ReadingParser::next(const char*& cursor, const char* end,
+                         StationObject& object) {
+  for (;;) {
+    const char* open = (const char*)memchr(cursor, '{', end - cursor);
+    if (open == nullptr) {
+      cursor = end;
+      return false;
+    }
+
+    object = {};
+    object.temperature = NAN;
+    object.pressure = NAN;
+    object.humidity = NAN;
+    bool malformed = false;
+    const char* p = open + 1;
+    for (;;) {
+      while (p < end && (isSpace(*p) || *p == ',')) {
+        p++;
+      }
+      if (p == end) {
+        cursor = open;
+        return false;
+      }
+      if (*p == '}') {
+        break;
+      }
+      if (*p != '"') {
+        malformed = true;
+        break;
+      }
+
+      const char* key = p + 1;
+      const char* keyEnd = (const char*)memchr(key, '"', end - key);
+      if (keyEnd == nullptr) {
+        cursor = open;
+        return false;
+      }
+      p = keyEnd + 1;
+      while (p < end && (isSpace(*p) || *p == ':')) {
+        p++;
+      }
+      if (p == end) {
+        cursor = open;
+        return false;
+      }
+
+      const char* value;
+      const char* valueEnd;
+      if (*p == '"') {
+        value = p + 1;
+        valueEnd = (const char*)memchr(value, '"', end - value);
+        if (valueEnd == nullptr) {
+          cursor = open;
+          return false;
+        }
+        p = valueEnd + 1;
+      } else {
+        value = p;
+        while (p < end && *p != ',' && *p != '}' && !isSpace(*p)) {
+          p++;
+        }
+        if (p == end) {
+          cursor = open;
+          return false;
+        }
+        valueEnd = p;
+      }
+
+      const size_t keyLength = keyEnd - key;
+      if (keyIs(key, keyLength, "seq")) {
+        object.hasSequence = parseUnsigned(value, valueEnd, object.sequence);
+      } else if (keyIs(key, keyLength, "timestamp")) {
+        object.hasTimestamp = parseTimestamp(value, valueEnd, object.timestamp);
+      } else if (keyIs(key, keyLength, "temperature")) {
+        parseNumber(value, valueEnd, object.temperature);
+      } else if (keyIs(key, keyLength, "pressure")) {
+        parseNumber(value, valueEnd, object.pressure);
+      } else if (keyIs(key, keyLength, "humidity")) {
+        parseNumber(value, valueEnd, object.humidity);
+      } else if (keyIs(key, keyLength, "boot")) {
+        object.isHello = parseUnsigned(value, valueEnd, object.boot);
+      } else if (keyIs(key, keyLength, "boot_seq")) {
+        parseUnsigned(value, valueEnd, object.bootSequence);
+      }
+    }
+
+    if (malformed) {
+      // Not one of ours, look for the next object after the brace
+      cursor = open + 1;
+      continue;
+    }
+    cursor = p + 1;
+    return true;
+  }
+}
@@ -0,0 +1,49 @@
+#ifndef COLLECTOR_READING_PARSER_H
+#define COLLECTOR_READING_PARSER_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Timestamps below this are seconds since power-on, as on the station
+const uint32_t READING_EPOCH_2020 = 1577836800;
+
+// One flat JSON object of a station response: a /data row, a /stream
+// "reading" event or the /stream "hello" event. Fields that were not
+// present keep their defaults (NAN for the channels).
+struct StationObject {
+  bool hasSequence;
+  bool hasTimestamp;
+  bool isHello;
+  uint32_t sequence;
+  uint32_t timestamp;  // epoch seconds, or seconds since power-on
+  float temperature;
+  float pressure;
+  float humidity;
+  uint32_t boot;          // hello only
+  uint32_t bootSequence;  // hello only, first reading recorded in this boot
+};
+
+/**
+ * Finds the flat objects in /data and /stream output and parses them where
+ * they lie in the receive buffer: no DOM, no strings, no allocation.
+ * Anything between objects (array brackets, commas, SSE "id:"/"data:"
+ * lines, keep-alive comments) is skipped. Objects must not nest, which
+ * holds for everything the station sends.
+ */
+class ReadingParser {
+ public:
+  // Parses the next complete object in [cursor, end) and moves cursor past
+  // it. Returns false when none is complete; cursor is then left at the
+  // start of the incomplete object, or at end if there is none, so the
+  // caller keeps that tail for the next receive.
+  static bool next(const char*& cursor, const char* end, StationObject& object);
+
+  // "YYYY-MM-DD HH:MM:SS" (UTC) or "ms:<uptime ms>"
+  static bool parseTimestamp(const char* begin, const char* end,
+                             uint32_t& timestamp);
+
+  // Fixed-point decimal as written by the station, or null
+  static bool parseNumber(const char* begin, const char* end, float& value);
+};
+
+#endif  // COLLECTOR_READING_PARSER_H
@@ -1,20 +1,150 @@
+// Messages above this level are compiled out. LOG_LEVEL_TRACE also dumps
+// every sample as a binary record and switches the UART to binary frames.
+#define LOG_LEVEL LOG_LEVEL_INFO
+
 #include <Wire.h>
 #include <Adafruit_GFX.h>
 #include <Adafruit_SSD1306.h>
 #include "bmx_280.h" 
+#include "mpu_x.h"
+#include "sampler.h"
+#include "sensor_registry.h"
+#include "i2c_scheduler.h"
+#include "oled_view.h"
+#include "metrics.h"
+#include "async_log.h"
+#include "low_power.h"
+#include "chunked_writer.h"
+#include "http_server.h"
+#include "history_store.h"
+#include "history_rollup.h"
 #include <WiFi.h>
+#include <Preferences.h>
 #include <time.h>
 
 const char* ssid = "adelin";      
 const char* password = "password"; 
 
 const int BME_ADDR_ON_BUS = 0x77;
-BMx280 envSensor(BME_ADDR_ON_BUS);
+
+// The OLED refreshes every 2 s, so one x1 forced conversion per read is
+// plenty: ~9 ms per sample and the sensor sleeps in between.
+constexpr BMx280Config envSensorConfig = BMx280Config::weatherMonitoring();
+BMx280 envSensor(BME_ADDR_ON_BUS, envSensorConfig);
+
+// Optional MPU-6500/9250, sampled alongside the BME280 when it answers
+const uint8_t IMU_ADDR_ON_BUS = 0x68;
+const uint8_t IMU_REG_WHO_AM_I = 0x75;
+MPUx imu(IMU_ADDR_ON_BUS);
+bool imuReady = false;
+// Offsets measured in the background on the first boot, then loaded from
+// NVS so warm boots skip the calibration
+const char* imuPrefsNamespace = "mpux";
+const char* imuCalibrationKey = "calib";
+bool imuCalibrationSaved = false;
+
+// The sensors are read by a task pinned to core 0 (WiFi's core; loop() runs
+// on core 1) on a fixed timer period. loop(), the OLED and the HTTP handlers
+// only see what it pushed into the sampler's rings. Every 20 ms tick drains
+// the MPU FIFO (42 frames deep at 1 kHz) into the vibration analyzer; the
+// BME280 is read every 50th tick, once a second.
+const uint32_t samplePeriodMicros = 20000;
+const uint32_t envEveryTicks = 50;
+const int samplerCore = 0;
+const int samplerPriority = 5;
+Sampler sampler(envSensor, samplePeriodMicros, envEveryTicks);
+SensorSample latestSample = {};
+bool haveSample = false;
+
+// 1 kHz accel + gyro through the MPU FIFO, 184 Hz DLPF; 256-sample windows
+// every 128 ms with 3.9 Hz bins up to 500 Hz
+const uint8_t imuSampleRateDivider = 0;
+const uint8_t imuDlpf = 1;
+VibrationAnalyzer vibration;
+bool vibrationEnabled = false;
+// Any axis above this RMS (g, DC removed) flags the window as an alert
+const float vibrationAlertRms = 0.05f;
+bool vibrationAlert = false;
+// Newest windows for /vibration, indexed by window number
+const size_t vibrationHistorySize = 16;
+VibrationAnalyzer::Result vibrationHistory[vibrationHistorySize];
+uint32_t vibrationWindowEnd = 0;
+
+// BME280 trim values persisted in NVS, validated against the chip ID and the
+// first trim words of the part
+Preferences prefs;
+const char* bmePrefsNamespace = "bmx280";
+const char* bmeCompCacheKey = "comp";
+
+// Battery mode: wake on the RTC timer, take one forced BME280 sample, keep it
+// in RTC memory and go straight back to deep sleep. Every
+// lowPowerSamplesPerFlush samples the AP comes up for lowPowerFlushWindow so
+// the batch can be pulled from /data.
+// #define LOW_POWER_MODE
+const uint32_t lowPowerSampleInterval = 60;       // seconds
+const uint16_t lowPowerSamplesPerFlush = 30;
+const unsigned long lowPowerFlushWindow = 30000;  // ms
+// Typical ESP32 figures: 80 MHz active, soft AP, deep sleep incl. regulator
+const LowPowerProfile lowPowerProfile = {40.0f, 120.0f, 12.0f, 3.7f,
+                                         70.0f, 15.0f, (float)lowPowerFlushWindow};
+unsigned long lowPowerFlushStart = 0;
+
+// Pause so a boot message can be read on the OLED. A flush wake runs
+// setup() again with nobody watching, so LOW_POWER_MODE skips the pauses
+// and the AP comes up right away, as lowPowerEstimate() assumes.
+void splashPause(unsigned long ms) {
+#ifndef LOW_POWER_MODE
+  delay(ms);
+#else
+  (void)ms;
+#endif
+}
+bool envSensorReady = false;
 
 #define SCREEN_WIDTH 128
 #define SCREEN_HEIGHT 64
+const uint8_t OLED_ADDR_ON_BUS = 0x3C;
 Adafruit_SSD1306 display(SCREEN_WIDTH, SCREEN_HEIGHT, &Wire, -1);
 
+// Header and value line in size 2 text. Refreshes only redraw the fields
+// whose text changed and send the changed columns, a few dozen bytes
+// instead of the whole 1 KB frame. The first update() after the init
+// screens clears them and sends everything.
+OledView oledView(display, i2cScheduler, OLED_ADDR_ON_BUS);
+int oledHeaderField = -1;
+int oledValueField = -1;
+
+// Every I2C transfer goes through i2cScheduler. Its worker runs on the
+// sampler's core above the sampler's priority: FIFO drains first, then
+// BME280 reads, then OLED frames in 32-byte chunks, so a sensor read waits
+// for at most one chunk (~0.8 ms at 400 kHz) of a running flush. Every
+// device runs at 400 kHz; the MPU-6500 and the SSD1306 are 400 kHz parts.
+const int i2cCore = 0;
+const int i2cPriority = 6;
+// The BME280 is rated for 3.4 MHz, but Fast-mode Plus (1 MHz) on a shared
+// bus also needs every other part on it, the TCA9548A muxes included, to
+// cope with 1 MHz traffic addressed to someone else, and pull-ups strong
+// enough for the bus capacitance: about 1 kOhm, not the 4.7-10 kOhm of
+// breakout boards. Only set this on a board built for it.
+const bool bmeFastModePlus = false;
+const I2cDeviceConfig imuBusConfig = {400000, I2cScheduler::PRIORITY_REALTIME, 2000, 0};
+const I2cDeviceConfig bmeBusConfig = {bmeFastModePlus ? 1000000u : 400000u,
+                                      I2cScheduler::PRIORITY_SENSOR, 5000, 0};
+const I2cDeviceConfig oledBusConfig = {400000, I2cScheduler::PRIORITY_DISPLAY, 0, 32};
+
+// Further BME280s on either bus, directly or behind TCA9548A muxes, are
+// found at boot and read in the sampler's environment ticks, up to four
+// per bus per tick in one batch. Wire1 is the second bus; nothing has to be
+// attached to it. Readings of sensor 0 (envSensor) feed the OLED and the
+// main history, the others a smaller history each for /data?sensor=.
+const int I2C1_SDA = 32;
+const int I2C1_SCL = 33;
+SensorRegistry sensors(envSensorConfig, bmeBusConfig);
+BMx280::BMx280Sample sensorLatest[SensorRegistry::MAX_SENSORS] = {};
+HistoryStore sensorHistory[SensorRegistry::MAX_SENSORS];
+const size_t sensorHistoryHeapBudget = 16 * 1024;
+const size_t sensorHistoryPsramBudget = 128 * 1024;
+
 unsigned long lastOledUpdate = 0;
 const unsigned long oledUpdateInterval = 2000;
 
@@ -22,22 +152,59 @@ float currentTemperature = NAN;
 float currentPressure = NAN;
 float currentHumidity = NAN;
 
+// Log messages are drained to the UART by a low-priority task on core 0;
+// loop() only formats them into the ring
+const int logCore = 0;
+const int logPriority = 1;
+// LOG_RECORD types for the binary sample dump
+const uint8_t LOG_RECORD_SAMPLE = 1;
+const uint8_t LOG_RECORD_VIBRATION = 2;
+
+// Start of the previous loop() in metricsTicks(), for the loop period
+// histogram on /metrics
+uint32_t lastLoopTicks = 0;
+
 unsigned long lastLogTime = 0;             
 const unsigned long logInterval = 5000;      
 
-struct SensorReading {
-  char timestamp[20]; 
-  float temperature;
-  float pressure;
-  float humidity;
-};
+// Recent readings for /data, compressed to a few bytes each. With PSRAM the
+// ring holds years at one reading per minute, otherwise a few months.
+HistoryStore history;
+const size_t historyHeapBudget = 200 * 1024;
+const size_t historyPsramBudget = 2 * 1024 * 1024;
 
-const int bufferSize = 15; 
-SensorReading readingsBuffer[bufferSize];
-int currentReadingIndex = 0;
-int readingsCount = 0;
+// 1 min / 10 min / 1 h min-max-mean buckets for /data?step= queries. The
+// heap budget keeps about 8 days of hourly buckets, PSRAM about a year.
+HistoryRollups rollups;
+const size_t rollupHeapBudget = 32 * 1024;
+const size_t rollupPsramBudget = 512 * 1024;
+
+// Every reading is also appended to the "history" partition (see
+// partitions.csv) so it survives resets and refills the RAM ring on boot
+#ifdef ESP_PLATFORM
+EspPartitionPageStore historyFlash;
+#endif
+FlashHistoryLog historyLog;
+
+unsigned long lastHistoryTime = 0;
+const unsigned long historyInterval = 60000;
+
+// /stream clients hold their connection, so they may take at most half of
+// the server's pool
+const uint8_t maxStreamClients = HttpServer::MAX_CONNECTIONS / 2;
+const unsigned long streamKeepAliveMs = 15000;
+uint8_t streamClients = 0;
+// Sent in the first /stream event and with /data; a new value tells
+// clients that the sequence numbers started over. Readings below
+// bootSequence were replayed from the flash log; a client may have them
+// already, under the numbers of an earlier boot.
+uint32_t bootId = 0;
+uint32_t bootSequence = 0;
 
 WiFiServer server(80);
+bool handleHttpRequest(WiFiClient& client, const HttpRequest& request, HttpResponseState& state);
+void abortHttpRequest(const HttpRequest& request, const HttpResponseState& state);
+HttpServer httpServer(server, handleHttpRequest);
 
 const char* ntpServer = "pool.ntp.org";
 const long  gmtOffset_sec = 0;     
@@ -46,36 +213,70 @@ const int   daylightOffset_sec = 0;
 int currentDisplay = 0; 
 
 bool readSensors();
-void handleClientRequest(WiFiClient client);
+bool streamReadingsJson(WiFiClient& client, const HttpRequest& request, HttpResponseState& state);
+bool streamSensorsJson(WiFiClient& client, const HttpRequest& request, HttpResponseState& state);
+bool streamReadingEvents(WiFiClient& client, const HttpRequest& request, HttpResponseState& state);
+bool streamReadingsBinary(WiFiClient& client, const HttpRequest& request, HttpResponseState& state);
+bool streamVibrationJson(WiFiClient& client, const HttpRequest& request, HttpResponseState& state);
+bool streamMetrics(WiFiClient& client, const HttpRequest& request, HttpResponseState& state);
 void logDataToSerial();
 void addManualReading();
 bool initializeTime();
+bool initEnvSensor();
+bool initHistory(bool coldBoot);
+void initSensors();
+void storeReading(uint32_t timestamp, float temperature, float pressure, float humidity);
+void runLowPowerCycle();
+bool initImu();
+void drainSamples();
+void startImuCalibration();
+void saveImuCalibration();
+void sleepAfterLog(uint32_t seconds);
 
 void setup() {
   Serial.begin(115200);
-  Serial.println("\n--- ESP32 Sensor and OLED Display Initialization ---");
+  logger.setBinaryOutput(LOG_LEVEL >= LOG_LEVEL_TRACE);
+  logger.begin(Serial, logCore, logPriority);
+  LOG_INFO("--- ESP32 Sensor and OLED Display Initialization ---");
+  bootId = esp_random();
 
   Wire.begin(21, 22); 
-  Serial.println("I2C initialized on SDA: GPIO21, SCL: GPIO22");
-  delay(250);
+  LOG_INFO("I2C initialized on SDA: GPIO21, SCL: GPIO22");
+  i2cScheduler.setDevice(IMU_ADDR_ON_BUS, imuBusConfig);
+  i2cScheduler.setDevice(BME_ADDR_ON_BUS, bmeBusConfig);
+  i2cScheduler.setDevice(OLED_ADDR_ON_BUS, oledBusConfig);
+  Wire1.begin(I2C1_SDA, I2C1_SCL);
+  sensors.addEnv(envSensor);
 
-  Serial.println("Initializing OLED display...");
-  if (!display.begin(SSD1306_SWITCHCAPVCC, 0x3C)) { 
-    Serial.println("OLED Initialization Failed!");
+#ifdef LOW_POWER_MODE
+  runLowPowerCycle();  // Returns only when a batch is due
+#else
+  if (!initHistory(true)) {
+    LOG_ERROR("History buffer allocation failed!");
+  }
+#endif
+
+  splashPause(250);
+
+  LOG_INFO("Initializing OLED display...");
+  if (!display.begin(SSD1306_SWITCHCAPVCC, OLED_ADDR_ON_BUS)) { 
+    LOG_ERROR("OLED Initialization Failed!");
     while (1); 
   }
-  Serial.println("OLED Initialized Successfully.");
+  LOG_INFO("OLED Initialized Successfully.");
+  oledHeaderField = oledView.addField(0, 0, 2);
+  oledValueField = oledView.addField(0, 16, 2);
 
   display.clearDisplay();
   display.setTextSize(2);
   display.setTextColor(WHITE);
   display.setCursor(0, 0);
   display.print("Init...");
-  delay(2000);
+  splashPause(2000);
 
-  Serial.println("Initializing BME280 sensor...");
-  if (!envSensor.init()) {
-    Serial.println("BME280 Init Failed!");
+  LOG_INFO("Initializing BME280 sensor...");
+  if (!envSensorReady && !(envSensorReady = initEnvSensor())) {
+    LOG_ERROR("BME280 Init Failed!");
 
     display.clearDisplay();
     display.setTextSize(2);
@@ -85,9 +286,10 @@ void setup() {
     display.setCursor(0, 16);
     display.print("Failed!");
     display.display();
-    Serial.println("Displayed 'Sensor Init Failed!' on OLED.");
+    LOG_DEBUG("Displayed 'Sensor Init Failed!' on OLED.");
     while (1);
-  Serial.println("BME280 Sensor Initialized Successfully.");
+  }
+  LOG_INFO("BME280 Sensor Initialized Successfully.");
 
   display.clearDisplay();
   display.setTextSize(2);
@@ -95,37 +297,61 @@ void setup() {
   display.setCursor(0, 0);
   display.print("Init OK");
   display.display();
-  Serial.println("Displayed 'Init OK' on OLED.");
-  delay(1000);
+  LOG_DEBUG("Displayed 'Init OK' on OLED.");
+  splashPause(1000);
 
-  Serial.println("Setting up Wi-Fi Access Point...");
+  LOG_INFO("Setting up Wi-Fi Access Point...");
   if (WiFi.softAP(ssid, password)) {
-    Serial.println("Wi-Fi Access Point Started Successfully.");
-    Serial.print("AP IP Address: ");
-    Serial.println(WiFi.softAPIP());
+    LOG_INFO("Wi-Fi Access Point Started Successfully.");
+    LOG_INFO("AP IP Address: %s", WiFi.softAPIP().toString().c_str());
   } else {
-    Serial.println("Failed to Start Wi-Fi Access Point!");
+    LOG_ERROR("Failed to Start Wi-Fi Access Point!");
     while (1);
   }
 
   if (!initializeTime()) {
-    Serial.println("Failed to initialize time.");
+    LOG_WARN("Failed to initialize time.");
+  }
+
+#ifndef LOW_POWER_MODE
+  if ((imuReady = initImu())) {
+    sampler.setImu(&imu);
+    vibrationEnabled = imu.beginFifo(imuSampleRateDivider, imuDlpf) &&
+                       vibration.begin(1000.0f / (1 + imuSampleRateDivider));
+    if (vibrationEnabled) {
+      sampler.setVibration(&vibration);
+    } else {
+      LOG_WARN("MPU FIFO setup failed, no vibration analysis.");
+    }
+    startImuCalibration();
+  }
+  initSensors();
+  // From here on the OLED is only drawn through oledView, the schedulers'
+  // workers own the buses
+  if (!i2cScheduler.begin(i2cCore, i2cPriority) ||
+      !i2cScheduler1.begin(i2cCore, i2cPriority)) {
+    LOG_ERROR("Failed to start the I2C scheduler!");
+  }
+  if (!sampler.start(samplerCore, samplerPriority)) {
+    LOG_ERROR("Failed to start the sampling task!");
   }
+#endif
 
-  server.begin();
-  Serial.println("HTTP server started.");
+  httpServer.onAbort(abortHttpRequest);
+  httpServer.begin();
+  LOG_INFO("HTTP server started.");
 }
 
 void loop() {
+  METRICS_MARK(MetricsStage::LoopPeriod, lastLoopTicks);
 
-  WiFiClient client = server.available(); 
+  // Advances every open connection by one step, never blocks on a client
+  httpServer.poll();
 
-  if (client) {
-    Serial.println("New client connected.");
-    handleClientRequest(client);
-    client.stop();
-    Serial.println("Client disconnected.");
-  }
+#ifndef LOW_POWER_MODE
+  drainSamples();
+  saveImuCalibration();
+#endif
 
   unsigned long now = millis();
   if (now - lastOledUpdate >= oledUpdateInterval) {
@@ -134,221 +360,949 @@ void loop() {
       // check if humidity exceeds 70%
       if (!isnan(currentHumidity) && currentHumidity > 70.0) {
 
-        display.clearDisplay();
-        display.setTextSize(2);
-        display.setTextColor(WHITE);
-        display.setCursor(0, 0);
-        display.println("WARNING");
-        display.setCursor(0, 16);
-        display.print("Hum:");
-        display.print(currentHumidity, 1);
-        display.print("%");
-        display.display(); 
-        Serial.println("Displayed WARNING on OLED due to high humidity.");
+        oledView.setText(oledHeaderField, "WARNING");
+        oledView.setTextf(oledValueField, "Hum:%.1f%%", currentHumidity);
+        oledView.update();
+        LOG_DEBUG("Displayed WARNING on OLED due to high humidity.");
       }
       else {
 
-        display.clearDisplay();
-        display.setTextSize(2); 
-        display.setTextColor(WHITE);
+        oledView.setText(oledHeaderField, "");
 
         switch (currentDisplay) {
           case 0: 
-            display.setCursor(0, 16); 
-            display.print("Temp:");
             if (!isnan(currentTemperature)) {
-              display.print(currentTemperature, 1);
-              display.print("C");
+              oledView.setTextf(oledValueField, "Temp:%.1fC", currentTemperature);
             } else {
-              display.print("N/A");
+              oledView.setText(oledValueField, "Temp:N/A");
             }
             break;
           case 1: 
-            display.setCursor(0, 16);
-            display.print("Pres:");
             if (!isnan(currentPressure)) {
-              display.print(currentPressure, 1);
-              display.print("hPa");
+              oledView.setTextf(oledValueField, "Pres:%.1fhPa", currentPressure);
             } else {
-              display.print("N/A");
+              oledView.setText(oledValueField, "Pres:N/A");
             }
             break;
           case 2: 
-            display.setCursor(0, 16);
-            display.print("Hum:");
             if (!isnan(currentHumidity)) {
-              display.print(currentHumidity, 1);
-              display.print("%");
+              oledView.setTextf(oledValueField, "Hum:%.1f%%", currentHumidity);
             } else {
-              display.print("N/A");
+              oledView.setText(oledValueField, "Hum:N/A");
             }
             break;
         }
 
-        display.display(); 
-        Serial.println("OLED updated with " + String(currentDisplay == 0 ? "Temperature" : (currentDisplay == 1 ? "Pressure" : "Humidity")) + " data.");
+        oledView.update(); 
+        LOG_DEBUG("OLED updated with %s data.", currentDisplay == 0 ? "Temperature" : (currentDisplay == 1 ? "Pressure" : "Humidity"));
 
         currentDisplay = (currentDisplay + 1) % 3; 
       }
     } else {
-      Serial.println("Failed to read sensors for OLED display.");
+      LOG_WARN("Failed to read sensors for OLED display.");
+    }
+  }
+
+  if (now - lastHistoryTime >= historyInterval) {
+    lastHistoryTime = now;
+    if (!isnan(currentTemperature)) {
+      storeReading((uint32_t)time(nullptr), currentTemperature, currentPressure, currentHumidity);
+    }
+    for (size_t i = 1; i < sensors.size(); i++) {
+      const BMx280::BMx280Sample& reading = sensorLatest[i];
+      if (sensorHistory[i].capacityBytes() > 0 && !isnan(reading.temperature)) {
+        sensorHistory[i].append(historyEncode({(uint32_t)time(nullptr), reading.temperature,
+                                               reading.pressure, reading.humidity}));
+      }
     }
   }
 
   if (now - lastLogTime >= logInterval) {
     lastLogTime = now;
 
-    if (readingsCount > 0) {
+    if (history.size() > 0) {
       logDataToSerial(); 
     } else {
-      Serial.println("No sensor data available to log.");
+      LOG_INFO("No sensor data available to log.");
     }
   }
 
+#ifdef LOW_POWER_MODE
+  if (now - lowPowerFlushStart >= lowPowerFlushWindow) {
+    LOG_INFO("Flush window over, going to deep sleep.");
+    display.ssd1306_command(SSD1306_DISPLAYOFF);
+    sleepAfterLog(lowPowerSampleInterval);
+  }
+#endif
+}
+
+bool initEnvSensor() {
+  BMx280::BMx280CompCache compCache;
+
+  prefs.begin(bmePrefsNamespace, false);
+  if (prefs.getBytes(bmeCompCacheKey, &compCache, sizeof(compCache)) == sizeof(compCache)) {
+    envSensor.setCompensationCache(compCache);
+  }
+
+  if (!envSensor.init()) {
+    prefs.end();
+    return false;
+  }
+
+  if (!envSensor.isCompensationFromCache()) {
+    compCache = envSensor.getCompensationCache();
+    prefs.putBytes(bmeCompCacheKey, &compCache, sizeof(compCache));
+  }
+  prefs.end();
+
+  LOG_INFO("BME280 init took %lu us (%s calibration)",
+           (unsigned long)envSensor.getInitTimeMicros(),
+           envSensor.isCompensationFromCache() ? "cached" : "fresh");
+  return true;
+}
+
+// Scans both buses and the muxes on them; sensor 0 is envSensor
+void initSensors() {
+  sensors.discover();
+  for (size_t i = 0; i < sensors.size(); i++) {
+    char tag[SensorRegistry::TAG_LENGTH];
+    sensors.formatTag(i, tag, sizeof(tag));
+    const SensorRegistry::SensorInfo& info = sensors.info(i);
+    LOG_INFO("Sensor %u: %s at %s (ID 0x%02X)", (unsigned)i,
+             SensorRegistry::kindName(info.kind), tag, info.chipId);
+    if (i > 0 && sensors.env(i) != nullptr &&
+        !sensorHistory[i].begin(sensorHistoryHeapBudget, sensorHistoryPsramBudget)) {
+      LOG_WARN("No history for sensor %u.", (unsigned)i);
+    }
+  }
+  LOG_INFO("Sensor discovery took %lu us, %u mux(es)",
+           (unsigned long)sensors.stats().discoverMicros, sensors.stats().muxes);
+  sampler.setRegistry(&sensors);
+}
+
+// coldBoot: the clock restarted, so the readings of this boot start a new
+// segment of the history (see HistoryStore); a timer wake from deep sleep
+// continues the previous one
+bool initHistory(bool coldBoot) {
+  if (!history.begin(historyHeapBudget, historyPsramBudget) ||
+      !rollups.begin(rollupHeapBudget, rollupPsramBudget)) {
+    return false;
+  }
+  LOG_INFO("History uses %u KB of %s", (unsigned)(history.capacityBytes() / 1024),
+           history.inPsram() ? "PSRAM" : "internal RAM");
+
+#ifdef ESP_PLATFORM
+  if (!historyFlash.begin("history") || !historyLog.begin(&historyFlash)) {
+    LOG_WARN("No history partition, readings are kept in RAM only.");
+    return true;
+  }
+#endif
+  if (coldBoot) {
+    historyLog.startSegment();
+  }
+
+  // Refill the RAM ring with the newest pages of the flash log. Both use
+  // the same block encoding, so a page holds about as much as 16 RAM blocks.
+  uint8_t* page = (uint8_t*)malloc(FlashHistoryLog::PAGE_DATA_SIZE);
+  const size_t pagesInRam = history.capacityBytes() / FlashPageStore::PAGE_SIZE + 1;
+  const size_t first = historyLog.pageCount() > pagesInRam ? historyLog.pageCount() - pagesInRam : 0;
+  for (size_t i = first; page != nullptr && i < historyLog.pageCount(); i++) {
+    bool segmentStart = false;
+    HistoryDecoder decoder(page, historyLog.readPage(i, page, &segmentStart));
+    if (segmentStart) {
+      history.startSegment();
+      rollups.startSegment();
+    }
+    HistoryRecord record;
+    while (decoder.next(record)) {
+      history.append(record);
+      rollups.add(record);
+    }
+  }
+  free(page);
+  if (coldBoot) {
+    history.startSegment();
+    rollups.startSegment();
+  }
+  bootSequence = history.endSequence();
+  LOG_INFO("Restored %u readings from %u flash pages", (unsigned)history.size(),
+           (unsigned)historyLog.pageCount());
+  return true;
 }
 
 bool initializeTime() {
   configTime(gmtOffset_sec, daylightOffset_sec, ntpServer);
-  Serial.println("Initializing NTP Time...");
+  LOG_INFO("Initializing NTP Time...");
 
   struct tm timeinfo;
   if (!getLocalTime(&timeinfo)) {
-    Serial.println("Failed to obtain time");
+    LOG_WARN("Failed to obtain time");
     return false;
   }
-  Serial.println(&timeinfo, "Current Time: %Y-%m-%d %H:%M:%S");
+  char now[24];
+  strftime(now, sizeof(now), "%Y-%m-%d %H:%M:%S", &timeinfo);
+  LOG_INFO("Current Time: %s", now);
   return true;
 }
 
-void handleClientRequest(WiFiClient client) {
-  String request = client.readStringUntil('\r');
-  client.flush();
-  Serial.println("Received request: " + request);
-
-  if (request.indexOf("GET /data") >= 0) {
-    String json = "[\n";
-    for (int i = 0; i < readingsCount; i++) {
-
-      int index = (currentReadingIndex + bufferSize - readingsCount + i) % bufferSize;
-      json += "  {\n";
-      json += "    \"timestamp\": \"" + String(readingsBuffer[index].timestamp) + "\",\n";
-      json += "    \"temperature\": " + String(readingsBuffer[index].temperature, 2) + ",\n";
-      json += "    \"pressure\": " + String(readingsBuffer[index].pressure, 2) + ",\n";
-      json += "    \"humidity\": " + String(readingsBuffer[index].humidity, 2) + "\n";
-      json += "  }";
-      if (i < readingsCount -1) {
-        json += ",";
-      }
-      json += "\n";
-    }
-    json += "]";
+const char* indexHtml =
+    "<!DOCTYPE html><html><head><title>ESP32 Sensor Data</title></head><body>"
+    "<h1>ESP32 Sensor Data</h1>"
+    "<p>Choose between endpoints:</p>"
+    "<ul>"
+    "<li><a href=\"/data\">/data</a> - Get sensor data in JSON format.</li>"
+    "<li>/data?from=&amp;to=&amp;step= - Readings between two timestamps since the "
+    "last restart of the clock, optionally as min/max/mean per step seconds.</li>"
+    "<li>/data?since=&lt;seq&gt; - Only readings from sequence number seq on.</li>"
+    "<li>/data?sensor=&lt;index&gt; - Readings of another sensor, combines with the above.</li>"
+    "<li><a href=\"/sensors\">/sensors</a> - Sensors found on the I2C buses and muxes.</li>"
+    "<li>/stream - Server-Sent Events, one event per stored reading.</li>"
+    "<li>/data.bin[?from=&amp;to=|since=] - Raw readings as packed binary records.</li>"
+    "<li><a href=\"/vibration\">/vibration</a>[?since=&lt;window&gt;] - Accelerometer RMS, "
+    "peak frequency and band energies per FFT window.</li>"
+    "<li><a href=\"/metrics\">/metrics</a> - Stage latency histograms and counters "
+    "in Prometheus text format.</li>"
+    "<li><a href=\"/add\">/add</a> - Add current sensor readings to data.</li>"
+    "</ul>"
+    "</body></html>";
 
-    client.println("HTTP/1.1 200 OK");
-    client.println("Content-Type: application/json");
-    client.println("Connection: close");
-    client.println();
-    client.print(json);
-    Serial.println("Sent JSON data with " + String(readingsCount) + " readings.");
+// Called by httpServer until it returns true; long bodies go out one chunk per call
+bool handleHttpRequest(WiFiClient& client, const HttpRequest& request, HttpResponseState& state) {
+  METRICS_SCOPE(MetricsStage::HttpHandler);
+  if (state.step == 0) {
+    LOG_DEBUG("Received request: %s %s", request.method, request.path);
+  }
+
+  if (request.isPath("/data.bin")) {
+    return streamReadingsBinary(client, request, state);
+  }
+  else if (request.isPath("/data")) {
+    return streamReadingsJson(client, request, state);
   }
-  else if (request.indexOf("GET /add") >= 0) {
+  else if (request.isPath("/sensors")) {
+    return streamSensorsJson(client, request, state);
+  }
+  else if (request.isPath("/stream")) {
+    return streamReadingEvents(client, request, state);
+  }
+  else if (request.isPath("/vibration")) {
+    return streamVibrationJson(client, request, state);
+  }
+  else if (request.isPath("/metrics")) {
+    return streamMetrics(client, request, state);
+  }
+  else if (request.isPath("/add")) {
     addManualReading();
 
-    String response = "Added Reading: Temp=" + String(currentTemperature, 2) + "C, Pres=" + String(currentPressure, 2) + "hPa, Hum=" + String(currentHumidity, 2) + "%";
-    client.println("HTTP/1.1 200 OK");
-    client.println("Content-Type: text/plain");
-    client.println("Connection: close");
-    client.println();
-    client.print(response);
-    Serial.println("Added manual sensor reading via /add.");
+    client.print("HTTP/1.1 200 OK\r\nContent-Type: text/plain\r\nConnection: close\r\n\r\n");
+    client.printf("Added Reading: Temp=%.2fC, Pres=%.2fhPa, Hum=%.2f%%",
+                  currentTemperature, currentPressure, currentHumidity);
+    LOG_DEBUG("Added manual sensor reading via /add.");
+    return true;
   }
   else {
-    String html = "<!DOCTYPE html><html><head><title>ESP32 Sensor Data</title></head><body>";
-    html += "<h1>ESP32 Sensor Data</h1>";
-    html += "<p>Choose between endpoints:</p>";
-    html += "<ul>";
-    html += "<li><a href=\"/data\">/data</a> - Get sensor data in JSON format.</li>";
-    html += "<li><a href=\"/add\">/add</a> - Add current sensor readings to data.</li>";
-    html += "</ul>";
-    html += "</body></html>";
+    client.print("HTTP/1.1 200 OK\r\nContent-Type: text/html\r\nConnection: close\r\n\r\n");
+    client.print(indexHtml);
+    LOG_DEBUG("Sent HTML page.");
+    return true;
+  }
+}
+
+// Ends a chunked response after a short write: the chunk framing is broken
+// for the client, so the rest cannot be sent
+bool closeChunked(WiFiClient& client, const char* path) {
+  client.stop();
+  LOG_INFO("Client stopped taking %s, closed.", path);
+  return true;
+}
+
+// Called by httpServer for a response whose client went away. A /stream
+// response past its first step holds one of the stream slots.
+void abortHttpRequest(const HttpRequest& request, const HttpResponseState& state) {
+  if (request.isPath("/stream") && state.step > 0) {
+    streamClients--;
+    LOG_INFO("Stream client disconnected.");
+  }
+}
+
+void writeReadingRow(ChunkedWriter& out, uint32_t sequence, const HistorySample& reading,
+                     const char* sensor, bool first) {
+  char timestamp[24];
+  historyFormatTimestamp(timestamp, sizeof(timestamp), reading.timestamp);
+
+  out.write(first ? "  {\n    \"seq\": " : ",\n  {\n    \"seq\": ");
+  out.writeUnsigned(sequence);
+  out.write(",\n    \"sensor\": \"");
+  out.write(sensor);
+  out.write("\",\n    \"timestamp\": \"");
+  out.write(timestamp);
+  out.write("\",\n    \"temperature\": ");
+  out.writeFixed(reading.temperature, 2);
+  out.write(",\n    \"pressure\": ");
+  out.writeFixed(reading.pressure, 2);
+  out.write(",\n    \"humidity\": ");
+  out.writeFixed(reading.humidity, 2);
+  out.write("\n  }");
+}
+
+// Mean under the usual keys, so clients of the raw rows keep working
+void writeAggregateRow(ChunkedWriter& out, const HistoryAggregate& group, const char* sensor,
+                       bool first) {
+  static const char* const names[] = {"temperature", "pressure", "humidity"};
+  char timestamp[24];
+  historyFormatTimestamp(timestamp, sizeof(timestamp), group.start);
+
+  out.write(first ? "  {\n    \"sensor\": \"" : ",\n  {\n    \"sensor\": \"");
+  out.write(sensor);
+  out.write("\",\n    \"timestamp\": \"");
+  out.write(timestamp);
+  out.write("\",\n    \"count\": ");
+  out.writeUnsigned(group.count());
+  for (int i = 0; i < HistoryAggregate::CHANNELS; i++) {
+    const HistoryAggregate::ChannelIndex channel = (HistoryAggregate::ChannelIndex)i;
+    out.write(",\n    \"");
+    out.write(names[i]);
+    out.write("\": ");
+    out.writeFixed(group.mean(channel), 2);
+    out.write(",\n    \"");
+    out.write(names[i]);
+    out.write("_min\": ");
+    out.writeFixed(group.minimum(channel), 2);
+    out.write(",\n    \"");
+    out.write(names[i]);
+    out.write("_max\": ");
+    out.writeFixed(group.maximum(channel), 2);
+  }
+  out.write("\n  }");
+}
+
+// /data[?from=&to=&step=|since=]. from and to are inclusive timestamps in the
+// units of the history (epoch seconds once NTP has set the clock, otherwise
+// seconds since the boot). They select readings of the newest segment of
+// the history only, since the clock of an earlier boot is not comparable;
+// without from, to and step every stored reading is sent, older boots
+// included. Without step every reading in the range is sent; with step,
+// readings are grouped into step-aligned intervals, served from the rollup
+// tiers when step is a multiple of 1 min, 10 min or 1 h. since=<seq> sends
+// the raw readings from sequence number seq on, so a poller only gets what
+// it has not seen; a since beyond the end (the device restarted) sends
+// everything. sensor=<index> selects another sensor of the registry (see
+// /sensors); its history has no rollups, so step= groups its raw readings.
+// Every row names its sensor.
+//
+// Rows are decoded straight into chunks on the socket, no String
+// temporaries. state.position is the sequence number of the next raw row,
+// or the start of the next interval; state.end is the end of the history
+// when the request arrived. The first call always writes a row or ends the
+// array, so later calls always need a separator.
+bool streamReadingsJson(WiFiClient& client, const HttpRequest& request, HttpResponseState& state) {
+  uint32_t from = 0;
+  uint32_t to = UINT32_MAX;
+  uint32_t step = 0;
+  uint32_t since = 0;
+  const bool hasFrom = request.queryUnsigned("from", from);
+  const bool hasTo = request.queryUnsigned("to", to);
+  request.queryUnsigned("step", step);
+  const bool timeRange = hasFrom || hasTo || step != 0;
+  const bool incremental = request.queryUnsigned("since", since);
+
+  uint32_t sensor = 0;
+  request.queryUnsigned("sensor", sensor);
+  if (sensor >= sensors.size() || sensors.env(sensor) == nullptr) {
+    client.print("HTTP/1.1 404 Not Found\r\nContent-Length: 0\r\nConnection: close\r\n\r\n");
+    return true;
+  }
+  // Sensors found at boot keep their raw readings only
+  static HistoryRollups noRollups;
+  const HistoryStore& history = sensor == 0 ? ::history : sensorHistory[sensor];
+  const HistoryRollups& rollups = sensor == 0 ? ::rollups : noRollups;
+  char tag[SensorRegistry::TAG_LENGTH];
+  sensors.formatTag(sensor, tag, sizeof(tag));
+
+  ChunkedWriter out(client);
+  HistoryStore::Reader reader(history);
+
+  if (state.step == 0) {
+    // Other sensors' histories are not replayed from flash
+    char bootHeaders[64];
+    snprintf(bootHeaders, sizeof(bootHeaders), "X-Boot-Id: %lu\r\nX-Boot-Sequence: %lu\r\n",
+             (unsigned long)bootId, (unsigned long)(sensor == 0 ? bootSequence : 0));
+    ChunkedWriter::writeHeaders(client, "application/json", bootHeaders);
+    if (incremental) {
+      state.position = since <= history.endSequence() ? since : 0;
+      step = 0;
+    } else if (!timeRange) {
+      state.position = history.firstSequence();
+    } else if (step == 0) {
+      reader.seekTime(from);
+      state.position = reader.sequence();
+    } else {
+      state.position = from - from % step;
+    }
+    state.end = history.endSequence();
+    out.write("[\n");
+  }
+
+  bool first = state.step == 0;
+  bool done = false;
+  if (step == 0 || incremental) {
+    // Rows dropped from the ring during the response are skipped
+    reader.seek(state.position);
+    HistoryRecord record;
+    while (!done && out.buffered() < ChunkedWriter::CHUNK_SIZE - 160) {
+      done = reader.sequence() >= state.end || !reader.next(record) || record.timestamp > to;
+      if (!done) {
+        writeReadingRow(out, reader.sequence() - 1, historyDecode(record), tag, first);
+        first = false;
+      }
+    }
+    state.position = reader.sequence();
+  } else {
+    HistoryAggregate group;
+    while (!done && out.buffered() < ChunkedWriter::CHUNK_SIZE - 160) {
+      done = !historyNextGroup(history, rollups, from, to, step, state.position, group);
+      if (!done) {
+        writeAggregateRow(out, group, tag, first);
+        first = false;
+        // The last interval before the clock wraps ends the query
+        done = group.start + step < group.start;
+        state.position = group.start + step;
+      }
+    }
+  }
+
+  if (!done) {
+    out.flush();
+    return out.ok() ? false : closeChunked(client, "/data");
+  }
+
+  out.write("\n]");
+  out.finish();
+  if (!out.ok()) {
+    return closeChunked(client, "/data");
+  }
+  LOG_DEBUG("Sent JSON data.");
+  return true;
+}
 
-    client.println("HTTP/1.1 200 OK");
-    client.println("Content-Type: text/html");
-    client.println("Connection: close");
-    client.println();
-    client.print(html);
-    Serial.println("Sent HTML page.");
+// /sensors: what discover() found, in registry order. index is the
+// sensor= of /data; sampled tells the environment sensors that are read.
+bool streamSensorsJson(WiFiClient& client, const HttpRequest& request, HttpResponseState& state) {
+  (void)request;
+  (void)state;
+  ChunkedWriter::writeHeaders(client, "application/json");
+  ChunkedWriter out(client);
+  out.write("[");
+  for (size_t i = 0; i < sensors.size(); i++) {
+    const SensorRegistry::SensorInfo& info = sensors.info(i);
+    char tag[SensorRegistry::TAG_LENGTH];
+    sensors.formatTag(i, tag, sizeof(tag));
+    char row[128];
+    const int len = snprintf(row, sizeof(row),
+                             "%s\n  {\"index\": %u, \"sensor\": \"%s\", \"kind\": \"%s\", "
+                             "\"chip_id\": %u, \"sampled\": %s}",
+                             i == 0 ? "" : ",", (unsigned)i, tag,
+                             SensorRegistry::kindName(info.kind), info.chipId,
+                             sensors.env(i) != nullptr ? "true" : "false");
+    out.write(row, len < (int)sizeof(row) ? len : sizeof(row) - 1);
   }
+  out.write("\n]");
+  out.finish();
+  return out.ok() ? true : closeChunked(client, "/sensors");
+}
+
+// /data.bin[?from=&to=|since=]: the raw readings of /data, with the same
+// from/to segment rule, as a HistoryExportHeader followed by the stored
+// 10-byte records, with no per-row formatting on the device. The ESP32 is
+// little-endian, so the records go out as they are. state.position is the
+// next sequence number, state.end the end of the history when the request
+// arrived.
+bool streamReadingsBinary(WiFiClient& client, const HttpRequest& request, HttpResponseState& state) {
+  uint32_t from = 0;
+  uint32_t to = UINT32_MAX;
+  uint32_t since = 0;
+  const bool hasFrom = request.queryUnsigned("from", from);
+  const bool hasTo = request.queryUnsigned("to", to);
+
+  ChunkedWriter out(client);
+  HistoryStore::Reader reader(history);
+
+  if (state.step == 0) {
+    ChunkedWriter::writeHeaders(client, "application/octet-stream");
+    if (request.queryUnsigned("since", since)) {
+      reader.seek(since <= history.endSequence() ? since : 0);
+    } else if (hasFrom || hasTo) {
+      reader.seekTime(from);
+    } else {
+      reader.seek(history.firstSequence());
+    }
+    state.position = reader.sequence();
+    state.end = history.endSequence();
+
+    const HistoryExportHeader header = historyExportHeader(state.position);
+    out.write((const char*)&header, sizeof(header));
+  }
+
+  reader.seek(state.position);
+  HistoryRecord record;
+  bool done = false;
+  while (!done && out.buffered() + sizeof(record) <= ChunkedWriter::CHUNK_SIZE) {
+    done = reader.sequence() >= state.end || !reader.next(record) || record.timestamp > to;
+    if (!done) {
+      out.write((const char*)&record, sizeof(record));
+    }
+  }
+  state.position = reader.sequence();
+
+  if (!done) {
+    out.flush();
+    return out.ok() ? false : closeChunked(client, "/data.bin");
+  }
+  out.finish();
+  if (!out.ok()) {
+    return closeChunked(client, "/data.bin");
+  }
+  return true;
+}
+
+// One reading as compact JSON for /stream, returns the length
+size_t formatReadingJson(char* out, size_t size, uint32_t sequence, const HistorySample& reading) {
+  char timestamp[24];
+  char values[3][16];
+  const float channels[3] = {reading.temperature, reading.pressure, reading.humidity};
+  historyFormatTimestamp(timestamp, sizeof(timestamp), reading.timestamp);
+  for (int i = 0; i < 3; i++) {
+    if (formatFixed(values[i], channels[i], 2) == 0) {
+      strcpy(values[i], "null");
+    }
+  }
+  const int len = snprintf(out, size,
+                           "{\"seq\":%lu,\"timestamp\":\"%s\",\"temperature\":%s,"
+                           "\"pressure\":%s,\"humidity\":%s}",
+                           (unsigned long)sequence, timestamp, values[0], values[1], values[2]);
+  return len < 0 ? 0 : ((size_t)len < size ? (size_t)len : size - 1);
+}
+
+// Writes one whole SSE event or comment. WiFiClient::write() gives up on a
+// congested socket and returns a short count; the rest of the event is
+// not kept, so the caller closes the stream and the client resumes with
+// since= from the last complete event (a torn event is never dispatched).
+bool writeEvent(WiFiClient& client, const char* event, size_t len) {
+  return client.write((const uint8_t*)event, len) == len;
+}
+
+// Ends a /stream response after a short write
+bool closeStream(WiFiClient& client) {
+  streamClients--;
+  client.stop();
+  LOG_INFO("Stream client dropped on a short write.");
+  return true;
+}
+
+// /stream[?since=]: Server-Sent Events over one long-lived connection. A
+// "hello" event carries the boot id, bootSequence ("boot_seq") and the
+// sequence range, then every stored reading is pushed as a "reading" event
+// whose id is its sequence number; reconnect with since=<last id + 1>, or
+// with since=0 after a restart (a new boot id). Without since only new
+// readings are sent. state.position is the next sequence number, state.end
+// the millis() of the last write, for the keep-alive comment that also
+// detects clients that went away; httpServer then calls abortHttpRequest().
+// A write that does not take a whole event closes the connection, see
+// writeEvent().
+bool streamReadingEvents(WiFiClient& client, const HttpRequest& request, HttpResponseState& state) {
+  char event[224];
+
+  if (state.step == 0) {
+    if (streamClients >= maxStreamClients) {
+      client.print("HTTP/1.1 503 Service Unavailable\r\nContent-Length: 0\r\nConnection: close\r\n\r\n");
+      return true;
+    }
+    streamClients++;
+
+    uint32_t since = history.endSequence();
+    request.queryUnsigned("since", since);
+    state.position = since <= history.endSequence() ? since : 0;
+    state.end = millis();
+
+    static const char headers[] =
+        "HTTP/1.1 200 OK\r\nContent-Type: text/event-stream\r\n"
+        "Cache-Control: no-cache\r\nConnection: close\r\n\r\n";
+    const int len = snprintf(event, sizeof(event),
+                             "event: hello\ndata: {\"boot\":%lu,\"boot_seq\":%lu,\"first\":%lu,\"end\":%lu}\n\n",
+                             (unsigned long)bootId, (unsigned long)bootSequence,
+                             (unsigned long)history.firstSequence(),
+                             (unsigned long)history.endSequence());
+    if (!writeEvent(client, headers, sizeof(headers) - 1) || !writeEvent(client, event, len)) {
+      return closeStream(client);
+    }
+    LOG_INFO("Stream client connected.");
+  }
+
+  // A few events per pass, so a long backlog does not stall the loop
+  HistoryStore::Reader reader(history);
+  reader.seek(state.position);
+  HistoryRecord record;
+  for (int i = 0; i < 4 && reader.next(record); i++) {
+    const uint32_t sequence = reader.sequence() - 1;
+    int len = snprintf(event, sizeof(event), "id: %lu\nevent: reading\ndata: ", (unsigned long)sequence);
+    len += formatReadingJson(event + len, sizeof(event) - len - 2, sequence, historyDecode(record));
+    event[len++] = '\n';
+    event[len++] = '\n';
+    if (!writeEvent(client, event, len)) {
+      return closeStream(client);
+    }
+    state.position = sequence + 1;
+    state.end = millis();
+  }
+
+  if (millis() - state.end >= streamKeepAliveMs) {
+    static const char keepAlive[] = ": keep-alive\n\n";
+    if (!writeEvent(client, keepAlive, sizeof(keepAlive) - 1)) {
+      return closeStream(client);
+    }
+    state.end = millis();
+  }
+  return false;
+}
+
+void writeVibrationWindow(ChunkedWriter& out, const VibrationAnalyzer::Result& result, bool first) {
+  static const char* const axisNames[] = {"x", "y", "z"};
+
+  out.write(first ? "  {\n    \"window\": " : ",\n  {\n    \"window\": ");
+  out.writeUnsigned(result.window);
+  bool alert = false;
+  for (size_t axis = 0; axis < VibrationAnalyzer::AXES; axis++) {
+    alert = alert || result.rms[axis] > vibrationAlertRms;
+  }
+  out.write(alert ? ",\n    \"alert\": true" : ",\n    \"alert\": false");
+  for (size_t axis = 0; axis < VibrationAnalyzer::AXES; axis++) {
+    out.write(",\n    \"");
+    out.write(axisNames[axis]);
+    out.write("\": {\"rms\": ");
+    out.writeFixed(result.rms[axis], 5);
+    out.write(", \"peak_hz\": ");
+    out.writeFixed(result.peakHz[axis], 1);
+    out.write(", \"peak_amplitude\": ");
+    out.writeFixed(result.peakAmplitude[axis], 5);
+    out.write(", \"bands\": [");
+    for (size_t band = 0; band < VibrationAnalyzer::BANDS; band++) {
+      if (band > 0) {
+        out.write(", ");
+      }
+      // g^2, scaled to keep the small values visible with fixed decimals
+      out.writeFixed(result.bandEnergy[axis][band] * 1e6f, 2);
+    }
+    out.write("]}");
+  }
+  out.write("\n  }");
+}
+
+// /vibration[?since=<window>]: the analyzer settings and the newest
+// vibrationHistorySize windows, oldest first. Band energies are in
+// micro-g^2 (mean square per band, their sum is rms^2). state.position is
+// the next window number, state.end the end when the request arrived.
+bool streamVibrationJson(WiFiClient& client, const HttpRequest& request, HttpResponseState& state) {
+  ChunkedWriter out(client);
+
+  if (state.step == 0) {
+    ChunkedWriter::writeHeaders(client, "application/json");
+    uint32_t since = 0;
+    request.queryUnsigned("since", since);
+    state.end = vibrationWindowEnd;
+    const uint32_t oldest = state.end > vibrationHistorySize ? state.end - vibrationHistorySize : 0;
+    state.position = since > oldest && since <= state.end ? since : oldest;
+
+    out.write("{\n\"enabled\": ");
+    out.write(vibrationEnabled ? "true" : "false");
+    out.write(",\n\"sample_rate\": ");
+    out.writeFixed(vibration.getSampleRate(), 1);
+    out.write(",\n\"window_size\": ");
+    out.writeUnsigned(VibrationAnalyzer::WINDOW);
+    out.write(",\n\"hop\": ");
+    out.writeUnsigned(VibrationAnalyzer::HOP);
+    out.write(",\n\"alert_rms\": ");
+    out.writeFixed(vibrationAlertRms, 3);
+    out.write(",\n\"band_edges_hz\": [");
+    for (size_t i = 0; i <= VibrationAnalyzer::BANDS; i++) {
+      if (i > 0) {
+        out.write(", ");
+      }
+      out.writeFixed(vibration.getBandEdge(i), 1);
+    }
+    out.write("],\n\"windows\": [\n");
+  }
+
+  // One window per call; windows overwritten in the meantime are skipped
+  const uint32_t oldest = vibrationWindowEnd > vibrationHistorySize ? vibrationWindowEnd - vibrationHistorySize : 0;
+  if (state.position < oldest) {
+    state.position = oldest;
+  }
+  if (state.position < state.end) {
+    writeVibrationWindow(out, vibrationHistory[state.position % vibrationHistorySize], state.step == 0);
+    state.position++;
+    out.flush();
+    return out.ok() ? false : closeChunked(client, "/vibration");
+  }
+
+  out.write("\n]\n}");
+  out.finish();
+  if (!out.ok()) {
+    return closeChunked(client, "/vibration");
+  }
+  LOG_DEBUG("Sent vibration data.");
+  return true;
+}
+
+// /metrics: the stage histograms from metrics.h, one stage per call, then
+// the counters and the sampler and OLED figures, in Prometheus text format
+bool streamMetrics(WiFiClient& client, const HttpRequest& request, HttpResponseState& state) {
+  ChunkedWriter out(client);
+
+  if (state.step == 0) {
+    ChunkedWriter::writeHeaders(client, "text/plain; version=0.0.4");
+    state.position = 0;
+  }
+
+  if (state.position < (uint32_t)MetricsStage::COUNT) {
+    metricsWriteStage(out, (MetricsStage)state.position);
+    state.position++;
+    out.flush();
+    return out.ok() ? false : closeChunked(client, "/metrics");
+  }
+
+  metricsWriteCounters(out);
+#ifndef LOW_POWER_MODE
+  const Sampler::Stats samplerStats = sampler.stats();
+  metricsWriteCounter(out, "dmp_sampler_ticks_total", "Sampling timer ticks.", samplerStats.ticks);
+  metricsWriteCounter(out, "dmp_sampler_dropped_total", "Samples dropped because the ring was full.", samplerStats.dropped);
+  metricsWriteCounter(out, "dmp_sampler_missed_ticks_total", "Ticks skipped while a read was still running.", samplerStats.missedTicks);
+  metricsWriteGauge(out, "dmp_sampler_max_late_microseconds", "Worst tick start delay.", samplerStats.maxLateMicros);
+  const SensorRegistry::Stats sensorStats = sensors.stats();
+  metricsWriteGauge(out, "dmp_sensors", "Environment sensors sampled.", sensors.envCount());
+  metricsWriteCounter(out, "dmp_sensor_batches_total", "Batched reads of the sensor registry.", sensorStats.batches);
+  metricsWriteCounter(out, "dmp_sensor_readings_total", "Sensor readings taken in batches.", sensorStats.readings);
+  metricsWriteCounter(out, "dmp_sensor_errors_total", "Batched readings that failed.", sensorStats.errors);
+#endif
+  metricsWriteCounter(out, "dmp_oled_bytes_total", "I2C bytes sent to the OLED.", oledView.stats().bytes);
+  const I2cScheduler::Stats i2cStats = i2cScheduler.stats();
+  metricsWriteCounter(out, "dmp_i2c_preemptions_total", "Transfers run between two chunks of another.", i2cStats.preemptions);
+  metricsWriteCounter(out, "dmp_i2c_missed_deadlines_total", "I2C transfers finished after their deadline.", i2cStats.missedDeadlines);
+  metricsWriteGauge(out, "dmp_i2c_imu_max_latency_microseconds", "Worst queue-to-done time of an MPU transfer.", i2cStats.maxLatencyMicros[I2cScheduler::PRIORITY_REALTIME]);
+  metricsWriteGauge(out, "dmp_i2c_sensor_max_latency_microseconds", "Worst queue-to-done time of a BME280 transfer.", i2cStats.maxLatencyMicros[I2cScheduler::PRIORITY_SENSOR]);
+  metricsWriteGauge(out, "dmp_free_heap_bytes", "Free heap.", ESP.getFreeHeap());
+  metricsWriteGauge(out, "dmp_history_readings", "Readings in the RAM history.", history.size());
+  out.finish();
+  return out.ok() ? true : closeChunked(client, "/metrics");
 }
 
 bool readSensors() {
-  float temp = envSensor.readTemperature();
-  float pres = envSensor.readPressure();
-  float hum = envSensor.readHumidity();
+  METRICS_SCOPE(MetricsStage::ReadSensors);
+#ifdef LOW_POWER_MODE
+  // One burst read, so all three values come from the same conversion
+  BMx280::BMx280Sample sample = envSensor.readAll();
+#else
+  // The sampling task owns the bus, use the newest sample it delivered
+  if (!haveSample) {
+    return false;
+  }
+  BMx280::BMx280Sample sample = latestSample.env;
+#endif
+  float temp = sample.temperature;
+  float pres = sample.pressure;
+  float hum = sample.humidity;
 
   bool success = false;
 
   if (!isnan(temp)) {
     currentTemperature = temp;
     success = true;
-    Serial.printf("Temp: %.1f°C ", currentTemperature);
-  } else {
-    Serial.print("Temp: N/A ");
   }
 
   if (!isnan(pres)) {
     currentPressure = pres;
     success = true;
-    Serial.printf("Pres: %.1f hPa ", currentPressure);
-  } else {
-    Serial.print("Pres: N/A ");
   }
 
   if (!isnan(hum)) {
     currentHumidity = hum;
     success = true;
-    Serial.printf("Hum: %.1f%%\n", currentHumidity);
-  } else {
-    Serial.println("Hum: N/A");
   }
 
+  // printf shows missing values as "nan"
+  LOG_DEBUG("Temp: %.1f°C Pres: %.1f hPa Hum: %.1f%%", temp, pres, hum);
   return success;
 }
 
 void logDataToSerial() {
-  Serial.println("--- Logging Sensor Readings ---");
-  for (int i = 0; i < readingsCount; i++) {
-    int index = (currentReadingIndex + bufferSize - readingsCount + i) % bufferSize;
-    Serial.printf("Time: %s, Temp: %.2f°C, Press: %.2fhPa, Hum: %.2f%%\n", 
-                  readingsBuffer[index].timestamp,
-                  readingsBuffer[index].temperature, 
-                  readingsBuffer[index].pressure, 
-                  readingsBuffer[index].humidity);
+  LOG_INFO("--- Logging Sensor Readings ---");
+  // Only the newest few, the history can hold hundreds of thousands
+  HistoryStore::Reader reader(history);
+  reader.seek(history.endSequence() - (history.size() < 15 ? history.size() : 15));
+  HistoryRecord record;
+  while (reader.next(record)) {
+    const HistorySample reading = historyDecode(record);
+    char timestamp[24];
+    historyFormatTimestamp(timestamp, sizeof(timestamp), reading.timestamp);
+    LOG_INFO("Time: %s, Temp: %.2f°C, Press: %.2fhPa, Hum: %.2f%%",
+             timestamp, reading.temperature, reading.pressure, reading.humidity);
   }
-  Serial.println("--- End of Log ---");
+#ifndef LOW_POWER_MODE
+  const Sampler::Stats stats = sampler.stats();
+  LOG_INFO("Sampler: %lu samples, %lu dropped, %lu missed ticks, late %lu us mean / %lu us max, read %lu us max",
+           (unsigned long)stats.samples, (unsigned long)stats.dropped,
+           (unsigned long)stats.missedTicks, (unsigned long)stats.meanLateMicros,
+           (unsigned long)stats.maxLateMicros, (unsigned long)stats.maxReadMicros);
+#endif
+  const AsyncLog::Stats logStats = logger.stats();
+  LOG_INFO("Log: %lu messages, %lu dropped, %lu truncated", (unsigned long)logStats.written,
+           (unsigned long)logStats.dropped, (unsigned long)logStats.truncated);
+  LOG_INFO("--- End of Log ---");
 }
 
-void addManualReading() {
-  if (readSensors()) {
-    struct tm timeinfo;
-    if (getLocalTime(&timeinfo)) {
-      char timeString[20];
-      strftime(timeString, sizeof(timeString), "%Y-%m-%d %H:%M:%S", &timeinfo);
-      strncpy(readingsBuffer[currentReadingIndex].timestamp, timeString, sizeof(readingsBuffer[currentReadingIndex].timestamp));
+bool initImu() {
+  uint8_t whoAmI = 0;
+  if (i2cReadRegister(IMU_ADDR_ON_BUS, IMU_REG_WHO_AM_I, whoAmI) != I2cStatus::Ok) {
+    LOG_INFO("No MPU found, sampling the BME280 only.");
+    return false;
+  }
+  MPUx::Calibration calibration;
+  prefs.begin(imuPrefsNamespace, true);
+  if (prefs.getBytes(imuCalibrationKey, &calibration, sizeof(calibration)) == sizeof(calibration)) {
+    imu.setCalibration(calibration);
+  }
+  prefs.end();
+
+  imu.init();
+  imuCalibrationSaved = imu.isCalibrationFromCache();
+  LOG_INFO("MPU init took %lu us (WHO_AM_I 0x%02X, %s calibration)",
+           (unsigned long)imu.getInitTimeMicros(), whoAmI,
+           imuCalibrationSaved ? "cached" : "measuring");
+  return true;
+}
+
+// Offsets for an MPU without cached ones. The background measurement needs
+// the sampler to consume the FIFO, which only happens with vibration
+// analysis on; otherwise they are measured here from register reads.
+void startImuCalibration() {
+  if (imuCalibrationSaved) {
+    return;
+  }
+  if (vibrationEnabled) {
+    // Runs on the FIFO data once the sampler is going, keep the device still
+    imu.startCalibration();
+    return;
+  }
+  LOG_INFO("No MPU FIFO consumer, calibrating from register reads.");
+  if (!imu.calibratePolled(3)) {
+    LOG_WARN("MPU kept moving, running without offsets.");
+  }
+}
+
+void saveImuCalibration() {
+  if (!imuReady || imuCalibrationSaved ||
+      imu.getCalibrationState() != MPUx::CalibrationState::Done) {
+    return;
+  }
+  const MPUx::Calibration calibration = imu.getCalibration();
+  prefs.begin(imuPrefsNamespace, false);
+  prefs.putBytes(imuCalibrationKey, &calibration, sizeof(calibration));
+  prefs.end();
+  imuCalibrationSaved = true;
+  LOG_INFO("MPU calibrated after %lu rejected attempts, offsets saved.",
+           (unsigned long)imu.getCalibrationRejects());
+}
+
+void drainSamples() {
+  // Single consumer: only loop() pops from the rings
+  SensorSample sample;
+  while (sampler.pop(sample)) {
+    LOG_RECORD(LOG_RECORD_SAMPLE, &sample, sizeof(sample));
+    if (sample.sensor == 0) {
+      latestSample = sample;
+      haveSample = true;
+    } else if (sample.sensor < SensorRegistry::MAX_SENSORS) {
+      sensorLatest[sample.sensor] = sample.env;
+    }
+  }
+
+  VibrationAnalyzer::Result result;
+  while (sampler.popVibration(result)) {
+    vibrationHistory[result.window % vibrationHistorySize] = result;
+    vibrationWindowEnd = result.window + 1;
+    LOG_RECORD(LOG_RECORD_VIBRATION, &result, sizeof(result));
+
+    bool alert = false;
+    for (size_t axis = 0; axis < VibrationAnalyzer::AXES; axis++) {
+      alert = alert || result.rms[axis] > vibrationAlertRms;
     }
-    else {
-      snprintf(readingsBuffer[currentReadingIndex].timestamp, sizeof(readingsBuffer[currentReadingIndex].timestamp), "ms:%lu", millis());
+    if (alert != vibrationAlert) {
+      vibrationAlert = alert;
+      LOG_WARN("Vibration %s: RMS x %.3f y %.3f z %.3f g, peak %.1f Hz",
+               alert ? "alert" : "back to normal", result.rms[0], result.rms[1],
+               result.rms[2], result.peakHz[2]);
     }
+  }
+}
 
-    readingsBuffer[currentReadingIndex].temperature = currentTemperature;
-    readingsBuffer[currentReadingIndex].pressure = currentPressure;
-    readingsBuffer[currentReadingIndex].humidity = currentHumidity;
+void storeReading(uint32_t timestamp, float temperature, float pressure, float humidity) {
+  const HistoryRecord record = historyEncode({timestamp, temperature, pressure, humidity});
+  history.append(record);
+  rollups.add(record);
+  historyLog.append(record);
+}
 
-    currentReadingIndex = (currentReadingIndex + 1) % bufferSize;
-    if (readingsCount < bufferSize) readingsCount++;
+void addManualReading() {
+  if (readSensors()) {
+    // Seconds since power-on until NTP has set the clock
+    storeReading((uint32_t)time(nullptr), currentTemperature, currentPressure, currentHumidity);
 
-    Serial.println("Added a new sensor reading via /add.");
+    LOG_INFO("Added a new sensor reading via /add.");
   }
   else {
-    Serial.println("Failed to read sensors. Manual reading not added.");
+    LOG_WARN("Failed to read sensors. Manual reading not added.");
   }
 }
+
+void runLowPowerCycle() {
+  const bool timerWake = lowPowerWokeFromTimer();
+  if (!timerWake) {
+    LowPowerEstimate estimate = lowPowerEstimate(lowPowerProfile, lowPowerSampleInterval,
+                                                 lowPowerSamplesPerFlush);
+    LOG_INFO("Low-power schedule: awake %.3f%%, %.1f uA average, %.2f mJ per sample",
+             estimate.dutyCycle * 100.0f, estimate.averageMicroamps,
+             estimate.energyPerSampleMj);
+  }
+
+  envSensorReady = initEnvSensor();
+  if (envSensorReady) {
+    BMx280::BMx280Sample sample = envSensor.readAll();
+    lowPowerAppend({(uint32_t)time(nullptr), sample.temperature, sample.pressure, sample.humidity});
+  }
+
+  // Back to sleep until a full batch is collected; a cold boot always
+  // comes up so the station can be checked after power-on
+  if (timerWake && lowPowerPending() < lowPowerSamplesPerFlush) {
+    sleepAfterLog(lowPowerSampleInterval);
+  }
+
+  // Move the batch into the history served by /data. The RTC keeps
+  // time(nullptr) running in deep sleep; without NTP it counts from power-on.
+  if (!initHistory(!timerWake)) {
+    LOG_ERROR("History buffer allocation failed!");
+  }
+  LowPowerSample sample;
+  while (lowPowerPop(sample)) {
+    storeReading(sample.timestamp, sample.temperature, sample.pressure, sample.humidity);
+  }
+
+  lowPowerFlushStart = millis();
+  LOG_INFO("Low-power flush after %lu wake-ups, %d readings",
+           (unsigned long)lowPowerWakeCount(), (int)history.size());
+}
+
+// Deep sleep restarts the CPU, so whatever is still queued goes out first
+void sleepAfterLog(uint32_t seconds) {
+  logger.end();
+  logger.flush(Serial);
+  lowPowerSleep(seconds);
+}
@@ -1,5 +1,9 @@
 # fetch_and_plot.py
 
+import calendar
+import json
+import threading
+import numpy as np
 import requests
 import time
 import matplotlib.pyplot as plt
@@ -9,109 +13,247 @@ from datetime import datetime
 # ESP32 web server URL
 esp32_ip = "192.168.4.1"
 esp32_url = f"http://{esp32_ip}/data"
+stream_url = f"http://{esp32_ip}/stream"
+binary_url = f"http://{esp32_ip}/data.bin"
+
+# True: one long-lived /stream connection pushes each new reading.
+# False: poll /data.bin?since= every 5 s and only receive the new rows.
+# Either way the backlog is loaded once from /data.bin.
+use_stream = True
+
+# Seconds of history shown on the x axis
+plot_window = 3600
 
 timestamps = []
 temperatures = []
 pressures = []
 humidities = []
 
+# Sequence number of the next reading we expect, and the device boot id
+next_seq = 0
+boot_id = None
+data_lock = threading.Lock()
 
 start_time = None
 
+# /data.bin layout, see HistoryExportHeader in history_codec.h
+HEADER_DTYPE = np.dtype([('magic', 'S4'), ('version', '<u2'), ('header_size', '<u2'),
+                         ('record_size', '<u2'), ('channel_count', '<u2'),
+                         ('first_seq', '<u4')])
+CHANNEL_DTYPE = np.dtype([('scale', '<f4'), ('offset', '<f4'), ('missing', '<i4')])
+RECORD_DTYPE = np.dtype([('timestamp', '<u4'), ('temperature', '<i2'),
+                         ('pressure', '<u2'), ('humidity', '<u2')])
+CHANNELS = ('temperature', 'pressure', 'humidity')
+EPOCH_2020 = 1577836800
+
 fig, (ax1, ax2, ax3) = plt.subplots(3, 1, figsize=(12, 10))
 plt.tight_layout(pad=4.0)
 fig.suptitle('Sensor Data', fontsize=16)
 
 
-def update(frame):
-    global timestamps, temperatures, pressures, humidities, start_time
-    try:
-        response = requests.get(esp32_url, timeout=2)
-        if response.status_code == 200:
-            data = response.json()
-
-
-            timestamps.clear()
-            temperatures.clear()
-            pressures.clear()
-            humidities.clear()
-
-            for reading in data:
-                timestamp_str = reading.get("timestamp", "")
-
-                if isinstance(timestamp_str, str):
-                    if timestamp_str.startswith("ms:"):
-
-                        try:
-                            ms = float(timestamp_str[3:])
-                            timestamp_sec = ms / 1000.0
-                        except ValueError:
-                            timestamp_sec = 0.0
-                    else:
-
-                        try:
-                            dt = datetime.strptime(timestamp_str, "%Y-%m-%d %H:%M:%S")
-                            timestamp_sec = time.mktime(dt.timetuple())
-                            if start_time is None:
-                                start_time = timestamp_sec
-
-                            timestamp_sec = timestamp_sec - start_time
-                        except ValueError:
-
-                            timestamp_sec = 0.0
-                else:
-
-                    try:
-                        timestamp_sec = float(timestamp_str) / 1000.0
-                    except (ValueError, TypeError):
-                        timestamp_sec = 0.0
-
-                timestamps.append(timestamp_sec)
-
-                #append sensor readings, handling None values
-                temp = reading.get("temperature", None)
-                press = reading.get("pressure", None)
-                hum = reading.get("humidity", None)
-
-                temperatures.append(temp if temp is not None else float('nan'))
-                pressures.append(press if press is not None else float('nan'))
-                humidities.append(hum if hum is not None else float('nan'))
-
-            #clear previous plots
-            ax1.cla()
-            ax2.cla()
-            ax3.cla()
-
-            #plot for temperature
-            ax1.plot(timestamps, temperatures, label='Temperature (°C)', color='red', marker='o')
-            ax1.set_ylabel('Temperature (°C)')
-            ax1.legend(loc='upper left')
-            ax1.grid(True)
-
-            #plot for pressure
-            ax2.plot(timestamps, pressures, label='Pressure (hPa)', color='blue', marker='o')
-            ax2.set_ylabel('Pressure (hPa)')
-            ax2.legend(loc='upper left')
-            ax2.grid(True)
-
-            #plot for humidity
-            ax3.plot(timestamps, humidities, label='Humidity (%)', color='green', marker='o')
-            ax3.set_ylabel('Humidity (%)')
-            ax3.legend(loc='upper left')
-            ax3.grid(True)
-            ax3.set_xlabel('Millis/1000')
-
-            for ax in [ax1, ax2, ax3]:
-                if timestamps:
-                    ax.set_xlim(left=max(0, timestamps[-1] - 20), right=timestamps[-1] + 1)
-                ax.tick_params(axis='x', rotation=45)
-
-            plt.tight_layout(pad=4.0)
+def parse_timestamp(timestamp_str):
+    global start_time
+    if isinstance(timestamp_str, str):
+        if timestamp_str.startswith("ms:"):
+
+            try:
+                ms = float(timestamp_str[3:])
+                return ms / 1000.0
+            except ValueError:
+                return 0.0
         else:
-            print(f"Failed to fetch data. Status code: {response.status_code}")
-    except requests.exceptions.RequestException as e:
-        print(f"Error fetching data: {e}")
 
-ani = FuncAnimation(fig, update, interval=5000)
+            try:
+                dt = datetime.strptime(timestamp_str, "%Y-%m-%d %H:%M:%S")
+                # The device formats UTC
+                timestamp_sec = calendar.timegm(dt.timetuple())
+                if start_time is None:
+                    start_time = timestamp_sec
+
+                return timestamp_sec - start_time
+            except ValueError:
+
+                return 0.0
+    else:
+
+        try:
+            return float(timestamp_str) / 1000.0
+        except (ValueError, TypeError):
+            return 0.0
+
+
+def clear_data():
+    global next_seq, start_time
+    timestamps.clear()
+    temperatures.clear()
+    pressures.clear()
+    humidities.clear()
+    next_seq = 0
+    start_time = None
+
+
+def append_reading(reading):
+    global next_seq
+    with data_lock:
+        seq = reading.get("seq", next_seq)
+        if seq < next_seq:
+            # Sequence numbers start over when the device restarts
+            clear_data()
+        next_seq = seq + 1
+
+        timestamps.append(parse_timestamp(reading.get("timestamp", "")))
+
+        #append sensor readings, handling None values
+        temp = reading.get("temperature", None)
+        press = reading.get("pressure", None)
+        hum = reading.get("humidity", None)
+
+        temperatures.append(temp if temp is not None else float('nan'))
+        pressures.append(press if press is not None else float('nan'))
+        humidities.append(hum if hum is not None else float('nan'))
+
+
+def decode_binary(payload):
+    """Returns (first sequence number, timestamps, [temperature, pressure,
+    humidity]) from a /data.bin body. The records are viewed in place with
+    numpy.frombuffer; only the scaled value arrays are new."""
+    header = np.frombuffer(payload, HEADER_DTYPE, count=1)[0]
+    if header['magic'] != b'DMPB' or header['version'] != 1 or \
+            header['record_size'] != RECORD_DTYPE.itemsize:
+        raise ValueError("unsupported /data.bin format")
+
+    channels = np.frombuffer(payload, CHANNEL_DTYPE, count=header['channel_count'],
+                             offset=HEADER_DTYPE.itemsize)
+    header_size = int(header['header_size'])
+    count = (len(payload) - header_size) // RECORD_DTYPE.itemsize
+    records = np.frombuffer(payload, RECORD_DTYPE, count=count, offset=header_size)
+
+    values = []
+    for name, channel in zip(CHANNELS, channels):
+        raw = records[name]
+        scaled = raw * np.float64(channel['scale']) + channel['offset']
+        scaled[raw == channel['missing']] = np.nan
+        values.append(scaled)
+    return int(header['first_seq']), records['timestamp'], values
+
+
+def append_binary(payload):
+    global next_seq, start_time
+    first_seq, stamps, values = decode_binary(payload)
+    with data_lock:
+        if first_seq < next_seq:
+            # Sequence numbers start over when the device restarts
+            clear_data()
+        if len(stamps) == 0:
+            return
+        next_seq = first_seq + len(stamps)
+
+        # Same axis as parse_timestamp(): epoch time relative to the first
+        # reading, seconds since power-on otherwise
+        seconds = stamps.astype(np.float64)
+        epoch = stamps >= EPOCH_2020
+        if start_time is None and epoch.any():
+            start_time = float(seconds[epoch][0])
+        if start_time is not None:
+            seconds[epoch] -= start_time
+
+        timestamps.extend(seconds.tolist())
+        temperatures.extend(values[0].tolist())
+        pressures.extend(values[1].tolist())
+        humidities.extend(values[2].tolist())
+
+
+def poll_once():
+    response = requests.get(binary_url, params={"since": next_seq}, timeout=5)
+    if response.status_code == 200:
+        append_binary(response.content)
+    else:
+        print(f"Failed to fetch data. Status code: {response.status_code}")
+
+
+def stream_forever():
+    global boot_id
+    while True:
+        try:
+            # Bulk catch-up first, the stream then only carries new readings
+            poll_once()
+            with requests.get(stream_url, params={"since": next_seq}, stream=True,
+                              timeout=(5, 60)) as response:
+                if response.status_code != 200:
+                    print(f"Stream refused. Status code: {response.status_code}")
+                    time.sleep(5)
+                    continue
+
+                event = None
+                for line in response.iter_lines(decode_unicode=True):
+                    if line.startswith("event:"):
+                        event = line[6:].strip()
+                    elif line.startswith("data:"):
+                        data = json.loads(line[5:])
+                        if event == "hello":
+                            if boot_id is not None and data["boot"] != boot_id:
+                                with data_lock:
+                                    clear_data()
+                            boot_id = data["boot"]
+                        elif event == "reading":
+                            append_reading(data)
+        except (requests.exceptions.RequestException, ValueError) as e:
+            print(f"Stream interrupted: {e}")
+            time.sleep(2)
+
+
+def update(frame):
+    if not use_stream:
+        try:
+            poll_once()
+        except (requests.exceptions.RequestException, ValueError) as e:
+            print(f"Error fetching data: {e}")
+
+    with data_lock:
+        x = list(timestamps)
+        series = (list(temperatures), list(pressures), list(humidities))
+
+    #clear previous plots
+    ax1.cla()
+    ax2.cla()
+    ax3.cla()
+
+    #plot for temperature
+    ax1.plot(x, series[0], label='Temperature (°C)', color='red', marker='o')
+    ax1.set_ylabel('Temperature (°C)')
+    ax1.legend(loc='upper left')
+    ax1.grid(True)
+
+    #plot for pressure
+    ax2.plot(x, series[1], label='Pressure (hPa)', color='blue', marker='o')
+    ax2.set_ylabel('Pressure (hPa)')
+    ax2.legend(loc='upper left')
+    ax2.grid(True)
+
+    #plot for humidity
+    ax3.plot(x, series[2], label='Humidity (%)', color='green', marker='o')
+    ax3.set_ylabel('Humidity (%)')
+    ax3.legend(loc='upper left')
+    ax3.grid(True)
+    ax3.set_xlabel('Seconds')
+
+    for ax in [ax1, ax2, ax3]:
+        if x:
+            ax.set_xlim(left=max(0, x[-1] - plot_window), right=x[-1] + 1)
+        ax.tick_params(axis='x', rotation=45)
+
+    plt.tight_layout(pad=4.0)
+
+# Importable without connecting, for bench/bench_data_export.py
+if __name__ == "__main__":
+    if use_stream:
+        threading.Thread(target=stream_forever, daemon=True).start()
+    else:
+        try:
+            poll_once()
+        except (requests.exceptions.RequestException, ValueError) as e:
+            print(f"Error fetching data: {e}")
+
+    ani = FuncAnimation(fig, update, interval=5000)
 
-plt.show()
+    plt.show()
@@ -0,0 +1,197 @@
+#include "history_codec.h"
+
+#include <time.h>
+
+static int32_t clampRound(float value, int32_t low, int32_t high) {
+  const float rounded = roundf(value);
+  if (rounded < low) return low;
+  if (rounded > high) return high;
+  return (int32_t)rounded;
+}
+
+HistoryRecord historyEncode(const HistorySample& sample) {
+  HistoryRecord record;
+  record.timestamp = sample.timestamp;
+  record.temperature = isnan(sample.temperature)
+      ? HISTORY_TEMPERATURE_NONE
+      : (int16_t)clampRound(sample.temperature * 100.0f, -32767, 32767);
+  record.pressure = isnan(sample.pressure)
+      ? HISTORY_PRESSURE_NONE
+      : (uint16_t)clampRound((sample.pressure - HISTORY_PRESSURE_OFFSET) * 100.0f, 0, 65534);
+  record.humidity = isnan(sample.humidity)
+      ? HISTORY_HUMIDITY_NONE
+      : (uint16_t)clampRound(sample.humidity * 100.0f, 0, 65534);
+  return record;
+}
+
+HistorySample historyDecode(const HistoryRecord& record) {
+  HistorySample sample;
+  sample.timestamp = record.timestamp;
+  sample.temperature = record.temperature == HISTORY_TEMPERATURE_NONE
+      ? NAN : record.temperature / 100.0f;
+  sample.pressure = record.pressure == HISTORY_PRESSURE_NONE
+      ? NAN : record.pressure / 100.0f + HISTORY_PRESSURE_OFFSET;
+  sample.humidity = record.humidity == HISTORY_HUMIDITY_NONE
+      ? NAN : record.humidity / 100.0f;
+  return sample;
+}
+
+size_t historyFormatTimestamp(char* out, size_t size, uint32_t timestamp) {
+  if (timestamp >= HISTORY_EPOCH_2020) {
+    const time_t t = timestamp;
+    struct tm timeinfo;
+    gmtime_r(&t, &timeinfo);
+    return strftime(out, size, "%Y-%m-%d %H:%M:%S", &timeinfo);
+  }
+  // 64-bit: uptime in ms passes 2^32 after 49.7 days
+  const int len = snprintf(out, size, "ms:%llu", (unsigned long long)timestamp * 1000ULL);
+  return len < 0 ? 0 : (size_t)len;
+}
+
+HistoryExportHeader historyExportHeader(uint32_t firstSequence) {
+  HistoryExportHeader header;
+  memcpy(header.magic, "DMPB", 4);
+  header.version = HISTORY_EXPORT_VERSION;
+  header.headerSize = sizeof(HistoryExportHeader);
+  header.recordSize = sizeof(HistoryRecord);
+  header.channelCount = 3;
+  header.firstSequence = firstSequence;
+  header.channels[0] = {0.01f, 0.0f, HISTORY_TEMPERATURE_NONE};
+  header.channels[1] = {0.01f, HISTORY_PRESSURE_OFFSET, HISTORY_PRESSURE_NONE};
+  header.channels[2] = {0.01f, 0.0f, HISTORY_HUMIDITY_NONE};
+  return header;
+}
+
+// -=| Block codec |=-
+
+static const uint8_t TAG_TIMESTAMP = 0x01;
+static const uint8_t TAG_TEMPERATURE = 0x02;
+static const uint8_t TAG_PRESSURE = 0x04;
+static const uint8_t TAG_HUMIDITY = 0x08;
+
+static uint32_t zigZag(int32_t value) {
+  return ((uint32_t)value << 1) ^ (uint32_t)(value >> 31);
+}
+
+static int32_t unZigZag(uint32_t value) {
+  return (int32_t)(value >> 1) ^ -(int32_t)(value & 1);
+}
+
+static size_t writeVarint(uint32_t value, uint8_t* out) {
+  size_t len = 0;
+  while (value >= 0x80) {
+    out[len++] = (uint8_t)(value | 0x80);
+    value >>= 7;
+  }
+  out[len++] = (uint8_t)value;
+  return len;
+}
+
+size_t HistoryEncoder::encode(const HistoryRecord& record, uint8_t* out) {
+  if (state.count == 0) {
+    memcpy(out, &record, sizeof(record));
+    state.previous = record;
+    state.previousDelta = 0;
+    state.count = 1;
+    return sizeof(record);
+  }
+
+  // All arithmetic wraps modulo 2^32 (2^16 for the channels), so decoding
+  // restores the exact bit patterns including the *_NONE sentinels
+  const uint32_t delta = record.timestamp - state.previous.timestamp;
+  const uint32_t deltaOfDelta = delta - state.previousDelta;
+  const int32_t temperature = (int16_t)(record.temperature - state.previous.temperature);
+  const int32_t pressure = (int16_t)(record.pressure - state.previous.pressure);
+  const int32_t humidity = (int16_t)(record.humidity - state.previous.humidity);
+
+  uint8_t tag = 0;
+  size_t len = 1;
+  if (deltaOfDelta != 0) {
+    tag |= TAG_TIMESTAMP;
+    len += writeVarint(zigZag((int32_t)deltaOfDelta), out + len);
+  }
+  if (temperature != 0) {
+    tag |= TAG_TEMPERATURE;
+    len += writeVarint(zigZag(temperature), out + len);
+  }
+  if (pressure != 0) {
+    tag |= TAG_PRESSURE;
+    len += writeVarint(zigZag(pressure), out + len);
+  }
+  if (humidity != 0) {
+    tag |= TAG_HUMIDITY;
+    len += writeVarint(zigZag(humidity), out + len);
+  }
+  out[0] = tag;
+
+  state.previous = record;
+  state.previousDelta = delta;
+  state.count++;
+  return len;
+}
+
+bool HistoryDecoder::readVarint(uint32_t& value) {
+  value = 0;
+  for (uint8_t shift = 0; shift < 35; shift += 7) {
+    if (offset >= size) {
+      return false;
+    }
+    const uint8_t byte = data[offset++];
+    value |= (uint32_t)(byte & 0x7F) << shift;
+    if ((byte & 0x80) == 0) {
+      return true;
+    }
+  }
+  return false;
+}
+
+bool HistoryDecoder::next(HistoryRecord& record) {
+  if (offset >= size) {
+    return false;
+  }
+
+  if (state.count == 0) {
+    if (size - offset < sizeof(record)) {
+      return false;
+    }
+    memcpy(&record, data + offset, sizeof(record));
+    if (record.timestamp == 0xFFFFFFFF) {
+      return false;  // erased
+    }
+    offset += sizeof(record);
+    state.previous = record;
+    state.previousDelta = 0;
+    state.count = 1;
+    return true;
+  }
+
+  const size_t start = offset;
+  const uint8_t tag = data[offset++];
+  if (tag & 0xF0) {
+    offset = start;  // erased flash or not a tag
+    return false;
+  }
+
+  uint32_t deltaOfDelta = 0;
+  uint32_t temperature = 0;
+  uint32_t pressure = 0;
+  uint32_t humidity = 0;
+  if (((tag & TAG_TIMESTAMP) && !readVarint(deltaOfDelta)) ||
+      ((tag & TAG_TEMPERATURE) && !readVarint(temperature)) ||
+      ((tag & TAG_PRESSURE) && !readVarint(pressure)) ||
+      ((tag & TAG_HUMIDITY) && !readVarint(humidity))) {
+    offset = start;
+    return false;
+  }
+
+  const uint32_t delta = state.previousDelta + (uint32_t)unZigZag(deltaOfDelta);
+  record.timestamp = state.previous.timestamp + delta;
+  record.temperature = (int16_t)(state.previous.temperature + unZigZag(temperature));
+  record.pressure = (uint16_t)(state.previous.pressure + unZigZag(pressure));
+  record.humidity = (uint16_t)(state.previous.humidity + unZigZag(humidity));
+
+  state.previous = record;
+  state.previousDelta = delta;
+  state.count++;
+  return true;
+}
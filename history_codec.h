@@ -0,0 +1,124 @@
+#ifndef HISTORY_CODEC_H
+#define HISTORY_CODEC_H
+
+#include <Arduino.h>
+
+// Timestamps below this are seconds since power-on rather than epoch time
+const uint32_t HISTORY_EPOCH_2020 = 1577836800;
+
+// One reading as seen by the rest of the firmware
+struct HistorySample {
+  uint32_t timestamp;  // epoch seconds, or seconds since power-on without NTP
+  float temperature;   // ˚C
+  float pressure;      // hPa
+  float humidity;      // %RH
+};
+
+// Stored form, 10 bytes. Missing channels use the *_NONE values.
+struct __attribute__((packed)) HistoryRecord {
+  uint32_t timestamp;
+  int16_t temperature;  // 0.01 ˚C
+  uint16_t pressure;    // 0.01 hPa above HISTORY_PRESSURE_OFFSET
+  uint16_t humidity;    // 0.01 %RH
+};
+
+static_assert(sizeof(HistoryRecord) == 10, "HistoryRecord must stay packed");
+
+const int16_t HISTORY_TEMPERATURE_NONE = INT16_MIN;
+const uint16_t HISTORY_PRESSURE_NONE = 0xFFFF;
+const uint16_t HISTORY_HUMIDITY_NONE = 0xFFFF;
+const float HISTORY_PRESSURE_OFFSET = 500.0f;  // covers 500..1155 hPa
+
+HistoryRecord historyEncode(const HistorySample& sample);
+HistorySample historyDecode(const HistoryRecord& record);
+
+// "YYYY-MM-DD HH:MM:SS" (UTC) for epoch time, "ms:<uptime ms>" otherwise
+size_t historyFormatTimestamp(char* out, size_t size, uint32_t timestamp);
+
+/**
+ * Header of the /data.bin export. It is followed by HistoryRecords exactly
+ * as stored: packed, little-endian, recordSize bytes each. Readers skip
+ * headerSize bytes, so later versions can append fields.
+ */
+struct __attribute__((packed)) HistoryExportHeader {
+  struct __attribute__((packed)) Channel {
+    float scale;      // value = raw * scale + offset
+    float offset;
+    int32_t missing;  // raw value of a missing reading
+  };
+
+  char magic[4];           // "DMPB"
+  uint16_t version;
+  uint16_t headerSize;
+  uint16_t recordSize;
+  uint16_t channelCount;
+  uint32_t firstSequence;  // sequence number of the first record
+  Channel channels[3];     // temperature, pressure, humidity
+};
+
+const uint16_t HISTORY_EXPORT_VERSION = 1;
+
+HistoryExportHeader historyExportHeader(uint32_t firstSequence);
+
+/**
+ * Block compression of consecutive records. A block starts with one raw
+ * record; every following record is a tag byte plus zig-zag varints of
+ * the timestamp delta-of-delta and of the per-channel deltas. Bit i of the
+ * tag is set when field i is non-zero, so a record whose interval and
+ * values did not change takes a single byte. The high nibble of a tag is
+ * always 0, which lets a decoder stop at erased flash (0xFF).
+ */
+struct HistoryCodecState {
+  HistoryRecord previous;
+  uint32_t previousDelta;  // timestamp delta of the previous record
+  uint32_t count;          // records in the block so far
+};
+
+class HistoryEncoder {
+ public:
+  // Raw first record, or tag + 5-byte timestamp varint + three 3-byte deltas
+  static constexpr size_t MAX_ENCODED_SIZE = 15;
+
+  HistoryEncoder() { reset(); }
+
+  // Starts a new block
+  void reset() { state.count = 0; }
+
+  // Continues a block that was decoded up to its end
+  void resume(const HistoryCodecState& decoded) { state = decoded; }
+
+  // Writes the next record of the block to out, returns its size
+  size_t encode(const HistoryRecord& record, uint8_t* out);
+
+  uint32_t count() const { return state.count; }
+
+ private:
+  HistoryCodecState state;
+};
+
+class HistoryDecoder {
+ public:
+  HistoryDecoder(const uint8_t* data, size_t size) : data(data), size(size) {
+    state.count = 0;
+  }
+
+  /**
+   * Decodes the next record. Returns false at the end of the data, at
+   * erased flash or at a truncated record.
+   */
+  bool next(HistoryRecord& record);
+
+  // Bytes consumed by the records decoded so far
+  size_t position() const { return offset; }
+  const HistoryCodecState& codecState() const { return state; }
+
+ private:
+  const uint8_t* data;
+  size_t size;
+  size_t offset = 0;
+  HistoryCodecState state;
+
+  bool readVarint(uint32_t& value);
+};
+
+#endif  // HISTORY_CODEC_H
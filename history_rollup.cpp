@@ -0,0 +1,233 @@
+#include "history_rollup.h"
+
+static const uint32_t TIER_WIDTHS[HistoryRollups::TIERS] = {60, 600, 3600};
+
+// -=| HistoryAggregate |=-
+
+// Field of a record as an unsigned code with the same ordering as the
+// value, UINT32_MAX if the value is missing
+static uint32_t channelCode(const HistoryRecord& record, int channel) {
+  switch (channel) {
+    case HistoryAggregate::Temperature:
+      return record.temperature == HISTORY_TEMPERATURE_NONE
+          ? UINT32_MAX : (uint16_t)(record.temperature ^ 0x8000);
+    case HistoryAggregate::Pressure:
+      return record.pressure == HISTORY_PRESSURE_NONE ? UINT32_MAX : record.pressure;
+    default:
+      return record.humidity == HISTORY_HUMIDITY_NONE ? UINT32_MAX : record.humidity;
+  }
+}
+
+// Inverse of channelCode() for a (possibly fractional) code
+static float channelValue(float code, int channel) {
+  switch (channel) {
+    case HistoryAggregate::Temperature:
+      return (code - 32768.0f) / 100.0f;
+    case HistoryAggregate::Pressure:
+      return code / 100.0f + HISTORY_PRESSURE_OFFSET;
+    default:
+      return code / 100.0f;
+  }
+}
+
+void HistoryAggregate::reset(uint32_t intervalStart) {
+  start = intervalStart;
+  for (Channel& channel : channels) {
+    channel.sum = 0;
+    channel.count = 0;
+    channel.min = UINT16_MAX;
+    channel.max = 0;
+  }
+}
+
+void HistoryAggregate::add(const HistoryRecord& record) {
+  for (int i = 0; i < CHANNELS; i++) {
+    const uint32_t code = channelCode(record, i);
+    if (code == UINT32_MAX) {
+      continue;
+    }
+    Channel& channel = channels[i];
+    channel.sum += code;
+    channel.count++;
+    if (code < channel.min) channel.min = code;
+    if (code > channel.max) channel.max = code;
+  }
+}
+
+void HistoryAggregate::merge(const HistoryAggregate& other) {
+  for (int i = 0; i < CHANNELS; i++) {
+    Channel& channel = channels[i];
+    const Channel& add = other.channels[i];
+    channel.sum += add.sum;
+    channel.count += add.count;
+    if (add.min < channel.min) channel.min = add.min;
+    if (add.max > channel.max) channel.max = add.max;
+  }
+}
+
+uint32_t HistoryAggregate::count() const {
+  uint32_t most = 0;
+  for (const Channel& channel : channels) {
+    if (channel.count > most) most = channel.count;
+  }
+  return most;
+}
+
+float HistoryAggregate::mean(ChannelIndex channel) const {
+  const Channel& c = channels[channel];
+  return c.count == 0 ? NAN : channelValue((float)((double)c.sum / c.count), channel);
+}
+
+float HistoryAggregate::minimum(ChannelIndex channel) const {
+  const Channel& c = channels[channel];
+  return c.count == 0 ? NAN : channelValue(c.min, channel);
+}
+
+float HistoryAggregate::maximum(ChannelIndex channel) const {
+  const Channel& c = channels[channel];
+  return c.count == 0 ? NAN : channelValue(c.max, channel);
+}
+
+// -=| HistoryRollups |=-
+
+HistoryRollups::~HistoryRollups() { free(memory); }
+
+bool HistoryRollups::begin(size_t heapBudget, size_t psramBudget) {
+  size_t bytes;
+  bool inPsram;
+  memory = historyAllocate(heapBudget, psramBudget, bytes, inPsram);
+
+  const size_t perTier = bytes / TIERS / sizeof(HistoryAggregate);
+  for (size_t i = 0; i < TIERS; i++) {
+    Tier& tier = tiers[i];
+    tier.buckets = (HistoryAggregate*)memory + i * perTier;
+    tier.capacity = perTier;
+    tier.head = 0;
+    tier.count = 0;
+    tier.width = TIER_WIDTHS[i];
+    tier.completeFrom = 0;
+  }
+  segmentPending = false;
+  started = false;
+  return perTier > 0;
+}
+
+void HistoryRollups::add(const HistoryRecord& record) {
+  // Same rule as HistoryStore::append(): a boot that restarted the clock,
+  // or a clock that went backwards, starts a segment
+  const bool restart = segmentPending || (started && record.timestamp < lastTimestamp);
+  segmentPending = false;
+  started = true;
+  lastTimestamp = record.timestamp;
+
+  for (Tier& tier : tiers) {
+    if (tier.capacity == 0) {
+      continue;
+    }
+    if (restart) {
+      // Nothing of the new segment was dropped yet
+      tier.head = 0;
+      tier.count = 0;
+      tier.completeFrom = 0;
+    }
+
+    const uint32_t start = record.timestamp - record.timestamp % tier.width;
+    HistoryAggregate* last =
+        tier.count > 0 ? &tier.buckets[(tier.head + tier.count - 1) % tier.capacity] : nullptr;
+
+    if (last == nullptr || start != last->start) {
+      if (tier.count == tier.capacity) {
+        tier.head = (tier.head + 1) % tier.capacity;
+        tier.count--;
+        tier.completeFrom = tier.buckets[tier.head].start;
+      }
+      last = &tier.buckets[(tier.head + tier.count) % tier.capacity];
+      last->reset(start);
+      tier.count++;
+    }
+    last->add(record);
+  }
+}
+
+size_t HistoryRollups::findBucket(size_t tier, uint32_t timestamp) const {
+  size_t low = 0;
+  size_t high = tiers[tier].count;
+  while (low < high) {
+    const size_t mid = (low + high) / 2;
+    if (bucket(tier, mid).start < timestamp) {
+      low = mid + 1;
+    } else {
+      high = mid;
+    }
+  }
+  return low;
+}
+
+int HistoryRollups::tierFor(uint32_t step, uint32_t from) const {
+  for (int i = TIERS - 1; i >= 0; i--) {
+    const Tier& tier = tiers[i];
+    if (tier.capacity > 0 && step >= tier.width && step % tier.width == 0 &&
+        tier.completeFrom <= from) {
+      return i;
+    }
+  }
+  return -1;
+}
+
+// -=| Queries |=-
+
+// Merges the raw readings of [start, end] into group
+static void addRaw(const HistoryStore& history, uint32_t start, uint32_t end,
+                   HistoryAggregate& group) {
+  HistoryStore::Reader reader(history);
+  reader.seekTime(start);
+  HistoryRecord record;
+  while (reader.next(record) && record.timestamp <= end) {
+    group.add(record);
+  }
+}
+
+bool historyNextGroup(const HistoryStore& history, const HistoryRollups& rollups,
+                      uint32_t from, uint32_t to, uint32_t step,
+                      uint32_t position, HistoryAggregate& group) {
+  const int tier = rollups.tierFor(step, from);
+  if (tier >= 0) {
+    // A bucket cut by from or to counts only its readings inside the
+    // range, read from the raw history; whole buckets are merged
+    const uint32_t width = rollups.width(tier);
+    size_t index = rollups.findBucket(tier, position);
+    while (index < rollups.bucketCount(tier) && rollups.bucket(tier, index).start <= to) {
+      const uint32_t start = rollups.bucket(tier, index).start;
+      group.reset(start - start % step);
+      for (; index < rollups.bucketCount(tier); index++) {
+        const HistoryAggregate& bucket = rollups.bucket(tier, index);
+        if (bucket.start - group.start >= step || bucket.start > to) {
+          break;
+        }
+        if (bucket.start >= from && to - bucket.start >= width - 1) {
+          group.merge(bucket);
+        } else {
+          addRaw(history, bucket.start > from ? bucket.start : from,
+                 to - bucket.start >= width - 1 ? bucket.start + (width - 1) : to, group);
+        }
+      }
+      if (group.count() > 0) {
+        return true;
+      }
+    }
+    return false;
+  }
+
+  HistoryStore::Reader reader(history);
+  reader.seekTime(position > from ? position : from);
+  HistoryRecord record;
+  if (!reader.next(record) || record.timestamp > to) {
+    return false;
+  }
+  group.reset(record.timestamp - record.timestamp % step);
+  do {
+    group.add(record);
+  } while (reader.next(record) && record.timestamp - group.start < step &&
+           record.timestamp <= to);
+  return true;
+}
@@ -0,0 +1,108 @@
+#ifndef HISTORY_ROLLUP_H
+#define HISTORY_ROLLUP_H
+
+#include "history_store.h"
+
+/**
+ * Minimum, maximum, mean and count of each channel over one time interval.
+ * Values are kept as order-preserving 16-bit codes of the scaled record
+ * fields; missing values are not counted.
+ */
+struct HistoryAggregate {
+  enum ChannelIndex { Temperature = 0, Pressure, Humidity, CHANNELS };
+
+  struct Channel {
+    uint64_t sum;
+    uint32_t count;
+    uint16_t min;
+    uint16_t max;
+  };
+
+  uint32_t start;  // first second of the interval
+  Channel channels[CHANNELS];
+
+  void reset(uint32_t intervalStart);
+  void add(const HistoryRecord& record);
+  void merge(const HistoryAggregate& other);
+
+  // Readings in the interval, the largest per-channel count
+  uint32_t count() const;
+
+  // Per channel in the units of HistorySample, NAN where nothing was counted
+  float mean(ChannelIndex channel) const;
+  float minimum(ChannelIndex channel) const;
+  float maximum(ChannelIndex channel) const;
+};
+
+/**
+ * Rollup tiers of 1 min, 10 min and 1 h buckets, updated on every add().
+ * Each tier is a ring of buckets ordered by start time; when one is full
+ * its oldest bucket is dropped. Like the time queries of HistoryStore the
+ * tiers cover the newest segment only; a new segment empties them.
+ */
+class HistoryRollups {
+ public:
+  static constexpr size_t TIERS = 3;
+
+  HistoryRollups() {}
+  ~HistoryRollups();
+
+  // Splits one allocation evenly across the tiers, see historyAllocate()
+  bool begin(size_t heapBudget, size_t psramBudget);
+
+  void add(const HistoryRecord& record);
+
+  // Call with HistoryStore::startSegment(), see there
+  void startSegment() { segmentPending = true; }
+
+  uint32_t width(size_t tier) const { return tiers[tier].width; }
+  size_t bucketCount(size_t tier) const { return tiers[tier].count; }
+  size_t bucketCapacity(size_t tier) const { return tiers[tier].capacity; }
+
+  // index 0 is the oldest bucket
+  const HistoryAggregate& bucket(size_t tier, size_t index) const {
+    const Tier& t = tiers[tier];
+    return t.buckets[(t.head + index) % t.capacity];
+  }
+
+  // Index of the first bucket starting at or after timestamp
+  size_t findBucket(size_t tier, uint32_t timestamp) const;
+
+  /**
+   * Coarsest tier whose width divides step and that holds everything
+   * from `from` on, or -1 if the query has to go to the raw history.
+   */
+  int tierFor(uint32_t step, uint32_t from) const;
+
+ private:
+  struct Tier {
+    HistoryAggregate* buckets;
+    size_t capacity;
+    size_t head;
+    size_t count;
+    uint32_t width;
+    uint32_t completeFrom;  // buckets before this were dropped
+  };
+
+  Tier tiers[TIERS] = {};
+  void* memory = nullptr;
+  bool segmentPending = false;
+  bool started = false;  // lastTimestamp is valid
+  uint32_t lastTimestamp = 0;
+
+  HistoryRollups(const HistoryRollups&) = delete;
+  HistoryRollups& operator=(const HistoryRollups&) = delete;
+};
+
+/**
+ * Aggregates the readings in [from, to] of the first non-empty step-aligned
+ * interval at or after position. Served from the rollup tier chosen by
+ * tierFor(step, from) when there is one, with the raw history filling in
+ * the buckets that from or to cut; otherwise computed from the raw history
+ * alone. Returns false when no readings are left.
+ */
+bool historyNextGroup(const HistoryStore& history, const HistoryRollups& rollups,
+                      uint32_t from, uint32_t to, uint32_t step,
+                      uint32_t position, HistoryAggregate& group);
+
+#endif  // HISTORY_ROLLUP_H
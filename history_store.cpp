@@ -0,0 +1,358 @@
+#include "history_store.h"
+
+#ifdef ESP_PLATFORM
+#include <esp_partition.h>
+#endif
+
+void* historyAllocate(size_t heapBudget, size_t psramBudget, size_t& bytes,
+                      bool& inPsram) {
+  void* memory = nullptr;
+  inPsram = false;
+
+#ifdef ESP_PLATFORM
+  if (psramFound() && psramBudget > 0) {
+    bytes = psramBudget;
+    memory = ps_malloc(bytes);
+    inPsram = memory != nullptr;
+  }
+  if (memory == nullptr) {
+    // Leave most of the internal heap to WiFi and lwIP
+    bytes = heapBudget < ESP.getFreeHeap() / 4 ? heapBudget : ESP.getFreeHeap() / 4;
+    memory = malloc(bytes);
+  }
+#else
+  (void)psramBudget;
+  bytes = heapBudget;
+  memory = malloc(bytes);
+#endif
+
+  if (memory == nullptr) {
+    bytes = 0;
+  }
+  return memory;
+}
+
+// -=| HistoryStore |=-
+
+HistoryStore::~HistoryStore() { free(blocks); }
+
+bool HistoryStore::begin(size_t heapBudget, size_t psramBudget) {
+  size_t bytes;
+  blocks = (Block*)historyAllocate(heapBudget, psramBudget, bytes, usesPsram);
+  blockCapacity = blocks != nullptr ? bytes / sizeof(Block) : 0;
+  headBlock = 0;
+  usedBlocks = 0;
+  recordCount = 0;
+  segmentPending = false;
+  return blockCapacity > 0;
+}
+
+void HistoryStore::append(const HistoryRecord& record) {
+  if (blockCapacity == 0) {
+    return;
+  }
+
+  // A clock that went backwards starts a segment like a boot does
+  if (usedBlocks > 0 && (segmentPending || record.timestamp < lastTimestamp)) {
+    segment++;
+    segmentPending = true;
+  }
+  lastTimestamp = record.timestamp;
+
+  uint8_t encoded[HistoryEncoder::MAX_ENCODED_SIZE];
+  size_t len = encoder.encode(record, encoded);
+
+  if (usedBlocks == 0 || segmentPending ||
+      block(usedBlocks - 1).used + len > sizeof(Block::data)) {
+    if (usedBlocks == blockCapacity) {
+      recordCount -= blocks[headBlock].count;
+      headBlock = (headBlock + 1) % blockCapacity;
+      usedBlocks--;
+    }
+    Block& fresh = blocks[(headBlock + usedBlocks) % blockCapacity];
+    fresh.firstSequence = nextSequence;
+    fresh.segment = segment;
+    fresh.count = 0;
+    fresh.used = 0;
+    usedBlocks++;
+    segmentPending = false;
+
+    encoder.reset();
+    len = encoder.encode(record, encoded);
+  }
+
+  Block& open = blocks[(headBlock + usedBlocks - 1) % blockCapacity];
+  memcpy(open.data + open.used, encoded, len);
+  open.used += len;
+  open.count++;
+  recordCount++;
+  nextSequence++;
+}
+
+size_t HistoryStore::bytesUsed() const {
+  return usedBlocks == 0 ? 0 : (usedBlocks - 1) * BLOCK_SIZE + 8 + block(usedBlocks - 1).used;
+}
+
+size_t HistoryStore::segmentBlock() const {
+  if (usedBlocks == 0) {
+    return 0;
+  }
+  // Segment ids relative to the oldest block do not decrease, even when
+  // the 16-bit id wrapped: the ring holds fewer blocks than that
+  const uint16_t oldest = block(0).segment;
+  const uint16_t newest = block(usedBlocks - 1).segment - oldest;
+  size_t low = 0;
+  size_t high = usedBlocks - 1;
+  while (low < high) {
+    const size_t mid = (low + high) / 2;
+    if ((uint16_t)(block(mid).segment - oldest) < newest) {
+      low = mid + 1;
+    } else {
+      high = mid;
+    }
+  }
+  return low;
+}
+
+uint32_t HistoryStore::segmentSequence() const {
+  if (usedBlocks == 0) {
+    return nextSequence;
+  }
+  const size_t index = segmentBlock();
+  return index == 0 ? firstSequence() : block(index).firstSequence;
+}
+
+void HistoryStore::Reader::openBlock(size_t index) {
+  blockIndex = index;
+  const Block& current = store.block(index);
+  decoder = HistoryDecoder(current.data, current.used);
+  nextSequence = current.firstSequence;
+}
+
+void HistoryStore::Reader::seek(uint32_t sequence) {
+  if (store.blockCount() == 0) {
+    decoder = HistoryDecoder(nullptr, 0);
+    nextSequence = store.endSequence();
+    return;
+  }
+  if (sequence < store.firstSequence()) {
+    sequence = store.firstSequence();
+  }
+
+  // Last block starting at or before sequence
+  size_t low = 0;
+  size_t high = store.blockCount();
+  while (high - low > 1) {
+    const size_t mid = (low + high) / 2;
+    if (store.block(mid).firstSequence <= sequence) {
+      low = mid;
+    } else {
+      high = mid;
+    }
+  }
+
+  openBlock(low);
+  HistoryRecord skipped;
+  while (nextSequence < sequence && next(skipped)) {
+  }
+}
+
+void HistoryStore::Reader::seekTime(uint32_t timestamp) {
+  if (store.blockCount() == 0) {
+    seek(store.endSequence());
+    return;
+  }
+
+  // Last block of the newest segment whose first record is at or before
+  // timestamp; every block starts with a raw record, so its timestamp is
+  // read without decoding
+  size_t low = store.segmentBlock();
+  size_t high = store.blockCount();
+  while (high - low > 1) {
+    const size_t mid = (low + high) / 2;
+    HistoryRecord first;
+    memcpy(&first, store.block(mid).data, sizeof(first));
+    if (first.timestamp <= timestamp) {
+      low = mid;
+    } else {
+      high = mid;
+    }
+  }
+
+  openBlock(low);
+  uint32_t sequence = nextSequence;
+  HistoryRecord record;
+  while (decoder.next(record) && record.timestamp < timestamp) {
+    sequence++;
+  }
+  seek(sequence);
+}
+
+bool HistoryStore::Reader::next(HistoryRecord& record) {
+  while (!decoder.next(record)) {
+    if (blockIndex + 1 >= store.blockCount()) {
+      return false;
+    }
+    openBlock(blockIndex + 1);
+  }
+  nextSequence++;
+  return true;
+}
+
+// -=| EspPartitionPageStore |=-
+
+#ifdef ESP_PLATFORM
+bool EspPartitionPageStore::begin(const char* label) {
+  const esp_partition_t* p = esp_partition_find_first(
+      ESP_PARTITION_TYPE_DATA, ESP_PARTITION_SUBTYPE_ANY, label);
+  partition = p;
+  pages = p != nullptr ? p->size / PAGE_SIZE : 0;
+  return pages > 0;
+}
+
+bool EspPartitionPageStore::erase(size_t page) {
+  return esp_partition_erase_range((const esp_partition_t*)partition,
+                                   page * PAGE_SIZE, PAGE_SIZE) == ESP_OK;
+}
+
+bool EspPartitionPageStore::program(size_t page, size_t offset,
+                                    const void* data, size_t len) {
+  return esp_partition_write((const esp_partition_t*)partition,
+                             page * PAGE_SIZE + offset, data, len) == ESP_OK;
+}
+
+bool EspPartitionPageStore::read(size_t page, size_t offset, void* data,
+                                 size_t len) {
+  return esp_partition_read((const esp_partition_t*)partition,
+                            page * PAGE_SIZE + offset, data, len) == ESP_OK;
+}
+#endif
+
+// -=| FlashHistoryLog |=-
+
+bool FlashHistoryLog::begin(FlashPageStore* pageStore) {
+  store = pageStore;
+  usedPages = 0;
+  openBytes = 0;
+  segmentPending = false;
+  if (store == nullptr || store->pageCount() == 0) {
+    store = nullptr;
+    return false;
+  }
+
+  // The newest page has the highest sequence among valid headers
+  bool found = false;
+  for (size_t page = 0; page < store->pageCount(); page++) {
+    PageHeader header;
+    if (!store->read(page, 0, &header, sizeof(header)) ||
+        header.magic != PAGE_MAGIC ||
+        header.sequence % store->pageCount() != page) {
+      continue;
+    }
+    usedPages++;
+    if (!found || header.sequence > openSequence) {
+      openSequence = header.sequence;
+      found = true;
+    }
+  }
+
+  if (found) {
+    resumePage(openSequence % store->pageCount());
+  }
+  return true;
+}
+
+void FlashHistoryLog::resumePage(size_t page) {
+  // Rebuild the encoder state by decoding what the page already holds
+  uint8_t* data = (uint8_t*)malloc(PAGE_DATA_SIZE);
+  if (data == nullptr ||
+      !store->read(page, sizeof(PageHeader), data, PAGE_DATA_SIZE)) {
+    free(data);
+    openBytes = PAGE_DATA_SIZE;  // continue on a fresh page
+    return;
+  }
+
+  HistoryDecoder decoder(data, PAGE_DATA_SIZE);
+  HistoryRecord record;
+  while (decoder.next(record)) {
+  }
+  encoder.resume(decoder.codecState());
+  openBytes = decoder.position();
+
+  // A record torn by a reset leaves programmed bytes behind; they cannot
+  // be overwritten, so the next record opens a new page
+  if (openBytes < PAGE_DATA_SIZE && data[openBytes] != 0xFF) {
+    openBytes = PAGE_DATA_SIZE;
+  }
+  free(data);
+}
+
+bool FlashHistoryLog::startPage(uint32_t sequence, uint32_t flags) {
+  const size_t page = sequence % store->pageCount();
+  if (!store->erase(page)) {
+    return false;
+  }
+  const PageHeader header = {PAGE_MAGIC, sequence, flags};
+  if (!store->program(page, 0, &header, sizeof(header))) {
+    return false;
+  }
+  openSequence = sequence;
+  openBytes = 0;
+  encoder.reset();
+  return true;
+}
+
+bool FlashHistoryLog::append(const HistoryRecord& record) {
+  if (store == nullptr) {
+    return false;
+  }
+
+  uint8_t encoded[HistoryEncoder::MAX_ENCODED_SIZE];
+  const HistoryEncoder saved = encoder;
+  size_t len = encoder.encode(record, encoded);
+
+  if (usedPages == 0 || segmentPending || openBytes + len > PAGE_DATA_SIZE) {
+    const uint32_t sequence = usedPages == 0 ? 0 : openSequence + 1;
+    // Wrapping around overwrites the oldest page
+    if (usedPages == store->pageCount()) {
+      usedPages--;
+    }
+    if (!startPage(sequence, segmentPending ? PAGE_SEGMENT_START : 0)) {
+      encoder = saved;
+      return false;
+    }
+    usedPages++;
+    segmentPending = false;
+    len = encoder.encode(record, encoded);
+  }
+
+  if (!store->program(openSequence % store->pageCount(),
+                      sizeof(PageHeader) + openBytes, encoded, len)) {
+    encoder = saved;
+    return false;
+  }
+  openBytes += len;
+  return true;
+}
+
+size_t FlashHistoryLog::readPage(size_t index, uint8_t* out, bool* segmentStart) {
+  if (store == nullptr || index >= usedPages) {
+    return 0;
+  }
+
+  const uint32_t sequence = openSequence - (usedPages - 1) + index;
+  const size_t page = sequence % store->pageCount();
+  const size_t bytes = sequence == openSequence ? openBytes : PAGE_DATA_SIZE;
+
+  // A page erased by an interrupted startPage() leaves a gap
+  PageHeader header;
+  if (!store->read(page, 0, &header, sizeof(header)) ||
+      header.magic != PAGE_MAGIC || header.sequence != sequence ||
+      !store->read(page, sizeof(PageHeader), out, bytes)) {
+    return 0;
+  }
+  if (segmentStart != nullptr) {
+    *segmentStart = (header.flags & PAGE_SEGMENT_START) != 0;
+  }
+  return bytes;
+}
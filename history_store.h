@@ -0,0 +1,198 @@
+#ifndef HISTORY_STORE_H
+#define HISTORY_STORE_H
+
+#include "history_codec.h"
+
+/**
+ * Allocates up to psramBudget bytes of PSRAM, or else up to heapBudget bytes
+ * (at most a quarter of the free heap) of internal RAM. bytes receives the
+ * size obtained.
+ */
+void* historyAllocate(size_t heapBudget, size_t psramBudget, size_t& bytes,
+                      bool& inPsram);
+
+/**
+ * RAM ring of the most recent records, compressed in fixed-size blocks
+ * that decode independently. The buffer is allocated once in begin(), from
+ * PSRAM when the board has it, so its capacity follows the memory that is
+ * actually available. When it is full the oldest block is dropped.
+ *
+ * The records form segments in which the clock never goes backwards. A
+ * segment starts on startSegment() (a boot that restarted the clock) and
+ * whenever a timestamp is lower than the previous one; timestamps are only
+ * compared within a segment.
+ */
+class HistoryStore {
+ public:
+  static constexpr size_t BLOCK_SIZE = 256;
+
+  struct Block {
+    uint32_t firstSequence;  // sequence number of the first record
+    uint16_t segment;        // increases by one per segment, wraps
+    uint8_t count;           // records in the block
+    uint8_t used;            // bytes of data in use
+    uint8_t data[BLOCK_SIZE - 8];
+  };
+
+  static_assert(sizeof(Block::data) <= UINT8_MAX, "Block::used must fit the data");
+
+  // Sequential access from any sequence number still held
+  class Reader {
+   public:
+    explicit Reader(const HistoryStore& store)
+        : store(store), decoder(nullptr, 0) {}
+
+    // Moves to sequence, or to the oldest record if it was already dropped
+    void seek(uint32_t sequence);
+
+    // Moves to the first record at or after timestamp in the newest
+    // segment; binary search over the blocks of that segment
+    void seekTime(uint32_t timestamp);
+    bool next(HistoryRecord& record);
+
+    // Sequence number of the record next() returns
+    uint32_t sequence() const { return nextSequence; }
+
+   private:
+    const HistoryStore& store;
+    size_t blockIndex = 0;
+    HistoryDecoder decoder;
+    uint32_t nextSequence = 0;
+
+    void openBlock(size_t index);
+  };
+
+  HistoryStore() {}
+  ~HistoryStore();
+
+  // Allocates the ring, see historyAllocate()
+  bool begin(size_t heapBudget, size_t psramBudget);
+
+  void append(const HistorySample& sample) { append(historyEncode(sample)); }
+  void append(const HistoryRecord& record);
+
+  // The next record opens a new segment
+  void startSegment() { segmentPending = true; }
+
+  // Sequence number of the first record of the newest segment still held
+  uint32_t segmentSequence() const;
+
+  // Records held and their sequence numbers [firstSequence, endSequence)
+  size_t size() const { return recordCount; }
+  uint32_t firstSequence() const { return endSequence() - recordCount; }
+  uint32_t endSequence() const { return nextSequence; }
+
+  size_t capacityBytes() const { return blockCapacity * BLOCK_SIZE; }
+  size_t bytesUsed() const;
+  bool inPsram() const { return usesPsram; }
+
+  // index 0 is the oldest block
+  size_t blockCount() const { return usedBlocks; }
+  const Block& block(size_t index) const {
+    return blocks[(headBlock + index) % blockCapacity];
+  }
+
+ private:
+  Block* blocks = nullptr;
+  size_t blockCapacity = 0;
+  size_t headBlock = 0;
+  size_t usedBlocks = 0;
+  size_t recordCount = 0;
+  uint32_t nextSequence = 0;
+  HistoryEncoder encoder;  // state of the newest block
+  bool usesPsram = false;
+  uint16_t segment = 0;
+  bool segmentPending = false;
+  uint32_t lastTimestamp = 0;
+
+  // Index of the first block of the newest segment
+  size_t segmentBlock() const;
+
+  HistoryStore(const HistoryStore&) = delete;
+  HistoryStore& operator=(const HistoryStore&) = delete;
+};
+
+/**
+ * Page-granular NOR flash: erase sets a page to 0xFF, program can only clear
+ * bits. Implemented by the ESP32 partition API on the device and by a file
+ * on the host.
+ */
+class FlashPageStore {
+ public:
+  static constexpr size_t PAGE_SIZE = 4096;
+
+  virtual ~FlashPageStore() {}
+  virtual size_t pageCount() const = 0;
+  virtual bool erase(size_t page) = 0;
+  virtual bool program(size_t page, size_t offset, const void* data, size_t len) = 0;
+  virtual bool read(size_t page, size_t offset, void* data, size_t len) = 0;
+};
+
+#ifdef ESP_PLATFORM
+// Data partition of the running firmware, looked up by label
+class EspPartitionPageStore : public FlashPageStore {
+ public:
+  bool begin(const char* label);
+
+  size_t pageCount() const override { return pages; }
+  bool erase(size_t page) override;
+  bool program(size_t page, size_t offset, const void* data, size_t len) override;
+  bool read(size_t page, size_t offset, void* data, size_t len) override;
+
+ private:
+  const void* partition = nullptr;  // const esp_partition_t*
+  size_t pages = 0;
+};
+#endif
+
+/**
+ * Append-only log of fixed-size pages used as a circular buffer. Each page
+ * holds one compressed block. Every record is programmed into the open page
+ * as it arrives, so nothing is lost on reset; when the log wraps, the
+ * oldest page is erased. A segment of HistoryStore always starts on a new
+ * page, flagged in its header.
+ */
+class FlashHistoryLog {
+ public:
+  struct PageHeader {
+    uint32_t magic;
+    uint32_t sequence;  // increases by one per page, never reused
+    uint32_t flags;     // PAGE_* bits
+  };
+
+  static constexpr uint32_t PAGE_MAGIC = 0x48535432;  // "HST2"
+  static constexpr uint32_t PAGE_SEGMENT_START = 1;   // first page of a segment
+  static constexpr size_t PAGE_DATA_SIZE =
+      FlashPageStore::PAGE_SIZE - sizeof(PageHeader);
+
+  // Scans the page headers and resumes after the newest record
+  bool begin(FlashPageStore* store);
+
+  bool append(const HistoryRecord& record);
+
+  // The next record opens a new page that starts a segment
+  void startSegment() { segmentPending = true; }
+
+  size_t pageCount() const { return usedPages; }
+
+  /**
+   * Reads the compressed block of the index-th oldest page into out (room
+   * for PAGE_DATA_SIZE), returns its size. Decode it with HistoryDecoder.
+   * segmentStart, if given, tells whether the page starts a segment.
+   */
+  size_t readPage(size_t index, uint8_t* out, bool* segmentStart = nullptr);
+
+ private:
+  // A page with sequence s always lives at physical page s % pageCount()
+  FlashPageStore* store = nullptr;
+  size_t usedPages = 0;
+  uint32_t openSequence = 0;  // sequence of the page being filled
+  size_t openBytes = 0;       // data bytes already in the open page
+  HistoryEncoder encoder;
+  bool segmentPending = false;
+
+  bool startPage(uint32_t sequence, uint32_t flags);
+  void resumePage(size_t page);
+};
+
+#endif  // HISTORY_STORE_H
@@ -0,0 +1,98 @@
+#include "Adafruit_GFX.h"
+
+// 5 columns of 7 rows per glyph; a fixed pattern derived from the code
+// point stands in for the font table
+static uint8_t glyphColumn(unsigned char c, uint8_t column) {
+  if (c == ' ') {
+    return 0;
+  }
+  uint32_t h = (c * 2654435761u) ^ (column * 40503u);
+  h ^= h >> 13;
+  return (uint8_t)((h & 0x7F) | 0x01);
+}
+
+void Adafruit_GFX::fillRect(int16_t x, int16_t y, int16_t w, int16_t h,
+                            uint16_t color) {
+  for (int16_t i = x; i < x + w; i++) {
+    for (int16_t j = y; j < y + h; j++) {
+      drawPixel(i, j, color);
+    }
+  }
+}
+
+void Adafruit_GFX::drawChar(int16_t x, int16_t y, unsigned char c,
+                            uint16_t color, uint16_t bg, uint8_t size) {
+  if (x >= WIDTH || y >= HEIGHT || x + 6 * size - 1 < 0 ||
+      y + 8 * size - 1 < 0) {
+    return;
+  }
+  for (int8_t i = 0; i < 5; i++) {
+    uint8_t line = glyphColumn(c, i);
+    for (int8_t j = 0; j < 8; j++, line >>= 1) {
+      if (line & 1) {
+        fillRect(x + i * size, y + j * size, size, size, color);
+      } else if (bg != color) {
+        fillRect(x + i * size, y + j * size, size, size, bg);
+      }
+    }
+  }
+  if (bg != color) {
+    fillRect(x + 5 * size, y, size, 8 * size, bg);
+  }
+}
+
+size_t Adafruit_GFX::write(uint8_t c) {
+  if (c == '\n') {
+    cursor_x = 0;
+    cursor_y += textsize * 8;
+  } else if (c != '\r') {
+    if (wrap && cursor_x + textsize * 6 > WIDTH) {
+      cursor_x = 0;
+      cursor_y += textsize * 8;
+    }
+    drawChar(cursor_x, cursor_y, c, textcolor, textbgcolor, textsize);
+    cursor_x += textsize * 6;
+  }
+  return 1;
+}
+
+void Adafruit_GFX::charBounds(unsigned char c, int16_t* x, int16_t* y,
+                              int16_t* minx, int16_t* miny, int16_t* maxx,
+                              int16_t* maxy) {
+  if (c == '\n') {
+    *x = 0;
+    *y += textsize * 8;
+  } else if (c != '\r') {
+    if (wrap && *x + textsize * 6 > WIDTH) {
+      *x = 0;
+      *y += textsize * 8;
+    }
+    const int16_t x2 = *x + textsize * 6 - 1;
+    const int16_t y2 = *y + textsize * 8 - 1;
+    if (x2 > *maxx) *maxx = x2;
+    if (y2 > *maxy) *maxy = y2;
+    if (*x < *minx) *minx = *x;
+    if (*y < *miny) *miny = *y;
+    *x += textsize * 6;
+  }
+}
+
+void Adafruit_GFX::getTextBounds(const char* str, int16_t x, int16_t y,
+                                 int16_t* x1, int16_t* y1, uint16_t* w,
+                                 uint16_t* h) {
+  int16_t minx = WIDTH, miny = HEIGHT, maxx = -1, maxy = -1;
+  *x1 = x;
+  *y1 = y;
+  *w = *h = 0;
+  while (*str) {
+    charBounds((unsigned char)*str++, &x, &y, &minx, &miny, &maxx, &maxy);
+  }
+  if (maxx >= minx) {
+    *x1 = minx;
+    *w = maxx - minx + 1;
+  }
+  if (maxy >= miny) {
+    *y1 = miny;
+    *h = maxy - miny + 1;
+  }
+}
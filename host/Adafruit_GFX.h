@@ -0,0 +1,61 @@
+// Adafruit_GFX.h -- host stand-in for the subset of Adafruit GFX used with
+// the OLED: pixels, filled rectangles and text in the classic 6x8 cell
+// font with the same cursor, size and wrap rules. Glyph shapes are
+// placeholders; positions and extents match the library.
+#ifndef HOST_ADAFRUIT_GFX_H
+#define HOST_ADAFRUIT_GFX_H
+
+#include "Arduino.h"
+
+class Adafruit_GFX : public Print {
+ public:
+  Adafruit_GFX(int16_t w, int16_t h) : WIDTH(w), HEIGHT(h) {}
+
+  virtual void drawPixel(int16_t x, int16_t y, uint16_t color) = 0;
+  virtual void fillRect(int16_t x, int16_t y, int16_t w, int16_t h,
+                        uint16_t color);
+  virtual void fillScreen(uint16_t color) { fillRect(0, 0, WIDTH, HEIGHT, color); }
+
+  void drawChar(int16_t x, int16_t y, unsigned char c, uint16_t color,
+                uint16_t bg, uint8_t size);
+
+  void setCursor(int16_t x, int16_t y) {
+    cursor_x = x;
+    cursor_y = y;
+  }
+  void setTextSize(uint8_t s) { textsize = s > 0 ? s : 1; }
+  void setTextColor(uint16_t c) { textcolor = textbgcolor = c; }
+  void setTextColor(uint16_t c, uint16_t bg) {
+    textcolor = c;
+    textbgcolor = bg;
+  }
+  void setTextWrap(bool w) { wrap = w; }
+
+  // Box covering `str` printed at (x, y) with the current size and wrap
+  void getTextBounds(const char* str, int16_t x, int16_t y, int16_t* x1,
+                     int16_t* y1, uint16_t* w, uint16_t* h);
+
+  size_t write(uint8_t c) override;
+  using Print::write;
+
+  int16_t width() const { return WIDTH; }
+  int16_t height() const { return HEIGHT; }
+  int16_t getCursorX() const { return cursor_x; }
+  int16_t getCursorY() const { return cursor_y; }
+
+ protected:
+  const int16_t WIDTH;
+  const int16_t HEIGHT;
+  int16_t cursor_x = 0;
+  int16_t cursor_y = 0;
+  uint16_t textcolor = 0xFFFF;
+  uint16_t textbgcolor = 0xFFFF;
+  uint8_t textsize = 1;
+  bool wrap = true;
+
+ private:
+  void charBounds(unsigned char c, int16_t* x, int16_t* y, int16_t* minx,
+                  int16_t* miny, int16_t* maxx, int16_t* maxy);
+};
+
+#endif  // HOST_ADAFRUIT_GFX_H
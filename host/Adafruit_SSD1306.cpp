@@ -0,0 +1,112 @@
+#include "Adafruit_SSD1306.h"
+
+#include <stdlib.h>
+
+Adafruit_SSD1306::Adafruit_SSD1306(uint8_t w, uint8_t h, TwoWire* twi,
+                                   int8_t /*rst_pin*/, uint32_t clkDuring,
+                                   uint32_t clkAfter)
+    : Adafruit_GFX(w, h),
+      wire(twi),
+      wireClk(clkDuring),
+      restoreClk(clkAfter) {}
+
+Adafruit_SSD1306::~Adafruit_SSD1306() { free(buffer); }
+
+void Adafruit_SSD1306::ssd1306_command1(uint8_t c) {
+  wire->beginTransmission(i2caddr);
+  wire->write((uint8_t)0x00);
+  wire->write(c);
+  wire->endTransmission();
+}
+
+void Adafruit_SSD1306::ssd1306_commandList(const uint8_t* c, uint8_t n) {
+  wire->beginTransmission(i2caddr);
+  wire->write((uint8_t)0x00);
+  size_t bytesOut = 1;
+  while (n--) {
+    if (bytesOut >= I2C_BUFFER_LENGTH) {
+      wire->endTransmission();
+      wire->beginTransmission(i2caddr);
+      wire->write((uint8_t)0x00);
+      bytesOut = 1;
+    }
+    wire->write(*c++);
+    bytesOut++;
+  }
+  wire->endTransmission();
+}
+
+void Adafruit_SSD1306::ssd1306_command(uint8_t c) {
+  wire->setClock(wireClk);
+  ssd1306_command1(c);
+  wire->setClock(restoreClk);
+}
+
+bool Adafruit_SSD1306::begin(uint8_t switchvcc, uint8_t addr, bool /*reset*/,
+                             bool /*periphBegin*/) {
+  if (!buffer && !(buffer = (uint8_t*)malloc(WIDTH * ((HEIGHT + 7) / 8)))) {
+    return false;
+  }
+  clearDisplay();
+  i2caddr = addr ? addr : ((HEIGHT == 32) ? 0x3C : 0x3D);
+
+  const uint8_t init[] = {
+      SSD1306_DISPLAYOFF, 0xD5, 0x80, 0xA8, (uint8_t)(HEIGHT - 1), 0xD3, 0x00,
+      0x40, SSD1306_CHARGEPUMP,
+      (uint8_t)(switchvcc == SSD1306_EXTERNALVCC ? 0x10 : 0x14),
+      SSD1306_MEMORYMODE, 0x00, 0xA1, 0xC8, 0xDA,
+      (uint8_t)(HEIGHT == 64 ? 0x12 : 0x02), SSD1306_SETCONTRAST, 0xCF, 0xD9,
+      0xF1, 0xDB, 0x40, 0xA4, 0xA6, 0x2E, SSD1306_DISPLAYON};
+  wire->setClock(wireClk);
+  ssd1306_commandList(init, sizeof(init));
+  wire->setClock(restoreClk);
+  return true;
+}
+
+void Adafruit_SSD1306::clearDisplay() {
+  memset(buffer, 0, WIDTH * ((HEIGHT + 7) / 8));
+}
+
+void Adafruit_SSD1306::drawPixel(int16_t x, int16_t y, uint16_t color) {
+  if (x < 0 || x >= WIDTH || y < 0 || y >= HEIGHT) {
+    return;
+  }
+  uint8_t& b = buffer[x + (y / 8) * WIDTH];
+  const uint8_t bit = 1 << (y & 7);
+  switch (color) {
+    case SSD1306_WHITE:
+      b |= bit;
+      break;
+    case SSD1306_BLACK:
+      b &= ~bit;
+      break;
+    case SSD1306_INVERSE:
+      b ^= bit;
+      break;
+  }
+}
+
+void Adafruit_SSD1306::display() {
+  wire->setClock(wireClk);
+  const uint8_t window[] = {SSD1306_PAGEADDR, 0, 0xFF, SSD1306_COLUMNADDR, 0};
+  ssd1306_commandList(window, sizeof(window));
+  ssd1306_command1(WIDTH - 1);
+
+  uint16_t count = WIDTH * ((HEIGHT + 7) / 8);
+  const uint8_t* ptr = buffer;
+  wire->beginTransmission(i2caddr);
+  wire->write((uint8_t)0x40);
+  size_t bytesOut = 1;
+  while (count--) {
+    if (bytesOut >= I2C_BUFFER_LENGTH) {
+      wire->endTransmission();
+      wire->beginTransmission(i2caddr);
+      wire->write((uint8_t)0x40);
+      bytesOut = 1;
+    }
+    wire->write(*ptr++);
+    bytesOut++;
+  }
+  wire->endTransmission();
+  wire->setClock(restoreClk);
+}
@@ -0,0 +1,55 @@
+// Adafruit_SSD1306.h -- host stand-in for the I2C variant of Adafruit's
+// SSD1306 driver. The framebuffer layout, begin() and display() traffic
+// follow the library: display() sets a full page/column window and sends
+// the whole buffer in I2C_BUFFER_LENGTH transactions at clkDuring, then
+// restores clkAfter. Attach an Ssd1306Sim to see what reaches the panel.
+#ifndef HOST_ADAFRUIT_SSD1306_H
+#define HOST_ADAFRUIT_SSD1306_H
+
+#include "Adafruit_GFX.h"
+#include "Wire.h"
+
+#define SSD1306_BLACK 0
+#define SSD1306_WHITE 1
+#define SSD1306_INVERSE 2
+#define BLACK SSD1306_BLACK
+#define WHITE SSD1306_WHITE
+#define INVERSE SSD1306_INVERSE
+
+#define SSD1306_MEMORYMODE 0x20
+#define SSD1306_COLUMNADDR 0x21
+#define SSD1306_PAGEADDR 0x22
+#define SSD1306_SETCONTRAST 0x81
+#define SSD1306_CHARGEPUMP 0x8D
+#define SSD1306_DISPLAYOFF 0xAE
+#define SSD1306_DISPLAYON 0xAF
+#define SSD1306_EXTERNALVCC 0x01
+#define SSD1306_SWITCHCAPVCC 0x02
+
+class Adafruit_SSD1306 : public Adafruit_GFX {
+ public:
+  Adafruit_SSD1306(uint8_t w, uint8_t h, TwoWire* twi, int8_t rst_pin = -1,
+                   uint32_t clkDuring = 400000UL,
+                   uint32_t clkAfter = 100000UL);
+  ~Adafruit_SSD1306();
+
+  bool begin(uint8_t switchvcc = SSD1306_SWITCHCAPVCC, uint8_t i2caddr = 0,
+             bool reset = true, bool periphBegin = true);
+  void display();
+  void clearDisplay();
+  void drawPixel(int16_t x, int16_t y, uint16_t color) override;
+  void ssd1306_command(uint8_t c);
+  uint8_t* getBuffer() { return buffer; }
+
+ private:
+  TwoWire* wire;
+  uint8_t* buffer = nullptr;
+  uint8_t i2caddr = 0;
+  uint32_t wireClk;
+  uint32_t restoreClk;
+
+  void ssd1306_command1(uint8_t c);
+  void ssd1306_commandList(const uint8_t* c, uint8_t n);
+};
+
+#endif  // HOST_ADAFRUIT_SSD1306_H
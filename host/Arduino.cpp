@@ -0,0 +1,66 @@
+#include "Arduino.h"
+
+#include <atomic>
+
+// Advanced by every thread that waits or uses a simulated bus
+static std::atomic<uint64_t> simMicros{0};
+static bool serialQuiet = false;
+
+HardwareSerial Serial;
+
+unsigned long millis() { return (unsigned long)(simMicros / 1000); }
+unsigned long micros() { return (unsigned long)simMicros; }
+void delay(unsigned long ms) { simMicros += (uint64_t)ms * 1000; }
+void delayMicroseconds(unsigned int us) { simMicros += us; }
+
+uint64_t host::nowMicros() { return simMicros; }
+void host::advanceMicros(uint64_t us) { simMicros += us; }
+void host::setSerialQuiet(bool quiet) { serialQuiet = quiet; }
+
+size_t Print::write(const uint8_t* buffer, size_t size) {
+  size_t n = 0;
+  while (size--) {
+    n += write(*buffer++);
+  }
+  return n;
+}
+
+size_t Print::print(long value, int base) {
+  char buffer[24];
+  snprintf(buffer, sizeof(buffer), base == HEX ? "%lX" : "%ld", value);
+  return write(buffer);
+}
+
+size_t Print::print(unsigned long value, int base) {
+  char buffer[24];
+  snprintf(buffer, sizeof(buffer), base == HEX ? "%lX" : "%lu", value);
+  return write(buffer);
+}
+
+size_t Print::print(double value, int digits) {
+  char buffer[48];
+  snprintf(buffer, sizeof(buffer), "%.*f", digits, value);
+  return write(buffer);
+}
+
+size_t Print::printf(const char* format, ...) {
+  char buffer[256];
+  va_list args;
+  va_start(args, format);
+  int len = vsnprintf(buffer, sizeof(buffer), format, args);
+  va_end(args);
+  if (len < 0) {
+    return 0;
+  }
+  return write((const uint8_t*)buffer,
+               (size_t)len < sizeof(buffer) ? len : sizeof(buffer) - 1);
+}
+
+size_t HardwareSerial::write(uint8_t c) { return write(&c, 1); }
+
+size_t HardwareSerial::write(const uint8_t* buffer, size_t size) {
+  if (!serialQuiet) {
+    fwrite(buffer, 1, size, stdout);
+  }
+  return size;
+}
@@ -0,0 +1,78 @@
+// Arduino.h -- host stand-in for the subset of the Arduino core used by the
+// drivers. Time is simulated: delay() and bus traffic advance the clock, so
+// runs are deterministic and independent of the host's speed.
+#ifndef HOST_ARDUINO_H
+#define HOST_ARDUINO_H
+
+#include <math.h>
+#include <stdarg.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+#define HEX 16
+#define DEC 10
+
+unsigned long millis();
+unsigned long micros();
+void delay(unsigned long ms);
+void delayMicroseconds(unsigned int us);
+
+// Simulated clock control for host programs
+namespace host {
+uint64_t nowMicros();
+void advanceMicros(uint64_t us);
+}  // namespace host
+
+class Print {
+ public:
+  virtual ~Print() {}
+  virtual size_t write(uint8_t c) = 0;
+  virtual size_t write(const uint8_t* buffer, size_t size);
+
+  size_t write(const char* str) {
+    return write((const uint8_t*)str, strlen(str));
+  }
+
+  size_t print(const char* str) { return write(str); }
+  size_t print(char c) { return write((uint8_t)c); }
+  size_t print(int value, int base = DEC) { return print((long)value, base); }
+  size_t print(unsigned int value, int base = DEC) {
+    return print((unsigned long)value, base);
+  }
+  size_t print(long value, int base = DEC);
+  size_t print(unsigned long value, int base = DEC);
+  size_t print(double value, int digits = 2);
+
+  size_t println() { return write("\r\n"); }
+  template <typename T>
+  size_t println(T value) {
+    return print(value) + println();
+  }
+  template <typename T>
+  size_t println(T value, int format) {
+    return print(value, format) + println();
+  }
+
+  size_t printf(const char* format, ...)
+      __attribute__((format(printf, 2, 3)));
+};
+
+// Serial writes to stdout unless host::setSerialQuiet(true) is called
+class HardwareSerial : public Print {
+ public:
+  void begin(unsigned long) {}
+  void flush() { fflush(stdout); }
+  size_t write(uint8_t c) override;
+  size_t write(const uint8_t* buffer, size_t size) override;
+  using Print::write;
+};
+
+extern HardwareSerial Serial;
+
+namespace host {
+void setSerialQuiet(bool quiet);
+}  // namespace host
+
+#endif  // HOST_ARDUINO_H
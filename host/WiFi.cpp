@@ -0,0 +1,135 @@
+#include "WiFi.h"
+
+#include <arpa/inet.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/ioctl.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+static void setNonBlocking(int fd) {
+  fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK);
+  const int one = 1;
+  setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+}
+
+static sockaddr_in loopback(uint16_t port) {
+  sockaddr_in address = {};
+  address.sin_family = AF_INET;
+  address.sin_port = htons(port);
+  address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+  return address;
+}
+
+WiFiClient::Socket::~Socket() { ::close(fd); }
+
+WiFiClient::WiFiClient(int fd) : socket(std::make_shared<Socket>(fd)) {
+  setNonBlocking(fd);
+}
+
+bool WiFiClient::connect(uint16_t port) {
+  stop();
+  const int fd = ::socket(AF_INET, SOCK_STREAM, 0);
+  if (fd < 0) {
+    return false;
+  }
+  const sockaddr_in address = loopback(port);
+  if (::connect(fd, (const sockaddr*)&address, sizeof(address)) != 0) {
+    ::close(fd);
+    return false;
+  }
+  socket = std::make_shared<Socket>(fd);
+  setNonBlocking(fd);
+  return true;
+}
+
+// Same test as the ESP32 core: a peek that returns 0 means the peer closed
+uint8_t WiFiClient::connected() {
+  if (!socket) {
+    return 0;
+  }
+  uint8_t byte;
+  const ssize_t n = recv(socket->fd, &byte, 1, MSG_PEEK | MSG_DONTWAIT);
+  if (n > 0) {
+    return 1;
+  }
+  if (n == 0) {
+    return 0;
+  }
+  return errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR;
+}
+
+int WiFiClient::available() {
+  int count = 0;
+  if (!socket || ioctl(socket->fd, FIONREAD, &count) != 0) {
+    return 0;
+  }
+  return count;
+}
+
+int WiFiClient::read() {
+  uint8_t byte;
+  return read(&byte, 1) == 1 ? byte : -1;
+}
+
+int WiFiClient::read(uint8_t* buffer, size_t size) {
+  if (!socket) {
+    return -1;
+  }
+  const ssize_t n = recv(socket->fd, buffer, size, MSG_DONTWAIT);
+  return n > 0 ? (int)n : -1;
+}
+
+size_t WiFiClient::write(uint8_t c) { return write(&c, 1); }
+
+size_t WiFiClient::write(const uint8_t* buffer, size_t size) {
+  if (!socket) {
+    return 0;
+  }
+  size_t sent = 0;
+  while (sent < size) {
+    const ssize_t n = send(socket->fd, buffer + sent, size - sent,
+                           MSG_DONTWAIT | MSG_NOSIGNAL);
+    if (n <= 0) {
+      break;
+    }
+    sent += n;
+  }
+  return sent;
+}
+
+void WiFiClient::stop() { socket.reset(); }
+
+WiFiServer::~WiFiServer() {
+  if (listenFd >= 0) {
+    ::close(listenFd);
+  }
+}
+
+void WiFiServer::begin() {
+  listenFd = ::socket(AF_INET, SOCK_STREAM, 0);
+  const int one = 1;
+  setsockopt(listenFd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+  sockaddr_in address = loopback(listenPort);
+  if (bind(listenFd, (const sockaddr*)&address, sizeof(address)) != 0 ||
+      listen(listenFd, 16) != 0) {
+    perror("WiFiServer");
+    ::close(listenFd);
+    listenFd = -1;
+    return;
+  }
+  socklen_t length = sizeof(address);
+  getsockname(listenFd, (sockaddr*)&address, &length);
+  listenPort = ntohs(address.sin_port);
+  fcntl(listenFd, F_SETFL, fcntl(listenFd, F_GETFL) | O_NONBLOCK);
+}
+
+WiFiClient WiFiServer::available() {
+  if (listenFd < 0) {
+    return WiFiClient();
+  }
+  const int fd = accept(listenFd, nullptr, nullptr);
+  return fd >= 0 ? WiFiClient(fd) : WiFiClient();
+}
@@ -0,0 +1,57 @@
+// WiFi.h -- host stand-in for WiFiServer / WiFiClient over POSIX sockets,
+// enough to run HttpServer on a real port. Sockets are non-blocking: a
+// write() returns how much the kernel took, so a full send buffer shows
+// up as a short write like a stalled client does on the ESP32.
+#ifndef HOST_WIFI_H
+#define HOST_WIFI_H
+
+#include <memory>
+
+#include "Arduino.h"
+
+class WiFiClient : public Print {
+ public:
+  WiFiClient() {}
+  explicit WiFiClient(int fd);
+
+  // Connects to 127.0.0.1:port, blocking; for test clients
+  bool connect(uint16_t port);
+
+  uint8_t connected();
+  int available();
+  int read();
+  int read(uint8_t* buffer, size_t size);
+  size_t write(uint8_t c) override;
+  size_t write(const uint8_t* buffer, size_t size) override;
+  using Print::write;
+  void stop();
+
+  int fd() const { return socket ? socket->fd : -1; }
+  explicit operator bool() const { return socket != nullptr; }
+
+ private:
+  // Copies share the socket like the ESP32 client does
+  struct Socket {
+    int fd;
+    explicit Socket(int fd) : fd(fd) {}
+    ~Socket();
+  };
+  std::shared_ptr<Socket> socket;
+};
+
+class WiFiServer {
+ public:
+  // Listens on 127.0.0.1 only; port 0 picks a free one, see port()
+  explicit WiFiServer(uint16_t port) : listenPort(port) {}
+  ~WiFiServer();
+
+  void begin();
+  WiFiClient available();
+  uint16_t port() const { return listenPort; }
+
+ private:
+  uint16_t listenPort;
+  int listenFd = -1;
+};
+
+#endif  // HOST_WIFI_H
@@ -0,0 +1,65 @@
+#include "Wire.h"
+
+TwoWire Wire(0);
+TwoWire Wire1(1);
+
+bool TwoWire::begin(int /*sda*/, int /*scl*/, uint32_t frequency) {
+  if (frequency != 0) {
+    bus.setClock(frequency);
+  }
+  return true;
+}
+
+bool TwoWire::setClock(uint32_t frequency) {
+  bus.setClock(frequency);
+  return true;
+}
+
+void TwoWire::beginTransmission(uint8_t address) {
+  txAddress = address;
+  txLength = 0;
+  txOverflow = false;
+}
+
+size_t TwoWire::write(uint8_t data) {
+  if (txLength == I2C_BUFFER_LENGTH) {
+    txOverflow = true;
+    return 0;
+  }
+  txBuffer[txLength++] = data;
+  return 1;
+}
+
+size_t TwoWire::write(const uint8_t* data, size_t len) {
+  size_t n = 0;
+  while (n < len && write(data[n])) {
+    n++;
+  }
+  return n;
+}
+
+// Error codes follow the ESP32 core: 1 data too long, 2 address NACK,
+// 3 data NACK
+uint8_t TwoWire::endTransmission(bool sendStop) {
+  if (txOverflow) {
+    return 1;
+  }
+  return bus.write(txAddress, txBuffer, txLength, sendStop);
+}
+
+size_t TwoWire::requestFrom(uint8_t address, size_t len, bool sendStop) {
+  rxIndex = 0;
+  rxLength = 0;
+  if (len > I2C_BUFFER_LENGTH) {
+    len = I2C_BUFFER_LENGTH;
+  }
+  rxLength = bus.read(address, rxBuffer, len, sendStop);
+  return rxLength;
+}
+
+int TwoWire::read() {
+  if (rxIndex >= rxLength) {
+    return -1;
+  }
+  return rxBuffer[rxIndex++];
+}
@@ -0,0 +1,46 @@
+// Wire.h -- host stand-in for the Arduino TwoWire API, backed by SimI2cBus
+#ifndef HOST_WIRE_H
+#define HOST_WIRE_H
+
+#include "Arduino.h"
+#include "sim_bus.h"
+
+#define I2C_BUFFER_LENGTH 128
+
+class TwoWire {
+ public:
+  explicit TwoWire(uint8_t busNum) : busNum(busNum) {}
+
+  bool begin(int sda = -1, int scl = -1, uint32_t frequency = 0);
+  bool setClock(uint32_t frequency);
+  uint32_t getClock() const { return bus.getClock(); }
+
+  void beginTransmission(uint8_t address);
+  size_t write(uint8_t data);
+  size_t write(const uint8_t* data, size_t len);
+  uint8_t endTransmission(bool sendStop = true);
+
+  size_t requestFrom(uint8_t address, size_t len, bool sendStop = true);
+  int available() const { return (int)(rxLength - rxIndex); }
+  int read();
+
+  SimI2cBus& simBus() { return bus; }
+
+ private:
+  const uint8_t busNum;
+  SimI2cBus bus;
+
+  uint8_t txAddress = 0;
+  uint8_t txBuffer[I2C_BUFFER_LENGTH];
+  size_t txLength = 0;
+  bool txOverflow = false;
+
+  uint8_t rxBuffer[I2C_BUFFER_LENGTH];
+  size_t rxLength = 0;
+  size_t rxIndex = 0;
+};
+
+extern TwoWire Wire;
+extern TwoWire Wire1;
+
+#endif  // HOST_WIRE_H
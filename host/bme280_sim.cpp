@@ -0,0 +1,166 @@
+#include "bme280_sim.h"
+
+#include "Arduino.h"
+
+static constexpr uint8_t REG_ID = 0xD0;
+static constexpr uint8_t REG_RESET = 0xE0;
+static constexpr uint8_t REG_CTRL_HUM = 0xF2;
+static constexpr uint8_t REG_STATUS = 0xF3;
+static constexpr uint8_t REG_CTRL_MEAS = 0xF4;
+static constexpr uint8_t REG_CONFIG = 0xF5;
+static constexpr uint8_t REG_DATA = 0xF7;
+
+static constexpr uint64_t NVM_COPY_MICROS = 2000;
+
+// Trim values of the Bosch datasheet / reference driver sample part
+static const uint8_t TRIM_BLOCK1[] = {
+    0x70, 0x6B, 0x43, 0x67, 0x18, 0xFC, 0x7D, 0x8E, 0x43, 0xD6, 0xD0, 0x0B, 0x27,
+    0x0B, 0x8C, 0x00, 0xF9, 0xFF, 0x8C, 0x3C, 0xF8, 0xC6, 0x70, 0x17, 0x00, 0x4B};
+static const uint8_t TRIM_BLOCK2[] = {0x6E, 0x01, 0x00, 0x13, 0x27, 0x03, 0x1E};
+
+// Oversampling register value to number of samples (0 = skipped)
+static uint32_t oversampling(uint8_t osrs) {
+  static const uint8_t samples[] = {0, 1, 2, 4, 8, 16, 16, 16};
+  return samples[osrs & 0x07];
+}
+
+static_assert(sizeof(TRIM_BLOCK1) == Bme280Sim::TRIM_BLOCK1_LENGTH &&
+                  sizeof(TRIM_BLOCK2) == Bme280Sim::TRIM_BLOCK2_LENGTH,
+              "trim block sizes");
+
+Bme280Sim::Bme280Sim() {
+  memcpy(trimBlock1, TRIM_BLOCK1, sizeof(trimBlock1));
+  memcpy(trimBlock2, TRIM_BLOCK2, sizeof(trimBlock2));
+  reset();
+}
+
+void Bme280Sim::setTrim(const uint8_t* block1, const uint8_t* block2) {
+  memcpy(trimBlock1, block1, sizeof(trimBlock1));
+  memcpy(trimBlock2, block2, sizeof(trimBlock2));
+  memcpy(&regs[0x88], trimBlock1, sizeof(trimBlock1));
+  memcpy(&regs[0xE1], trimBlock2, sizeof(trimBlock2));
+}
+
+void Bme280Sim::reset() {
+  memset(regs, 0, sizeof(regs));
+  memcpy(&regs[0x88], trimBlock1, sizeof(trimBlock1));
+  memcpy(&regs[0xE1], trimBlock2, sizeof(trimBlock2));
+  regs[REG_ID] = CHIP_ID;
+
+  dataT = dataP = 0x80000;
+  dataH = 0x8000;
+  osrsH = 0;
+  mode = 0;
+  pending = false;
+  resetAt = host::nowMicros();
+}
+
+// Maximum measurement time from the datasheet, section 9.1
+uint32_t Bme280Sim::measurementMicros() const {
+  const uint32_t osT = oversampling(regs[REG_CTRL_MEAS] >> 5);
+  const uint32_t osP = oversampling(regs[REG_CTRL_MEAS] >> 2);
+  const uint32_t osH = oversampling(osrsH);
+
+  uint32_t us = 1250 + 2300 * osT;
+  if (osP) us += 2300 * osP + 575;
+  if (osH) us += 2300 * osH + 575;
+  return us;
+}
+
+uint32_t Bme280Sim::standbyMicros() const {
+  static const uint32_t standby[] = {500,    62500,  125000, 250000,
+                                     500000, 1000000, 10000, 20000};
+  return standby[regs[REG_CONFIG] >> 5];
+}
+
+void Bme280Sim::latchData() {
+  dataT = oversampling(regs[REG_CTRL_MEAS] >> 5) ? rawT : 0x80000;
+  dataP = oversampling(regs[REG_CTRL_MEAS] >> 2) ? rawP : 0x80000;
+  dataH = oversampling(osrsH) ? rawH : 0x8000;
+}
+
+// Finishes conversions that are due at the current simulated time
+void Bme280Sim::update() {
+  const uint64_t elapsed = host::nowMicros() - measureStart;
+
+  if (mode == 1 || mode == 2) {
+    if (pending && elapsed >= measurementMicros()) {
+      latchData();
+      conversionCount++;
+      pending = false;
+      mode = 0;
+      regs[REG_CTRL_MEAS] &= ~0x03;
+    }
+  } else if (mode == 3 && elapsed >= measurementMicros()) {
+    // Conversions end at measurementMicros() + k * period
+    const uint64_t period = measurementMicros() + standbyMicros();
+    const uint32_t completed = (elapsed - measurementMicros()) / period + 1;
+    if (completed != normalConversions) {
+      latchData();
+      conversionCount += completed - normalConversions;
+      normalConversions = completed;
+    }
+  }
+}
+
+uint8_t Bme280Sim::readRegister(uint8_t reg) {
+  update();
+
+  switch (reg) {
+    case REG_STATUS: {
+      const uint64_t now = host::nowMicros();
+      uint8_t status = 0;
+      if (now < resetAt + NVM_COPY_MICROS) {
+        status |= 0x01;
+      }
+      if (mode == 1 || mode == 2) {
+        status |= pending ? 0x08 : 0;
+      } else if (mode == 3) {
+        // Measuring during the conversion phase of every period
+        const uint64_t period = measurementMicros() + standbyMicros();
+        status |= (now - measureStart) % period < measurementMicros() ? 0x08 : 0;
+      }
+      return status;
+    }
+    case REG_DATA + 0: return (dataP >> 12) & 0xFF;
+    case REG_DATA + 1: return (dataP >> 4) & 0xFF;
+    case REG_DATA + 2: return (dataP << 4) & 0xF0;
+    case REG_DATA + 3: return (dataT >> 12) & 0xFF;
+    case REG_DATA + 4: return (dataT >> 4) & 0xFF;
+    case REG_DATA + 5: return (dataT << 4) & 0xF0;
+    case REG_DATA + 6: return (dataH >> 8) & 0xFF;
+    case REG_DATA + 7: return dataH & 0xFF;
+    default: return regs[reg];
+  }
+}
+
+void Bme280Sim::writeRegister(uint8_t reg, uint8_t value) {
+  update();
+
+  switch (reg) {
+    case REG_RESET:
+      if (value == 0xB6) {
+        reset();
+      }
+      break;
+    case REG_CTRL_HUM:
+      regs[reg] = value & 0x07;
+      break;
+    case REG_CTRL_MEAS:
+      regs[reg] = value;
+      osrsH = regs[REG_CTRL_HUM];
+      mode = value & 0x03;
+      if (mode != 0) {
+        measureStart = host::nowMicros();
+        pending = true;
+        normalConversions = 0;
+      }
+      break;
+    case REG_CONFIG:
+      regs[reg] = value & 0xFD;
+      break;
+    default:
+      // Trim, ID and data registers are read-only
+      break;
+  }
+}
@@ -0,0 +1,64 @@
+// bme280_sim.h -- register-level BME280 model for host builds
+#ifndef HOST_BME280_SIM_H
+#define HOST_BME280_SIM_H
+
+#include "sim_bus.h"
+
+class Bme280Sim : public SimRegisterDevice {
+ public:
+  static constexpr uint8_t CHIP_ID = 0x60;
+  // Trim blocks 0x88..0xA1 and 0xE1..0xE7
+  static constexpr size_t TRIM_BLOCK1_LENGTH = 26;
+  static constexpr size_t TRIM_BLOCK2_LENGTH = 7;
+
+  Bme280Sim();
+
+  // Replaces the NVM trim values, e.g. to model a different part with the
+  // same chip ID. They survive soft resets like the real NVM.
+  void setTrim(const uint8_t* block1, const uint8_t* block2);
+
+  // Uncompensated ADC values returned by the next conversions (20/20/16 bit)
+  void setRawSample(int32_t adcT, int32_t adcP, int32_t adcH) {
+    rawT = adcT;
+    rawP = adcP;
+    rawH = adcH;
+  }
+
+  // Number of completed conversions, forced and normal mode
+  uint32_t conversions() const { return conversionCount; }
+
+  // Conversion time for the current ctrl_hum/ctrl_meas settings
+  uint32_t measurementMicros() const;
+
+ protected:
+  uint8_t readRegister(uint8_t reg) override;
+  void writeRegister(uint8_t reg, uint8_t value) override;
+
+ private:
+  uint8_t trimBlock1[TRIM_BLOCK1_LENGTH];
+  uint8_t trimBlock2[TRIM_BLOCK2_LENGTH];
+
+  int32_t rawT = 0x80000;
+  int32_t rawP = 0x80000;
+  int32_t rawH = 0x8000;
+
+  // Values of the last completed conversion, as shown in 0xF7..0xFE
+  int32_t dataT = 0x80000;
+  int32_t dataP = 0x80000;
+  int32_t dataH = 0x8000;
+
+  uint8_t osrsH = 0;  // ctrl_hum is latched on the next ctrl_meas write
+  uint64_t resetAt = 0;
+  uint64_t measureStart = 0;
+  uint8_t mode = 0;
+  bool pending = false;              // forced conversion in progress
+  uint32_t normalConversions = 0;    // conversions since normal mode started
+  uint32_t conversionCount = 0;
+
+  void reset();
+  void update();
+  uint32_t standbyMicros() const;
+  void latchData();
+};
+
+#endif  // HOST_BME280_SIM_H
@@ -0,0 +1,62 @@
+#include "file_page_store.h"
+
+FilePageStore::~FilePageStore() {
+  if (file != nullptr) {
+    fclose(file);
+  }
+}
+
+bool FilePageStore::begin(const char* path, size_t pageCount) {
+  file = fopen(path, "r+b");
+  if (file == nullptr) {
+    file = fopen(path, "w+b");
+  }
+  if (file == nullptr) {
+    return false;
+  }
+  pages = pageCount;
+
+  // Extend to the full size with erased pages
+  fseek(file, 0, SEEK_END);
+  const long size = ftell(file);
+  for (size_t page = size / PAGE_SIZE; page < pages; page++) {
+    erase(page);
+  }
+  eraseCount = 0;
+  return true;
+}
+
+bool FilePageStore::erase(size_t page) {
+  if (page >= pages) {
+    return false;
+  }
+  uint8_t blank[PAGE_SIZE];
+  memset(blank, 0xFF, sizeof(blank));
+  eraseCount++;
+  return fseek(file, (long)(page * PAGE_SIZE), SEEK_SET) == 0 &&
+         fwrite(blank, 1, PAGE_SIZE, file) == PAGE_SIZE;
+}
+
+bool FilePageStore::program(size_t page, size_t offset, const void* data,
+                            size_t len) {
+  if (page >= pages || offset + len > PAGE_SIZE) {
+    return false;
+  }
+  uint8_t current[PAGE_SIZE];
+  if (!read(page, offset, current, len)) {
+    return false;
+  }
+  for (size_t i = 0; i < len; i++) {
+    current[i] &= ((const uint8_t*)data)[i];
+  }
+  return fseek(file, (long)(page * PAGE_SIZE + offset), SEEK_SET) == 0 &&
+         fwrite(current, 1, len, file) == len;
+}
+
+bool FilePageStore::read(size_t page, size_t offset, void* data, size_t len) {
+  if (page >= pages || offset + len > PAGE_SIZE) {
+    return false;
+  }
+  return fseek(file, (long)(page * PAGE_SIZE + offset), SEEK_SET) == 0 &&
+         fread(data, 1, len, file) == len;
+}
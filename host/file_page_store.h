@@ -0,0 +1,30 @@
+// file_page_store.h -- file-backed FlashPageStore for host builds. Keeps
+// NOR semantics: erase sets a page to 0xFF, program only clears bits.
+#ifndef HOST_FILE_PAGE_STORE_H
+#define HOST_FILE_PAGE_STORE_H
+
+#include <stdio.h>
+
+#include "history_store.h"
+
+class FilePageStore : public FlashPageStore {
+ public:
+  ~FilePageStore();
+
+  // Opens or creates path with `pages` pages; new space reads as erased
+  bool begin(const char* path, size_t pages);
+
+  size_t pageCount() const override { return pages; }
+  bool erase(size_t page) override;
+  bool program(size_t page, size_t offset, const void* data, size_t len) override;
+  bool read(size_t page, size_t offset, void* data, size_t len) override;
+
+  uint32_t erases() const { return eraseCount; }
+
+ private:
+  FILE* file = nullptr;
+  size_t pages = 0;
+  uint32_t eraseCount = 0;
+};
+
+#endif  // HOST_FILE_PAGE_STORE_H
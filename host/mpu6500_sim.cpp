@@ -0,0 +1,179 @@
+#include "mpu6500_sim.h"
+
+#include <string.h>
+
+#include "Arduino.h"
+
+static constexpr uint8_t REG_SMPLRT_DIV = 0x19;
+static constexpr uint8_t REG_CONFIG = 0x1A;
+static constexpr uint8_t REG_FIFO_EN = 0x23;
+static constexpr uint8_t REG_INT_STATUS = 0x3A;
+static constexpr uint8_t REG_ACCEL_XOUT_H = 0x3B;
+static constexpr uint8_t REG_TEMP_OUT_H = 0x41;
+static constexpr uint8_t REG_GYRO_XOUT_H = 0x43;
+static constexpr uint8_t REG_USER_CTRL = 0x6A;
+static constexpr uint8_t REG_PWR_MGMT_1 = 0x6B;
+static constexpr uint8_t REG_FIFO_COUNTH = 0x72;
+static constexpr uint8_t REG_FIFO_COUNTL = 0x73;
+static constexpr uint8_t REG_FIFO_R_W = 0x74;
+static constexpr uint8_t REG_WHO_AM_I = 0x75;
+
+static constexpr uint8_t CONFIG_FIFO_MODE = 0x40;
+static constexpr uint8_t USER_CTRL_FIFO_EN = 0x40;
+static constexpr uint8_t USER_CTRL_FIFO_RST = 0x04;
+static constexpr uint8_t INT_STATUS_FIFO_OFLOW = 0x10;
+
+void Mpu6500Sim::reset() {
+  memset(regs, 0, sizeof(regs));
+  regs[REG_PWR_MGMT_1] = 0x01;
+  regs[REG_WHO_AM_I] = WHO_AM_I;
+  fifoStart = 0;
+  fifoLength = 0;
+  fifoFrameCount = 0;
+  nextSampleAt = host::nowMicros();
+}
+
+bool Mpu6500Sim::resetting() const {
+  return host::nowMicros() < resetDoneAt;
+}
+
+void Mpu6500Sim::putWord(uint8_t reg, int16_t value) {
+  regs[reg] = (uint16_t)value >> 8;
+  regs[reg + 1] = value & 0xFF;
+}
+
+void Mpu6500Sim::setSample(const int16_t accl[3], int16_t temp,
+                           const int16_t gyro[3]) {
+  update();
+  for (int i = 0; i < 3; i++) {
+    putWord(REG_ACCEL_XOUT_H + 2 * i, accl[i]);
+    putWord(REG_GYRO_XOUT_H + 2 * i, gyro[i]);
+  }
+  putWord(REG_TEMP_OUT_H, temp);
+}
+
+// 8 kHz internal rate with the DLPF bypassed (DLPF_CFG 0 or 7), else 1 kHz
+uint32_t Mpu6500Sim::samplePeriodMicros() const {
+  const uint8_t dlpf = regs[REG_CONFIG] & 0x07;
+  const uint32_t base = (dlpf == 0 || dlpf == 7) ? 125 : 1000;
+  return base * (1 + regs[REG_SMPLRT_DIV]);
+}
+
+bool Mpu6500Sim::fifoActive() const {
+  return (regs[REG_USER_CTRL] & USER_CTRL_FIFO_EN) && regs[REG_FIFO_EN] != 0;
+}
+
+void Mpu6500Sim::pushFifo(uint8_t value) {
+  if (fifoLength == FIFO_SIZE) {
+    regs[REG_INT_STATUS] |= INT_STATUS_FIFO_OFLOW;
+    if (regs[REG_CONFIG] & CONFIG_FIFO_MODE) {
+      return;
+    }
+    // Default mode overwrites the oldest byte
+    fifoStart = (fifoStart + 1) % FIFO_SIZE;
+    fifoLength--;
+  }
+  fifo[(fifoStart + fifoLength) % FIFO_SIZE] = value;
+  fifoLength++;
+}
+
+// Writes the samples that are due at the current simulated time
+void Mpu6500Sim::update() {
+  const uint64_t now = host::nowMicros();
+  const uint32_t period = samplePeriodMicros();
+  if (!fifoActive()) {
+    nextSampleAt = now + period;
+    return;
+  }
+
+  // More than a FIFO's worth of samples only overflows again
+  const uint64_t due = now >= nextSampleAt ? (now - nextSampleAt) / period + 1 : 0;
+  const uint64_t maxWrites = FIFO_SIZE / 2 + 1;
+  if (due > maxWrites) {
+    fifoFrameCount += due - maxWrites;
+    nextSampleAt += (due - maxWrites) * period;
+  }
+
+  const uint8_t enabled = regs[REG_FIFO_EN];
+  while (nextSampleAt <= now) {
+    // Datasheet order: accel, temperature, gyro X, Y, Z
+    if (enabled & 0x08) {
+      for (int i = 0; i < 6; i++) pushFifo(regs[REG_ACCEL_XOUT_H + i]);
+    }
+    if (enabled & 0x80) {
+      for (int i = 0; i < 2; i++) pushFifo(regs[REG_TEMP_OUT_H + i]);
+    }
+    for (int axis = 0; axis < 3; axis++) {
+      if (enabled & (0x40 >> axis)) {
+        pushFifo(regs[REG_GYRO_XOUT_H + 2 * axis]);
+        pushFifo(regs[REG_GYRO_XOUT_H + 2 * axis + 1]);
+      }
+    }
+    fifoFrameCount++;
+    nextSampleAt += period;
+  }
+}
+
+uint8_t Mpu6500Sim::readRegister(uint8_t reg) {
+  update();
+  if (resetting()) {
+    return reg == REG_PWR_MGMT_1 ? 0x80 : 0x00;
+  }
+  switch (reg) {
+    case REG_FIFO_COUNTH:
+      return fifoLength >> 8;
+    case REG_FIFO_COUNTL:
+      return fifoLength & 0xFF;
+    case REG_FIFO_R_W: {
+      if (fifoLength == 0) {
+        return 0xFF;
+      }
+      const uint8_t value = fifo[fifoStart];
+      fifoStart = (fifoStart + 1) % FIFO_SIZE;
+      fifoLength--;
+      return value;
+    }
+    case REG_INT_STATUS: {
+      // Cleared by reading
+      const uint8_t value = regs[REG_INT_STATUS];
+      regs[REG_INT_STATUS] = 0;
+      return value;
+    }
+    default:
+      return regs[reg];
+  }
+}
+
+// Reading FIFO_R_W does not advance the register pointer
+uint8_t Mpu6500Sim::nextRegister(uint8_t reg) {
+  return reg == REG_FIFO_R_W ? reg : reg + 1;
+}
+
+void Mpu6500Sim::writeRegister(uint8_t reg, uint8_t value) {
+  update();
+  if (resetting()) {
+    return;
+  }
+  if (reg == REG_PWR_MGMT_1 && (value & 0x80)) {
+    reset();
+    resetDoneAt = host::nowMicros() + RESET_MICROS;
+    return;
+  }
+  // Sensor data, FIFO count and WHO_AM_I are read-only
+  if ((reg >= REG_ACCEL_XOUT_H && reg <= REG_GYRO_XOUT_H + 5) ||
+      reg == REG_FIFO_COUNTH || reg == REG_FIFO_COUNTL ||
+      reg == REG_WHO_AM_I) {
+    return;
+  }
+  if (reg == REG_USER_CTRL && (value & USER_CTRL_FIFO_RST)) {
+    // Self-clearing
+    fifoStart = 0;
+    fifoLength = 0;
+    value &= ~USER_CTRL_FIFO_RST;
+  }
+  const bool wasActive = fifoActive();
+  regs[reg] = value;
+  if (!wasActive && fifoActive()) {
+    nextSampleAt = host::nowMicros() + samplePeriodMicros();
+  }
+}
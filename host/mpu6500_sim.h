@@ -0,0 +1,46 @@
+// mpu6500_sim.h -- register-level MPU-6500 model for host builds
+#ifndef HOST_MPU6500_SIM_H
+#define HOST_MPU6500_SIM_H
+
+#include "sim_bus.h"
+
+class Mpu6500Sim : public SimRegisterDevice {
+ public:
+  static constexpr uint8_t WHO_AM_I = 0x70;
+  static constexpr size_t FIFO_SIZE = 512;
+  // A soft reset takes this long; until then DEVICE_RESET reads back set
+  // and writes are ignored
+  static constexpr uint32_t RESET_MICROS = 20000;
+
+  Mpu6500Sim() { reset(); }
+
+  // Raw values shown in the 0x3B..0x48 data block
+  void setSample(const int16_t accl[3], int16_t temp, const int16_t gyro[3]);
+
+  // Samples written to the FIFO since reset, including ones that did not fit
+  uint32_t fifoFrames() const { return fifoFrameCount; }
+
+ protected:
+  uint8_t readRegister(uint8_t reg) override;
+  void writeRegister(uint8_t reg, uint8_t value) override;
+  uint8_t nextRegister(uint8_t reg) override;
+
+ private:
+  // The FIFO fills at the sample rate on the simulated clock
+  uint8_t fifo[FIFO_SIZE];
+  size_t fifoStart = 0;
+  size_t fifoLength = 0;
+  uint64_t nextSampleAt = 0;
+  uint32_t fifoFrameCount = 0;
+  uint64_t resetDoneAt = 0;
+
+  bool resetting() const;
+  void reset();
+  void putWord(uint8_t reg, int16_t value);
+  uint32_t samplePeriodMicros() const;
+  bool fifoActive() const;
+  void update();
+  void pushFifo(uint8_t value);
+};
+
+#endif  // HOST_MPU6500_SIM_H
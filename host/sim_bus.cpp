@@ -0,0 +1,111 @@
+#include "sim_bus.h"
+
+#include "Arduino.h"
+
+void SimRegisterDevice::onWrite(const uint8_t* data, size_t len) {
+  if (len == 0) {
+    return;
+  }
+  pointer = data[0];
+  for (size_t i = 1; i < len; i++) {
+    writeRegister(pointer++, data[i]);
+  }
+}
+
+void SimRegisterDevice::onRead(uint8_t* data, size_t len) {
+  for (size_t i = 0; i < len; i++) {
+    data[i] = readRegister(pointer);
+    pointer = nextRegister(pointer);
+  }
+}
+
+bool SimI2cBus::attach(uint8_t address, SimI2cDevice* device) {
+  for (size_t i = 0; i < slotCount; i++) {
+    if (slots[i].address == address) {
+      slots[i].device = device;
+      return true;
+    }
+  }
+  if (slotCount == MAX_DEVICES) {
+    return false;
+  }
+  slots[slotCount++] = {address, device};
+  return true;
+}
+
+void SimI2cBus::detach(uint8_t address) {
+  for (size_t i = 0; i < slotCount; i++) {
+    if (slots[i].address == address) {
+      slots[i] = slots[--slotCount];
+      return;
+    }
+  }
+}
+
+SimI2cDevice* SimI2cBus::find(uint8_t address) const {
+  for (size_t i = 0; i < slotCount; i++) {
+    if (slots[i].address == address) {
+      return slots[i].device;
+    }
+  }
+  for (size_t i = 0; i < slotCount; i++) {
+    SimI2cDevice* routed = slots[i].device->route(address);
+    if (routed != nullptr) {
+      return routed;
+    }
+  }
+  return nullptr;
+}
+
+// (Repeated) START + address byte + payload, 9 clocks per byte, plus STOP
+void SimI2cBus::accountTransfer(size_t bytes, bool stop) {
+  if (!inTransaction) {
+    busStats.transactions++;
+  }
+  inTransaction = !stop;
+
+  const uint64_t clocks = 1 + 9 * (bytes + 1) + (stop ? 1 : 0);
+  const uint64_t us = (clocks * 1000000 + clockHz - 1) / clockHz;
+  busStats.busMicros += us;
+  host::advanceMicros(us);
+}
+
+uint8_t SimI2cBus::write(uint8_t address, const uint8_t* data, size_t len,
+                         bool stop) {
+  SimI2cDevice* device = find(address);
+  if (device == nullptr) {
+    accountTransfer(0, true);
+    busStats.nacks++;
+    return 2;
+  }
+  if (nackWrite && len != 0) {
+    // The master stops after the first refused byte
+    nackWrite = false;
+    accountTransfer(1, true);
+    busStats.nacks++;
+    return 3;
+  }
+
+  accountTransfer(len, stop);
+  busStats.bytesWritten += len;
+  device->onWrite(data, len);
+  return 0;
+}
+
+size_t SimI2cBus::read(uint8_t address, uint8_t* data, size_t len, bool stop) {
+  SimI2cDevice* device = find(address);
+  if (device == nullptr) {
+    accountTransfer(0, true);
+    busStats.nacks++;
+    return 0;
+  }
+  if (len > readLimit) {
+    len = readLimit;
+  }
+  readLimit = SIZE_MAX;
+
+  accountTransfer(len, stop);
+  busStats.bytesRead += len;
+  device->onRead(data, len);
+  return len;
+}
@@ -0,0 +1,101 @@
+// sim_bus.h -- simulated I2C bus for host builds. Devices are register-level
+// models attached at an address; the bus counts transactions and bytes and
+// advances the simulated clock by the time the transfer would take on the
+// wire at the configured SCL frequency.
+#ifndef HOST_SIM_BUS_H
+#define HOST_SIM_BUS_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+class SimI2cDevice {
+ public:
+  virtual ~SimI2cDevice() {}
+
+  // Bytes of a write transfer; the first byte is the register pointer
+  virtual void onWrite(const uint8_t* data, size_t len) = 0;
+
+  // Fills `len` bytes for a read transfer
+  virtual void onRead(uint8_t* data, size_t len) = 0;
+
+  // Device at `address` reached through this one, such as on an open
+  // channel of a mux; asked when nothing on the bus itself answers
+  virtual SimI2cDevice* route(uint8_t address) {
+    (void)address;
+    return nullptr;
+  }
+};
+
+// Device with a 256-byte register file and an auto-incrementing pointer
+class SimRegisterDevice : public SimI2cDevice {
+ public:
+  void onWrite(const uint8_t* data, size_t len) override;
+  void onRead(uint8_t* data, size_t len) override;
+
+  uint8_t peek(uint8_t reg) const { return regs[reg]; }
+  void poke(uint8_t reg, uint8_t value) { regs[reg] = value; }
+
+ protected:
+  uint8_t regs[256] = {0};
+  uint8_t pointer = 0;
+
+  // Hooks for registers with side effects
+  virtual uint8_t readRegister(uint8_t reg) { return regs[reg]; }
+  virtual void writeRegister(uint8_t reg, uint8_t value) { regs[reg] = value; }
+
+  // Register the pointer moves to after `reg` has been read
+  virtual uint8_t nextRegister(uint8_t reg) { return reg + 1; }
+};
+
+class SimI2cBus {
+ public:
+  struct Stats {
+    uint32_t transactions;  // START ... STOP sequences
+    uint32_t nacks;         // transfers to an address nobody answered
+    uint64_t bytesWritten;  // payload bytes, excluding address bytes
+    uint64_t bytesRead;
+    uint64_t busMicros;     // time the bus was busy
+  };
+
+  static constexpr size_t MAX_DEVICES = 16;
+
+  bool attach(uint8_t address, SimI2cDevice* device);
+  void detach(uint8_t address);
+  SimI2cDevice* find(uint8_t address) const;
+
+  void setClock(uint32_t hz) { clockHz = hz; }
+  uint32_t getClock() const { return clockHz; }
+
+  const Stats& stats() const { return busStats; }
+  void resetStats() { busStats = Stats{}; }
+
+  // Faults for tests, each applies to the next transfer only: the device
+  // stops sending after `bytes` bytes of a read, or NACKs the first data
+  // byte of a write
+  void truncateNextRead(size_t bytes) { readLimit = bytes; }
+  void nackNextWrite() { nackWrite = true; }
+
+  // Called by TwoWire. write() returns the ESP32 endTransmission() code
+  // (0 ok, 2 address NACK, 3 data NACK); read() the bytes received, 0 if
+  // the address was not acknowledged
+  uint8_t write(uint8_t address, const uint8_t* data, size_t len, bool stop);
+  size_t read(uint8_t address, uint8_t* data, size_t len, bool stop);
+
+ private:
+  struct Slot {
+    uint8_t address;
+    SimI2cDevice* device;
+  };
+
+  Slot slots[MAX_DEVICES] = {};
+  size_t slotCount = 0;
+  uint32_t clockHz = 100000;
+  bool inTransaction = false;
+  size_t readLimit = SIZE_MAX;
+  bool nackWrite = false;
+  Stats busStats = {};
+
+  void accountTransfer(size_t bytes, bool stop);
+};
+
+#endif  // HOST_SIM_BUS_H
@@ -0,0 +1,114 @@
+#include "ssd1306_sim.h"
+
+#include <string.h>
+
+void Ssd1306Sim::reset() {
+  memset(gddram, 0, sizeof(gddram));
+  displayOn = false;
+  addressingMode = 2;
+  columnStart = column = 0;
+  columnEnd = WIDTH - 1;
+  pageStart = page = 0;
+  pageEnd = PAGES - 1;
+  argsPending = 0;
+  argCount = 0;
+  commandCount = 0;
+  dataCount = 0;
+}
+
+// Control byte: bit 7 (Co) means one byte follows and then another control
+// byte, bit 6 (D/C#) selects data or command for the following bytes
+void Ssd1306Sim::onWrite(const uint8_t* data, size_t len) {
+  size_t i = 0;
+  while (i < len) {
+    const uint8_t control = data[i++];
+    const bool isData = control & 0x40;
+    const size_t end = (control & 0x80) ? (i + 1 < len ? i + 1 : len) : len;
+    for (; i < end; i++) {
+      if (isData) {
+        dataByte(data[i]);
+      } else {
+        commandByte(data[i]);
+      }
+    }
+  }
+}
+
+// Status byte reads as 0: display RAM cannot be read over I2C
+void Ssd1306Sim::onRead(uint8_t* data, size_t len) { memset(data, 0, len); }
+
+static uint8_t argumentCount(uint8_t command) {
+  switch (command) {
+    case 0x20: case 0x81: case 0x8D: case 0xA8: case 0xD3:
+    case 0xD5: case 0xD9: case 0xDA: case 0xDB:
+      return 1;
+    case 0x21: case 0x22: case 0xA3:
+      return 2;
+    case 0x29: case 0x2A:
+      return 5;
+    case 0x26: case 0x27:
+      return 6;
+    default:
+      return 0;
+  }
+}
+
+void Ssd1306Sim::commandByte(uint8_t value) {
+  commandCount++;
+  if (argsPending > 0) {
+    args[argCount++] = value;
+    if (--argsPending == 0) {
+      execute();
+    }
+    return;
+  }
+  command = value;
+  argCount = 0;
+  argsPending = argumentCount(value);
+  if (argsPending == 0) {
+    execute();
+  }
+}
+
+void Ssd1306Sim::execute() {
+  if (command <= 0x0F) {
+    column = (column & 0xF0) | command;
+  } else if (command <= 0x1F) {
+    column = (column & 0x0F) | ((command & 0x07) << 4);
+  } else if (command == 0x20) {
+    addressingMode = args[0] & 0x03;
+  } else if (command == 0x21) {
+    columnStart = column = args[0] & 0x7F;
+    columnEnd = args[1] & 0x7F;
+  } else if (command == 0x22) {
+    pageStart = page = args[0] & 0x07;
+    pageEnd = args[1] & 0x07;
+  } else if (command >= 0xB0 && command <= 0xB7) {
+    page = command & 0x07;
+  } else if (command == 0xAE || command == 0xAF) {
+    displayOn = command == 0xAF;
+  }
+}
+
+void Ssd1306Sim::dataByte(uint8_t value) {
+  dataCount++;
+  gddram[page * WIDTH + column] = value;
+
+  switch (addressingMode) {
+    case 0:
+      if (column++ >= columnEnd) {
+        column = columnStart;
+        page = page >= pageEnd ? pageStart : page + 1;
+      }
+      break;
+    case 1:
+      if (page++ >= pageEnd) {
+        page = pageStart;
+        column = column >= columnEnd ? columnStart : column + 1;
+      }
+      break;
+    default:
+      column = (column + 1) & 0x7F;
+      break;
+  }
+}
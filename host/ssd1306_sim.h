@@ -0,0 +1,49 @@
+// ssd1306_sim.h -- SSD1306 controller model for host builds: the I2C
+// control byte, the addressing commands and the display RAM, so partial
+// updates can be checked against the framebuffer they came from
+#ifndef HOST_SSD1306_SIM_H
+#define HOST_SSD1306_SIM_H
+
+#include "sim_bus.h"
+
+class Ssd1306Sim : public SimI2cDevice {
+ public:
+  static constexpr uint8_t WIDTH = 128;
+  static constexpr uint8_t PAGES = 8;
+
+  Ssd1306Sim() { reset(); }
+
+  void onWrite(const uint8_t* data, size_t len) override;
+  void onRead(uint8_t* data, size_t len) override;
+
+  // Display RAM, page-major like the Adafruit buffer
+  const uint8_t* ram() const { return gddram; }
+
+  uint32_t commandBytes() const { return commandCount; }
+  uint32_t dataBytes() const { return dataCount; }
+  bool isOn() const { return displayOn; }
+
+  void reset();
+
+ private:
+  uint8_t gddram[WIDTH * PAGES];
+  bool displayOn;
+  uint8_t addressingMode;  // 0 horizontal, 1 vertical, 2 page
+  uint8_t columnStart, columnEnd, column;
+  uint8_t pageStart, pageEnd, page;
+
+  // Command being assembled across bytes and transactions
+  uint8_t command;
+  uint8_t argsPending;
+  uint8_t args[6];
+  uint8_t argCount;
+
+  uint32_t commandCount;
+  uint32_t dataCount;
+
+  void commandByte(uint8_t value);
+  void execute();
+  void dataByte(uint8_t value);
+};
+
+#endif  // HOST_SSD1306_SIM_H
@@ -0,0 +1,280 @@
+#include "station_sim.h"
+
+#include <arpa/inet.h>
+#include <errno.h>
+#include <math.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <poll.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <time.h>
+#include <unistd.h>
+
+// Rows per chunk, as the firmware's ChunkedWriter flushes at 512 bytes
+static constexpr size_t CHUNK_BYTES = 512 - 160;
+
+StationSim::~StationSim() {
+  for (const auto& connection : connections) {
+    ::close(connection->fd);
+  }
+  for (const Station& station : stations) {
+    ::close(station.listenFd);
+  }
+}
+
+bool StationSim::begin(size_t count, uint16_t basePort) {
+  for (size_t i = 0; i < count; i++) {
+    Station station;
+    station.boot = nextBoot++;
+    station.listenFd = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (station.listenFd < 0) {
+      return false;
+    }
+    stations.push_back(station);
+
+    const int one = 1;
+    setsockopt(station.listenFd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+    sockaddr_in address = {};
+    address.sin_family = AF_INET;
+    address.sin_port = htons(basePort == 0 ? 0 : basePort + i);
+    address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    socklen_t length = sizeof(address);
+    if (bind(station.listenFd, (const sockaddr*)&address, sizeof(address)) != 0 ||
+        listen(station.listenFd, 64) != 0 ||
+        getsockname(station.listenFd, (sockaddr*)&address, &length) != 0) {
+      return false;
+    }
+    stations.back().port = ntohs(address.sin_port);
+  }
+  return true;
+}
+
+double StationSim::temperature(size_t station, uint32_t timestamp) {
+  return 15.0 + (timestamp % 1000) / 100.0 + station % 7;
+}
+
+double StationSim::pressure(uint32_t timestamp) {
+  return 990.0 + (timestamp % 3000) / 100.0;
+}
+
+double StationSim::humidity(uint32_t timestamp) {
+  return timestamp % 11 == 0 ? NAN : 30.0 + (timestamp % 4000) / 100.0;
+}
+
+void StationSim::addReading(size_t station, uint32_t timestamp) {
+  stations[station].timestamps.push_back(timestamp);
+}
+
+void StationSim::restart(size_t station, size_t keep) {
+  Station& restarted = stations[station];
+  if (keep < restarted.timestamps.size()) {
+    restarted.timestamps.erase(restarted.timestamps.begin(),
+                               restarted.timestamps.end() - keep);
+  }
+  restarted.boot = nextBoot++;
+  restarted.bootSequence = restarted.timestamps.size();
+  for (size_t i = 0; i < connections.size();) {
+    if (connections[i]->station == station) {
+      ::close(connections[i]->fd);
+      connections.erase(connections.begin() + i);
+    } else {
+      i++;
+    }
+  }
+}
+
+void StationSim::format(size_t station, uint32_t sequence, Fields& fields) const {
+  const Station& served = stations[station];
+  const uint32_t timestamp = served.timestamps[sequence];
+  if (served.uptime) {
+    snprintf(fields.timestamp, sizeof(fields.timestamp), "ms:%llu",
+             (unsigned long long)timestamp * 1000);
+  } else {
+    const time_t seconds = timestamp;
+    tm utc;
+    gmtime_r(&seconds, &utc);
+    strftime(fields.timestamp, sizeof(fields.timestamp), "%Y-%m-%d %H:%M:%S", &utc);
+  }
+  snprintf(fields.temperature, sizeof(fields.temperature), "%.2f",
+           temperature(station, timestamp));
+  snprintf(fields.pressure, sizeof(fields.pressure), "%.2f", pressure(timestamp));
+  if (isnan(humidity(timestamp))) {
+    strcpy(fields.humidity, "null");
+  } else {
+    snprintf(fields.humidity, sizeof(fields.humidity), "%.2f", humidity(timestamp));
+  }
+}
+
+static void appendChunk(std::string& out, std::string& chunk) {
+  if (chunk.empty()) {
+    return;
+  }
+  char size[24];
+  snprintf(size, sizeof(size), "%zX\r\n", chunk.size());
+  out += size;
+  out += chunk;
+  out += "\r\n";
+  chunk.clear();
+}
+
+void StationSim::answer(Connection& connection) {
+  Station& station = stations[connection.station];
+  const std::string line = connection.in.substr(0, connection.in.find("\r\n"));
+  const size_t pathEnd = line.find(' ', 4);
+  const std::string path = line.substr(4, pathEnd == std::string::npos ? pathEnd : pathEnd - 4);
+  const uint32_t end = station.timestamps.size();
+  const size_t query = path.find("since=");
+  uint32_t since = query == std::string::npos ? UINT32_MAX
+                                              : strtoul(path.c_str() + query + 6, nullptr, 10);
+  char text[320];
+
+  if (path.compare(0, 5, "/data") == 0) {
+    if (query == std::string::npos) {
+      since = 0;
+    }
+    snprintf(text, sizeof(text),
+             "HTTP/1.1 200 OK\r\nContent-Type: application/json\r\n"
+             "X-Boot-Id: %lu\r\nX-Boot-Sequence: %lu\r\n"
+             "Transfer-Encoding: chunked\r\nConnection: close\r\n\r\n",
+             (unsigned long)station.boot, (unsigned long)station.bootSequence);
+    connection.out = text;
+    std::string chunk = "[\n";
+    Fields fields;
+    bool first = true;
+    for (uint32_t sequence = since <= end ? since : 0; sequence < end; sequence++) {
+      format(connection.station, sequence, fields);
+      chunk.append(text, snprintf(text, sizeof(text),
+                                  "%s  {\n    \"seq\": %lu,\n    \"sensor\": \"bus0/0x77\",\n"
+                                  "    \"timestamp\": \"%s\",\n    \"temperature\": %s,\n"
+                                  "    \"pressure\": %s,\n    \"humidity\": %s\n  }",
+                                  first ? "" : ",\n",
+                                  (unsigned long)sequence, fields.timestamp, fields.temperature,
+                                  fields.pressure, fields.humidity));
+      first = false;
+      served++;
+      if (chunk.size() >= CHUNK_BYTES) {
+        appendChunk(connection.out, chunk);
+      }
+    }
+    chunk += "\n]";
+    appendChunk(connection.out, chunk);
+    connection.out += "0\r\n\r\n";
+    connection.closeAfter = true;
+  } else if (path.compare(0, 7, "/stream") == 0) {
+    if (query == std::string::npos) {
+      since = end;
+    }
+    connection.stream = true;
+    connection.next = since <= end ? since : 0;
+    connection.out =
+        "HTTP/1.1 200 OK\r\nContent-Type: text/event-stream\r\n"
+        "Cache-Control: no-cache\r\nConnection: close\r\n\r\n";
+    snprintf(text, sizeof(text),
+             "event: hello\ndata: {\"boot\":%lu,\"boot_seq\":%lu,\"first\":0,\"end\":%lu}\n\n",
+             (unsigned long)station.boot, (unsigned long)station.bootSequence,
+             (unsigned long)end);
+    connection.out += text;
+    appendEvents(connection);
+  } else {
+    connection.out = "HTTP/1.1 404 Not Found\r\nContent-Length: 0\r\nConnection: close\r\n\r\n";
+    connection.closeAfter = true;
+  }
+}
+
+void StationSim::appendEvents(Connection& connection) {
+  const Station& station = stations[connection.station];
+  char event[320];
+  Fields fields;
+  while (connection.next < station.timestamps.size()) {
+    const uint32_t sequence = connection.next++;
+    format(connection.station, sequence, fields);
+    connection.out.append(
+        event, snprintf(event, sizeof(event),
+                        "id: %lu\nevent: reading\ndata: {\"seq\":%lu,\"timestamp\":\"%s\","
+                        "\"temperature\":%s,\"pressure\":%s,\"humidity\":%s}\n\n",
+                        (unsigned long)sequence, (unsigned long)sequence, fields.timestamp,
+                        fields.temperature, fields.pressure, fields.humidity));
+    served++;
+  }
+}
+
+bool StationSim::flush(Connection& connection) {
+  while (connection.sent < connection.out.size()) {
+    const ssize_t sent = send(connection.fd, connection.out.data() + connection.sent,
+                              connection.out.size() - connection.sent, MSG_NOSIGNAL);
+    if (sent < 0) {
+      return errno == EAGAIN || errno == EWOULDBLOCK;
+    }
+    connection.sent += sent;
+  }
+  connection.out.clear();
+  connection.sent = 0;
+  return !connection.closeAfter;
+}
+
+void StationSim::poll(int timeoutMs) {
+  for (const auto& connection : connections) {
+    if (connection->stream && connection->out.empty()) {
+      appendEvents(*connection);
+    }
+  }
+
+  // Listeners first, then the connections in order
+  std::vector<pollfd> fds;
+  for (const Station& station : stations) {
+    fds.push_back({station.listenFd, POLLIN, 0});
+  }
+  for (const auto& connection : connections) {
+    fds.push_back({connection->fd, (short)(connection->out.empty() ? POLLIN : POLLIN | POLLOUT), 0});
+  }
+  if (::poll(fds.data(), fds.size(), timeoutMs) <= 0) {
+    return;
+  }
+
+  std::vector<std::unique_ptr<Connection>> kept;
+  for (size_t i = 0; i < connections.size(); i++) {
+    Connection& connection = *connections[i];
+    const short events = fds[stations.size() + i].revents;
+    bool open = true;
+    if ((events & (POLLIN | POLLHUP | POLLERR)) != 0) {
+      char buffer[2048];
+      const ssize_t received = recv(connection.fd, buffer, sizeof(buffer), 0);
+      if (received == 0 || (received < 0 && errno != EAGAIN && errno != EWOULDBLOCK)) {
+        open = false;
+      } else if (received > 0 && !connection.stream && connection.out.empty()) {
+        connection.in.append(buffer, received);
+        if (connection.in.find("\r\n\r\n") != std::string::npos) {
+          answer(connection);
+        }
+      }
+    }
+    if (open && !connection.out.empty()) {
+      open = flush(connection);
+    }
+    if (open) {
+      kept.push_back(std::move(connections[i]));
+    } else {
+      ::close(connection.fd);
+    }
+  }
+  connections.swap(kept);
+
+  for (size_t i = 0; i < stations.size(); i++) {
+    if ((fds[i].revents & POLLIN) == 0) {
+      continue;
+    }
+    int fd;
+    while ((fd = accept4(stations[i].listenFd, nullptr, nullptr,
+                         SOCK_NONBLOCK | SOCK_CLOEXEC)) >= 0) {
+      const int one = 1;
+      setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+      std::unique_ptr<Connection> connection(new Connection());
+      connection->fd = fd;
+      connection->station = i;
+      connections.push_back(std::move(connection));
+    }
+  }
+}
@@ -0,0 +1,90 @@
+// station_sim.h -- stations on loopback for the collector tests and
+// benchmarks. Each serves /data?since= (chunked JSON rows with the X-Boot
+// headers) and /stream?since= (SSE with the hello event) the way the
+// firmware does, from readings the caller adds. Single-threaded: poll()
+// accepts, answers and pushes new stream events.
+#ifndef HOST_STATION_SIM_H
+#define HOST_STATION_SIM_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <memory>
+#include <string>
+#include <vector>
+
+class StationSim {
+ public:
+  StationSim() {}
+  ~StationSim();
+  StationSim(const StationSim&) = delete;
+  StationSim& operator=(const StationSim&) = delete;
+
+  // Listens on 127.0.0.1:basePort.. or, with 0, on free ports (see port())
+  bool begin(size_t count, uint16_t basePort = 0);
+
+  size_t count() const { return stations.size(); }
+  uint16_t port(size_t station) const { return stations[station].port; }
+  uint32_t boot(size_t station) const { return stations[station].boot; }
+  // Readings under the current numbering, replayed ones included
+  size_t readings(size_t station) const { return stations[station].timestamps.size(); }
+
+  // Timestamps as "ms:<uptime>" instead of UTC, like before the NTP sync
+  void setUptime(size_t station, bool uptime) { stations[station].uptime = uptime; }
+  // timestamp is epoch seconds, or seconds since power-on
+  void addReading(size_t station, uint32_t timestamp);
+  // Reboots the station: a new boot id, its connections drop, and the
+  // newest `keep` readings come back from flash numbered from 0
+  void restart(size_t station, size_t keep);
+
+  // Serves until something happened or timeoutMs passed
+  void poll(int timeoutMs);
+  uint64_t rowsServed() const { return served; }
+
+  // What a reading is served with, written with two decimals
+  static double temperature(size_t station, uint32_t timestamp);
+  static double pressure(uint32_t timestamp);
+  static double humidity(uint32_t timestamp);  // NAN is served as null
+
+ private:
+  struct Station {
+    int listenFd = -1;
+    uint16_t port = 0;
+    uint32_t boot = 0;
+    uint32_t bootSequence = 0;
+    bool uptime = false;
+    std::vector<uint32_t> timestamps;  // index is the sequence number
+  };
+
+  struct Connection {
+    int fd;
+    size_t station;
+    std::string in;
+    std::string out;
+    size_t sent = 0;
+    bool stream = false;
+    bool closeAfter = false;
+    uint32_t next = 0;  // stream: next sequence number
+  };
+
+  std::vector<Station> stations;
+  std::vector<std::unique_ptr<Connection>> connections;
+  uint32_t nextBoot = 1000;
+  uint64_t served = 0;
+
+  // A reading's values as the station writes them
+  struct Fields {
+    char timestamp[32];
+    char temperature[16];
+    char pressure[16];
+    char humidity[16];
+  };
+
+  void format(size_t station, uint32_t sequence, Fields& fields) const;
+  void answer(Connection& connection);
+  void appendEvents(Connection& connection);
+  // false when the connection is done
+  bool flush(Connection& connection);
+};
+
+#endif  // HOST_STATION_SIM_H
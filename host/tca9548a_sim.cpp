@@ -0,0 +1,35 @@
+#include "tca9548a_sim.h"
+
+bool Tca9548aSim::attach(uint8_t channel, uint8_t address,
+                         SimI2cDevice* device) {
+  if (channel >= 8 || slotCount == MAX_DEVICES) {
+    return false;
+  }
+  slots[slotCount++] = {channel, address, device};
+  return true;
+}
+
+void Tca9548aSim::onWrite(const uint8_t* data, size_t len) {
+  if (len == 0) {
+    return;
+  }
+  control = data[len - 1];
+  selectCount++;
+}
+
+void Tca9548aSim::onRead(uint8_t* data, size_t len) {
+  for (size_t i = 0; i < len; i++) {
+    data[i] = control;
+  }
+}
+
+// Two devices with the same address on open channels would collide on real
+// hardware; the first one attached answers here
+SimI2cDevice* Tca9548aSim::route(uint8_t address) {
+  for (size_t i = 0; i < slotCount; i++) {
+    if ((control & 1 << slots[i].channel) != 0 && slots[i].address == address) {
+      return slots[i].device;
+    }
+  }
+  return nullptr;
+}
@@ -0,0 +1,35 @@
+// tca9548a_sim.h -- TCA9548A 8-channel I2C multiplexer model for host builds
+#ifndef HOST_TCA9548A_SIM_H
+#define HOST_TCA9548A_SIM_H
+
+#include "sim_bus.h"
+
+// The control register is the last byte written; a read returns it. Bit n
+// connects channel n, and devices on connected channels answer on the bus.
+class Tca9548aSim : public SimI2cDevice {
+ public:
+  static constexpr size_t MAX_DEVICES = 16;
+
+  bool attach(uint8_t channel, uint8_t address, SimI2cDevice* device);
+
+  uint8_t channels() const { return control; }
+  uint32_t selects() const { return selectCount; }
+
+  void onWrite(const uint8_t* data, size_t len) override;
+  void onRead(uint8_t* data, size_t len) override;
+  SimI2cDevice* route(uint8_t address) override;
+
+ private:
+  struct Slot {
+    uint8_t channel;
+    uint8_t address;
+    SimI2cDevice* device;
+  };
+
+  Slot slots[MAX_DEVICES] = {};
+  size_t slotCount = 0;
+  uint8_t control = 0;  // every channel disconnected after power-on
+  uint32_t selectCount = 0;
+};
+
+#endif  // HOST_TCA9548A_SIM_H
@@ -0,0 +1,208 @@
+#include "http_server.h"
+
+bool HttpRequest::isPath(const char* route) const {
+  const size_t len = strlen(route);
+  return strncmp(path, route, len) == 0 &&
+         (path[len] == '\0' || path[len] == '?');
+}
+
+bool HttpRequest::queryUnsigned(const char* name, uint32_t& value) const {
+  const size_t len = strlen(name);
+  for (const char* p = query; *p != '\0';) {
+    if (strncmp(p, name, len) == 0 && p[len] == '=') {
+      char* end;
+      const unsigned long parsed = strtoul(p + len + 1, &end, 10);
+      if (end == p + len + 1 || (*end != '\0' && *end != '&')) {
+        return false;
+      }
+      value = (uint32_t)parsed;
+      return true;
+    }
+    const char* next = strchr(p, '&');
+    if (next == nullptr) {
+      break;
+    }
+    p = next + 1;
+  }
+  return false;
+}
+
+size_t HttpServer::activeConnections() const {
+  size_t active = 0;
+  for (const Connection& conn : connections) {
+    if (conn.state != State::Idle) {
+      active++;
+    }
+  }
+  return active;
+}
+
+void HttpServer::poll() {
+  const unsigned long start = micros();
+
+  accept();
+
+  const unsigned long now = millis();
+  for (Connection& conn : connections) {
+    if (conn.state != State::Idle) {
+      advance(conn, now);
+    }
+  }
+
+  const uint32_t elapsed = micros() - start;
+  if (elapsed > serverStats.maxPollMicros) {
+    serverStats.maxPollMicros = elapsed;
+  }
+}
+
+// Takes at most one pending client per pass, and only into a free slot;
+// further clients wait in the listen backlog
+void HttpServer::accept() {
+  for (Connection& conn : connections) {
+    if (conn.state != State::Idle) {
+      continue;
+    }
+    WiFiClient client = server.available();
+    if (!client) {
+      return;
+    }
+    conn.client = client;
+    conn.state = State::RequestLine;
+    conn.lineLength = 0;
+    conn.lineTooLong = false;
+    conn.since = millis();
+    serverStats.accepted++;
+    return;
+  }
+}
+
+void HttpServer::advance(Connection& conn, unsigned long now) {
+  // Also checked before every handler step, so an abandoned response stops
+  if (!conn.client.connected()) {
+    if (conn.state == State::Responding) {
+      serverStats.disconnects++;
+      if (abortHandler != nullptr) {
+        abortHandler(conn.request, conn.response);
+      }
+    }
+    close(conn);
+    return;
+  }
+
+  switch (conn.state) {
+    case State::RequestLine:
+      if (readLine(conn)) {
+        const char* error = parseRequestLine(conn);
+        if (error != nullptr) {
+          serverStats.badRequests++;
+          reply(conn, error);
+          return;
+        }
+        conn.state = State::Headers;
+        conn.lineLength = 0;
+        conn.lineTooLong = false;
+      }
+      break;
+
+    case State::Headers:
+      // Headers are not needed; read up to the blank line and drop them,
+      // long ones included
+      while (conn.state == State::Headers && readLine(conn)) {
+        if (conn.lineLength == 0 && !conn.lineTooLong) {
+          conn.state = State::Responding;
+          conn.response = {0, 0, 0};
+        }
+        conn.lineLength = 0;
+        conn.lineTooLong = false;
+      }
+      break;
+
+    case State::Responding:
+      if (handler(conn.client, conn.request, conn.response)) {
+        serverStats.served++;
+        close(conn);
+      } else {
+        conn.response.step++;
+      }
+      return;
+
+    default:
+      break;
+  }
+
+  if (conn.state != State::Responding && now - conn.since >= REQUEST_TIMEOUT_MS) {
+    serverStats.timeouts++;
+    reply(conn, "408 Request Timeout");
+  }
+}
+
+// Consumes available bytes up to the next line end without blocking.
+// Returns true once a full line (without CRLF) is in conn.line.
+bool HttpServer::readLine(Connection& conn) {
+  while (conn.client.available() > 0) {
+    const int c = conn.client.read();
+    if (c < 0) {
+      break;
+    }
+    if (c == '\n') {
+      conn.line[conn.lineLength] = '\0';
+      return true;
+    }
+    if (c == '\r') {
+      continue;
+    }
+    if (conn.lineLength < LINE_MAX - 1) {
+      conn.line[conn.lineLength++] = (char)c;
+    } else {
+      conn.lineTooLong = true;
+    }
+  }
+  return false;
+}
+
+// Returns nullptr for a valid request line, otherwise the status to reply
+// with. A path that does not fit into HttpRequest::path is refused rather
+// than cut, so a long query string can never be half applied.
+const char* HttpServer::parseRequestLine(Connection& conn) {
+  static const char* const BAD_REQUEST = "400 Bad Request";
+  static const char* const URI_TOO_LONG = "414 URI Too Long";
+  HttpRequest& request = conn.request;
+  const char* p = conn.line;
+
+  const char* space = strchr(p, ' ');
+  if (space == nullptr || space == p ||
+      (size_t)(space - p) >= HttpRequest::METHOD_MAX) {
+    return BAD_REQUEST;
+  }
+  memcpy(request.method, p, space - p);
+  request.method[space - p] = '\0';
+
+  p = space + 1;
+  if (*p != '/') {
+    return BAD_REQUEST;
+  }
+  space = strchr(p, ' ');
+  const size_t pathLength = space != nullptr ? (size_t)(space - p) : strlen(p);
+  if (conn.lineTooLong || pathLength >= HttpRequest::PATH_MAX) {
+    return URI_TOO_LONG;
+  }
+  memcpy(request.path, p, pathLength);
+  request.path[pathLength] = '\0';
+
+  const char* query = strchr(request.path, '?');
+  request.query = query != nullptr ? query + 1 : request.path + pathLength;
+  return nullptr;
+}
+
+void HttpServer::reply(Connection& conn, const char* status) {
+  conn.client.print("HTTP/1.1 ");
+  conn.client.print(status);
+  conn.client.print("\r\nContent-Length: 0\r\nConnection: close\r\n\r\n");
+  close(conn);
+}
+
+void HttpServer::close(Connection& conn) {
+  conn.client.stop();
+  conn.client = WiFiClient();
+  conn.state = State::Idle;
+}
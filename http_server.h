@@ -0,0 +1,102 @@
+#ifndef HTTP_SERVER_H
+#define HTTP_SERVER_H
+
+#include <Arduino.h>
+#include <WiFi.h>
+
+struct HttpRequest {
+  static constexpr size_t METHOD_MAX = 8;
+  static constexpr size_t PATH_MAX = 96;
+
+  char method[METHOD_MAX];
+  char path[PATH_MAX];  // including the query string
+  const char* query;    // points into path after '?', or to ""
+
+  // True if the path without query string equals route
+  bool isPath(const char* route) const;
+
+  // Parses name=<decimal> from the query string; false if absent or invalid
+  bool queryUnsigned(const char* name, uint32_t& value) const;
+};
+
+// Progress of a response that is written over several poll() passes
+struct HttpResponseState {
+  uint32_t step;      // number of previous handler calls for this request
+  uint32_t position;  // free for the handler, starts at 0
+  uint32_t end;
+};
+
+/**
+ * Writes the next part of the response. Called once per poll() pass until
+ * it returns true; it should write at most about one chunk per call.
+ */
+typedef bool (*HttpHandler)(WiFiClient& client, const HttpRequest& request,
+                            HttpResponseState& state);
+
+/**
+ * Called instead of the handler when the client of an unfinished response
+ * went away, so the handler can release what it holds for the request.
+ */
+typedef void (*HttpAbortHandler)(const HttpRequest& request,
+                                 const HttpResponseState& state);
+
+/**
+ * Event-driven HTTP/1.1 server on top of WiFiServer with a fixed pool of
+ * connections. Each poll() reads whatever request bytes are available,
+ * and advances every response by one step, so a slow client never stalls
+ * the caller.
+ */
+class HttpServer {
+ public:
+  static constexpr size_t MAX_CONNECTIONS = 4;
+  static constexpr unsigned long REQUEST_TIMEOUT_MS = 3000;
+  static constexpr size_t LINE_MAX = HttpRequest::METHOD_MAX + HttpRequest::PATH_MAX + 16;
+
+  struct Stats {
+    uint32_t accepted;
+    uint32_t served;
+    uint32_t timeouts;
+    uint32_t badRequests;
+    uint32_t disconnects;  // clients gone before their response finished
+    uint32_t maxPollMicros;
+  };
+
+  HttpServer(WiFiServer& server, HttpHandler handler)
+      : server(server), handler(handler) {}
+
+  void begin() { server.begin(); }
+  void onAbort(HttpAbortHandler handler) { abortHandler = handler; }
+  void poll();
+
+  size_t activeConnections() const;
+  const Stats& stats() const { return serverStats; }
+
+ private:
+  enum class State : uint8_t { Idle, RequestLine, Headers, Responding };
+
+  struct Connection {
+    WiFiClient client;
+    State state = State::Idle;
+    char line[LINE_MAX];
+    size_t lineLength = 0;
+    bool lineTooLong = false;  // bytes beyond LINE_MAX were dropped
+    unsigned long since = 0;
+    HttpRequest request;
+    HttpResponseState response;
+  };
+
+  WiFiServer& server;
+  const HttpHandler handler;
+  HttpAbortHandler abortHandler = nullptr;
+  Connection connections[MAX_CONNECTIONS];
+  Stats serverStats = {};
+
+  void accept();
+  void advance(Connection& conn, unsigned long now);
+  bool readLine(Connection& conn);
+  const char* parseRequestLine(Connection& conn);
+  void reply(Connection& conn, const char* status);
+  void close(Connection& conn);
+};
+
+#endif  // HTTP_SERVER_H
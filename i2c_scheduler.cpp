@@ -0,0 +1,446 @@
+#include "i2c_scheduler.h"
+
+#include "metrics.h"
+
+#ifdef ESP_PLATFORM
+#include <freertos/FreeRTOS.h>
+#include <freertos/task.h>
+#endif
+
+I2cScheduler i2cScheduler(Wire);
+I2cScheduler i2cScheduler1(Wire1);
+
+I2cScheduler& i2cSchedulerFor(I2cDeviceId device) {
+  return i2cBusOf(device) == 0 ? i2cScheduler : i2cScheduler1;
+}
+
+static const I2cDeviceConfig DEFAULT_DEVICE = {0, I2cScheduler::PRIORITY_SENSOR,
+                                               0, 0};
+
+// Lets the executor of a chunk finish when a caller has nothing to run
+static void pause() {
+#ifdef ESP_PLATFORM
+  vTaskDelay(1);
+#else
+  std::this_thread::yield();
+#endif
+}
+
+bool I2cScheduler::setDevice(I2cDeviceId device,
+                             const I2cDeviceConfig& config) {
+  std::lock_guard<std::mutex> lock(mutex);
+  for (size_t i = 0; i < deviceCount; i++) {
+    if (devices[i].id == device) {
+      devices[i].config = config;
+      return true;
+    }
+  }
+  if (deviceCount == MAX_DEVICES) {
+    return false;
+  }
+  devices[deviceCount++] = {device, config};
+  return true;
+}
+
+I2cDeviceConfig I2cScheduler::device(I2cDeviceId device) const {
+  for (size_t i = 0; i < deviceCount; i++) {
+    if (devices[i].id == device) {
+      return devices[i].config;
+    }
+  }
+  return DEFAULT_DEVICE;
+}
+
+// -=| Queue |=-
+
+int I2cScheduler::submit(const I2cTransfer& transfer, bool block) {
+  // Exactly one buffer, or none for a probe
+  const bool probe = transfer.readBuffer == nullptr &&
+                     transfer.writeBuffer == nullptr;
+  if (probe ? transfer.length != 0
+            : transfer.length == 0 || (transfer.readBuffer != nullptr &&
+                                       transfer.writeBuffer != nullptr)) {
+    return -1;
+  }
+
+  std::unique_lock<std::mutex> lock(mutex);
+  for (;;) {
+    for (size_t i = 0; i < MAX_JOBS; i++) {
+      Job& job = jobs[i];
+      if (job.state != JobState::Free) {
+        continue;
+      }
+      job = {};
+      job.transfer = transfer;
+      job.config = device(transfer.device);
+      job.state = JobState::Queued;
+      job.order = nextOrder++;
+      job.queuedMicros = micros();
+      job.deadline = job.queuedMicros + job.config.deadlineMicros;
+      changed.notify_all();
+      return (int)i;
+    }
+    if (!block) {
+      return -1;
+    }
+    if (running) {
+      changed.wait(lock);
+    } else {
+      lock.unlock();
+      if (!runOnce()) {
+        pause();
+      }
+      lock.lock();
+    }
+  }
+}
+
+bool I2cScheduler::done(int ticket) {
+  if (ticket < 0 || ticket >= (int)MAX_JOBS) {
+    return false;
+  }
+  std::lock_guard<std::mutex> lock(mutex);
+  return jobs[ticket].state == JobState::Done;
+}
+
+I2cStatus I2cScheduler::wait(int ticket) {
+  if (ticket < 0 || ticket >= (int)MAX_JOBS) {
+    return I2cStatus::InvalidArgument;
+  }
+  std::unique_lock<std::mutex> lock(mutex);
+  Job& job = jobs[ticket];
+  while (job.state != JobState::Done) {
+    if (job.state == JobState::Free) {
+      return I2cStatus::InvalidArgument;
+    }
+    if (running) {
+      changed.wait(lock);
+    } else {
+      lock.unlock();
+      if (!runOnce()) {
+        pause();
+      }
+      lock.lock();
+    }
+  }
+  const I2cStatus status = job.status;
+  job.state = JobState::Free;
+  changed.notify_all();
+  return status;
+}
+
+I2cStatus I2cScheduler::transfer(const I2cTransfer& transfer) {
+  const int ticket = submit(transfer);
+  return ticket < 0 ? I2cStatus::InvalidArgument : wait(ticket);
+}
+
+// Priority first, then the earlier deadline (transfers with one go before
+// those without), then arrival. Called with the mutex held.
+int I2cScheduler::pick() const {
+  int best = -1;
+  for (size_t i = 0; i < MAX_JOBS; i++) {
+    const Job& job = jobs[i];
+    if (job.state != JobState::Queued) {
+      continue;
+    }
+    if (best < 0) {
+      best = i;
+      continue;
+    }
+    const Job& other = jobs[best];
+    bool first;
+    if (job.config.priority != other.config.priority) {
+      first = job.config.priority < other.config.priority;
+    } else if ((job.config.deadlineMicros != 0) !=
+               (other.config.deadlineMicros != 0)) {
+      first = job.config.deadlineMicros != 0;
+    } else if (job.config.deadlineMicros != 0 && job.deadline != other.deadline) {
+      first = (int32_t)(job.deadline - other.deadline) < 0;
+    } else {
+      first = (int32_t)(job.order - other.order) < 0;
+    }
+    if (first) {
+      best = i;
+    }
+  }
+  return best;
+}
+
+// -=| Execution |=-
+
+bool I2cScheduler::runOnce() {
+  std::lock_guard<std::mutex> executing(executor);
+  std::unique_lock<std::mutex> lock(mutex);
+  const int index = pick();
+  if (index < 0) {
+    return false;
+  }
+  Job& job = jobs[index];
+  if (lastJob >= 0 && lastJob != index && jobs[lastJob].started &&
+      jobs[lastJob].state == JobState::Queued) {
+    schedulerStats.preemptions++;
+  }
+  lastJob = index;
+  job.state = JobState::Running;
+
+  const uint8_t priority = job.config.priority < PRIORITIES
+                               ? job.config.priority
+                               : PRIORITIES - 1;
+  if (!job.started) {
+    job.started = true;
+    const uint32_t waited = micros() - job.queuedMicros;
+    if (waited > schedulerStats.maxWaitMicros[priority]) {
+      schedulerStats.maxWaitMicros[priority] = waited;
+    }
+  }
+
+  // One byte of every write is taken by the register address
+  const size_t limit = job.transfer.readBuffer != nullptr ? I2C_MAX_CHUNK
+                                                          : I2C_MAX_CHUNK - 1;
+  size_t chunk = job.transfer.length - job.offset;
+  if (job.config.chunk != 0 && chunk > job.config.chunk) {
+    chunk = job.config.chunk;
+  }
+  if (chunk > limit) {
+    chunk = limit;
+  }
+  const size_t offset = job.offset;
+  lock.unlock();
+
+  // Only the holder of `executor` touches a running job and the bus
+  bool clockChanged = false;
+  if (job.config.clockHz != 0 && wire.getClock() != job.config.clockHz) {
+    wire.setClock(job.config.clockHz);
+    clockChanged = true;
+  }
+  uint32_t selects = 0;
+  I2cStatus status = route(job.transfer.device, selects);
+  if (status == I2cStatus::Ok) {
+    status = runTransaction(job, offset, chunk);
+  }
+
+  lock.lock();
+  schedulerStats.transactions++;
+  schedulerStats.muxSelects += selects;
+  if (clockChanged) {
+    schedulerStats.clockChanges++;
+  }
+  if (status != I2cStatus::Ok) {
+    // An absent device is the expected answer to most probes
+    if (job.transfer.length != 0 || status != I2cStatus::AddressNack) {
+      schedulerStats.errors++;
+    }
+    finish(job, status);
+  } else if ((job.offset += chunk) == job.transfer.length) {
+    finish(job, I2cStatus::Ok);
+  } else {
+    job.state = JobState::Queued;
+  }
+  return true;
+}
+
+// A TCA9548A has a single control register: the byte written is the mask
+// of open channels. Its power-on state is all closed.
+I2cStatus I2cScheduler::writeMux(uint8_t index, uint8_t channels) {
+  wire.beginTransmission((uint8_t)(I2C_MUX_BASE + index));
+  wire.write(channels);
+  const uint8_t error = wire.endTransmission();
+  if (error != 0) {
+    METRICS_ADD(MetricsCounter::I2cErrors, 1);
+    muxKnown &= ~(1 << index);
+    return (I2cStatus)error;
+  }
+  muxChannels[index] = channels;
+  muxKnown |= 1 << index;
+  return I2cStatus::Ok;
+}
+
+// Opens the channel of a muxed device with every other mux closed, or
+// closes the muxes before a trunk device whose address also lives behind
+// one. Runs on the executor only.
+I2cStatus I2cScheduler::route(I2cDeviceId device, uint32_t& selects) {
+  const uint8_t address = i2cAddressOf(device);
+  uint8_t target = 0xFF;
+  if (i2cIsMuxed(device)) {
+    target = i2cMuxAddressOf(device) - I2C_MUX_BASE;
+    muxPresent |= 1 << target;
+    muxedAddresses[address / 32] |= 1u << address % 32;
+  } else if ((muxedAddresses[address / 32] & 1u << address % 32) == 0) {
+    return I2cStatus::Ok;
+  }
+
+  for (uint8_t i = 0; i < 8; i++) {
+    if (i == target || (muxPresent & 1 << i) == 0 ||
+        ((muxKnown & 1 << i) != 0 && muxChannels[i] == 0)) {
+      continue;
+    }
+    const I2cStatus status = writeMux(i, 0);
+    if (status != I2cStatus::Ok) {
+      return status;
+    }
+    selects++;
+  }
+  if (target == 0xFF) {
+    return I2cStatus::Ok;
+  }
+  const uint8_t channels = 1 << i2cMuxChannelOf(device);
+  if ((muxKnown & 1 << target) != 0 && muxChannels[target] == channels) {
+    return I2cStatus::Ok;
+  }
+  selects++;
+  return writeMux(target, channels);
+}
+
+I2cStatus I2cScheduler::runTransaction(const Job& job, size_t offset,
+                                       size_t chunk) {
+  const I2cTransfer& transfer = job.transfer;
+  const uint8_t address = i2cAddressOf(transfer.device);
+  METRICS_SCOPE(MetricsStage::I2cTransaction);
+  // Anyone talking to a mux directly leaves it in an unknown state
+  if (!i2cIsMuxed(transfer.device) && address >= I2C_MUX_BASE &&
+      address < I2C_MUX_BASE + 8) {
+    muxKnown &= ~(1 << (address - I2C_MUX_BASE));
+  }
+
+  wire.beginTransmission(address);
+  if (transfer.readBuffer == nullptr && transfer.writeBuffer == nullptr) {
+    const uint8_t error = wire.endTransmission();
+    return (I2cStatus)error;
+  }
+  wire.write((uint8_t)(transfer.autoIncrement
+                           ? transfer.registerAddress + offset
+                           : transfer.registerAddress));
+
+  if (transfer.writeBuffer != nullptr) {
+    wire.write(transfer.writeBuffer + offset, chunk);
+    const uint8_t error = wire.endTransmission();
+    if (error != 0) {
+      METRICS_ADD(MetricsCounter::I2cErrors, 1);
+      return (I2cStatus)error;
+    }
+    METRICS_ADD(MetricsCounter::I2cBytes, chunk);
+    return I2cStatus::Ok;
+  }
+
+  const uint8_t error = wire.endTransmission(false);
+  if (error != 0) {
+    METRICS_ADD(MetricsCounter::I2cErrors, 1);
+    return (I2cStatus)error;
+  }
+  const size_t received = wire.requestFrom(address, (uint8_t)chunk);
+  uint8_t* buffer = transfer.readBuffer + offset;
+  size_t idx = 0;
+  while (wire.available() && idx < chunk) {
+    buffer[idx++] = wire.read();
+  }
+  METRICS_ADD(MetricsCounter::I2cBytes, idx);
+  if (received < chunk || idx < chunk) {
+    METRICS_ADD(MetricsCounter::I2cErrors, 1);
+    return I2cStatus::ShortRead;
+  }
+  return I2cStatus::Ok;
+}
+
+// Called with the mutex held
+void I2cScheduler::finish(Job& job, I2cStatus status) {
+  const uint32_t now = micros();
+  const uint8_t priority = job.config.priority < PRIORITIES
+                               ? job.config.priority
+                               : PRIORITIES - 1;
+  const uint32_t latency = now - job.queuedMicros;
+  if (latency > schedulerStats.maxLatencyMicros[priority]) {
+    schedulerStats.maxLatencyMicros[priority] = latency;
+  }
+  if (job.config.deadlineMicros != 0 && (int32_t)(now - job.deadline) > 0) {
+    schedulerStats.missedDeadlines++;
+  }
+  schedulerStats.transfers++;
+  job.status = status;
+  job.state = JobState::Done;
+  changed.notify_all();
+}
+
+I2cScheduler::Stats I2cScheduler::stats() {
+  std::lock_guard<std::mutex> lock(mutex);
+  return schedulerStats;
+}
+
+void I2cScheduler::resetStats() {
+  std::lock_guard<std::mutex> lock(mutex);
+  schedulerStats = {};
+}
+
+// -=| Worker |=-
+
+void I2cScheduler::workerLoop() {
+  while (running) {
+    if (!runOnce()) {
+      std::unique_lock<std::mutex> lock(mutex);
+      changed.wait(lock, [this] { return !running || pick() >= 0; });
+    }
+  }
+}
+
+#ifdef ESP_PLATFORM
+
+void I2cScheduler::taskMain(void* arg) {
+  I2cScheduler* self = (I2cScheduler*)arg;
+  self->workerLoop();
+  self->task = nullptr;
+  vTaskDelete(nullptr);
+}
+
+bool I2cScheduler::begin(int core, int priority) {
+  if (running) {
+    return false;
+  }
+  running = true;
+
+  TaskHandle_t handle;
+  if (xTaskCreatePinnedToCore(taskMain, "i2c", 3072, this, priority, &handle,
+                              core) != pdPASS) {
+    running = false;
+    return false;
+  }
+  task = handle;
+  return true;
+}
+
+void I2cScheduler::end() {
+  if (running) {
+    {
+      std::lock_guard<std::mutex> lock(mutex);
+      running = false;
+      changed.notify_all();
+    }
+    while (task != nullptr) {
+      vTaskDelay(1);
+    }
+  }
+}
+
+#else
+
+bool I2cScheduler::begin(int core, int priority) {
+  (void)core;
+  (void)priority;
+  if (running) {
+    return false;
+  }
+  running = true;
+  thread = std::thread([this] { workerLoop(); });
+  return true;
+}
+
+void I2cScheduler::end() {
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    running = false;
+    changed.notify_all();
+  }
+  if (thread.joinable()) {
+    thread.join();
+  }
+}
+
+#endif
@@ -0,0 +1,228 @@
+#ifndef I2C_SCHEDULER_H
+#define I2C_SCHEDULER_H
+
+#include <Arduino.h>
+#include <Wire.h>
+
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+
+#ifndef ESP_PLATFORM
+#include <thread>
+#endif
+
+// Largest chunk moved in one transaction, bounded by the Wire RX/TX buffer
+#ifdef I2C_BUFFER_LENGTH
+const size_t I2C_MAX_CHUNK = I2C_BUFFER_LENGTH;
+#else
+const size_t I2C_MAX_CHUNK = 32;
+#endif
+
+// Result of a register transfer. The first values match the codes returned
+// by Wire.endTransmission().
+enum class I2cStatus : uint8_t {
+  Ok = 0,
+  DataTooLong = 1,
+  AddressNack = 2,
+  DataNack = 3,
+  OtherError = 4,
+  Timeout = 5,
+  ShortRead = 6,  // device returned fewer bytes than requested
+  InvalidArgument = 7,
+};
+
+// -=| Devices |=-
+// A device is its 7-bit address plus the route to it: which controller
+// (Wire or Wire1) and, behind a TCA9548A multiplexer, the mux and channel.
+// A plain 7-bit address is a device on Wire that is not behind a mux, so
+// single-bus code can keep passing addresses.
+typedef uint16_t I2cDeviceId;
+
+const uint8_t I2C_BUSES = 2;
+const uint8_t I2C_MUX_BASE = 0x70;  // TCA9548A at 0x70..0x77
+const uint8_t I2C_MUX_CHANNELS = 8;
+const I2cDeviceId I2C_ROUTE_MUXED = 0x4000;
+
+constexpr I2cDeviceId i2cDeviceOnBus(uint8_t bus, uint8_t address) {
+  return (I2cDeviceId)((bus & 1) << 7 | (address & 0x7F));
+}
+
+constexpr I2cDeviceId i2cDeviceBehindMux(uint8_t bus, uint8_t muxAddress,
+                                         uint8_t channel, uint8_t address) {
+  return (I2cDeviceId)(i2cDeviceOnBus(bus, address) | I2C_ROUTE_MUXED |
+                       (channel & 7) << 8 | (muxAddress & 7) << 11);
+}
+
+constexpr uint8_t i2cAddressOf(I2cDeviceId device) { return device & 0x7F; }
+constexpr uint8_t i2cBusOf(I2cDeviceId device) { return device >> 7 & 1; }
+constexpr bool i2cIsMuxed(I2cDeviceId device) {
+  return (device & I2C_ROUTE_MUXED) != 0;
+}
+constexpr uint8_t i2cMuxAddressOf(I2cDeviceId device) {
+  return I2C_MUX_BASE + (device >> 11 & 7);
+}
+constexpr uint8_t i2cMuxChannelOf(I2cDeviceId device) {
+  return device >> 8 & 7;
+}
+
+// A read into `readBuffer` or a write from `writeBuffer` of `length` bytes.
+// Every transaction starts with `registerAddress`, plus the offset reached
+// so far when `autoIncrement` is set; without it the same register (a FIFO
+// port, or an SSD1306 control byte) is addressed again for each chunk.
+// Without buffers and with length 0 it is a probe: just the address.
+struct I2cTransfer {
+  I2cDeviceId device;
+  uint8_t registerAddress;
+  bool autoIncrement;
+  uint8_t* readBuffer;
+  const uint8_t* writeBuffer;
+  size_t length;
+};
+
+// How the scheduler treats the transfers of one device
+struct I2cDeviceConfig {
+  uint32_t clockHz;         // SCL while talking to it, 0 leaves the bus as is
+  uint8_t priority;         // 0 is served first
+  uint32_t deadlineMicros;  // from queueing, orders equal priorities; 0 none
+  uint8_t chunk;            // payload bytes per transaction, 0 the maximum
+};
+
+/**
+ * Owns one Wire bus and runs the transfers of every device on it in order
+ * of priority, then deadline, then arrival. Transfers are cut into
+ * transactions of at most the device's `chunk` bytes and the queue is
+ * looked at again after each one, so a sensor read waits for at most one
+ * chunk of a running display update, not for the whole frame. The SCL
+ * clock is switched per device, so a Fast-mode Plus part is not held back
+ * by a 400 kHz one on the same bus. Devices behind a TCA9548A get their
+ * channel selected first; the mux is only written when the channel
+ * changes, or to close it before a device on the trunk whose address was
+ * also used behind it. A mux whose state is unknown (after an error, or
+ * after someone addressed it directly) is closed before any routed
+ * transfer, as it may have any channel open.
+ *
+ * After begin() a worker (a FreeRTOS task pinned to a core on the ESP32, a
+ * std::thread on the host) executes the queue: transfer() blocks the caller
+ * until its transfer is done, submit() returns at once with a ticket for
+ * wait(). Before begin() callers execute the queue themselves, one chunk at
+ * a time and one caller at a time, so drivers work the same during setup
+ * and in battery mode.
+ *
+ * Nothing else may use the bus while the worker runs.
+ */
+class I2cScheduler {
+ public:
+  static constexpr uint8_t PRIORITY_REALTIME = 0;  // FIFO drains
+  static constexpr uint8_t PRIORITY_SENSOR = 1;
+  static constexpr uint8_t PRIORITY_DISPLAY = 2;
+  static constexpr uint8_t PRIORITIES = 3;
+  static constexpr size_t MAX_DEVICES = 16;
+  static constexpr size_t MAX_JOBS = 32;
+
+  struct Stats {
+    uint32_t transfers;
+    uint32_t transactions;
+    uint32_t errors;
+    uint32_t preemptions;      // a transfer ran between chunks of another
+    uint32_t clockChanges;
+    uint32_t muxSelects;
+    uint32_t missedDeadlines;
+    // Per priority: queued until the first chunk started, and until done
+    uint32_t maxWaitMicros[PRIORITIES];
+    uint32_t maxLatencyMicros[PRIORITIES];
+  };
+
+  explicit I2cScheduler(TwoWire& wire) : wire(wire) {}
+  ~I2cScheduler() { end(); }
+
+  // Devices without a config use the bus clock at PRIORITY_SENSOR
+  bool setDevice(I2cDeviceId device, const I2cDeviceConfig& config);
+  I2cDeviceConfig device(I2cDeviceId device) const;
+
+  // core and priority only apply to the ESP32 task
+  bool begin(int core, int priority);
+  void end();
+  bool isRunning() const { return running; }
+
+  I2cStatus transfer(const I2cTransfer& transfer);
+
+  // Queues a transfer whose buffer stays valid until wait(); returns a
+  // ticket, or -1 (after waiting for a free slot when `block` is set)
+  int submit(const I2cTransfer& transfer, bool block = true);
+  bool done(int ticket);
+  // Waits for the transfer and frees its ticket
+  I2cStatus wait(int ticket);
+
+  // Runs one transaction of the most urgent transfer; false if none was
+  // waiting. The worker's loop, also usable by host simulations.
+  bool runOnce();
+
+  Stats stats();
+  void resetStats();
+
+ private:
+  enum class JobState : uint8_t { Free, Queued, Running, Done };
+
+  struct Device {
+    I2cDeviceId id;
+    I2cDeviceConfig config;
+  };
+
+  struct Job {
+    I2cTransfer transfer;
+    I2cDeviceConfig config;
+    JobState state;
+    I2cStatus status;
+    bool started;
+    size_t offset;
+    uint32_t order;
+    uint32_t queuedMicros;
+    uint32_t deadline;
+  };
+
+  TwoWire& wire;
+  Device devices[MAX_DEVICES];
+  size_t deviceCount = 0;
+
+  std::mutex mutex;
+  std::condition_variable changed;
+  // Held by whoever runs a transaction: the worker, or before begin() any
+  // caller waiting in submit() or wait(). Taken before `mutex`.
+  std::mutex executor;
+  Job jobs[MAX_JOBS] = {};
+  uint32_t nextOrder = 0;
+  int lastJob = -1;
+  Stats schedulerStats = {};
+  std::atomic<bool> running{false};
+
+  // Channel mask last written to each mux (bit set in muxKnown), the muxes
+  // routed through so far (0x76/0x77 may as well be sensors), and the
+  // addresses used behind any mux; touched by the executor only
+  uint8_t muxChannels[8] = {};
+  uint8_t muxKnown = 0;
+  uint8_t muxPresent = 0;
+  uint32_t muxedAddresses[4] = {};
+
+#ifdef ESP_PLATFORM
+  void* task = nullptr;  // TaskHandle_t
+  static void taskMain(void* arg);
+#else
+  std::thread thread;
+#endif
+
+  void workerLoop();
+  int pick() const;
+  I2cStatus route(I2cDeviceId device, uint32_t& selects);
+  I2cStatus writeMux(uint8_t index, uint8_t channels);
+  I2cStatus runTransaction(const Job& job, size_t offset, size_t chunk);
+  void finish(Job& job, I2cStatus status);
+};
+
+// Wire and Wire1
+extern I2cScheduler i2cScheduler;
+extern I2cScheduler i2cScheduler1;
+
+I2cScheduler& i2cSchedulerFor(I2cDeviceId device);
+
+#endif  // I2C_SCHEDULER_H
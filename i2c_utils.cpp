@@ -1,120 +1,116 @@
 #include "i2c_utils.h"
 
-void i2cWriteToRegister(const uint8_t deviceAddress,
-                        const uint8_t registerAddress, const uint8_t value) {
-  Wire.beginTransmission(deviceAddress);
-  Wire.write(registerAddress);
-  Wire.write(value);
-  Wire.endTransmission();
+#ifdef I2C_UTILS_COUNT_TRANSACTIONS
+static uint32_t transactionBase = 0;
+
+static uint32_t transactions() {
+  return i2cScheduler.stats().transactions + i2cScheduler1.stats().transactions;
 }
 
-uint8_t i2cReadByteFromRegister(const uint8_t deviceAddress,
-                                const uint8_t registerAddress) {
-  uint8_t value = 0;
+uint32_t i2cGetTransactionCount() { return transactions() - transactionBase; }
+void i2cResetTransactionCount() { transactionBase = transactions(); }
+#endif
 
-  Wire.beginTransmission(deviceAddress);
-  Wire.write(registerAddress);
-  Wire.endTransmission(false);
-  Wire.requestFrom(deviceAddress, (uint8_t)1);
-  while (Wire.available()) {
-    value = Wire.read();
+I2cStatus i2cReadBlock(const I2cDeviceId deviceAddress,
+                       const uint8_t registerAddress, uint8_t* buffer,
+                       const size_t length) {
+  if (buffer == nullptr || length == 0 ||
+      registerAddress + length - 1 > 0xFF) {
+    return I2cStatus::InvalidArgument;
   }
+  return i2cSchedulerFor(deviceAddress).transfer(
+      {deviceAddress, registerAddress, true, buffer, nullptr, length});
+}
 
-  return value;
+I2cStatus i2cReadFifo(const I2cDeviceId deviceAddress,
+                      const uint8_t registerAddress, uint8_t* buffer,
+                      const size_t length) {
+  if (buffer == nullptr || length == 0) {
+    return I2cStatus::InvalidArgument;
+  }
+  return i2cSchedulerFor(deviceAddress).transfer(
+      {deviceAddress, registerAddress, false, buffer, nullptr, length});
 }
 
-uint16_t i2cReadWordFromRegister(const uint8_t deviceAddress,
-                                 const uint8_t registerAddress) {
-  uint16_t value = 0;
-  uint8_t buffer[2];
-  uint8_t idx = 0;
+I2cStatus i2cWriteBlock(const I2cDeviceId deviceAddress,
+                        const uint8_t registerAddress, const uint8_t* buffer,
+                        const size_t length) {
+  if (buffer == nullptr || length == 0 ||
+      registerAddress + length - 1 > 0xFF) {
+    return I2cStatus::InvalidArgument;
+  }
+  return i2cSchedulerFor(deviceAddress).transfer(
+      {deviceAddress, registerAddress, true, nullptr, buffer, length});
+}
 
-  Wire.beginTransmission(deviceAddress);
-  Wire.write(registerAddress);
-  Wire.endTransmission(false);
-  Wire.requestFrom(deviceAddress, (uint8_t)2);
+I2cStatus i2cProbe(const I2cDeviceId device) {
+  return i2cSchedulerFor(device).transfer({device, 0, false, nullptr, nullptr, 0});
+}
 
-  while (Wire.available()) {
-    buffer[idx++] = Wire.read();
-  }
+I2cStatus i2cWriteToRegister(const I2cDeviceId deviceAddress,
+                             const uint8_t registerAddress,
+                             const uint8_t value) {
+  return i2cWriteRegister<uint8_t>(deviceAddress, registerAddress, value);
+}
 
-  value = (buffer[0] << 8) | buffer[1];
+uint8_t i2cReadByteFromRegister(const I2cDeviceId deviceAddress,
+                                const uint8_t registerAddress) {
+  uint8_t value = 0;
+  i2cReadRegister<uint8_t>(deviceAddress, registerAddress, value);
+  return value;
+}
 
+uint16_t i2cReadWordFromRegister(const I2cDeviceId deviceAddress,
+                                 const uint8_t registerAddress) {
+  uint16_t value = 0;
+  i2cReadRegister<uint16_t>(deviceAddress, registerAddress, value);
   return value;
 }
 
-uint16_t i2cReadWordFromRegisterLE(const uint8_t deviceAddress,
+uint16_t i2cReadWordFromRegisterLE(const I2cDeviceId deviceAddress,
                                    const uint8_t registerAddress) {
   uint16_t value = 0;
-  uint8_t buffer[2];
-  uint8_t idx = 0;
-
-  Wire.beginTransmission(deviceAddress);
-  Wire.write(registerAddress);
-  Wire.endTransmission(false);
-  Wire.requestFrom(deviceAddress, (uint8_t)2);
-
-  while (Wire.available()) {
-    buffer[idx++] = Wire.read();
-  }
-
-  value = (buffer[0] << 8) | buffer[1];
-
-  return (value >> 8) | (value << 8);
+  i2cReadRegister<uint16_t, 2, I2cEndian::Little>(deviceAddress,
+                                                  registerAddress, value);
+  return value;
 }
 
-uint32_t i2cReadThreeBytesFromRegister(const uint8_t deviceAddress,
+uint32_t i2cReadThreeBytesFromRegister(const I2cDeviceId deviceAddress,
                                        const uint8_t registerAddress) {
-  int32_t value = 0;
-  uint8_t buffer[3];
-  uint8_t idx = 0;
-
-  Wire.beginTransmission(deviceAddress);
-  Wire.write(registerAddress);
-  Wire.endTransmission(false);
-  Wire.requestFrom(deviceAddress, (uint8_t)3);
-
-  while (Wire.available()) {
-    buffer[idx++] = Wire.read();
-  }
-
-  value = (buffer[0] << 16) | buffer[1] << 8 | buffer[2];
-
+  uint32_t value = 0;
+  i2cReadRegister<uint32_t, 3>(deviceAddress, registerAddress, value);
   return value;
 }
 
-void wakeUpDevice(const uint8_t deviceAddress, const uint8_t resetAddress,
+void wakeUpDevice(const I2cDeviceId deviceAddress, const uint8_t resetAddress,
                   const uint8_t resetValue) {
   i2cWriteToRegister(deviceAddress, resetAddress, resetValue);
   delay(10);
 }
 
-void identifyDevice(const uint8_t deviceAddress,
+void identifyDevice(const I2cDeviceId deviceAddress,
                     const uint8_t whoAmIRegAddress) {
   const uint8_t responseWhoAmI =
       i2cReadByteFromRegister(deviceAddress, whoAmIRegAddress);
   Serial.printf("Device address on I²C bus: 0x%X, WHO_AM_I reg val --> 0x%X\n",
-                deviceAddress, responseWhoAmI);
+                i2cAddressOf(deviceAddress), responseWhoAmI);
 }
 
-void printAllI2CDevicesOnBus() {
-  uint8_t deviceCounter;
+uint8_t printAllI2CDevicesOnBus(const uint8_t bus) {
+  uint8_t deviceCounter = 0;
 
-  Serial.println("Scanning for devices");
+  Serial.printf("Scanning for devices on bus %u\n", bus);
   Serial.println("--------------------");
 
   // Scan all addresses from 1 to 126
   for (uint8_t i = 1; i < 127; i++) {
-    Wire.beginTransmission(i);
-
-    // Check for error at address i
-    const uint8_t error = Wire.endTransmission();
+    const I2cStatus error = i2cProbe(i2cDeviceOnBus(bus, i));
 
-    if (error == 0) {
+    if (error == I2cStatus::Ok) {
 
       Serial.printf("I²C device found at address 0x%02X\n", i);
       deviceCounter++;
-    } else if (error == 4) {
+    } else if (error == I2cStatus::OtherError) {
 
       Serial.printf("Unknown error at address 0x%02X\n", i);
     }
@@ -124,4 +120,5 @@ void printAllI2CDevicesOnBus() {
     Serial.println("No I2C devices found");
   else
     Serial.printf("Found %d device(s) in total\n", deviceCounter);
+  return deviceCounter;
 }
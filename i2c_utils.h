@@ -6,31 +6,119 @@
 
 #include <cstdlib>
 
+#include "i2c_scheduler.h"
+
 // -=| I2C |=-
 const int I2C_SDA = 9;
 const int I2C_SCL = 10;
 
-void i2cWriteToRegister(const uint8_t deviceAddress,
-                        const uint8_t registerAddress, const uint8_t value);
+enum class I2cEndian : uint8_t { Big, Little };
+
+/**
+ * Reads `length` consecutive registers starting at `registerAddress` into
+ * `buffer`. Transfers longer than I2C_MAX_CHUNK are split into several
+ * transactions at increasing register addresses. Like every transfer
+ * below it goes through the scheduler of the device's bus
+ * (i2cSchedulerFor()), at the priority and clock set for the device there,
+ * and returns when it is done.
+ */
+I2cStatus i2cReadBlock(const I2cDeviceId deviceAddress,
+                       const uint8_t registerAddress, uint8_t* buffer,
+                       const size_t length);
+
+/**
+ * Reads `length` bytes from a single data port register that does not
+ * auto-increment, such as a sensor FIFO. Every chunk of up to
+ * I2C_MAX_CHUNK bytes addresses the same register again.
+ */
+I2cStatus i2cReadFifo(const I2cDeviceId deviceAddress,
+                      const uint8_t registerAddress, uint8_t* buffer,
+                      const size_t length);
+
+/**
+ * Writes `length` bytes to consecutive registers starting at
+ * `registerAddress`, split the same way as i2cReadBlock().
+ */
+I2cStatus i2cWriteBlock(const I2cDeviceId deviceAddress,
+                        const uint8_t registerAddress, const uint8_t* buffer,
+                        const size_t length);
+
+/**
+ * Reads a `Width`-byte register value (8/16/24/32-bit) in one transaction.
+ * `value` is only written on success.
+ */
+template <typename T, size_t Width = sizeof(T), I2cEndian Order = I2cEndian::Big>
+I2cStatus i2cReadRegister(const I2cDeviceId deviceAddress,
+                          const uint8_t registerAddress, T& value) {
+  static_assert(Width >= 1 && Width <= 4, "register width must be 1..4 bytes");
+  static_assert(Width <= sizeof(T), "register does not fit into T");
+
+  uint8_t buffer[Width];
+  const I2cStatus status =
+      i2cReadBlock(deviceAddress, registerAddress, buffer, Width);
+  if (status != I2cStatus::Ok) {
+    return status;
+  }
+
+  uint32_t raw = 0;
+  for (size_t i = 0; i < Width; i++) {
+    raw = (raw << 8) | buffer[Order == I2cEndian::Big ? i : Width - 1 - i];
+  }
+  value = (T)raw;
 
-uint8_t i2cReadByteFromRegister(const uint8_t deviceAddress,
+  return I2cStatus::Ok;
+}
+
+template <typename T, size_t Width = sizeof(T), I2cEndian Order = I2cEndian::Big>
+I2cStatus i2cWriteRegister(const I2cDeviceId deviceAddress,
+                           const uint8_t registerAddress, const T value) {
+  static_assert(Width >= 1 && Width <= 4, "register width must be 1..4 bytes");
+  static_assert(Width <= sizeof(T), "register does not fit into T");
+
+  uint8_t buffer[Width];
+  uint32_t raw = (uint32_t)value;
+  for (size_t i = 0; i < Width; i++) {
+    buffer[Order == I2cEndian::Big ? Width - 1 - i : i] = raw & 0xFF;
+    raw >>= 8;
+  }
+
+  return i2cWriteBlock(deviceAddress, registerAddress, buffer, Width);
+}
+
+// Addresses the device without a register: Ok if it acknowledged
+I2cStatus i2cProbe(const I2cDeviceId device);
+
+I2cStatus i2cWriteToRegister(const I2cDeviceId deviceAddress,
+                             const uint8_t registerAddress,
+                             const uint8_t value);
+
+// Convenience readers; they return 0 if the transfer failed
+uint8_t i2cReadByteFromRegister(const I2cDeviceId deviceAddress,
                                 const uint8_t registerAddress);
 
-uint16_t i2cReadWordFromRegister(const uint8_t deviceAddress,
+uint16_t i2cReadWordFromRegister(const I2cDeviceId deviceAddress,
                                  const uint8_t registerAddress);
 
-uint16_t i2cReadWordFromRegisterLE(const uint8_t deviceAddress,
+uint16_t i2cReadWordFromRegisterLE(const I2cDeviceId deviceAddress,
                                    const uint8_t registerAddress);
 
-uint32_t i2cReadThreeBytesFromRegister(const uint8_t deviceAddress,
+uint32_t i2cReadThreeBytesFromRegister(const I2cDeviceId deviceAddress,
                                        const uint8_t registerAddress);
 
-void wakeUpDevice(const uint8_t deviceAddress, const uint8_t resetAddress,
+// Bus transaction counter, compiled in with -DI2C_UTILS_COUNT_TRANSACTIONS.
+// Counts every transaction both schedulers ran, i.e. one per chunk.
+#ifdef I2C_UTILS_COUNT_TRANSACTIONS
+uint32_t i2cGetTransactionCount();
+void i2cResetTransactionCount();
+#endif
+
+void wakeUpDevice(const I2cDeviceId deviceAddress, const uint8_t resetAddress,
                   const uint8_t resetValue);
 
-void identifyDevice(const uint8_t deviceAddress,
+void identifyDevice(const I2cDeviceId deviceAddress,
                     const uint8_t whoAmIRegAddress);
 
-void printAllI2CDevicesOnBus();
+// Probes 1..126 on Wire (bus 0) or Wire1 and returns how many answered
+uint8_t printAllI2CDevicesOnBus(const uint8_t bus = 0);
 
 #endif  // I2C_UTILS_H
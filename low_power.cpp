@@ -0,0 +1,59 @@
+#include "low_power.h"
+
+#ifdef ESP_PLATFORM
+#include <esp_sleep.h>
+#else
+// Host build: RTC memory is ordinary memory and deep sleep only advances
+// the simulated clock, see bench/sim_low_power.cpp
+#define RTC_DATA_ATTR
+static bool hostTimerWake = false;
+#endif
+
+// Survives deep sleep, cleared on power-on
+RTC_DATA_ATTR static LowPowerSample sampleRing[LOW_POWER_RING_SIZE];
+RTC_DATA_ATTR static uint16_t ringHead = 0;
+RTC_DATA_ATTR static uint16_t ringCount = 0;
+RTC_DATA_ATTR static uint32_t wakeCount = 0;
+
+bool lowPowerWokeFromTimer() {
+#ifdef ESP_PLATFORM
+  return esp_sleep_get_wakeup_cause() == ESP_SLEEP_WAKEUP_TIMER;
+#else
+  return hostTimerWake;
+#endif
+}
+
+uint32_t lowPowerWakeCount() { return wakeCount; }
+
+void lowPowerAppend(const LowPowerSample& sample) {
+  sampleRing[(ringHead + ringCount) % LOW_POWER_RING_SIZE] = sample;
+  if (ringCount < LOW_POWER_RING_SIZE) {
+    ringCount++;
+  } else {
+    ringHead = (ringHead + 1) % LOW_POWER_RING_SIZE;
+  }
+}
+
+size_t lowPowerPending() { return ringCount; }
+
+bool lowPowerPop(LowPowerSample& sample) {
+  if (ringCount == 0) {
+    return false;
+  }
+  sample = sampleRing[ringHead];
+  ringHead = (ringHead + 1) % LOW_POWER_RING_SIZE;
+  ringCount--;
+  return true;
+}
+
+void lowPowerSleep(uint32_t seconds) {
+  wakeCount++;
+  Serial.flush();
+#ifdef ESP_PLATFORM
+  esp_sleep_enable_timer_wakeup((uint64_t)seconds * 1000000ULL);
+  esp_deep_sleep_start();
+#else
+  host::advanceMicros((uint64_t)seconds * 1000000ULL);
+  hostTimerWake = true;
+#endif
+}
@@ -0,0 +1,74 @@
+#ifndef LOW_POWER_H
+#define LOW_POWER_H
+
+#include <Arduino.h>
+
+// One reading kept in RTC slow memory while the chip is in deep sleep
+struct LowPowerSample {
+  uint32_t timestamp;  // time(nullptr), keeps counting across deep sleep
+  float temperature;
+  float pressure;
+  float humidity;
+};
+
+const size_t LOW_POWER_RING_SIZE = 64;
+
+bool lowPowerWokeFromTimer();
+uint32_t lowPowerWakeCount();
+
+// Appends to the RTC ring, overwriting the oldest sample when full
+void lowPowerAppend(const LowPowerSample& sample);
+size_t lowPowerPending();
+
+// Removes the oldest sample; false when the ring is empty
+bool lowPowerPop(LowPowerSample& sample);
+
+// Arms the RTC timer and enters deep sleep. Does not return; on the host
+// it advances the simulated clock and the next call is a timer wake.
+void lowPowerSleep(uint32_t seconds);
+
+// Current draw and durations of one wake/sleep cycle
+struct LowPowerProfile {
+  float activeMilliamps;  // CPU running, radio off
+  float wifiMilliamps;    // soft AP up
+  float sleepMicroamps;   // deep sleep incl. BME280 standby
+  float supplyVolts;
+  float wakeMillis;       // boot from deep sleep to setup()
+  float sampleMillis;     // sensor init + one forced conversion
+  float flushMillis;      // radio on-time per batch
+};
+
+struct LowPowerEstimate {
+  float dutyCycle;          // fraction of time awake
+  float averageMicroamps;
+  float energyPerSampleMj;
+};
+
+/**
+ * Models the schedule: every sample costs one wake, every
+ * `samplesPerFlush` samples one flush window, and every wake is followed
+ * by a full `sampleIntervalS` of deep sleep. The flush wake runs setup()
+ * without the splash pauses, so its awake time is the flush window.
+ * bench/sim_low_power.cpp steps through the same schedule.
+ */
+inline LowPowerEstimate lowPowerEstimate(const LowPowerProfile& profile,
+                                         uint32_t sampleIntervalS,
+                                         uint16_t samplesPerFlush) {
+  const float sampleMs = samplesPerFlush * (profile.wakeMillis + profile.sampleMillis);
+  const float awakeMs = sampleMs + profile.flushMillis;
+  const float sleepMs = 1000.0f * sampleIntervalS * samplesPerFlush;
+  const float periodMs = awakeMs + sleepMs;
+
+  // Charge per flush period in mA*ms
+  const float charge = sampleMs * profile.activeMilliamps +
+                       profile.flushMillis * profile.wifiMilliamps +
+                       sleepMs * profile.sleepMicroamps / 1000.0f;
+
+  LowPowerEstimate estimate;
+  estimate.dutyCycle = awakeMs / periodMs;
+  estimate.averageMicroamps = 1000.0f * charge / periodMs;
+  estimate.energyPerSampleMj = charge * profile.supplyVolts / 1000.0f / samplesPerFlush;
+  return estimate;
+}
+
+#endif  // LOW_POWER_H
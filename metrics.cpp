@@ -0,0 +1,246 @@
+#include "metrics.h"
+
+#include <atomic>
+
+#include "chunked_writer.h"
+
+#ifdef ESP_PLATFORM
+#include <freertos/FreeRTOS.h>
+#include <freertos/task.h>
+static constexpr size_t SHARDS = portNUM_PROCESSORS;
+#else
+static constexpr size_t SHARDS = 4;
+#endif
+
+static constexpr size_t STAGES = (size_t)MetricsStage::COUNT;
+static constexpr size_t COUNTERS = (size_t)MetricsCounter::COUNT;
+
+// Another task on the same core may preempt a record halfway, so the shard
+// is updated with relaxed atomic adds; the Xtensa cores do the 32-bit ones
+// with S32C1I, the 64-bit sums and counters take a short critical section
+struct Histogram {
+  std::atomic<uint32_t> buckets[METRICS_BUCKETS + 1];
+  std::atomic<uint64_t> sumTicks;
+};
+
+struct Shard {
+  Histogram histograms[STAGES];
+  std::atomic<uint64_t> counters[COUNTERS];
+};
+
+static Shard shards[SHARDS];
+
+static const char* const STAGE_NAMES[STAGES] = {
+    "i2c_transaction", "bme_compensation", "read_sensors",
+    "oled_flush",      "http_handler",     "loop_period"};
+
+static const struct {
+  const char* name;
+  const char* help;
+} COUNTER_INFO[COUNTERS] = {
+    {"dmp_i2c_errors_total", "I2C transactions that ended with an error."},
+    {"dmp_i2c_bytes_total", "Payload bytes moved on the I2C bus."},
+};
+
+// Each core writes its own shard; host threads are spread over the shards
+static inline Shard& currentShard() {
+#ifdef ESP_PLATFORM
+  return shards[xPortGetCoreID()];
+#else
+  static std::atomic<uint32_t> nextShard{0};
+  thread_local const size_t index = nextShard.fetch_add(1) % SHARDS;
+  return shards[index];
+#endif
+}
+
+// Bucket i counts durations up to 2^(METRICS_FIRST_SHIFT + i) ticks
+static inline size_t bucketFor(uint32_t ticks) {
+  if (ticks <= (1u << METRICS_FIRST_SHIFT)) {
+    return 0;
+  }
+  const size_t bits = 32 - __builtin_clz(ticks - 1);
+  const size_t bucket = bits - METRICS_FIRST_SHIFT;
+  return bucket < METRICS_BUCKETS ? bucket : METRICS_BUCKETS;
+}
+
+uint32_t metricsTicksPerMicro() {
+#ifdef ESP_PLATFORM
+  return getCpuFrequencyMhz();
+#else
+  return 1000;
+#endif
+}
+
+void metricsRecord(MetricsStage stage, uint32_t ticks) {
+  Histogram& histogram = currentShard().histograms[(size_t)stage];
+  histogram.buckets[bucketFor(ticks)].fetch_add(1, std::memory_order_relaxed);
+  histogram.sumTicks.fetch_add(ticks, std::memory_order_relaxed);
+}
+
+void metricsAdd(MetricsCounter counter, uint32_t amount) {
+  currentShard().counters[(size_t)counter].fetch_add(amount, std::memory_order_relaxed);
+}
+
+void metricsMark(MetricsStage stage, uint32_t& last) {
+  const uint32_t now = metricsTicks();
+  if (last != 0) {
+    metricsRecord(stage, now - last);
+  }
+  last = now != 0 ? now : 1;
+}
+
+void metricsSnapshot(MetricsStage stage, MetricsHistogram& histogram) {
+  histogram = {};
+  for (size_t s = 0; s < SHARDS; s++) {
+    const Histogram& shard = shards[s].histograms[(size_t)stage];
+    for (size_t i = 0; i <= METRICS_BUCKETS; i++) {
+      const uint32_t count = shard.buckets[i].load(std::memory_order_relaxed);
+      histogram.buckets[i] += count;
+      histogram.count += count;
+    }
+    histogram.sumTicks += shard.sumTicks.load(std::memory_order_relaxed);
+  }
+}
+
+uint64_t metricsCounter(MetricsCounter counter) {
+  uint64_t value = 0;
+  for (size_t s = 0; s < SHARDS; s++) {
+    value += shards[s].counters[(size_t)counter].load(std::memory_order_relaxed);
+  }
+  return value;
+}
+
+const char* metricsStageName(MetricsStage stage) {
+  return (size_t)stage < STAGES ? STAGE_NAMES[(size_t)stage] : "";
+}
+
+void metricsReset() {
+  for (Shard& shard : shards) {
+    for (Histogram& histogram : shard.histograms) {
+      for (std::atomic<uint32_t>& bucket : histogram.buckets) {
+        bucket.store(0, std::memory_order_relaxed);
+      }
+      histogram.sumTicks.store(0, std::memory_order_relaxed);
+    }
+    for (std::atomic<uint64_t>& counter : shard.counters) {
+      counter.store(0, std::memory_order_relaxed);
+    }
+  }
+}
+
+// -=| Prometheus text format |=-
+
+static void writeUnsigned64(ChunkedWriter& out, uint64_t value) {
+  char digits[24];
+  char* p = digits + sizeof(digits);
+  do {
+    *--p = '0' + value % 10;
+    value /= 10;
+  } while (value != 0);
+  out.write(p, digits + sizeof(digits) - p);
+}
+
+// Seconds with up to 9 decimals, integer math only
+static void writeSeconds(ChunkedWriter& out, uint64_t nanos) {
+  writeUnsigned64(out, nanos / 1000000000);
+  uint32_t fraction = nanos % 1000000000;
+  if (fraction == 0) {
+    return;
+  }
+  char digits[10] = {'.'};
+  for (int i = 9; i >= 1; i--) {
+    digits[i] = '0' + fraction % 10;
+    fraction /= 10;
+  }
+  size_t len = 10;
+  while (digits[len - 1] == '0') {
+    len--;
+  }
+  out.write(digits, len);
+}
+
+static uint64_t ticksToNanos(uint64_t ticks) {
+  return ticks * 1000 / metricsTicksPerMicro();
+}
+
+static void writeHeader(ChunkedWriter& out, const char* name, const char* help,
+                        const char* type) {
+  out.write("# HELP ");
+  out.write(name);
+  out.write(' ');
+  out.write(help);
+  out.write("\n# TYPE ");
+  out.write(name);
+  out.write(' ');
+  out.write(type);
+  out.write('\n');
+}
+
+static void writeStageLabel(ChunkedWriter& out, const char* suffix,
+                            MetricsStage stage) {
+  out.write("dmp_stage_seconds");
+  out.write(suffix);
+  out.write("{stage=\"");
+  out.write(metricsStageName(stage));
+  out.write('"');
+}
+
+void metricsWriteStage(ChunkedWriter& out, MetricsStage stage) {
+  if (stage == (MetricsStage)0) {
+    writeHeader(out, "dmp_stage_seconds",
+                "Time spent per call in instrumented stages.", "histogram");
+  }
+
+  MetricsHistogram histogram;
+  metricsSnapshot(stage, histogram);
+
+  // Buckets are cumulative in the exposition format
+  uint64_t cumulative = 0;
+  for (size_t i = 0; i <= METRICS_BUCKETS; i++) {
+    cumulative += histogram.buckets[i];
+    writeStageLabel(out, "_bucket", stage);
+    out.write(",le=\"");
+    if (i < METRICS_BUCKETS) {
+      writeSeconds(out, ticksToNanos(1ull << (METRICS_FIRST_SHIFT + i)));
+    } else {
+      out.write("+Inf");
+    }
+    out.write("\"} ");
+    writeUnsigned64(out, cumulative);
+    out.write('\n');
+  }
+
+  writeStageLabel(out, "_sum", stage);
+  out.write("} ");
+  writeSeconds(out, ticksToNanos(histogram.sumTicks));
+  out.write('\n');
+  writeStageLabel(out, "_count", stage);
+  out.write("} ");
+  writeUnsigned64(out, histogram.count);
+  out.write('\n');
+}
+
+void metricsWriteCounter(ChunkedWriter& out, const char* name,
+                         const char* help, uint64_t value) {
+  writeHeader(out, name, help, "counter");
+  out.write(name);
+  out.write(' ');
+  writeUnsigned64(out, value);
+  out.write('\n');
+}
+
+void metricsWriteGauge(ChunkedWriter& out, const char* name, const char* help,
+                       uint64_t value) {
+  writeHeader(out, name, help, "gauge");
+  out.write(name);
+  out.write(' ');
+  writeUnsigned64(out, value);
+  out.write('\n');
+}
+
+void metricsWriteCounters(ChunkedWriter& out) {
+  for (size_t i = 0; i < COUNTERS; i++) {
+    metricsWriteCounter(out, COUNTER_INFO[i].name, COUNTER_INFO[i].help,
+                        metricsCounter((MetricsCounter)i));
+  }
+}
@@ -0,0 +1,108 @@
+#ifndef METRICS_H
+#define METRICS_H
+
+#include <Arduino.h>
+
+#ifndef ESP_PLATFORM
+#include <chrono>
+#endif
+
+class ChunkedWriter;
+
+/**
+ * Latency histograms and counters for the hot paths, exported in the
+ * Prometheus text format. Durations are measured in ticks of a free-running
+ * counter (CPU cycles on the ESP32, nanoseconds on the host) and counted in
+ * power-of-two buckets from 2^8 to 2^31 ticks plus +Inf. Each core records
+ * into its own shard with relaxed atomic adds, so a record is a counter
+ * read, a count-leading-zeros and two adds with no lock and no allocation,
+ * and tasks preempting each other on a core lose no samples. Readers may
+ * see a sum that is one update ahead of the buckets.
+ *
+ * Build with -DMETRICS_DISABLE to compile the METRICS_* macros out.
+ */
+
+enum class MetricsStage : uint8_t {
+  I2cTransaction,   // one I2cScheduler START..STOP
+  BmeCompensation,  // BME280 raw to physical values
+  ReadSensors,      // readSensors() in the sketch
+  OledFlush,        // OledView::update()
+  HttpHandler,      // one call of the HTTP request handler
+  LoopPeriod,       // start to start of loop()
+  COUNT
+};
+
+enum class MetricsCounter : uint8_t {
+  I2cErrors,  // transactions that ended with an error
+  I2cBytes,   // payload bytes moved on the bus
+  COUNT
+};
+
+static constexpr size_t METRICS_BUCKETS = 24;
+static constexpr uint8_t METRICS_FIRST_SHIFT = 8;
+
+// Free-running tick counter; differences are valid across wrap-around
+inline uint32_t metricsTicks() {
+#ifdef ESP_PLATFORM
+  return ESP.getCycleCount();
+#else
+  return (uint32_t)std::chrono::duration_cast<std::chrono::nanoseconds>(
+             std::chrono::steady_clock::now().time_since_epoch())
+      .count();
+#endif
+}
+
+uint32_t metricsTicksPerMicro();
+
+void metricsRecord(MetricsStage stage, uint32_t ticks);
+void metricsAdd(MetricsCounter counter, uint32_t amount);
+
+// Records the ticks since `last` (skipped while it is 0) and moves it on
+void metricsMark(MetricsStage stage, uint32_t& last);
+
+// Stage histogram summed over the shards; the last bucket is +Inf
+struct MetricsHistogram {
+  uint64_t buckets[METRICS_BUCKETS + 1];
+  uint64_t count;
+  uint64_t sumTicks;
+};
+
+void metricsSnapshot(MetricsStage stage, MetricsHistogram& histogram);
+uint64_t metricsCounter(MetricsCounter counter);
+const char* metricsStageName(MetricsStage stage);
+void metricsReset();
+
+// Prometheus text for one stage (the first one also writes # HELP/# TYPE)
+// and for the counters
+void metricsWriteStage(ChunkedWriter& out, MetricsStage stage);
+void metricsWriteCounters(ChunkedWriter& out);
+
+// Prometheus helpers for values kept elsewhere
+void metricsWriteCounter(ChunkedWriter& out, const char* name,
+                         const char* help, uint64_t value);
+void metricsWriteGauge(ChunkedWriter& out, const char* name, const char* help,
+                       uint64_t value);
+
+// Records the lifetime of the scope
+class MetricsScope {
+ public:
+  explicit MetricsScope(MetricsStage stage)
+      : stage(stage), start(metricsTicks()) {}
+  ~MetricsScope() { metricsRecord(stage, metricsTicks() - start); }
+
+ private:
+  const MetricsStage stage;
+  const uint32_t start;
+};
+
+#ifdef METRICS_DISABLE
+#define METRICS_SCOPE(stage) ((void)0)
+#define METRICS_ADD(counter, amount) ((void)0)
+#define METRICS_MARK(stage, last) ((void)0)
+#else
+#define METRICS_SCOPE(stage) MetricsScope metricsScope_(stage)
+#define METRICS_ADD(counter, amount) metricsAdd(counter, amount)
+#define METRICS_MARK(stage, last) metricsMark(stage, last)
+#endif
+
+#endif  // METRICS_H
@@ -1,15 +1,21 @@
 #include "mpu_x.h"
 
+#include <math.h>
 #include <stdint.h>
 
 void MPUx::init() {
-  // Perform soft reset
-  wakeUpDevice(deviceAddress, IMU_REG_PWR_MGMT_1, IMU_VAL_PWR_MGMT_1_RESET);
+  const uint32_t startMicros = micros();
+
+  // Perform soft reset; writes before it completes would be lost
+  i2cWriteToRegister(deviceAddress, IMU_REG_PWR_MGMT_1, IMU_VAL_PWR_MGMT_1_RESET);
+  if (!waitForReset()) {
+    Serial.println("MPU soft reset did not complete!");
+  }
+  chipId = i2cReadByteFromRegister(deviceAddress, IMU_REG_WHO_AM_I);
 
   // Enable bypass mode
   i2cWriteToRegister(deviceAddress, IMU_REG_INT_BYP_CFG,
                      IMU_VAL_REG_INT_BYP_CFG_BYP_EN);
-  delay(100);
 
   // Enable measurements on device
   uint8_t currPwrMgmt =
@@ -17,95 +23,175 @@ void MPUx::init() {
   uint8_t newPwrMgmt = currPwrMgmt & ~0x40;
   i2cWriteToRegister(deviceAddress, IMU_REG_PWR_MGMT_1, newPwrMgmt);
 
-  delay(200);
-
-  selfCalibrate();
-  delay(100);
+  configure();
 
   // Set the sample rate divider to 5
   i2cWriteToRegister(deviceAddress, IMU_REG_SMP_RAT_CFG, 0x05);
-  delay(100);
+
+  calibrationFromCache =
+      cachedCalibration.whoAmI != 0 && cachedCalibration.whoAmI == chipId;
+  if (calibrationFromCache) {
+    acclOffset = cachedCalibration.acclOffset;
+    gyroOffset = cachedCalibration.gyroOffset;
+    calibrationState = CalibrationState::Done;
+  }
+  updateConversion();
+
+  // Register writes take effect at once, only the gyro needs to spin up
+  delay(IMU_STARTUP_MS);
+  initTimeMicros = micros() - startMicros;
+}
+
+// Polls PWR_MGMT_1 until the self-clearing DEVICE_RESET bit reads 0
+bool MPUx::waitForReset() {
+  const unsigned long start = millis();
+  do {
+    delay(1);
+    uint8_t value = 0;
+    if (i2cReadRegister<uint8_t>(deviceAddress, IMU_REG_PWR_MGMT_1, value) == I2cStatus::Ok &&
+        (value & IMU_VAL_PWR_MGMT_1_RESET) == 0) {
+      return true;
+    }
+  } while (millis() - start < IMU_RESET_TIMEOUT_MS);
+  return false;
 }
 
-void MPUx::selfCalibrate() {
+void MPUx::configure() {
   // Enable digital low pass filter for the gyroscope
   uint8_t currGyroCfg =
       i2cReadByteFromRegister(deviceAddress, IMU_REG_GYRO_CFG);
   uint8_t newGyroCfg = currGyroCfg & 0xFC;
   i2cWriteToRegister(deviceAddress, IMU_REG_GYRO_CFG, newGyroCfg);
-  delay(100);
 
   // Set gyroscope low pass filter to the lowest noise setting
   uint8_t currConfReg = i2cReadByteFromRegister(deviceAddress, IMU_REG_GEN_CFG);
   uint8_t newConfReg = currConfReg & 0xF8;  // Set the last 3 bits to 0
   newConfReg |= 0x06;                       // Set the last 3 bits to 110
   i2cWriteToRegister(deviceAddress, IMU_REG_GEN_CFG, newConfReg);
-  delay(100);
 
   // Set Accl & Gyro range
   uint8_t currAclCfg = i2cReadByteFromRegister(deviceAddress, IMU_REG_ACL1_CFG);
   uint8_t newAclCfg = currAclCfg & 0xE7;
   newAclCfg |= (0 << 3);
   i2cWriteToRegister(deviceAddress, IMU_REG_ACL1_CFG, newAclCfg);
-  delay(100);
 
-  currGyroCfg = i2cReadByteFromRegister(deviceAddress, IMU_REG_GYRO_CFG);
-  newGyroCfg = currGyroCfg & 0xE7;
+  newGyroCfg &= 0xE7;
   newGyroCfg |= (0 << 3);
   i2cWriteToRegister(deviceAddress, IMU_REG_GYRO_CFG, newGyroCfg);
-  delay(100);
 
   // Enable accelerometer low pass filter & set to lowest noise
   uint8_t currAcl2Cfg =
       i2cReadByteFromRegister(deviceAddress, IMU_REG_ACL2_CFG);
-  uint8_t newAcl2Cfg = currAcl2Cfg & ~8;
-  i2cWriteToRegister(deviceAddress, IMU_REG_ACL2_CFG, newAcl2Cfg);
-  delay(100);
-
-  currAcl2Cfg = i2cReadByteFromRegister(deviceAddress, IMU_REG_ACL2_CFG);
-  newAcl2Cfg = currAclCfg & 0xF8;
+  uint8_t newAcl2Cfg = currAcl2Cfg & ~8 & 0xF8;
   newAcl2Cfg |= 0x06;
   i2cWriteToRegister(deviceAddress, IMU_REG_ACL2_CFG, newAcl2Cfg);
+}
+
+// -=| Calibration |=-
 
-  delay(200);
+void MPUx::startCalibration() {
+  calibrationSkip = CALIBRATION_SKIP_SAMPLES;
+  calibrationCount = 0;
+  calibrationFromCache = false;
+  calibrationState = CalibrationState::Collecting;
+}
+
+bool MPUx::calibratePolled(uint8_t attempts) {
+  startCalibration();
+  const uint32_t rejects = calibrationRejects.load();
+  while (calibrationState.load() == CalibrationState::Collecting &&
+         calibrationRejects.load() - rejects < attempts) {
+    const floatThreeVals accl = getThreeValsRaw(IMU_REG_ACCL_VALS_X, IMU_REG_ACCL_VALS_Y,
+                                                IMU_REG_ACCL_VALS_Z);
+    const floatThreeVals gyro = getThreeValsRaw(IMU_REG_GYRO_VALS_X, IMU_REG_GYRO_VALS_Y,
+                                                IMU_REG_GYRO_VALS_Z);
+    const RawSample sample = {{(int16_t)accl.x, (int16_t)accl.y, (int16_t)accl.z},
+                              {(int16_t)gyro.x, (int16_t)gyro.y, (int16_t)gyro.z}};
+    calibrationAdd(&sample, 1);
+    delay(1);
+  }
+  if (calibrationState.load() != CalibrationState::Done) {
+    calibrationState = CalibrationState::None;
+    return false;
+  }
+  return true;
+}
 
-  // Get an average from 100 samples to determine a minimal offset
-  floatThreeVals initialOffsetAccl{0.0, 0.0, 0.0};
-  floatThreeVals initialOffsetGyro{0.0, 0.0, 0.0};
+void MPUx::calibrationAdd(const RawSample* raw, size_t count) {
+  if (calibrationState.load(std::memory_order_relaxed) != CalibrationState::Collecting) {
+    return;
+  }
 
-  for (int i = 0; i < 100; i++) {
-    floatThreeVals acclCurr = getThreeValsRaw(
-        IMU_REG_ACCL_VALS_X, IMU_REG_ACCL_VALS_Y, IMU_REG_ACCL_VALS_Z);
-    floatThreeVals gyroCurr = getThreeValsRaw(
-        IMU_REG_GYRO_VALS_X, IMU_REG_GYRO_VALS_Y, IMU_REG_GYRO_VALS_Z);
+  const int16_t* words = (const int16_t*)raw;
+  for (size_t i = 0; i < count; i++) {
+    // The first frames after a reset or a DLPF change are still settling
+    if (calibrationSkip > 0) {
+      calibrationSkip--;
+      continue;
+    }
+    calibrationCount++;
+    const float weight = 1.0f / calibrationCount;
+    for (size_t axis = 0; axis < AXES; axis++) {
+      const float value = words[AXES * i + axis];
+      const float delta = value - calibrationMean[axis];
+      calibrationMean[axis] = calibrationCount == 1 ? value : calibrationMean[axis] + delta * weight;
+      calibrationM2[axis] = calibrationCount == 1 ? 0.0f : calibrationM2[axis] + delta * (value - calibrationMean[axis]);
+    }
+    if (calibrationCount == CALIBRATION_SAMPLES) {
+      calibrationFinish();
+      return;
+    }
+  }
+}
 
-    initialOffsetAccl.x += acclCurr.x;
-    initialOffsetAccl.y += acclCurr.y;
-    initialOffsetAccl.z += acclCurr.z;
+void MPUx::calibrationFinish() {
+  bool still = fabsf(calibrationMean[AcclZ] - IMU_ACCL_ONE_G) <= CALIBRATION_MAX_GRAVITY_ERROR;
+  for (size_t axis = 0; axis < AXES; axis++) {
+    const float stddev = sqrtf(calibrationM2[axis] / (calibrationCount - 1));
+    const float limit = axis < GyroX ? CALIBRATION_MAX_ACCL_STDDEV : CALIBRATION_MAX_GYRO_STDDEV;
+    still = still && stddev <= limit;
+  }
 
-    initialOffsetGyro.x += gyroCurr.x;
-    initialOffsetGyro.y += gyroCurr.y;
-    initialOffsetGyro.z += gyroCurr.z;
-    delay(5);
+  if (!still) {
+    calibrationRejects++;
+    calibrationCount = 0;
+    return;
   }
 
-  acclOffset.x = initialOffsetAccl.x / 100.0f;
-  acclOffset.y = initialOffsetAccl.y / 100.0f;
-  acclOffset.z = initialOffsetAccl.z / 100.0f - 16384.0f;
+  acclOffset = {calibrationMean[AcclX], calibrationMean[AcclY],
+                calibrationMean[AcclZ] - IMU_ACCL_ONE_G};
+  gyroOffset = {calibrationMean[GyroX], calibrationMean[GyroY], calibrationMean[GyroZ]};
+  updateConversion();
+  // Publishes the offsets to other cores reading getCalibration()
+  calibrationState.store(CalibrationState::Done, std::memory_order_release);
+}
 
-  gyroOffset.x = initialOffsetGyro.x / 100.0f;
-  gyroOffset.y = initialOffsetGyro.y / 100.0f;
-  gyroOffset.z = initialOffsetGyro.z / 100.0f;
+// Same units as getAcclVals() / getGyroVals()
+void MPUx::updateConversion() {
+  const float acclScale = 1.0f / 16384.0f;
+  const float gyroScale = 250.0f / 16384.0f;
+  const float* accl = &acclOffset.x;
+  const float* gyro = &gyroOffset.x;
+  for (int i = 0; i < 3; i++) {
+    conversion.scale[AcclX + i] = acclScale;
+    conversion.bias[AcclX + i] = -accl[i] * acclScale;
+    conversion.scale[GyroX + i] = gyroScale;
+    conversion.bias[GyroX + i] = -gyro[i] * gyroScale;
+  }
 }
 
 MPUx::floatThreeVals MPUx::getThreeValsRaw(uint8_t xAddr, uint8_t yAddr,
                                            uint8_t zAddr) {
-  // Read raw data
-  int16_t xRaw = (int16_t)i2cReadWordFromRegister(deviceAddress, xAddr);
-  int16_t yRaw = (int16_t)i2cReadWordFromRegister(deviceAddress, yAddr);
-  int16_t zRaw = (int16_t)i2cReadWordFromRegister(deviceAddress, zAddr);
-
-  return {(float)xRaw, (float)yRaw, (float)zRaw};
+  // The three axes are consecutive big-endian words, one burst keeps them
+  // from the same sample
+  (void)yAddr;
+  (void)zAddr;
+  uint8_t raw[6] = {0};
+  i2cReadBlock(deviceAddress, xAddr, raw, sizeof(raw));
+
+  return {(float)(int16_t)(raw[0] << 8 | raw[1]),
+          (float)(int16_t)(raw[2] << 8 | raw[3]),
+          (float)(int16_t)(raw[4] << 8 | raw[5])};
 }
 
 MPUx::floatThreeVals MPUx::getThreeValsComp(uint8_t xAddr, uint8_t yAddr,
@@ -155,4 +241,176 @@ void MPUx::printMPUData() {
                 accl.x, accl.y, accl.z);
   Serial.printf("| Gyroscope (°/sec) >>> x: %+07.2f y: %+07.2f z: %+07.2f |\n",
                 gyro.x, gyro.y, gyro.z);
-}
\ No newline at end of file
+}
+
+// -=| FIFO |=-
+
+bool MPUx::beginFifo(uint8_t sampleRateDivider, uint8_t dlpf) {
+  if (dlpf < 1 || dlpf > 6) {
+    return false;
+  }
+
+  // Stop the FIFO before changing what is written into it
+  if (i2cWriteToRegister(deviceAddress, IMU_REG_USER_CTRL, 0) != I2cStatus::Ok ||
+      i2cWriteToRegister(deviceAddress, IMU_REG_FIFO_EN, 0) != I2cStatus::Ok) {
+    return false;
+  }
+
+  // FCHOICE_B = 0 so both DLPFs are in use and the internal rate is 1 kHz
+  const uint8_t gyroCfg = i2cReadByteFromRegister(deviceAddress, IMU_REG_GYRO_CFG);
+  if (i2cWriteToRegister(deviceAddress, IMU_REG_GYRO_CFG, gyroCfg & 0xFC) != I2cStatus::Ok ||
+      i2cWriteToRegister(deviceAddress, IMU_REG_ACL2_CFG, dlpf) != I2cStatus::Ok ||
+      i2cWriteToRegister(deviceAddress, IMU_REG_GEN_CFG,
+                         IMU_VAL_GEN_CFG_FIFO_MODE | dlpf) != I2cStatus::Ok ||
+      i2cWriteToRegister(deviceAddress, IMU_REG_SMP_RAT_CFG, sampleRateDivider) != I2cStatus::Ok ||
+      i2cWriteToRegister(deviceAddress, IMU_REG_FIFO_EN,
+                         IMU_VAL_FIFO_EN_ACCL_GYRO) != I2cStatus::Ok) {
+    return false;
+  }
+
+  fifoHead = 0;
+  fifoCount = 0;
+  fifoStats = {};
+  fifoEnabled = true;
+  resetFifo();
+  return true;
+}
+
+void MPUx::endFifo() {
+  i2cWriteToRegister(deviceAddress, IMU_REG_USER_CTRL, 0);
+  i2cWriteToRegister(deviceAddress, IMU_REG_FIFO_EN, 0);
+  fifoEnabled = false;
+}
+
+void MPUx::resetFifo() {
+  i2cWriteToRegister(deviceAddress, IMU_REG_USER_CTRL,
+                     IMU_VAL_USER_CTRL_FIFO_EN | IMU_VAL_USER_CTRL_FIFO_RST);
+}
+
+size_t MPUx::pollFifo() {
+  if (!fifoEnabled) {
+    return 0;
+  }
+
+  // Reading INT_STATUS clears the overflow flag. Frames drained by the
+  // previous poll were all written before the FIFO filled up, but what
+  // follows the cut-off frame is misaligned.
+  uint8_t status = 0;
+  if (i2cReadRegister(deviceAddress, IMU_REG_INT_STATUS, status) != I2cStatus::Ok) {
+    return 0;
+  }
+  if (status & IMU_VAL_INT_STATUS_FIFO_OFLOW) {
+    fifoStats.overflows++;
+    resetFifo();
+    return 0;
+  }
+
+  uint16_t bytes = 0;
+  if (i2cReadRegister(deviceAddress, IMU_REG_FIFO_COUNT, bytes) != I2cStatus::Ok) {
+    return 0;
+  }
+  bytes &= 0x1FFF;
+
+  size_t frames = bytes / IMU_FIFO_FRAME;
+  if (frames > FIFO_RING_SAMPLES - fifoCount) {
+    // Left in the sensor; it overflows if the consumer keeps falling behind
+    frames = FIFO_RING_SAMPLES - fifoCount;
+  }
+
+  size_t added = 0;
+  while (added < frames) {
+    // One burst up to the end of the ring, i2cReadFifo splits it further
+    // into Wire-buffer-sized transactions
+    const size_t tail = (fifoHead + fifoCount) % FIFO_RING_SAMPLES;
+    size_t run = frames - added;
+    if (run > FIFO_RING_SAMPLES - tail) {
+      run = FIFO_RING_SAMPLES - tail;
+    }
+
+    uint8_t* raw = (uint8_t*)&fifoRing[tail];
+    fifoStats.bursts++;
+    if (i2cReadFifo(deviceAddress, IMU_REG_FIFO_R_W, raw,
+                    run * IMU_FIFO_FRAME) != I2cStatus::Ok) {
+      // Frame alignment is lost, start over with an empty FIFO
+      fifoStats.overflows++;
+      resetFifo();
+      return added;
+    }
+
+    // Big-endian words to int16 in place
+    int16_t* words = (int16_t*)raw;
+    for (size_t i = 0; i < run * IMU_FIFO_FRAME / 2; i++) {
+      words[i] = (int16_t)(raw[2 * i] << 8 | raw[2 * i + 1]);
+    }
+
+    fifoCount += run;
+    added += run;
+  }
+  fifoStats.samples += added;
+  return added;
+}
+
+size_t MPUx::readSamples(RawSample* samples, size_t count) {
+  pollFifo();
+
+  if (count > fifoCount) {
+    count = fifoCount;
+  }
+  for (size_t i = 0; i < count; i++) {
+    samples[i] = fifoRing[(fifoHead + i) % FIFO_RING_SAMPLES];
+  }
+  calibrationAdd(samples, count);
+  fifoHead = (fifoHead + count) % FIFO_RING_SAMPLES;
+  fifoCount -= count;
+  return count;
+}
+
+size_t MPUx::readBlock(SampleBlock& block) {
+  pollFifo();
+
+  size_t count = fifoCount < SampleBlock::CAPACITY ? fifoCount : SampleBlock::CAPACITY;
+  block.count = 0;
+  while (block.count < count) {
+    // At most two contiguous runs of the ring
+    size_t run = count - block.count;
+    if (run > FIFO_RING_SAMPLES - fifoHead) {
+      run = FIFO_RING_SAMPLES - fifoHead;
+    }
+    float* const out[AXES] = {
+        block.values[AcclX] + block.count, block.values[AcclY] + block.count,
+        block.values[AcclZ] + block.count, block.values[GyroX] + block.count,
+        block.values[GyroY] + block.count, block.values[GyroZ] + block.count};
+    calibrationAdd(&fifoRing[fifoHead], run);
+    convertSamples(&fifoRing[fifoHead], run, conversion, out);
+
+    fifoHead = (fifoHead + run) % FIFO_RING_SAMPLES;
+    fifoCount -= run;
+    block.count += run;
+  }
+  return block.count;
+}
+
+void MPUx::convertSamples(const RawSample* raw, size_t count,
+                          const Conversion& conversion, float* const out[AXES]) {
+  // RawSample is six int16, so the batch is a flat array with stride AXES
+  const int16_t* words = (const int16_t*)raw;
+  const size_t grouped = count - count % CONVERT_LANES;
+
+  for (size_t axis = 0; axis < AXES; axis++) {
+    const float scale = conversion.scale[axis];
+    const float bias = conversion.bias[axis];
+    float* __restrict dst = out[axis];
+    for (size_t i = 0; i < grouped; i += CONVERT_LANES) {
+      for (size_t lane = 0; lane < CONVERT_LANES; lane++) {
+        dst[i + lane] = (float)words[AXES * (i + lane) + axis] * scale + bias;
+      }
+    }
+  }
+
+  for (size_t i = grouped; i < count; i++) {
+    for (size_t axis = 0; axis < AXES; axis++) {
+      out[axis][i] = (float)words[AXES * i + axis] * conversion.scale[axis] +
+                     conversion.bias[axis];
+    }
+  }
+}
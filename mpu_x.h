@@ -3,6 +3,8 @@
 
 #include "i2c_utils.h"
 
+#include <atomic>
+
 class MPUx {
  public:
   struct floatThreeVals {
@@ -11,6 +13,61 @@ class MPUx {
     float z;
   };
 
+  // One FIFO frame as stored by the sensor: raw accelerometer and gyroscope
+  // counts of the same sample instant
+  struct RawSample {
+    int16_t accl[3];
+    int16_t gyro[3];
+  };
+
+  struct FifoStats {
+    uint32_t samples;    // frames moved into the ring
+    uint32_t overflows;  // times the sensor FIFO filled up and was reset
+    uint32_t bursts;     // FIFO data reads
+  };
+
+  // Frames buffered on the host side between pollFifo() and readSamples()
+  static constexpr size_t FIFO_RING_SAMPLES = 512;
+
+  enum Axis { AcclX, AcclY, AcclZ, GyroX, GyroY, GyroZ, AXES };
+
+  // Raw count to physical unit per axis, value = raw * scale + bias, with
+  // the calibration offset folded into bias
+  struct Conversion {
+    float scale[AXES];
+    float bias[AXES];
+  };
+
+  // Structure-of-arrays batch: accel in g, gyro in °/s, one array per axis
+  struct SampleBlock {
+    static constexpr size_t CAPACITY = 256;
+    float values[AXES][CAPACITY];
+    size_t count;
+  };
+
+  // Samples handled per vector group by convertSamples()
+  static constexpr size_t CONVERT_LANES = 8;
+
+  // Offsets in raw counts as they are persisted across resets. whoAmI is 0
+  // while nothing has been loaded or measured.
+  struct Calibration {
+    uint8_t whoAmI;
+    floatThreeVals acclOffset;
+    floatThreeVals gyroOffset;
+  };
+
+  enum class CalibrationState : uint8_t { None, Collecting, Done };
+
+  // FIFO frames averaged per calibration attempt, after the skipped ones
+  static constexpr uint32_t CALIBRATION_SAMPLES = 1000;
+  static constexpr uint32_t CALIBRATION_SKIP_SAMPLES = 50;
+  // An attempt is rejected as "moving" above these standard deviations,
+  // in raw counts: about 1 °/s and 0.02 g at ±250 °/s / ±2 g
+  static constexpr float CALIBRATION_MAX_GYRO_STDDEV = 131.0f;
+  static constexpr float CALIBRATION_MAX_ACCL_STDDEV = 328.0f;
+  // ... or if Z is further than 0.1 g from 1 g, the offsets assume Z up
+  static constexpr float CALIBRATION_MAX_GRAVITY_ERROR = 1638.0f;
+
  private:
   static uint8_t constexpr IMU_REG_GEN_CFG = 0x1A;
   static uint8_t constexpr IMU_REG_GYRO_CFG = 0x1B;
@@ -26,26 +83,160 @@ class MPUx {
   static uint8_t constexpr IMU_REG_GYRO_VALS_X = 0x43;
   static uint8_t constexpr IMU_REG_GYRO_VALS_Y = 0x45;
   static uint8_t constexpr IMU_REG_GYRO_VALS_Z = 0x47;
+  static uint8_t constexpr IMU_REG_FIFO_EN = 0x23;
+  static uint8_t constexpr IMU_REG_INT_STATUS = 0x3A;
+  static uint8_t constexpr IMU_REG_USER_CTRL = 0x6A;
+  static uint8_t constexpr IMU_REG_FIFO_COUNT = 0x72;
+  static uint8_t constexpr IMU_REG_FIFO_R_W = 0x74;
 
   static uint8_t constexpr IMU_VAL_PWR_MGMT_1_RESET = 0x80;
   static uint8_t constexpr IMU_VAL_REG_INT_BYP_CFG_BYP_EN = 0x02;
+  static uint8_t constexpr IMU_VAL_FIFO_EN_ACCL_GYRO = 0x78;
+  static uint8_t constexpr IMU_VAL_USER_CTRL_FIFO_EN = 0x40;
+  static uint8_t constexpr IMU_VAL_USER_CTRL_FIFO_RST = 0x04;
+  static uint8_t constexpr IMU_VAL_GEN_CFG_FIFO_MODE = 0x40;
+  static uint8_t constexpr IMU_VAL_INT_STATUS_FIFO_OFLOW = 0x10;
+
+  // Gyro start-up time after leaving sleep, datasheet table 1
+  static constexpr unsigned long IMU_STARTUP_MS = 35;
+  // Register access start-up time, the longest a soft reset can take
+  static constexpr unsigned long IMU_RESET_TIMEOUT_MS = 100;
+  static constexpr float IMU_ACCL_ONE_G = 16384.0f;
+
+  // MPU-6500/9250 FIFO size and the accel + gyro frame written per sample
+  static constexpr size_t IMU_FIFO_SIZE = 512;
+  static constexpr size_t IMU_FIFO_FRAME = sizeof(RawSample);
 
-  const uint8_t deviceAddress;
+  const I2cDeviceId deviceAddress;
 
   floatThreeVals acclOffset = {0.0, 0.0, 0.0};
   floatThreeVals gyroOffset = {0.0, 0.0, 0.0};
+  Conversion conversion = {};
 
-  void selfCalibrate();
+  uint8_t chipId = 0;
+  Calibration cachedCalibration = {};
+  bool calibrationFromCache = false;
+  uint32_t initTimeMicros = 0;
+
+  // Running Welford mean / variance over the frames read from the FIFO
+  std::atomic<CalibrationState> calibrationState{CalibrationState::None};
+  uint32_t calibrationSkip = 0;
+  uint32_t calibrationCount = 0;
+  float calibrationMean[AXES];
+  float calibrationM2[AXES];
+  std::atomic<uint32_t> calibrationRejects{0};
+
+  // Frames drained from the sensor FIFO, consumed by readSamples()
+  RawSample fifoRing[FIFO_RING_SAMPLES];
+  size_t fifoHead = 0;  // next frame to hand out
+  size_t fifoCount = 0;
+  bool fifoEnabled = false;
+  FifoStats fifoStats = {};
+
+  void resetFifo();
+
+  bool waitForReset();
+  void configure();
+  void updateConversion();
+  void calibrationAdd(const RawSample* raw, size_t count);
+  void calibrationFinish();
   floatThreeVals getThreeValsRaw(uint8_t xAddr, uint8_t yAddr, uint8_t zAddr);
   floatThreeVals getThreeValsComp(uint8_t xAddr, uint8_t yAddr, uint8_t zAddr,
                                   floatThreeVals offset);
 
  public:
-  MPUx(const uint8_t deviceAddress) : deviceAddress(deviceAddress) {}
+  MPUx(const I2cDeviceId deviceAddress) : deviceAddress(deviceAddress) {}
+
+  /**
+   * Resets and configures the sensor (±2 g, ±250 °/s, lowest-noise DLPF)
+   * in about 50 ms. Offsets come from setCalibration() when the chip
+   * matches, otherwise they stay zero until a startCalibration() run has
+   * finished.
+   */
   void init();
+
+  /**
+   * Provides offsets saved on a previous boot. They are used if the
+   * WHO_AM_I value read in init() matches. Must be called before init().
+   */
+  void setCalibration(const Calibration& calibration) {
+    cachedCalibration = calibration;
+  }
+
+  // Offsets in use, ready to be persisted once getCalibrationState() is Done
+  Calibration getCalibration() const { return {chipId, acclOffset, gyroOffset}; }
+  bool isCalibrationFromCache() const { return calibrationFromCache; }
+
+  /**
+   * Starts measuring the offsets from the frames that pass through
+   * readSamples() / readBlock(), so it needs beginFifo() and runs while
+   * the data is used normally. Attempts where the device moved are
+   * rejected and started over. Call it before the FIFO consumer starts.
+   */
+  void startCalibration();
+
+  /**
+   * The same measurement from register reads 1 ms apart, for when nothing
+   * consumes the FIFO. Blocks for about 1.1 s per attempt, up to
+   * `attempts` of them.
+   * @return true once the offsets are set, false if the device kept moving
+   */
+  bool calibratePolled(uint8_t attempts);
+  CalibrationState getCalibrationState() const { return calibrationState.load(); }
+  uint32_t getCalibrationRejects() const { return calibrationRejects.load(); }
+
+  // Duration of the last init() call
+  uint32_t getInitTimeMicros() const { return initTimeMicros; }
+
   floatThreeVals getAcclVals();
   floatThreeVals getGyroVals();
   void printMPUData();
+
+  /**
+   * Streams accel + gyro frames through the sensor FIFO at
+   * 1 kHz / (1 + sampleRateDivider). `dlpf` (1..6) is the DLPF_CFG setting
+   * for both sensors; 1 gives 184 Hz bandwidth, enough for kHz sampling.
+   * The FIFO stops accepting frames when full, possibly in the middle of a
+   * frame; pollFifo() sees the overflow flag and starts over with an empty
+   * FIFO so the frames never get misaligned.
+   */
+  bool beginFifo(uint8_t sampleRateDivider, uint8_t dlpf);
+  void endFifo();
+
+  /**
+   * Moves all complete frames from the sensor FIFO into the ring with as
+   * few burst reads as the Wire buffer allows. Call it at least every
+   * IMU_FIFO_SIZE / 12 sample periods (42 ms at 1 kHz).
+   * @return number of frames added
+   */
+  size_t pollFifo();
+
+  /**
+   * Polls the FIFO and copies up to `count` of the oldest buffered frames
+   * to `samples`.
+   * @return number of frames copied
+   */
+  size_t readSamples(RawSample* samples, size_t count);
+
+  /**
+   * Drains buffered frames, up to SampleBlock::CAPACITY, into `block` and
+   * converts them with convertSamples().
+   * @return block.count
+   */
+  size_t readBlock(SampleBlock& block);
+
+  /**
+   * Converts `count` raw frames to `out[axis][i]` with one multiply-add per
+   * value. Whole groups of CONVERT_LANES samples are converted axis by
+   * axis, which GCC vectorizes even at -O2; the remainder goes sample by
+   * sample.
+   */
+  static void convertSamples(const RawSample* raw, size_t count,
+                             const Conversion& conversion, float* const out[AXES]);
+
+  const Conversion& getConversion() const { return conversion; }
+  size_t bufferedSamples() const { return fifoCount; }
+  const FifoStats& getFifoStats() const { return fifoStats; }
 };
 
 #endif
@@ -0,0 +1,259 @@
+#include "oled_view.h"
+
+#include <stdarg.h>
+
+#include "metrics.h"
+
+// SSD1306 I2C control bytes: the rest of the transaction is commands/data
+static constexpr uint8_t CONTROL_COMMANDS = 0x00;
+static constexpr uint8_t CONTROL_DATA = 0x40;
+static constexpr uint8_t CMD_COLUMN_ADDRESS = 0x21;
+static constexpr uint8_t CMD_PAGE_ADDRESS = 0x22;
+
+// Bus bytes a separate window costs on top of its data: the address
+// command transaction and a second address + control byte for the data
+static constexpr int WINDOW_OVERHEAD = 10;
+
+static constexpr int16_t CLEAN = -1;
+
+OledView::OledView(Adafruit_SSD1306& display, I2cScheduler& bus,
+                   uint8_t address)
+    : display(display), bus(bus), address(address) {
+  for (uint8_t p = 0; p < MAX_PAGES; p++) {
+    dirty[p] = {CLEAN, CLEAN};
+  }
+}
+
+int OledView::addField(int16_t x, int16_t y, uint8_t textSize) {
+  if (fieldCount == MAX_FIELDS) {
+    return -1;
+  }
+  Field& field = fields[fieldCount];
+  field = {};
+  field.x = x;
+  field.y = y;
+  field.textSize = textSize;
+  return fieldCount++;
+}
+
+bool OledView::setText(int index, const char* text) {
+  if (index < 0 || index >= fieldCount) {
+    return false;
+  }
+  Field& field = fields[index];
+  if (strncmp(field.text, text, MAX_TEXT - 1) == 0) {
+    return false;
+  }
+  snprintf(field.text, sizeof(field.text), "%s", text);
+  field.changed = true;
+  return true;
+}
+
+bool OledView::setTextf(int index, const char* format, ...) {
+  char text[MAX_TEXT];
+  va_list args;
+  va_start(args, format);
+  vsnprintf(text, sizeof(text), format, args);
+  va_end(args);
+  return setText(index, text);
+}
+
+const char* OledView::getText(int index) const {
+  return index >= 0 && index < fieldCount ? fields[index].text : "";
+}
+
+void OledView::markDirty(int16_t x, int16_t y, uint16_t w, uint16_t h) {
+  if (w == 0 || h == 0) {
+    return;
+  }
+  const int16_t x0 = x < 0 ? 0 : x;
+  const int16_t x1 = x + w - 1 >= width ? width - 1 : x + w - 1;
+  const int16_t p0 = y < 0 ? 0 : y / 8;
+  const int16_t p1 = (y + h - 1) / 8 >= pages ? pages - 1 : (y + h - 1) / 8;
+  for (int16_t p = p0; p <= p1 && x0 <= x1; p++) {
+    Span& span = dirty[p];
+    if (span.first == CLEAN) {
+      span = {x0, x1};
+    } else {
+      span.first = x0 < span.first ? x0 : span.first;
+      span.last = x1 > span.last ? x1 : span.last;
+    }
+  }
+}
+
+void OledView::drawField(Field& field) {
+  display.fillRect(field.drawnX, field.drawnY, field.drawnW, field.drawnH,
+                   SSD1306_BLACK);
+  markDirty(field.drawnX, field.drawnY, field.drawnW, field.drawnH);
+
+  display.setTextSize(field.textSize);
+  display.setTextColor(SSD1306_WHITE);
+  display.getTextBounds(field.text, field.x, field.y, &field.drawnX,
+                        &field.drawnY, &field.drawnW, &field.drawnH);
+  display.setCursor(field.x, field.y);
+  display.print(field.text);
+  markDirty(field.drawnX, field.drawnY, field.drawnW, field.drawnH);
+  field.changed = false;
+}
+
+bool OledView::update() {
+  METRICS_SCOPE(MetricsStage::OledFlush);
+  if (display.getBuffer() == nullptr) {
+    return false;
+  }
+  // The previous frame is sent from `shown`, so it must be out first
+  const bool previousOk = finishFrame();
+
+  if (invalid) {
+    width = display.width() < MAX_WIDTH ? display.width() : MAX_WIDTH;
+    pages = display.height() / 8 < MAX_PAGES ? display.height() / 8 : MAX_PAGES;
+    display.clearDisplay();
+    for (uint8_t i = 0; i < fieldCount; i++) {
+      fields[i].drawnW = fields[i].drawnH = 0;
+      fields[i].changed = true;
+    }
+    markDirty(0, 0, width, pages * 8);
+  }
+
+  for (uint8_t i = 0; i < fieldCount; i++) {
+    if (fields[i].changed) {
+      drawField(fields[i]);
+    }
+  }
+
+  uint32_t bytes = 0;
+  const bool ok = flush(bytes);
+  if (bytes > 0) {
+    viewStats.frames++;
+    viewStats.lastFrameBytes = bytes;
+    viewStats.bytes += bytes;
+  }
+  return ok && previousOk;
+}
+
+bool OledView::flush(uint32_t& bytes) {
+  const uint8_t* buffer = display.getBuffer();
+
+  // Trim each page's span to the columns that differ from the panel. With
+  // the panel contents unknown everything is sent.
+  for (uint8_t p = 0; p < pages; p++) {
+    Span& span = dirty[p];
+    if (span.first == CLEAN || invalid) {
+      continue;
+    }
+    const uint8_t* row = buffer + p * width;
+    const uint8_t* old = shown + p * width;
+    while (span.first <= span.last && row[span.first] == old[span.first]) {
+      span.first++;
+    }
+    while (span.last >= span.first && row[span.last] == old[span.last]) {
+      span.last--;
+    }
+    if (span.first > span.last) {
+      span = {CLEAN, CLEAN};
+    }
+  }
+
+  // Consecutive dirty pages share one window while covering their union
+  // costs fewer bytes than a window of their own
+  bool ok = true;
+  uint8_t p = 0;
+  while (p < pages && ok) {
+    if (dirty[p].first == CLEAN) {
+      p++;
+      continue;
+    }
+    uint8_t last = p;
+    int16_t first = dirty[p].first, end = dirty[p].last;
+    while (last + 1 < pages && dirty[last + 1].first != CLEAN) {
+      const Span& next = dirty[last + 1];
+      const int16_t mergedFirst = next.first < first ? next.first : first;
+      const int16_t mergedEnd = next.last > end ? next.last : end;
+      const int merged = (last + 2 - p) * (mergedEnd - mergedFirst + 1);
+      const int separate = (last + 1 - p) * (end - first + 1) +
+                           (next.last - next.first + 1) + WINDOW_OVERHEAD;
+      if (merged > separate) {
+        break;
+      }
+      first = mergedFirst;
+      end = mergedEnd;
+      last++;
+    }
+    ok = sendWindow(p, last, first, end, bytes);
+    p = last + 1;
+  }
+
+  // Without the scheduler's worker nobody else would run the frame
+  if (!bus.isRunning() || !ok) {
+    ok = finishFrame() && ok;
+  }
+
+  for (uint8_t i = 0; i < MAX_PAGES; i++) {
+    dirty[i] = {CLEAN, CLEAN};
+  }
+  invalid = !ok;
+  return ok;
+}
+
+bool OledView::sendWindow(uint8_t firstPage, uint8_t lastPage,
+                          uint8_t firstColumn, uint8_t lastColumn,
+                          uint32_t& bytes) {
+  uint8_t* commands = windowCommands[windowCount++];
+  commands[0] = CMD_COLUMN_ADDRESS;
+  commands[1] = firstColumn;
+  commands[2] = lastColumn;
+  commands[3] = CMD_PAGE_ADDRESS;
+  commands[4] = firstPage;
+  commands[5] = lastPage;
+  if (!queue({address, CONTROL_COMMANDS, false, nullptr, commands, 6})) {
+    return false;
+  }
+  bytes += 7;
+  viewStats.windows++;
+
+  // The controller advances column by column, then to the next page of the
+  // window, so the pages can follow each other as separate transfers.
+  // Every transaction of a transfer starts with the control byte again.
+  const uint8_t* buffer = display.getBuffer();
+  const uint8_t columns = lastColumn - firstColumn + 1;
+  const uint8_t chunk = bus.device(address).chunk;
+  const size_t perTransaction = chunk != 0 && chunk < I2C_MAX_CHUNK - 1
+                                    ? chunk
+                                    : I2C_MAX_CHUNK - 1;
+  for (uint8_t p = firstPage; p <= lastPage; p++) {
+    const size_t offset = p * width + firstColumn;
+    memcpy(shown + offset, buffer + offset, columns);
+    if (!queue({address, CONTROL_DATA, false, nullptr, shown + offset, columns})) {
+      return false;
+    }
+    bytes += columns + (columns + perTransaction - 1) / perTransaction;
+  }
+  return true;
+}
+
+bool OledView::queue(const I2cTransfer& transfer) {
+  if (ticketCount == sizeof(tickets) / sizeof(tickets[0])) {
+    return false;
+  }
+  const int ticket = bus.submit(transfer);
+  if (ticket < 0) {
+    return false;
+  }
+  tickets[ticketCount++] = ticket;
+  return true;
+}
+
+// Waits for the frame in flight; a failed transfer leaves the panel in an
+// unknown state, so the next update() sends everything
+bool OledView::finishFrame() {
+  bool ok = true;
+  for (uint8_t i = 0; i < ticketCount; i++) {
+    ok = bus.wait(tickets[i]) == I2cStatus::Ok && ok;
+  }
+  ticketCount = 0;
+  windowCount = 0;
+  if (!ok) {
+    invalid = true;
+  }
+  return ok;
+}
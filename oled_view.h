@@ -0,0 +1,112 @@
+#ifndef OLED_VIEW_H
+#define OLED_VIEW_H
+
+#include <Adafruit_SSD1306.h>
+
+#include "i2c_scheduler.h"
+
+/**
+ * Retained-mode text on top of Adafruit_SSD1306. The screen is a set of
+ * text fields; setText() only records the new string, and update() redraws
+ * the fields whose text changed into the display buffer and sends just the
+ * columns of each page that differ from what the panel already shows. Each
+ * changed region goes out as a column/page address window (0x21/0x22) and
+ * its bytes, so a refresh that changes a few digits costs tens of bytes on
+ * the bus instead of the whole 1 KB buffer that display() sends.
+ *
+ * The bytes go out through an I2cScheduler, at the priority, clock and
+ * chunk size configured for the display's address there. While the
+ * scheduler's worker runs, update() returns as soon as the frame is queued
+ * and the next update() waits for it first.
+ *
+ * The view owns the screen: fields must not overlap, and after drawing on
+ * the display directly (or display()), call invalidate(). Only rotation 0
+ * is supported, and the controller must be in horizontal addressing mode,
+ * which Adafruit_SSD1306::begin() sets.
+ */
+class OledView {
+ public:
+  static constexpr uint8_t MAX_FIELDS = 8;
+  static constexpr uint8_t MAX_TEXT = 24;  // including the terminator
+  static constexpr uint8_t MAX_WIDTH = 128;
+  static constexpr uint8_t MAX_PAGES = 8;
+
+  struct Stats {
+    uint32_t frames;          // update() calls that sent something
+    uint32_t windows;         // address windows sent
+    uint32_t lastFrameBytes;  // I2C payload of the last frame
+    uint64_t bytes;           // I2C payload since boot
+  };
+
+  OledView(Adafruit_SSD1306& display, I2cScheduler& bus,
+           uint8_t address = 0x3C);
+
+  // Text at (x, y) in size `textSize`, wrapping like Adafruit GFX print().
+  // Returns the field index, -1 when all fields are in use.
+  int addField(int16_t x, int16_t y, uint8_t textSize = 1);
+
+  // Returns true if the field will be redrawn
+  bool setText(int field, const char* text);
+  bool setTextf(int field, const char* format, ...)
+      __attribute__((format(printf, 3, 4)));
+  const char* getText(int field) const;
+
+  // Forget what the panel shows: the next update() clears the buffer,
+  // redraws every field and sends the whole screen
+  void invalidate() { invalid = true; }
+
+  // Draws and sends the changes; false on a bus error, in which case the
+  // next update() sends the whole screen again. Errors of a frame sent in
+  // the background are reported by the update() after it.
+  bool update();
+
+  const Stats& stats() const { return viewStats; }
+
+ private:
+  struct Field {
+    int16_t x, y;
+    uint8_t textSize;
+    bool changed;
+    char text[MAX_TEXT];
+    // Area covered by the text drawn last, cleared before redrawing
+    int16_t drawnX, drawnY;
+    uint16_t drawnW, drawnH;
+  };
+
+  // Columns [first, last] of a page that may differ from the panel
+  struct Span {
+    int16_t first, last;
+  };
+
+  Adafruit_SSD1306& display;
+  I2cScheduler& bus;
+  const uint8_t address;
+
+  Field fields[MAX_FIELDS];
+  uint8_t fieldCount = 0;
+  bool invalid = true;
+
+  Span dirty[MAX_PAGES];
+  uint8_t shown[MAX_WIDTH * MAX_PAGES];  // what the panel displays
+  uint8_t width = 0;
+  uint8_t pages = 0;
+
+  // Transfers of the frame in flight; each window is a command transfer
+  // plus one data transfer per page
+  int tickets[2 * MAX_PAGES];
+  uint8_t ticketCount = 0;
+  uint8_t windowCommands[MAX_PAGES][6];
+  uint8_t windowCount = 0;
+
+  Stats viewStats = {};
+
+  void drawField(Field& field);
+  void markDirty(int16_t x, int16_t y, uint16_t w, uint16_t h);
+  bool flush(uint32_t& bytes);
+  bool sendWindow(uint8_t firstPage, uint8_t lastPage, uint8_t firstColumn,
+                  uint8_t lastColumn, uint32_t& bytes);
+  bool queue(const I2cTransfer& transfer);
+  bool finishFrame();
+};
+
+#endif  // OLED_VIEW_H
@@ -0,0 +1,230 @@
+#include "sampler.h"
+
+#ifdef ESP_PLATFORM
+#include <esp_timer.h>
+#include <freertos/FreeRTOS.h>
+#include <freertos/task.h>
+#else
+#include <chrono>
+#endif
+
+uint64_t Sampler::clockMicros() {
+#ifdef ESP_PLATFORM
+  return esp_timer_get_time();
+#else
+  return std::chrono::duration_cast<std::chrono::microseconds>(
+             std::chrono::steady_clock::now().time_since_epoch())
+      .count();
+#endif
+}
+
+Sampler::Stats Sampler::stats() const {
+  Stats s;
+  s.ticks = tickCount.load();
+  s.samples = samples.load();
+  s.dropped = dropped.load();
+  s.missedTicks = missedTicks.load();
+  s.maxLateMicros = maxLateMicros.load();
+  s.meanLateMicros = s.ticks > 0 ? (uint32_t)(totalLateMicros.load() / s.ticks) : 0;
+  s.maxReadMicros = maxReadMicros.load();
+  s.vibrationWindows = vibrationWindows.load();
+  s.vibrationDropped = vibrationDropped.load();
+  return s;
+}
+
+void Sampler::analyzeVibration() {
+  block.count = 0;
+  imu->readBlock(block);
+
+  const float* axes[VibrationAnalyzer::AXES] = {
+      block.values[MPUx::AcclX], block.values[MPUx::AcclY], block.values[MPUx::AcclZ]};
+  size_t done = 0;
+  while (done < block.count) {
+    const size_t n = vibration->feed(axes, block.count - done);
+    for (size_t axis = 0; axis < VibrationAnalyzer::AXES; axis++) {
+      axes[axis] += n;
+    }
+    done += n;
+    if (vibration->windowReady()) {
+      if (vibrationRing.push(vibration->analyze())) {
+        vibrationWindows++;
+      } else {
+        vibrationDropped++;
+      }
+    }
+  }
+}
+
+void Sampler::sampleOnce(uint64_t scheduledMicros, uint64_t nowMicros) {
+  const uint32_t late = (uint32_t)(nowMicros - scheduledMicros);
+  totalLateMicros += late;
+  if (late > maxLateMicros) {
+    maxLateMicros = late;
+  }
+
+  const bool streaming = vibration != nullptr && imu != nullptr;
+  if (streaming) {
+    analyzeVibration();
+  }
+  if (tickCount++ % envEveryTicks != 0) {
+    return;
+  }
+
+  SensorSample sample;
+  sample.micros = (uint32_t)nowMicros;
+  sample.sensor = 0;
+  size_t batch = 0;
+  if (registry != nullptr) {
+    batch = registry->sampleBatch(readings, SensorRegistry::MAX_BATCH);
+  } else {
+    sample.env = envSensor.readAll();
+  }
+  sample.hasImu = imu != nullptr;
+  if (streaming) {
+    // Newest frame of the FIFO, the registers are not read separately
+    sample.hasImu = block.count > 0;
+    if (sample.hasImu) {
+      const size_t last = block.count - 1;
+      sample.accl = {block.values[MPUx::AcclX][last], block.values[MPUx::AcclY][last],
+                     block.values[MPUx::AcclZ][last]};
+      sample.gyro = {block.values[MPUx::GyroX][last], block.values[MPUx::GyroY][last],
+                     block.values[MPUx::GyroZ][last]};
+    }
+  } else if (imu != nullptr) {
+    sample.accl = imu->getAcclVals();
+    sample.gyro = imu->getGyroVals();
+  }
+  sample.readMicros = (uint32_t)(clockMicros() - nowMicros);
+  if (sample.readMicros > maxReadMicros) {
+    maxReadMicros = sample.readMicros;
+  }
+
+  if (registry == nullptr) {
+    push(sample);
+    return;
+  }
+  for (size_t i = 0; i < batch; i++) {
+    sample.sensor = readings[i].sensor;
+    sample.env = readings[i].env;
+    push(sample);
+  }
+}
+
+void Sampler::push(SensorSample& sample) {
+  sample.sequence = sequence++;
+  if (ring.push(sample)) {
+    samples++;
+  } else {
+    dropped++;
+  }
+}
+
+#ifdef ESP_PLATFORM
+
+void Sampler::onTimer(void* arg) {
+  xTaskNotifyGive((TaskHandle_t)((Sampler*)arg)->task);
+}
+
+void Sampler::taskMain(void* arg) {
+  Sampler* self = (Sampler*)arg;
+  uint64_t scheduled = clockMicros();
+  while (self->running) {
+    // Counts ticks that fired while the previous sample was being read
+    const uint32_t ticks = ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+    if (!self->running) {
+      break;
+    }
+    if (ticks > 1) {
+      self->missedTicks += ticks - 1;
+    }
+    scheduled += (uint64_t)ticks * self->periodMicros;
+    self->sampleOnce(scheduled, clockMicros());
+  }
+  self->task = nullptr;
+  vTaskDelete(nullptr);
+}
+
+bool Sampler::start(int core, int priority) {
+  if (running) {
+    return false;
+  }
+  running = true;
+
+  TaskHandle_t handle;
+  if (xTaskCreatePinnedToCore(taskMain, "sampler", 4096, this, priority,
+                              &handle, core) != pdPASS) {
+    running = false;
+    return false;
+  }
+  task = handle;
+
+  esp_timer_create_args_t args = {};
+  args.callback = onTimer;
+  args.arg = this;
+  args.name = "sampler";
+  esp_timer_handle_t handleTimer;
+  if (esp_timer_create(&args, &handleTimer) != ESP_OK ||
+      esp_timer_start_periodic(handleTimer, periodMicros) != ESP_OK) {
+    stop();
+    return false;
+  }
+  timer = handleTimer;
+  return true;
+}
+
+void Sampler::stop() {
+  if (timer != nullptr) {
+    esp_timer_stop((esp_timer_handle_t)timer);
+    esp_timer_delete((esp_timer_handle_t)timer);
+    timer = nullptr;
+  }
+  if (running) {
+    running = false;
+    if (task != nullptr) {
+      xTaskNotifyGive((TaskHandle_t)task);
+    }
+    while (task != nullptr) {
+      vTaskDelay(1);
+    }
+  }
+}
+
+#else
+
+void Sampler::threadMain() {
+  uint64_t scheduled = clockMicros();
+  while (running) {
+    scheduled += periodMicros;
+    uint64_t now = clockMicros();
+    if (now < scheduled) {
+      std::this_thread::sleep_for(std::chrono::microseconds(scheduled - now));
+      now = clockMicros();
+    }
+    // Skip ticks that passed while the previous sample was being read
+    while (now - scheduled >= periodMicros) {
+      scheduled += periodMicros;
+      missedTicks++;
+    }
+    sampleOnce(scheduled, now);
+  }
+}
+
+bool Sampler::start(int core, int priority) {
+  (void)core;
+  (void)priority;
+  if (running) {
+    return false;
+  }
+  running = true;
+  thread = std::thread(&Sampler::threadMain, this);
+  return true;
+}
+
+void Sampler::stop() {
+  running = false;
+  if (thread.joinable()) {
+    thread.join();
+  }
+}
+
+#endif
@@ -0,0 +1,130 @@
+#ifndef SAMPLER_H
+#define SAMPLER_H
+
+#include <atomic>
+
+#include "bmx_280.h"
+#include "mpu_x.h"
+#include "sensor_registry.h"
+#include "spsc_ring.h"
+#include "vibration.h"
+
+#ifndef ESP_PLATFORM
+#include <thread>
+#endif
+
+// One acquisition, stamped when the timer tick fired
+struct SensorSample {
+  uint32_t sequence;
+  uint32_t micros;      // sampler clock at the tick
+  uint32_t readMicros;  // from the tick until the sample was complete
+  uint8_t sensor;       // SensorRegistry index, 0 without a registry
+  BMx280::BMx280Sample env;
+  bool hasImu;
+  MPUx::floatThreeVals accl;
+  MPUx::floatThreeVals gyro;
+};
+
+/**
+ * Reads the BME280 (and the MPU if one is set) on a fixed period in its own
+ * thread of execution and hands the samples over through a lock-free ring.
+ * On the ESP32 this is a FreeRTOS task pinned to one core, woken by a
+ * periodic esp_timer (hardware timer based, dispatched from the esp_timer
+ * task); on the host it is a std::thread. The sampler must be the only
+ * user of the sensors while it runs; other I2C users such as the OLED share
+ * the bus through i2cScheduler, which serves the sensors first.
+ *
+ * With a VibrationAnalyzer set, every tick drains the MPU FIFO into it and
+ * the BME280 is only read every envEveryTicks ticks, so the period can be
+ * short enough to keep up with kHz IMU data.
+ *
+ * With a SensorRegistry set, an environment tick reads one of its batches
+ * instead of the BME280 alone and pushes a sample per sensor read, each
+ * with the IMU values of that tick.
+ */
+class Sampler {
+ public:
+  static constexpr size_t RING_SIZE = 64;
+  static constexpr size_t VIBRATION_RING_SIZE = 16;
+
+  struct Stats {
+    uint32_t ticks;
+    uint32_t samples;       // pushed into the ring
+    uint32_t dropped;       // ring was full
+    uint32_t missedTicks;   // the previous sample was still being read
+    uint32_t maxLateMicros; // worst start delay against the schedule
+    uint32_t meanLateMicros;
+    uint32_t maxReadMicros;
+    uint32_t vibrationWindows;
+    uint32_t vibrationDropped;
+  };
+
+  Sampler(BMx280& envSensor, uint32_t periodMicros, uint32_t envEveryTicks = 1)
+      : envSensor(envSensor), periodMicros(periodMicros),
+        envEveryTicks(envEveryTicks) {}
+  ~Sampler() { stop(); }
+
+  // Optional; must be called before start()
+  void setImu(MPUx* imu) { this->imu = imu; }
+
+  // Optional, needs setImu() and MPUx::beginFifo(); before start() too
+  void setVibration(VibrationAnalyzer* analyzer) { vibration = analyzer; }
+
+  // Optional, after SensorRegistry::discover(); before start() too
+  void setRegistry(SensorRegistry* sensors) { registry = sensors; }
+
+  // core and priority only apply to the ESP32 task
+  bool start(int core, int priority);
+  void stop();
+
+  bool pop(SensorSample& sample) { return ring.pop(sample); }
+  bool popVibration(VibrationAnalyzer::Result& result) {
+    return vibrationRing.pop(result);
+  }
+  size_t pending() const { return ring.size(); }
+
+  Stats stats() const;
+  uint32_t getPeriodMicros() const { return periodMicros; }
+
+ private:
+  BMx280& envSensor;
+  MPUx* imu = nullptr;
+  VibrationAnalyzer* vibration = nullptr;
+  SensorRegistry* registry = nullptr;
+  const uint32_t periodMicros;
+  const uint32_t envEveryTicks;
+  SpscRing<SensorSample, RING_SIZE> ring;
+  SpscRing<VibrationAnalyzer::Result, VIBRATION_RING_SIZE> vibrationRing;
+  std::atomic<bool> running{false};
+
+  // Written by the sampler only
+  uint32_t sequence = 0;
+  std::atomic<uint32_t> tickCount{0};
+  MPUx::SampleBlock block;
+  SensorRegistry::Reading readings[SensorRegistry::MAX_BATCH];
+  std::atomic<uint32_t> vibrationWindows{0};
+  std::atomic<uint32_t> vibrationDropped{0};
+  std::atomic<uint32_t> samples{0};
+  std::atomic<uint32_t> dropped{0};
+  std::atomic<uint32_t> missedTicks{0};
+  std::atomic<uint32_t> maxLateMicros{0};
+  std::atomic<uint32_t> maxReadMicros{0};
+  std::atomic<uint64_t> totalLateMicros{0};
+
+#ifdef ESP_PLATFORM
+  void* task = nullptr;   // TaskHandle_t
+  void* timer = nullptr;  // esp_timer_handle_t
+  static void onTimer(void* arg);
+  static void taskMain(void* arg);
+#else
+  std::thread thread;
+  void threadMain();
+#endif
+
+  void sampleOnce(uint64_t scheduledMicros, uint64_t nowMicros);
+  void analyzeVibration();
+  void push(SensorSample& sample);
+  static uint64_t clockMicros();
+};
+
+#endif  // SAMPLER_H
@@ -0,0 +1,361 @@
+#include "sensor_registry.h"
+
+#include <atomic>
+#include <new>
+
+#ifdef ESP_PLATFORM
+#include <freertos/FreeRTOS.h>
+#include <freertos/task.h>
+#else
+#include <thread>
+#endif
+
+// ID registers and values
+static const uint8_t BMX_REG_ID = 0xD0;
+static const uint8_t BME280_ID = 0x60;
+static const uint8_t BMP280_ID = 0x58;
+static const uint8_t MPU_REG_WHO_AM_I = 0x75;
+
+// Addresses looked for behind a mux; probing all 126 on every channel
+// would take 64 probes per address
+static const uint8_t MUXED_CANDIDATES[] = {0x76, 0x77, 0x68, 0x69};
+
+SensorRegistry::SensorRegistry(const BMx280Config& envConfig,
+                               const I2cDeviceConfig& busConfig,
+                               uint8_t perBus)
+    : envConfig(envConfig), busConfig(busConfig),
+      perBus(perBus == 0 ? 1
+             : perBus > MAX_BATCH / I2C_BUSES ? MAX_BATCH / I2C_BUSES
+                                              : perBus) {}
+
+SensorRegistry::~SensorRegistry() {
+  for (size_t i = 0; i < count; i++) {
+    if (entries[i].owned) {
+      delete entries[i].env;
+    }
+  }
+}
+
+bool SensorRegistry::addEnv(BMx280& sensor, SensorKind kind) {
+  if (count == MAX_SENSORS || indexOf(sensor.getDevice()) >= 0) {
+    return false;
+  }
+  entries[count++] = {{sensor.getDevice(), kind, 0}, &sensor, false};
+  return true;
+}
+
+int SensorRegistry::indexOf(I2cDeviceId device) const {
+  for (size_t i = 0; i < count; i++) {
+    if (entries[i].info.device == device) {
+      return i;
+    }
+  }
+  return -1;
+}
+
+int SensorRegistry::find(SensorKind kind) const {
+  for (size_t i = 0; i < count; i++) {
+    if (entries[i].info.kind == kind) {
+      return i;
+    }
+  }
+  return -1;
+}
+
+size_t SensorRegistry::envCount() const {
+  size_t envs = 0;
+  for (size_t i = 0; i < count; i++) {
+    envs += entries[i].env != nullptr;
+  }
+  return envs;
+}
+
+// -=| Discovery |=-
+
+// A TCA9548A reads back the channel mask last written to it
+bool SensorRegistry::isMux(I2cDeviceId device) {
+  uint8_t value = 0;
+  if (i2cReadRegister<uint8_t>(device, 0x05, value) != I2cStatus::Ok ||
+      value != 0x05) {
+    return false;
+  }
+  return i2cReadRegister<uint8_t>(device, 0x00, value) == I2cStatus::Ok &&
+         value == 0x00;
+}
+
+void SensorRegistry::identify(I2cDeviceId device, BusScan& scan) {
+  const uint8_t address = i2cAddressOf(device);
+  uint8_t id = 0;
+
+  if (address == 0x76 || address == 0x77) {
+    if (i2cReadRegister<uint8_t>(device, BMX_REG_ID, id) == I2cStatus::Ok &&
+        (id == BME280_ID || id == BMP280_ID)) {
+      if (scan.count < MAX_SENSORS) {
+        scan.found[scan.count++] = {
+            device, id == BME280_ID ? SensorKind::Bme280 : SensorKind::Bmp280,
+            id};
+      }
+      return;
+    }
+  }
+
+  if (address == 0x68 || address == 0x69) {
+    if (i2cReadRegister<uint8_t>(device, MPU_REG_WHO_AM_I, id) ==
+        I2cStatus::Ok) {
+      const SensorKind kind = id == 0x70                ? SensorKind::Mpu6500
+                              : id == 0x71 || id == 0x73 ? SensorKind::Mpu9250
+                              : id == 0x68               ? SensorKind::Mpu6050
+                                                         : SensorKind::Unknown;
+      if (scan.count < MAX_SENSORS) {
+        scan.found[scan.count++] = {device, kind, id};
+      }
+    }
+    return;
+  }
+
+  if (i2cIsMuxed(device) || address < I2C_MUX_BASE ||
+      address >= I2C_MUX_BASE + 8 || !isMux(device)) {
+    return;
+  }
+  scan.muxes++;
+
+  // A device answering on the trunk as well cannot be told apart
+  const uint8_t bus = i2cBusOf(device);
+  for (uint8_t channel = 0; channel < I2C_MUX_CHANNELS; channel++) {
+    for (uint8_t candidate : MUXED_CANDIDATES) {
+      if ((scan.trunk[candidate / 32] & 1u << candidate % 32) != 0) {
+        continue;
+      }
+      const I2cDeviceId muxed =
+          i2cDeviceBehindMux(bus, address, channel, candidate);
+      if (i2cProbe(muxed) == I2cStatus::Ok) {
+        identify(muxed, scan);
+      }
+    }
+  }
+}
+
+void SensorRegistry::scanBus(uint8_t bus, BusScan& scan) {
+  // A mux keeps its channels across a reset of the ESP32, and whatever is
+  // behind an open channel would be taken for a trunk device. Close every
+  // mux that may be there first; a TCA9548A keeps the last byte written,
+  // and on a BMx280 register 0x00 is not writable.
+  for (uint8_t address = I2C_MUX_BASE; address < I2C_MUX_BASE + 8; address++) {
+    const I2cDeviceId device = i2cDeviceOnBus(bus, address);
+    const I2cStatus status = i2cProbe(device);
+    if (status == I2cStatus::Ok) {
+      i2cWriteToRegister(device, 0x00, 0x00);
+    } else if (status != I2cStatus::AddressNack) {
+      return;
+    }
+  }
+
+  for (uint8_t address = 1; address < 127; address++) {
+    const I2cStatus status = i2cProbe(i2cDeviceOnBus(bus, address));
+    if (status == I2cStatus::Ok) {
+      scan.trunk[address / 32] |= 1u << address % 32;
+    } else if (status != I2cStatus::AddressNack) {
+      // Bus not started, no pull-ups, or held low: nothing to find
+      return;
+    }
+  }
+
+  for (uint8_t address = 1; address < 127; address++) {
+    if ((scan.trunk[address / 32] & 1u << address % 32) != 0) {
+      identify(i2cDeviceOnBus(bus, address), scan);
+    }
+  }
+}
+
+void SensorRegistry::add(const SensorInfo& found) {
+  const int existing = indexOf(found.device);
+  if (existing >= 0) {
+    entries[existing].info = found;
+    return;
+  }
+  if (count == MAX_SENSORS) {
+    return;
+  }
+
+  Entry entry = {found, nullptr, false};
+  if (found.kind == SensorKind::Bme280 || found.kind == SensorKind::Bmp280) {
+    i2cSchedulerFor(found.device).setDevice(found.device, busConfig);
+    BMx280* sensor = new (std::nothrow) BMx280(found.device, envConfig);
+    if (sensor != nullptr && sensor->init()) {
+      entry.env = sensor;
+      entry.owned = true;
+    } else {
+      delete sensor;
+    }
+  }
+  entries[count++] = entry;
+}
+
+size_t SensorRegistry::discover() {
+  const uint32_t start = micros();
+  BusScan scans[I2C_BUSES] = {};
+
+  // Wire1 is scanned by a helper while this task scans Wire; each bus has
+  // its own scheduler, so the probes of both run at the same time
+#ifdef ESP_PLATFORM
+  struct Helper {
+    BusScan* scan;
+    std::atomic<bool> done{false};
+  } helper;
+  helper.scan = &scans[1];
+  TaskHandle_t handle;
+  const bool helped =
+      xTaskCreate(
+          [](void* arg) {
+            Helper* self = (Helper*)arg;
+            scanBus(1, *self->scan);
+            self->done = true;
+            vTaskDelete(nullptr);
+          },
+          "scan", 4096, &helper, uxTaskPriorityGet(nullptr),
+          &handle) == pdPASS;
+  scanBus(0, scans[0]);
+  if (helped) {
+    while (!helper.done) {
+      vTaskDelay(1);
+    }
+  } else {
+    scanBus(1, scans[1]);
+  }
+#else
+  std::thread helper([&scans] { scanBus(1, scans[1]); });
+  scanBus(0, scans[0]);
+  helper.join();
+#endif
+
+  registryStats.muxes = 0;
+  for (uint8_t bus = 0; bus < I2C_BUSES; bus++) {
+    registryStats.muxes += scans[bus].muxes;
+    for (size_t i = 0; i < scans[bus].count; i++) {
+      add(scans[bus].found[i]);
+    }
+  }
+  registryStats.discoverMicros = micros() - start;
+  return count;
+}
+
+// -=| Sampling |=-
+
+size_t SensorRegistry::sampleBatch(Reading* readings, size_t maxReadings) {
+  const size_t limit = maxReadings < MAX_BATCH ? maxReadings : MAX_BATCH;
+  size_t batch = 0;
+  for (uint8_t bus = 0; bus < I2C_BUSES; bus++) {
+    uint8_t onBus[MAX_SENSORS];
+    size_t sensors = 0;
+    for (size_t i = 0; i < count; i++) {
+      if (entries[i].env != nullptr && i2cBusOf(entries[i].info.device) == bus) {
+        onBus[sensors++] = i;
+      }
+    }
+    if (sensors == 0) {
+      continue;
+    }
+    size_t take = sensors < perBus ? sensors : perBus;
+    if (take > limit - batch) {
+      take = limit - batch;
+    }
+    for (size_t j = 0; j < take; j++) {
+      pending[batch++].sensor = onBus[(nextEnv[bus] + j) % sensors];
+    }
+    nextEnv[bus] = (nextEnv[bus] + take) % sensors;
+  }
+  if (batch == 0) {
+    return 0;
+  }
+
+  // Start every forced-mode conversion, then wait for the slowest once
+  uint32_t conversionMicros = 0;
+  for (size_t i = 0; i < batch; i++) {
+    Pending& p = pending[i];
+    BMx280& sensor = *entries[p.sensor].env;
+    p.status = I2cStatus::Ok;
+    p.ticket = -1;
+    if (sensor.needsTrigger()) {
+      p.trigger = sensor.triggerValue();
+      p.ticket = i2cSchedulerFor(sensor.getDevice())
+                     .submit(sensor.triggerTransfer(&p.trigger));
+      const uint32_t micros = sensor.getConfig().maxMeasurementMicros();
+      if (micros > conversionMicros) {
+        conversionMicros = micros;
+      }
+    }
+  }
+  for (size_t i = 0; i < batch; i++) {
+    Pending& p = pending[i];
+    if (entries[p.sensor].env->needsTrigger()) {
+      p.status = p.ticket < 0 ? I2cStatus::InvalidArgument
+                              : i2cSchedulerFor(entries[p.sensor].info.device)
+                                    .wait(p.ticket);
+    }
+  }
+  if (conversionMicros != 0) {
+    bmx280WaitConversion(conversionMicros);
+  }
+
+  for (size_t i = 0; i < batch; i++) {
+    Pending& p = pending[i];
+    BMx280& sensor = *entries[p.sensor].env;
+    p.ticket = p.status != I2cStatus::Ok
+                   ? -1
+                   : i2cSchedulerFor(sensor.getDevice())
+                         .submit(sensor.dataTransfer(p.raw));
+  }
+  for (size_t i = 0; i < batch; i++) {
+    Pending& p = pending[i];
+    BMx280& sensor = *entries[p.sensor].env;
+    if (p.status == I2cStatus::Ok) {
+      p.status = p.ticket < 0
+                     ? I2cStatus::InvalidArgument
+                     : i2cSchedulerFor(sensor.getDevice()).wait(p.ticket);
+    }
+    readings[i].sensor = p.sensor;
+    readings[i].env = p.status == I2cStatus::Ok
+                          ? sensor.decode(p.raw)
+                          : BMx280::BMx280Sample{NAN, NAN, NAN};
+    if (isnan(readings[i].env.temperature)) {
+      registryStats.errors++;
+    }
+  }
+
+  registryStats.batches++;
+  registryStats.readings += batch;
+  return batch;
+}
+
+// -=| Names |=-
+
+size_t SensorRegistry::formatTag(size_t index, char* out, size_t size) const {
+  const I2cDeviceId device = entries[index].info.device;
+  int length;
+  if (i2cIsMuxed(device)) {
+    length = snprintf(out, size, "bus%u/mux0x%02X.%u/0x%02X", i2cBusOf(device),
+                      i2cMuxAddressOf(device), i2cMuxChannelOf(device),
+                      i2cAddressOf(device));
+  } else {
+    length = snprintf(out, size, "bus%u/0x%02X", i2cBusOf(device),
+                      i2cAddressOf(device));
+  }
+  return length < 0 ? 0 : ((size_t)length < size ? length : size - 1);
+}
+
+const char* SensorRegistry::kindName(SensorKind kind) {
+  switch (kind) {
+    case SensorKind::Bme280:
+      return "bme280";
+    case SensorKind::Bmp280:
+      return "bmp280";
+    case SensorKind::Mpu6500:
+      return "mpu6500";
+    case SensorKind::Mpu9250:
+      return "mpu9250";
+    case SensorKind::Mpu6050:
+      return "mpu6050";
+    default:
+      return "unknown";
+  }
+}
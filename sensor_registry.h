@@ -0,0 +1,128 @@
+#ifndef SENSOR_REGISTRY_H
+#define SENSOR_REGISTRY_H
+
+#include <Arduino.h>
+
+#include "bmx_280.h"
+
+enum class SensorKind : uint8_t {
+  Bme280,
+  Bmp280,
+  Mpu6500,
+  Mpu9250,
+  Mpu6050,
+  Unknown,
+};
+
+/**
+ * Every sensor on Wire, Wire1 and the channels of TCA9548A multiplexers on
+ * either bus, identified by its ID register (BMx280 0xD0, MPU WHO_AM_I
+ * 0x75). discover() scans both buses at the same time, Wire1 from a helper
+ * task (a std::thread on the host), and creates a BMx280 for every
+ * environment sensor it finds.
+ *
+ * sampleBatch() reads up to `perBus` environment sensors per bus, taking
+ * turns so every sensor is read every ceil(sensors on its bus / perBus)
+ * batches. The forced-mode triggers of the whole batch are queued at once,
+ * the conversions are waited for once, and the data reads are queued on
+ * both schedulers together, so the two buses transfer in parallel and a
+ * batch costs one conversion plus the bus time of the busier bus.
+ *
+ * discover() must finish before sampling starts; after that the sampler is
+ * the only caller of sampleBatch().
+ */
+class SensorRegistry {
+ public:
+  static constexpr size_t MAX_SENSORS = 16;
+  static constexpr size_t MAX_BATCH = 8;
+  static constexpr size_t TAG_LENGTH = 24;  // "bus1/mux0x77.7/0x77"
+
+  struct SensorInfo {
+    I2cDeviceId device;
+    SensorKind kind;
+    uint8_t chipId;
+  };
+
+  struct Reading {
+    uint8_t sensor;  // index in the registry
+    BMx280::BMx280Sample env;
+  };
+
+  struct Stats {
+    uint32_t batches;
+    uint32_t readings;
+    uint32_t errors;  // readings that came back NAN
+    uint32_t discoverMicros;
+    uint8_t muxes;
+  };
+
+  // New environment sensors get envConfig and busConfig on their scheduler
+  SensorRegistry(const BMx280Config& envConfig,
+                 const I2cDeviceConfig& busConfig, uint8_t perBus = 4);
+  ~SensorRegistry();
+
+  // Registers a sensor owned by the caller, e.g. the primary BME280 as
+  // index 0. discover() does not create a second one at its address.
+  bool addEnv(BMx280& sensor, SensorKind kind = SensorKind::Bme280);
+
+  // Returns the number of sensors known afterwards
+  size_t discover();
+
+  size_t size() const { return count; }
+  const SensorInfo& info(size_t index) const { return entries[index].info; }
+  // nullptr for sensors that are not sampled, such as IMUs
+  BMx280* env(size_t index) const { return entries[index].env; }
+  size_t envCount() const;
+  // Index of the first sensor of `kind`, or -1
+  int find(SensorKind kind) const;
+
+  size_t sampleBatch(Reading* readings, size_t maxReadings);
+
+  // "bus0/0x77" or "bus1/mux0x70.3/0x76"
+  size_t formatTag(size_t index, char* out, size_t size) const;
+  static const char* kindName(SensorKind kind);
+
+  Stats stats() const { return registryStats; }
+
+ private:
+  struct Entry {
+    SensorInfo info;
+    BMx280* env;
+    bool owned;
+  };
+
+  // Sensors and muxes found on one bus, and the addresses on its trunk
+  struct BusScan {
+    uint32_t trunk[4];
+    SensorInfo found[MAX_SENSORS];
+    size_t count;
+    uint8_t muxes;
+  };
+
+  const BMx280Config envConfig;
+  const I2cDeviceConfig busConfig;
+  const uint8_t perBus;
+
+  Entry entries[MAX_SENSORS] = {};
+  size_t count = 0;
+  uint8_t nextEnv[I2C_BUSES] = {};  // round-robin position per bus
+  Stats registryStats = {};
+
+  // State of the batch in flight
+  struct Pending {
+    uint8_t sensor;
+    uint8_t trigger;
+    int ticket;
+    I2cStatus status;
+    uint8_t raw[BMx280::DATA_LENGTH];
+  };
+  Pending pending[MAX_BATCH];
+
+  static void scanBus(uint8_t bus, BusScan& scan);
+  static void identify(I2cDeviceId device, BusScan& scan);
+  static bool isMux(I2cDeviceId device);
+  int indexOf(I2cDeviceId device) const;
+  void add(const SensorInfo& found);
+};
+
+#endif  // SENSOR_REGISTRY_H
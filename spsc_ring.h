@@ -0,0 +1,58 @@
+#ifndef SPSC_RING_H
+#define SPSC_RING_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <atomic>
+
+/**
+ * Lock-free ring for exactly one producer and one consumer, e.g. a sampling
+ * task on one core and loop() on the other. Size must be a power of two.
+ * head and tail only ever increase; each side writes one of them and reads
+ * the other with acquire/release ordering, so no locks or critical sections
+ * are needed. A full ring rejects new items rather than overwriting ones
+ * the consumer may be reading.
+ */
+template <typename T, size_t Size>
+class SpscRing {
+  static_assert(Size >= 2 && (Size & (Size - 1)) == 0,
+                "ring size must be a power of two");
+
+ public:
+  // Producer side; false if the ring is full
+  bool push(const T& item) {
+    const uint32_t head = writeIndex.load(std::memory_order_relaxed);
+    if (head - readIndex.load(std::memory_order_acquire) == Size) {
+      return false;
+    }
+    items[head & (Size - 1)] = item;
+    writeIndex.store(head + 1, std::memory_order_release);
+    return true;
+  }
+
+  // Consumer side; false if the ring is empty
+  bool pop(T& item) {
+    const uint32_t tail = readIndex.load(std::memory_order_relaxed);
+    if (writeIndex.load(std::memory_order_acquire) == tail) {
+      return false;
+    }
+    item = items[tail & (Size - 1)];
+    readIndex.store(tail + 1, std::memory_order_release);
+    return true;
+  }
+
+  // Approximate when called from the side that is not moving
+  size_t size() const {
+    return writeIndex.load(std::memory_order_acquire) -
+           readIndex.load(std::memory_order_acquire);
+  }
+  static constexpr size_t capacity() { return Size; }
+
+ private:
+  T items[Size];
+  std::atomic<uint32_t> writeIndex{0};
+  std::atomic<uint32_t> readIndex{0};
+};
+
+#endif  // SPSC_RING_H
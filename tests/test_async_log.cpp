@@ -0,0 +1,219 @@
+// test_async_log.cpp -- AsyncLog: text lines, dropping and counting when
+// the ring is full, truncation, binary frames and their checksum, records
+// of the full payload size in text mode, and the order of each producer's
+// messages when several threads log while the drain thread runs.
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "async_log.h"
+#include "test_check.h"
+
+struct StringPrint : Print {
+  std::string text;
+  size_t write(uint8_t c) override {
+    text += (char)c;
+    return 1;
+  }
+  size_t write(const uint8_t* buffer, size_t size) override {
+    text.append((const char*)buffer, size);
+    return size;
+  }
+};
+
+static std::vector<std::string> lines(const std::string& text) {
+  std::vector<std::string> result;
+  size_t position = 0;
+  size_t end;
+  while ((end = text.find("\r\n", position)) != std::string::npos) {
+    result.push_back(text.substr(position, end - position));
+    position = end + 2;
+  }
+  return result;
+}
+
+// The message after the "[   12.345] I " prefix
+static std::string message(const std::string& line) {
+  const size_t bracket = line.find("] ");
+  return bracket == std::string::npos ? "" : line.substr(bracket + 4);
+}
+
+static void testText() {
+  AsyncLog log;
+  StringPrint out;
+  CHECK(log.write(LogLevel::Info, "x=%d %s", 5, "ok"));
+  CHECK(log.write(LogLevel::Error, "failed"));
+  CHECK_EQ(log.flush(out), 2);
+  const std::vector<std::string> result = lines(out.text);
+  CHECK_EQ(result.size(), 2);
+  if (result.size() == 2) {
+    CHECK(result[0][0] == '[');
+    CHECK(result[0].find("] I ") != std::string::npos);
+    CHECK(message(result[0]) == "x=5 ok");
+    CHECK(result[1].find("] E ") != std::string::npos);
+    CHECK(message(result[1]) == "failed");
+  }
+  CHECK_EQ(log.flush(out), 0);
+  CHECK_EQ(log.stats().written, 2);
+}
+
+static void testDropOnFull() {
+  AsyncLog log;
+  StringPrint out;
+  for (size_t i = 0; i < AsyncLog::SLOTS; i++) {
+    CHECK(log.write(LogLevel::Debug, "%zu", i));
+  }
+  CHECK(!log.write(LogLevel::Debug, "no room"));
+  CHECK(!log.record(1, "abc", 3));
+  CHECK_EQ(log.stats().written, AsyncLog::SLOTS);
+  CHECK_EQ(log.stats().dropped, 2);
+
+  // Nothing queued was overwritten, and draining frees the slots again
+  CHECK_EQ(log.flush(out), AsyncLog::SLOTS);
+  const std::vector<std::string> result = lines(out.text);
+  CHECK_EQ(result.size(), AsyncLog::SLOTS);
+  CHECK(message(result.front()) == "0");
+  CHECK(message(result.back()) == std::to_string(AsyncLog::SLOTS - 1));
+  CHECK(log.write(LogLevel::Debug, "room again"));
+  CHECK_EQ(log.stats().dropped, 2);
+}
+
+static void testTruncation() {
+  AsyncLog log;
+  StringPrint out;
+  const std::string exact(AsyncLog::PAYLOAD - 1, 'a');
+  const std::string longer(2 * AsyncLog::PAYLOAD, 'b');
+  log.write(LogLevel::Warn, "%s", exact.c_str());
+  CHECK_EQ(log.stats().truncated, 0);
+  log.write(LogLevel::Warn, "%s", longer.c_str());
+  CHECK_EQ(log.stats().truncated, 1);
+  log.flush(out);
+  const std::vector<std::string> result = lines(out.text);
+  CHECK_EQ(result.size(), 2);
+  if (result.size() == 2) {
+    CHECK(message(result[0]) == exact);
+    CHECK(message(result[1]) == longer.substr(0, AsyncLog::PAYLOAD - 1));
+  }
+}
+
+static void testBinaryFrames() {
+  AsyncLog log;
+  StringPrint out;
+  log.setBinaryOutput(true);
+  const uint8_t payload[] = {0x01, 0xFF, 0x80, 0x7F, 0x00};
+  CHECK(log.record(3, payload, sizeof(payload)));
+  CHECK(log.write(LogLevel::Info, "hi"));
+  CHECK(!log.record(AsyncLog::RECORD_KIND, payload, 1));
+  CHECK(!log.record(1, payload, AsyncLog::PAYLOAD + 1));
+  CHECK_EQ(log.flush(out), 2);
+
+  // 0xA5, kind, length, micros (4), payload, checksum of kind..payload
+  const uint8_t* bytes = (const uint8_t*)out.text.data();
+  const size_t first = 7 + sizeof(payload) + 1;
+  CHECK_EQ(out.text.size(), first + 7 + 2 + 1);
+  if (out.text.size() != first + 7 + 2 + 1) {
+    return;
+  }
+  for (size_t start : {(size_t)0, first}) {
+    CHECK_EQ(bytes[start], AsyncLog::FRAME_SYNC);
+    const size_t length = bytes[start + 2];
+    uint8_t checksum = 0;
+    for (size_t i = start + 1; i < start + 7 + length; i++) {
+      checksum += bytes[i];
+    }
+    CHECK_EQ(bytes[start + 7 + length], checksum);
+  }
+  CHECK_EQ(bytes[1], AsyncLog::RECORD_KIND + 3);
+  CHECK_EQ(bytes[2], sizeof(payload));
+  CHECK(memcmp(bytes + 7, payload, sizeof(payload)) == 0);
+  CHECK_EQ(bytes[first + 1], (uint8_t)LogLevel::Info);
+  CHECK_EQ(bytes[first + 2], 2);
+  CHECK(memcmp(bytes + first + 7, "hi", 2) == 0);
+}
+
+// The longest text form of a record: a 3-digit type and PAYLOAD bytes
+static void testFullRecordAsText() {
+  AsyncLog log;
+  StringPrint out;
+  uint8_t payload[AsyncLog::PAYLOAD];
+  for (size_t i = 0; i < sizeof(payload); i++) {
+    payload[i] = (uint8_t)(i * 37);
+  }
+  CHECK(log.record(127, payload, sizeof(payload)));
+  log.flush(out);
+  const std::vector<std::string> result = lines(out.text);
+  CHECK_EQ(result.size(), 1);
+  if (result.size() != 1) {
+    return;
+  }
+  CHECK(result[0].find("] R ") != std::string::npos);
+  std::string expected = "127";
+  char hex[3];
+  for (size_t i = 0; i < sizeof(payload); i++) {
+    if (i % 4 == 0) {
+      expected += ' ';
+    }
+    snprintf(hex, sizeof(hex), "%02x", payload[i]);
+    expected += hex;
+  }
+  CHECK_EQ(message(result[0]).size(), expected.size());
+  CHECK(message(result[0]) == expected);
+}
+
+static void testProducerOrder() {
+  static constexpr int THREADS = 4;
+  static constexpr int MESSAGES = 20000;
+  AsyncLog log;
+  StringPrint out;
+  CHECK(log.begin(out, 0, 1));
+  std::vector<std::thread> threads;
+  for (int t = 0; t < THREADS; t++) {
+    threads.emplace_back([&log, t] {
+      for (int i = 0; i < MESSAGES; i++) {
+        if (!log.write(LogLevel::Info, "t%d %d", t, i)) {
+          std::this_thread::yield();
+        }
+      }
+    });
+  }
+  for (std::thread& thread : threads) {
+    thread.join();
+  }
+  log.end();
+  log.flush(out);
+
+  const AsyncLog::Stats stats = log.stats();
+  CHECK_EQ(stats.written + stats.dropped, THREADS * MESSAGES);
+  const std::vector<std::string> result = lines(out.text);
+  CHECK_EQ(result.size(), stats.written);
+  int last[THREADS] = {-1, -1, -1, -1};
+  int malformed = 0, reordered = 0;
+  for (const std::string& line : result) {
+    int thread, index;
+    if (sscanf(message(line).c_str(), "t%d %d", &thread, &index) != 2 || thread < 0 ||
+        thread >= THREADS) {
+      malformed++;
+      continue;
+    }
+    if (index <= last[thread]) {
+      reordered++;
+    }
+    last[thread] = index;
+  }
+  CHECK_EQ(malformed, 0);
+  CHECK_EQ(reordered, 0);
+}
+
+int main() {
+  testText();
+  testDropOnFull();
+  testTruncation();
+  testBinaryFrames();
+  testFullRecordAsText();
+  testProducerOrder();
+  return testExitCode("test_async_log");
+}
@@ -0,0 +1,55 @@
+// test_check.h -- minimal checks for the host tests. A failed check prints
+// its location and the test carries on; testExitCode() ends main().
+#ifndef TESTS_TEST_CHECK_H
+#define TESTS_TEST_CHECK_H
+
+#include <math.h>
+#include <stdio.h>
+
+inline int& testFailures() {
+  static int failures = 0;
+  return failures;
+}
+
+#define CHECK(condition)                                              \
+  do {                                                                \
+    if (!(condition)) {                                               \
+      fprintf(stderr, "%s:%d: CHECK(%s) failed\n", __FILE__, __LINE__, \
+              #condition);                                            \
+      testFailures()++;                                               \
+    }                                                                 \
+  } while (0)
+
+#define CHECK_EQ(actual, expected)                                          \
+  do {                                                                      \
+    const long long actualValue = (long long)(actual);                      \
+    const long long expectedValue = (long long)(expected);                  \
+    if (actualValue != expectedValue) {                                     \
+      fprintf(stderr, "%s:%d: %s is %lld, expected %lld\n", __FILE__,       \
+              __LINE__, #actual, actualValue, expectedValue);               \
+      testFailures()++;                                                     \
+    }                                                                       \
+  } while (0)
+
+#define CHECK_NEAR(actual, expected, tolerance)                             \
+  do {                                                                      \
+    const double actualValue = (double)(actual);                            \
+    const double expectedValue = (double)(expected);                        \
+    if (!(fabs(actualValue - expectedValue) <= (tolerance))) {              \
+      fprintf(stderr, "%s:%d: %s is %g, expected %g +- %g\n", __FILE__,     \
+              __LINE__, #actual, actualValue, expectedValue,                \
+              (double)(tolerance));                                         \
+      testFailures()++;                                                     \
+    }                                                                       \
+  } while (0)
+
+inline int testExitCode(const char* name) {
+  if (testFailures() == 0) {
+    printf("%s: all checks passed\n", name);
+    return 0;
+  }
+  printf("%s: %d check(s) failed\n", name, testFailures());
+  return 1;
+}
+
+#endif  // TESTS_TEST_CHECK_H
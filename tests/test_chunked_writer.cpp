@@ -0,0 +1,173 @@
+// test_chunked_writer.cpp -- ChunkedWriter framing (one write() per chunk,
+// de-chunks to the exact body), the response headers, a client that stops
+// taking bytes, and formatFixed against printf.
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <string>
+#include <vector>
+
+#include "chunked_writer.h"
+#include "test_check.h"
+
+// Takes at most `limit` bytes in total, like a socket whose peer went away
+struct CapturePrint : Print {
+  std::string text;
+  std::vector<size_t> writes;
+  size_t limit = SIZE_MAX;
+
+  size_t write(uint8_t c) override { return write(&c, 1); }
+  size_t write(const uint8_t* buffer, size_t size) override {
+    const size_t taken = size < limit - text.size() ? size : limit - text.size();
+    text.append((const char*)buffer, taken);
+    writes.push_back(size);
+    return taken;
+  }
+};
+
+// Body of a chunked transfer; false if the framing is broken
+static bool unchunk(const std::string& raw, std::string& body, size_t& chunks) {
+  body.clear();
+  chunks = 0;
+  size_t position = 0;
+  for (;;) {
+    const size_t lineEnd = raw.find("\r\n", position);
+    if (lineEnd == std::string::npos) {
+      return false;
+    }
+    char* end;
+    const size_t length = strtoul(raw.c_str() + position, &end, 16);
+    if (end != raw.c_str() + lineEnd || lineEnd == position) {
+      return false;
+    }
+    position = lineEnd + 2;
+    if (length == 0) {
+      return raw.compare(position, std::string::npos, "\r\n") == 0;
+    }
+    if (position + length + 2 > raw.size() || raw.compare(position + length, 2, "\r\n") != 0) {
+      return false;
+    }
+    body.append(raw, position, length);
+    position += length + 2;
+    chunks++;
+  }
+}
+
+static void testFraming() {
+  CapturePrint out;
+  std::string expected;
+  {
+    ChunkedWriter writer(out);
+    for (int i = 0; i < 300; i++) {
+      switch (i % 4) {
+        case 0:
+          writer.write("{\"seq\": ");
+          expected += "{\"seq\": ";
+          break;
+        case 1:
+          writer.writeUnsigned(i * 7919);
+          expected += std::to_string(i * 7919);
+          break;
+        case 2:
+          writer.writeFixed(i * 0.37f - 40.0f, 2);
+          char digits[16];
+          snprintf(digits, sizeof(digits), "%.2f", i * 0.37f - 40.0f);
+          expected += digits;
+          break;
+        default:
+          writer.write(',');
+          expected += ',';
+      }
+    }
+    writer.finish();
+    CHECK(writer.ok());
+    CHECK_EQ(writer.bytesWritten(), out.text.size());
+  }
+
+  std::string body;
+  size_t chunks;
+  CHECK(unchunk(out.text, body, chunks));
+  CHECK(body == expected);
+  // Every chunk in one write(), then the terminator
+  CHECK_EQ(out.writes.size(), chunks + 1);
+  CHECK_EQ(chunks, (expected.size() + ChunkedWriter::CHUNK_SIZE - 1) / ChunkedWriter::CHUNK_SIZE);
+}
+
+static void testEmptyBody() {
+  CapturePrint out;
+  ChunkedWriter writer(out);
+  writer.flush();
+  writer.finish();
+  CHECK(out.text == "0\r\n\r\n");
+}
+
+static void testHeaders() {
+  CapturePrint out;
+  ChunkedWriter::writeHeaders(out, "application/json");
+  CHECK(out.text ==
+        "HTTP/1.1 200 OK\r\nContent-Type: application/json\r\n"
+        "Transfer-Encoding: chunked\r\nConnection: close\r\n\r\n");
+  out.text.clear();
+  ChunkedWriter::writeHeaders(out, "application/json", "X-Boot-Id: 7\r\nX-Boot-Sequence: 12\r\n");
+  CHECK(out.text ==
+        "HTTP/1.1 200 OK\r\nContent-Type: application/json\r\n"
+        "X-Boot-Id: 7\r\nX-Boot-Sequence: 12\r\n"
+        "Transfer-Encoding: chunked\r\nConnection: close\r\n\r\n");
+}
+
+static void testShortWrite() {
+  CapturePrint out;
+  out.limit = 700;
+  ChunkedWriter writer(out);
+  for (int i = 0; i < 1000; i++) {
+    writer.write("0123456789");
+  }
+  writer.finish();
+  CHECK(!writer.ok());
+  CHECK_EQ(out.text.size(), 700);
+  CHECK_EQ(writer.bytesWritten(), 700);
+  // The first chunk went through, the second came up short, nothing after
+  CHECK_EQ(out.writes.size(), 2);
+}
+
+static void testFormatFixed() {
+  char out[16];
+  size_t length = formatFixed(out, 1003.25f, 2);
+  CHECK(std::string(out, length) == "1003.25");
+  length = formatFixed(out, -0.004f, 2);
+  CHECK(std::string(out, length) == "0.00");
+  length = formatFixed(out, -12.5f, 0);
+  CHECK(std::string(out, length) == "-13");
+  length = formatFixed(out, 0.1234564f, 6);
+  CHECK(std::string(out, length) == "0.123456");
+  CHECK_EQ(formatFixed(out, NAN, 2), 0);
+  CHECK_EQ(formatFixed(out, INFINITY, 2), 0);
+  CHECK_EQ(formatFixed(out, 5e7f, 2), 0);
+  CHECK_EQ(formatFixed(out, 1.0f, 7), 0);
+
+  // Off by one in the last digit only on a rounding boundary, where the
+  // single-precision scaling rounds the other way
+  srand(1);
+  int differ = 0;
+  const int count = 100000;
+  for (int i = 0; i < count; i++) {
+    const float value = (rand() / (float)RAND_MAX - 0.5f) * 2000.0f;
+    char expected[32];
+    snprintf(expected, sizeof(expected), "%.2f", value);
+    length = formatFixed(out, value, 2);
+    if (std::string(out, length) != expected) {
+      differ++;
+      CHECK_NEAR(strtod(std::string(out, length).c_str(), nullptr), value, 0.01);
+    }
+  }
+  CHECK(differ < count / 100);
+}
+
+int main() {
+  testFraming();
+  testEmptyBody();
+  testHeaders();
+  testShortWrite();
+  testFormatFixed();
+  return testExitCode("test_chunked_writer");
+}
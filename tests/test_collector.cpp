@@ -0,0 +1,186 @@
+// test_collector.cpp -- Collector against StationSim stations on loopback:
+// a backlog and new readings, stations that restart behind the collector
+// (since= past their end) and ahead of it (a replay longer than since=),
+// readings that were taken before a restart but not fetched yet, uptime
+// timestamps, and a collector restart in stream mode. The column files
+// must hold every reading exactly once, in order.
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <string>
+#include <vector>
+
+#include "collector.h"
+#include "station_sim.h"
+#include "test_check.h"
+
+static const char* const DIRECTORY = "test_collector.stations";
+static constexpr uint32_t EPOCH = 1760000000;
+static constexpr uint32_t UPTIME = 100;
+static constexpr uint32_t INTERVAL_MS = 20;
+
+static StationSim sim;
+static uint32_t nextTimestamp[3];
+
+static std::string stationName(size_t station) {
+  return "s" + std::to_string(station);
+}
+
+static void addReadings(size_t station, size_t count) {
+  for (size_t i = 0; i < count; i++) {
+    sim.addReading(station, nextTimestamp[station]);
+    nextTimestamp[station] += 5;
+  }
+}
+
+struct Rows {
+  std::vector<uint32_t> timestamps;
+  std::vector<uint32_t> sequences;
+  std::vector<float> temperatures;
+  std::vector<float> humidities;
+};
+
+static std::vector<uint32_t> readColumn(size_t station, const char* name, const char* type) {
+  ColumnFile column;
+  const std::string path = std::string(DIRECTORY) + "/" + stationName(station) + "/" + name;
+  if (!column.open(path + ".col", name, type)) {
+    return {};
+  }
+  return std::vector<uint32_t>(column.values(), column.values() + column.count());
+}
+
+static Rows readRows(size_t station) {
+  Rows rows;
+  rows.timestamps = readColumn(station, "timestamp", "<u4");
+  rows.sequences = readColumn(station, "seq", "<u4");
+  for (const char* name : {"temperature", "humidity"}) {
+    const std::vector<uint32_t> bits = readColumn(station, name, "<f4");
+    std::vector<float>& values = strcmp(name, "temperature") == 0 ? rows.temperatures
+                                                                  : rows.humidities;
+    values.resize(bits.size());
+    memcpy(values.data(), bits.data(), bits.size() * sizeof(float));
+  }
+  return rows;
+}
+
+static size_t rowCount(size_t station) {
+  return readColumn(station, "timestamp", "<u4").size();
+}
+
+// Turns between the collector and the stations until the stores hold
+// `rows` rows, then a few more polls to catch rows that come twice
+static void runUntil(Collector& collector, const std::vector<size_t>& rows) {
+  volatile sig_atomic_t stop = 0;
+  int settle = -1;
+  for (int i = 0; i < 10000 && settle != 0; i++) {
+    collector.runFor(1, stop);
+    sim.poll(0);
+    if (settle > 0) {
+      settle--;
+      continue;
+    }
+    bool done = true;
+    for (size_t station = 0; station < rows.size(); station++) {
+      done = done && rowCount(station) >= rows[station];
+    }
+    if (done) {
+      settle = 5 * INTERVAL_MS;
+    }
+  }
+  for (size_t station = 0; station < rows.size(); station++) {
+    CHECK_EQ(rowCount(station), rows[station]);
+  }
+}
+
+// Every reading once, timestamps 5 s apart, with the values served
+static void checkRows(size_t station, uint32_t firstTimestamp) {
+  const Rows rows = readRows(station);
+  CHECK(!rows.timestamps.empty());
+  CHECK_EQ(rows.sequences.size(), rows.timestamps.size());
+  size_t wrong = 0;
+  for (size_t i = 0; i < rows.timestamps.size(); i++) {
+    const uint32_t timestamp = rows.timestamps[i];
+    const double humidity = StationSim::humidity(timestamp);
+    wrong += timestamp != firstTimestamp + 5 * i ||
+             fabs(rows.temperatures[i] - StationSim::temperature(station, timestamp)) > 0.006 ||
+             isnan(rows.humidities[i]) != isnan(humidity) ||
+             (!isnan(humidity) && fabs(rows.humidities[i] - humidity) > 0.006);
+  }
+  CHECK_EQ(wrong, 0);
+}
+
+int main() {
+  CHECK(system((std::string("rm -rf ") + DIRECTORY + " && mkdir " + DIRECTORY).c_str()) == 0);
+  CHECK(sim.begin(3));
+  nextTimestamp[0] = EPOCH;
+  nextTimestamp[1] = EPOCH;
+  nextTimestamp[2] = UPTIME;
+  sim.setUptime(2, true);
+  for (size_t station = 0; station < 3; station++) {
+    addReadings(station, 500);
+  }
+
+  {
+    Collector collector(DIRECTORY, CollectMode::Poll, INTERVAL_MS);
+    for (size_t station = 0; station < 3; station++) {
+      CHECK(collector.addStation({stationName(station), "127.0.0.1", sim.port(station), 0}));
+    }
+    runUntil(collector, {500, 500, 500});
+    for (size_t station = 0; station < 3; station++) {
+      addReadings(station, 10);
+    }
+    runUntil(collector, {510, 510, 510});
+    CHECK_EQ(collector.stats().skipped, 0);
+    CHECK_EQ(collector.stats().restarts, 0);
+
+    // Station 0 takes 3 readings nobody fetched, restarts and replays its
+    // newest 100: since=510 is past its end
+    addReadings(0, 3);
+    sim.restart(0, 100);
+    // Station 1 takes 600, and its replay of 1000 reaches past since=510
+    addReadings(1, 600);
+    sim.restart(1, 1000);
+    // Seconds since power-on start over, and cannot tell replayed rows
+    // apart from stored ones
+    sim.restart(2, 50);
+    nextTimestamp[2] = UPTIME;
+    addReadings(2, 20);
+    runUntil(collector, {513, 1110, 530});
+    addReadings(0, 5);
+    addReadings(1, 5);
+    runUntil(collector, {518, 1115, 530});
+    CHECK_EQ(collector.stats().restarts, 3);
+    // Station 0 replays 100 of which 3 are new, station 1 has 400 stored
+    CHECK_EQ(collector.stats().skipped, 97 + 400 + 50);
+  }
+  checkRows(0, EPOCH);
+  checkRows(1, EPOCH);
+  const Rows uptime = readRows(2);
+  CHECK_EQ(uptime.sequences.size(), 530);
+  if (uptime.sequences.size() == 530) {
+    CHECK_EQ(uptime.sequences[509], 509);
+    CHECK_EQ(uptime.sequences[510], 50);
+    CHECK_EQ(uptime.timestamps[510], UPTIME);
+  }
+
+  // A new collector continues after the stored rows, in stream mode
+  {
+    addReadings(0, 7);
+    addReadings(1, 7);
+    addReadings(2, 7);
+    Collector collector(DIRECTORY, CollectMode::Stream, INTERVAL_MS);
+    for (size_t station = 0; station < 3; station++) {
+      CHECK(collector.addStation({stationName(station), "127.0.0.1", sim.port(station), 0}));
+    }
+    runUntil(collector, {525, 1122, 537});
+    sim.restart(0, 10);
+    addReadings(0, 2);
+    runUntil(collector, {527, 1122, 537});
+    CHECK_EQ(collector.stats().skipped, 10);
+    CHECK_EQ(collector.stats().restarts, 1);
+  }
+  checkRows(0, EPOCH);
+  checkRows(1, EPOCH);
+  return testExitCode("test_collector");
+}
@@ -0,0 +1,268 @@
+// test_history.cpp -- HistoryStore, HistoryRollups and FlashHistoryLog
+// across reboots without NTP: every boot restarts the clock near 0, and the
+// RAM history is refilled from the flash pages of earlier boots the way
+// initHistory() does it. Time queries must only see the newest boot.
+// historyNextGroup() is compared against grouping the raw readings by hand,
+// with ranges that cut rollup buckets.
+#include <stdio.h>
+
+#include <map>
+#include <vector>
+
+#include "file_page_store.h"
+#include "history_rollup.h"
+#include "test_check.h"
+
+static const char* const FLASH_FILE = "test_history.flash";
+static constexpr size_t FLASH_PAGES = 16;
+
+// One boot of the firmware: RAM history, rollups and the flash log
+struct Station {
+  FilePageStore flash;
+  FlashHistoryLog log;
+  HistoryStore history;
+  HistoryRollups rollups;
+
+  // initHistory(true)
+  void boot() {
+    CHECK(history.begin(64 * 1024, 0));
+    CHECK(rollups.begin(16 * 1024, 0));
+    CHECK(flash.begin(FLASH_FILE, FLASH_PAGES));
+    CHECK(log.begin(&flash));
+    log.startSegment();
+
+    std::vector<uint8_t> page(FlashHistoryLog::PAGE_DATA_SIZE);
+    for (size_t i = 0; i < log.pageCount(); i++) {
+      bool segmentStart = false;
+      HistoryDecoder decoder(page.data(), log.readPage(i, page.data(), &segmentStart));
+      if (segmentStart) {
+        history.startSegment();
+        rollups.startSegment();
+      }
+      HistoryRecord record;
+      while (decoder.next(record)) {
+        history.append(record);
+        rollups.add(record);
+      }
+    }
+    history.startSegment();
+    rollups.startSegment();
+  }
+
+  // storeReading()
+  void store(uint32_t timestamp, float temperature) {
+    const HistoryRecord record = historyEncode({timestamp, temperature, 1000.0f, 50.0f});
+    history.append(record);
+    rollups.add(record);
+    CHECK(log.append(record));
+  }
+};
+
+// One reading per minute from uptime `start` on
+static void runBoot(Station& station, uint32_t start, uint32_t readings, float temperature) {
+  for (uint32_t i = 0; i < readings; i++) {
+    station.store(start + i * 60, temperature + (i % 7) * 0.25f);
+  }
+}
+
+static uint32_t seekTime(const HistoryStore& history, uint32_t timestamp,
+                         HistoryRecord& record) {
+  HistoryStore::Reader reader(history);
+  reader.seekTime(timestamp);
+  const uint32_t sequence = reader.sequence();
+  if (!reader.next(record)) {
+    record.timestamp = UINT32_MAX;
+  }
+  return sequence;
+}
+
+static void testReboot() {
+  remove(FLASH_FILE);
+
+  // Boot 1 runs for 10 hours
+  uint32_t boot2Sequence;
+  {
+    Station station;
+    station.boot();
+    runBoot(station, 5, 600, 20.0f);
+    CHECK_EQ(station.history.size(), 600);
+    boot2Sequence = station.history.endSequence();
+  }
+
+  // Boot 2 restarts the clock at 0 and runs for 2 hours
+  uint32_t boot3Sequence;
+  {
+    Station station;
+    station.boot();
+    CHECK_EQ(station.history.size(), 600);
+    runBoot(station, 3, 120, 30.0f);
+    CHECK_EQ(station.history.size(), 720);
+    CHECK_EQ(station.history.segmentSequence(), boot2Sequence);
+
+    // Time search stays within boot 2, even for times that boot 1 covers
+    HistoryRecord record;
+    CHECK_EQ(seekTime(station.history, 0, record), boot2Sequence);
+    CHECK_EQ(record.timestamp, 3);
+    CHECK_EQ(seekTime(station.history, 3600, record), boot2Sequence + 60);
+    CHECK_EQ(record.timestamp, 3603);
+    CHECK_EQ(seekTime(station.history, 20000, record), station.history.endSequence());
+
+    // The 1 h tier only holds boot 2, and its means are boot 2 readings
+    CHECK_EQ(station.rollups.bucketCount(2), 2);
+    CHECK(station.rollups.bucket(2, 0).mean(HistoryAggregate::Temperature) > 29.0f);
+
+    HistoryAggregate group;
+    CHECK(historyNextGroup(station.history, station.rollups, 0, UINT32_MAX, 3600, 0, group));
+    CHECK_EQ(group.start, 0);
+    CHECK_EQ(group.count(), 60);
+    CHECK(group.minimum(HistoryAggregate::Temperature) >= 30.0f);
+
+    // Sequence access still reaches boot 1
+    HistoryStore::Reader reader(station.history);
+    reader.seek(station.history.firstSequence());
+    CHECK(reader.next(record));
+    CHECK_EQ(record.timestamp, 5);
+    boot3Sequence = station.history.endSequence();
+  }
+
+  // Boot 3 ends before its clock reaches the end of boot 2; boot 4 starts
+  // later than boot 3 ended, so only the page flag separates them
+  uint32_t boot4Sequence;
+  {
+    Station station;
+    station.boot();
+    runBoot(station, 100, 2, 40.0f);
+    CHECK_EQ(station.history.segmentSequence(), boot3Sequence);
+    boot4Sequence = station.history.endSequence();
+  }
+  {
+    Station station;
+    station.boot();
+    CHECK_EQ(station.history.size(), 722);
+    CHECK_EQ(station.history.segmentSequence(), boot3Sequence);
+    runBoot(station, 200, 3, 50.0f);
+    CHECK_EQ(station.history.segmentSequence(), boot4Sequence);
+
+    HistoryRecord record;
+    CHECK_EQ(seekTime(station.history, 0, record), boot4Sequence);
+    CHECK_EQ(record.timestamp, 200);
+    CHECK_EQ(station.rollups.bucketCount(0), 3);
+  }
+  remove(FLASH_FILE);
+}
+
+// Without a boot in between, a clock that steps back also starts a segment
+static void testClockStepBack() {
+  HistoryStore history;
+  HistoryRollups rollups;
+  CHECK(history.begin(16 * 1024, 0));
+  CHECK(rollups.begin(4 * 1024, 0));
+  for (uint32_t t : {1000u, 1060u, 1120u, 10u, 70u}) {
+    const HistoryRecord record = historyEncode({t, 21.0f, 1000.0f, 50.0f});
+    history.append(record);
+    rollups.add(record);
+  }
+  CHECK_EQ(history.segmentSequence(), 3);
+  HistoryRecord record;
+  CHECK_EQ(seekTime(history, 50, record), 4);
+  CHECK_EQ(rollups.bucketCount(0), 2);
+  CHECK_EQ(rollups.bucket(0, 0).start, 0);
+}
+
+static bool sameAggregate(const HistoryAggregate& a, const HistoryAggregate& b) {
+  if (a.start != b.start) {
+    return false;
+  }
+  for (int i = 0; i < HistoryAggregate::CHANNELS; i++) {
+    const HistoryAggregate::Channel& x = a.channels[i];
+    const HistoryAggregate::Channel& y = b.channels[i];
+    if (x.sum != y.sum || x.count != y.count || x.min != y.min || x.max != y.max) {
+      return false;
+    }
+  }
+  return true;
+}
+
+// Groups like streamReadingsJson() and compares every row with the readings
+// of [from, to] grouped by hand; returns the number of rows
+static size_t checkGroups(const HistoryStore& history, const HistoryRollups& rollups,
+                          uint32_t from, uint32_t to, uint32_t step) {
+  std::map<uint32_t, HistoryAggregate> expected;
+  HistoryStore::Reader reader(history);
+  reader.seek(history.firstSequence());
+  HistoryRecord record;
+  while (reader.next(record)) {
+    if (record.timestamp < from || record.timestamp > to) {
+      continue;
+    }
+    const uint32_t start = record.timestamp - record.timestamp % step;
+    if (expected.count(start) == 0) {
+      expected[start].reset(start);
+    }
+    expected[start].add(record);
+  }
+
+  size_t rows = 0;
+  size_t mismatches = 0;
+  auto next = expected.begin();
+  uint32_t position = from - from % step;
+  HistoryAggregate group;
+  while (historyNextGroup(history, rollups, from, to, step, position, group)) {
+    if (next == expected.end() || !sameAggregate(group, next->second)) {
+      mismatches++;
+    }
+    if (next != expected.end()) {
+      ++next;
+    }
+    rows++;
+    position = group.start + step;
+  }
+  CHECK_EQ(rows, expected.size());
+  CHECK_EQ(mismatches, 0);
+  return rows;
+}
+
+static void testGroupsMatchRawReadings() {
+  HistoryStore history;
+  HistoryRollups rollups;
+  HistoryRollups noRollups;
+  CHECK(history.begin(64 * 1024, 0));
+  CHECK(rollups.begin(256 * 1024, 0));
+  // Two days, one reading every 37 s, humidity missing now and then
+  for (uint32_t i = 0; i < 2 * 86400 / 37; i++) {
+    const float humidity = i % 11 == 0 ? NAN : 40.0f + (i * 7 % 23) * 0.5f;
+    const HistoryRecord record =
+        historyEncode({1760000000 + i * 37, 15.0f + (i * 13 % 97) * 0.1f,
+                       990.0f + (i % 41) * 0.25f, humidity});
+    history.append(record);
+    rollups.add(record);
+  }
+
+  const uint32_t t0 = 1760000000;
+  const struct {
+    uint32_t from;
+    uint32_t to;
+    uint32_t step;
+  } queries[] = {
+      {0, UINT32_MAX, 3600},
+      {t0 + 1234, t0 + 86400 + 4321, 3600},
+      {t0 + 1234, t0 + 86400 + 4321, 600},
+      {t0 + 86400 + 1234, t0 + 2 * 86400 - 4321, 60},
+      {t0 + 1234, t0 + 86400 + 4321, 7200},
+      {t0 + 3600, t0 + 7199, 3600},
+      {t0 + 3601, t0 + 3700, 3600},
+      {t0 + 5000, t0 + 5000, 600},
+  };
+  for (const auto& query : queries) {
+    CHECK(rollups.tierFor(query.step, query.from) >= 0);
+    const size_t rows = checkGroups(history, rollups, query.from, query.to, query.step);
+    CHECK_EQ(checkGroups(history, noRollups, query.from, query.to, query.step), rows);
+  }
+}
+
+int main() {
+  testReboot();
+  testClockStepBack();
+  testGroupsMatchRawReadings();
+  return testExitCode("test_history");
+}
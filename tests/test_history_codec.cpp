@@ -0,0 +1,44 @@
+// test_history_codec.cpp -- record encoding and the timestamp format of
+// the JSON export, including uptimes beyond 32 bits of milliseconds.
+#include <string>
+
+#include "history_codec.h"
+#include "test_check.h"
+
+static std::string format(uint32_t timestamp) {
+  char text[32];
+  historyFormatTimestamp(text, sizeof(text), timestamp);
+  return text;
+}
+
+static void testTimestampFormat() {
+  CHECK(format(0) == "ms:0");
+  CHECK(format(1234) == "ms:1234000");
+  // 49.7 days of uptime is where a 32-bit product wrapped
+  CHECK(format(4294967) == "ms:4294967000");
+  CHECK(format(4294968) == "ms:4294968000");
+  CHECK(format(HISTORY_EPOCH_2020 - 1) == "ms:1577836799000");
+  CHECK(format(HISTORY_EPOCH_2020) == "2020-01-01 00:00:00");
+  CHECK(format(1760000000) == "2025-10-09 08:53:20");
+}
+
+static void testRoundTrip() {
+  const HistorySample sample = {1760000000, 21.37f, 1013.25f, 45.5f};
+  const HistorySample decoded = historyDecode(historyEncode(sample));
+  CHECK_EQ(decoded.timestamp, sample.timestamp);
+  CHECK_NEAR(decoded.temperature, 21.37, 0.005);
+  CHECK_NEAR(decoded.pressure, 1013.25, 0.005);
+  CHECK_NEAR(decoded.humidity, 45.5, 0.005);
+
+  const HistorySample missing = {5, NAN, NAN, NAN};
+  const HistorySample decodedMissing = historyDecode(historyEncode(missing));
+  CHECK(isnan(decodedMissing.temperature));
+  CHECK(isnan(decodedMissing.pressure));
+  CHECK(isnan(decodedMissing.humidity));
+}
+
+int main() {
+  testTimestampFormat();
+  testRoundTrip();
+  return testExitCode("test_history_codec");
+}
@@ -0,0 +1,259 @@
+// test_host_sim.cpp -- BMx280 and MPUx against the register models in host/:
+// datasheet compensation values, the bus traffic of one read, the cached
+// trim across restarts, the MPU calibration from the FIFO and from
+// register reads, and the MPU configuration surviving the soft reset.
+#include <string.h>
+
+#include <initializer_list>
+
+#include "bme280_sim.h"
+#include "bmx_280.h"
+#include "mpu6500_sim.h"
+#include "mpu_x.h"
+#include "test_check.h"
+
+static void testBmeDatasheetSample() {
+  Bme280Sim sim;
+  SimI2cBus& bus = Wire.simBus();
+  bus.attach(0x77, &sim);
+  bus.setClock(400000);
+  i2cScheduler.setDevice(0x77, {400000, I2cScheduler::PRIORITY_SENSOR, 0, 0});
+
+  BMx280 bme(0x77, BMx280Config::highResolution());
+  CHECK(bme.init());
+
+  // Bosch datasheet section 8.2 example with the sample trim of the model
+  sim.setRawSample(519888, 415148, 27000);
+  delay(200);
+
+  bus.resetStats();
+  const BMx280::BMx280Sample sample = bme.readAll();
+  CHECK_NEAR(sample.temperature, 25.08, 0.01);
+  CHECK_NEAR(sample.pressure, 1006.53, 0.02);
+  CHECK(sample.humidity > 0.0f && sample.humidity < 100.0f);
+
+  // Normal mode: one burst over 0xF7..0xFE
+  CHECK_EQ(bus.stats().transactions, 1);
+  CHECK_EQ(bus.stats().bytesRead, BMx280::DATA_LENGTH);
+  CHECK_NEAR((double)bus.stats().busMicros, 256, 30);
+
+  bus.detach(0x77);
+}
+
+static void testTrimCache() {
+  Bme280Sim sim;
+  Wire.simBus().attach(0x77, &sim);
+
+  BMx280 first(0x77);
+  CHECK(first.init());
+  CHECK(!first.isCompensationFromCache());
+  const BMx280::BMx280CompCache cache = first.getCompensationCache();
+
+  // Same part: the cache is used
+  BMx280 again(0x77);
+  again.setCompensationCache(cache);
+  CHECK(again.init());
+  CHECK(again.isCompensationFromCache());
+
+  // Another BME280 with the same chip ID but its own trim
+  uint8_t block1[Bme280Sim::TRIM_BLOCK1_LENGTH];
+  uint8_t block2[Bme280Sim::TRIM_BLOCK2_LENGTH];
+  for (size_t i = 0; i < sizeof(block1); i++) block1[i] = sim.peek(0x88 + i);
+  for (size_t i = 0; i < sizeof(block2); i++) block2[i] = sim.peek(0xE1 + i);
+  block1[2] ^= 0x10;  // dig_T2
+  sim.setTrim(block1, block2);
+
+  BMx280 swapped(0x77);
+  swapped.setCompensationCache(cache);
+  CHECK(swapped.init());
+  CHECK(!swapped.isCompensationFromCache());
+  CHECK_EQ(swapped.getCompensationCache().compVals.T2,
+           (int16_t)(block1[2] | block1[3] << 8));
+
+  Wire.simBus().detach(0x77);
+}
+
+// The datasheet sample through a forced conversion, as the sketch reads it
+static void checkDatasheetSample(Bme280Sim& sim, BMx280& bme) {
+  sim.setRawSample(519888, 415148, 27000);
+  const BMx280::BMx280Sample sample = bme.readAll();
+  CHECK_NEAR(sample.temperature, 25.08, 0.01);
+  CHECK_NEAR(sample.pressure, 1006.53, 0.02);
+}
+
+// The sketch keeps the cache as raw bytes in NVS (Preferences putBytes /
+// getBytes) and hands whatever it reads back to the next boot's init()
+static void testTrimCacheRestore() {
+  Bme280Sim sim;
+  SimI2cBus& bus = Wire.simBus();
+  bus.attach(0x77, &sim);
+
+  bus.resetStats();
+  BMx280 first(0x77, BMx280Config::weatherMonitoring());
+  CHECK(first.init());
+  const uint64_t freshBytes = bus.stats().bytesRead;
+  uint8_t nvs[sizeof(BMx280::BMx280CompCache)];
+  const BMx280::BMx280CompCache stored = first.getCompensationCache();
+  memcpy(nvs, &stored, sizeof(nvs));
+
+  // Next boot: restored from NVS, only the check bytes are read
+  BMx280::BMx280CompCache restored;
+  memcpy(&restored, nvs, sizeof(restored));
+  BMx280 cached(0x77, BMx280Config::weatherMonitoring());
+  cached.setCompensationCache(restored);
+  bus.resetStats();
+  CHECK(cached.init());
+  CHECK(cached.isCompensationFromCache());
+  CHECK(bus.stats().bytesRead < freshBytes);
+  checkDatasheetSample(sim, cached);
+
+  // Nothing in NVS yet, or a cache left by a BMP280 (chip ID 0x58)
+  for (uint8_t chipId : {0x00, 0x58}) {
+    BMx280::BMx280CompCache stale = restored;
+    stale.chipId = chipId;
+    BMx280 bme(0x77, BMx280Config::weatherMonitoring());
+    bme.setCompensationCache(stale);
+    CHECK(bme.init());
+    CHECK(!bme.isCompensationFromCache());
+    CHECK_EQ(bme.getCompensationCache().chipId, Bme280Sim::CHIP_ID);
+  }
+
+  // A cache whose trim disagrees with the part falls back to a fresh read,
+  // and the fresh values replace it
+  BMx280::BMx280CompCache mismatched = restored;
+  mismatched.compVals.T1 += 1;
+  mismatched.compVals.P2 = 0;
+  BMx280 fallback(0x77, BMx280Config::weatherMonitoring());
+  fallback.setCompensationCache(mismatched);
+  bus.resetStats();
+  CHECK(fallback.init());
+  CHECK(!fallback.isCompensationFromCache());
+  // dig_T1..dig_P1 for the check, then the full trim
+  CHECK_EQ(bus.stats().bytesRead, freshBytes + 8);
+  CHECK_EQ(fallback.getCompensationCache().compVals.T1, restored.compVals.T1);
+  CHECK_EQ(fallback.getCompensationCache().compVals.P2, restored.compVals.P2);
+  checkDatasheetSample(sim, fallback);
+
+  bus.detach(0x77);
+}
+
+static void testMpuDataBlock() {
+  Mpu6500Sim sim;
+  Wire.simBus().attach(0x68, &sim);
+
+  MPUx mpu(0x68);
+  mpu.init();
+
+  // The soft reset takes 20 ms on the model; configuration written before it
+  // completes would be dropped
+  uint8_t value = 0;
+  CHECK(i2cReadRegister<uint8_t>(0x68, 0x6B, value) == I2cStatus::Ok);
+  CHECK_EQ(value & 0xC0, 0);
+  CHECK(i2cReadRegister<uint8_t>(0x68, 0x1A, value) == I2cStatus::Ok);
+  CHECK_EQ(value & 0x07, 0x06);
+  CHECK(i2cReadRegister<uint8_t>(0x68, 0x19, value) == I2cStatus::Ok);
+  CHECK_EQ(value, 0x05);
+
+  // init() resets the device, so the sample goes in afterwards
+  const int16_t accl[3] = {1000, -2000, 16384};
+  const int16_t gyro[3] = {131, -262, 0};
+  sim.setSample(accl, 0, gyro);
+  MPUx::floatThreeVals a = mpu.getAcclVals();
+  // ±2 g: 16384 LSB/g
+  CHECK_NEAR(a.x, 1000 / 16384.0, 0.01);
+  CHECK_NEAR(a.y, -2000 / 16384.0, 0.01);
+  CHECK_NEAR(a.z, 1.0, 0.01);
+
+  Wire.simBus().detach(0x68);
+}
+
+// Offsets measured from the FIFO frames while they are consumed; half a
+// second of swaying first, which the attempt in progress must reject
+static void testMpuBackgroundCalibration() {
+  Mpu6500Sim sim;
+  Wire.simBus().attach(0x68, &sim);
+  MPUx mpu(0x68);
+  mpu.init();
+  CHECK(mpu.beginFifo(0, 1));
+  mpu.startCalibration();
+
+  const int16_t still[3] = {119, -300, 16384 + 400};
+  const int16_t swayed[3] = {2119, -2300, 16384 - 1600};
+  const int16_t gyro[3] = {40, -24, 12};
+  const int16_t turning[3] = {1040, -1024, 12};
+  MPUx::SampleBlock block;
+  for (int poll = 0; poll < 150 && mpu.getCalibrationState() != MPUx::CalibrationState::Done;
+       poll++) {
+    const bool moving = poll < 25 && poll % 2 == 1;
+    sim.setSample(moving ? swayed : still, 0, moving ? turning : gyro);
+    delay(20);
+    mpu.readBlock(block);
+  }
+  CHECK(mpu.getCalibrationState() == MPUx::CalibrationState::Done);
+  CHECK(mpu.getCalibrationRejects() >= 1);
+  const MPUx::Calibration calibration = mpu.getCalibration();
+  CHECK_NEAR(calibration.acclOffset.x, 119, 0.5);
+  CHECK_NEAR(calibration.acclOffset.y, -300, 0.5);
+  CHECK_NEAR(calibration.acclOffset.z, 400, 0.5);
+  CHECK_NEAR(calibration.gyroOffset.x, 40, 0.5);
+  CHECK_NEAR(calibration.gyroOffset.z, 12, 0.5);
+
+  // The next frames come out level at 1 g
+  delay(20);
+  CHECK(mpu.readBlock(block) > 0);
+  CHECK_NEAR(block.values[MPUx::AcclX][0], 0.0, 0.001);
+  CHECK_NEAR(block.values[MPUx::AcclZ][0], 1.0, 0.001);
+  CHECK_NEAR(block.values[MPUx::GyroY][0], 0.0, 0.01);
+  mpu.endFifo();
+  Wire.simBus().detach(0x68);
+}
+
+// Without a FIFO consumer the offsets come from register reads instead
+static void testMpuPolledCalibration() {
+  Mpu6500Sim sim;
+  Wire.simBus().attach(0x68, &sim);
+  MPUx mpu(0x68);
+  mpu.init();
+
+  // On its side, so z is far from 1 g: every attempt is rejected
+  const int16_t side[3] = {16384, 0, 0};
+  const int16_t gyro[3] = {40, -24, 12};
+  sim.setSample(side, 0, gyro);
+  CHECK(!mpu.calibratePolled(2));
+  CHECK(mpu.getCalibrationState() == MPUx::CalibrationState::None);
+  CHECK_EQ(mpu.getCalibrationRejects(), 2);
+
+  const int16_t still[3] = {119, -300, 16384 + 400};
+  sim.setSample(still, 0, gyro);
+  const uint32_t start = millis();
+  CHECK(mpu.calibratePolled(2));
+  CHECK(millis() - start < 1500);
+  CHECK(mpu.getCalibrationState() == MPUx::CalibrationState::Done);
+  const MPUx::Calibration calibration = mpu.getCalibration();
+  CHECK_NEAR(calibration.acclOffset.z, 400, 0.5);
+  CHECK_NEAR(calibration.gyroOffset.y, -24, 0.5);
+  CHECK_NEAR(mpu.getAcclVals().z, 1.0, 0.001);
+  Wire.simBus().detach(0x68);
+}
+
+static void testNackOnEmptyAddress() {
+  SimI2cBus& bus = Wire.simBus();
+  bus.resetStats();
+  CHECK(i2cProbe(0x50) == I2cStatus::AddressNack);
+  CHECK_EQ(bus.stats().nacks, 1);
+  uint8_t value = 0xAA;
+  CHECK(i2cReadRegister<uint8_t>(0x50, 0x00, value) == I2cStatus::AddressNack);
+  CHECK_EQ(value, 0xAA);
+}
+
+int main() {
+  host::setSerialQuiet(true);
+  testBmeDatasheetSample();
+  testTrimCache();
+  testTrimCacheRestore();
+  testMpuDataBlock();
+  testMpuBackgroundCalibration();
+  testMpuPolledCalibration();
+  testNackOnEmptyAddress();
+  return testExitCode("test_host_sim");
+}
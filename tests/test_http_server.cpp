@@ -0,0 +1,137 @@
+// test_http_server.cpp -- HttpServer on a loopback port through the POSIX
+// WiFi stand-in: multi-step responses, 400/408/414 replies and clients
+// that leave in the middle of a response, which the abort handler hears of.
+#include <sys/socket.h>
+
+#include <string>
+
+#include "http_server.h"
+#include "test_check.h"
+
+static uint32_t endlessSteps = 0;
+static uint32_t endlessAborts = 0;
+
+static bool handler(WiFiClient& client, const HttpRequest& request,
+                    HttpResponseState& state) {
+  if (request.isPath("/count")) {
+    if (state.step == 0) {
+      client.print("HTTP/1.1 200 OK\r\nConnection: close\r\n\r\n");
+    }
+    client.printf("step %u\n", (unsigned)state.step);
+    return state.step == 4;
+  }
+  if (request.isPath("/endless")) {
+    endlessSteps++;
+    char block[256];
+    memset(block, 'x', sizeof(block));
+    client.write((const uint8_t*)block, sizeof(block));
+    return false;
+  }
+  client.print("HTTP/1.1 404 Not Found\r\nContent-Length: 0\r\n\r\n");
+  return true;
+}
+
+static void abortHandler(const HttpRequest& request, const HttpResponseState& state) {
+  if (request.isPath("/endless") && state.step > 0) {
+    endlessAborts++;
+  }
+}
+
+static WiFiServer wifiServer(0);
+static HttpServer server(wifiServer, handler);
+
+// Sends `request`, polls the server and collects the response until the
+// server closes the connection
+static std::string exchange(const std::string& request) {
+  WiFiClient client;
+  if (!client.connect(wifiServer.port())) {
+    return "";
+  }
+  client.write((const uint8_t*)request.data(), request.size());
+  std::string response;
+  for (int i = 0; i < 1000; i++) {
+    server.poll();
+    char buffer[512];
+    const ssize_t n = recv(client.fd(), buffer, sizeof(buffer), MSG_DONTWAIT);
+    if (n == 0) {
+      break;
+    }
+    if (n > 0) {
+      response.append(buffer, n);
+    }
+  }
+  return response;
+}
+
+static bool startsWith(const std::string& text, const char* prefix) {
+  return text.compare(0, strlen(prefix), prefix) == 0;
+}
+
+static void testMultiStepResponse() {
+  const std::string response = exchange("GET /count HTTP/1.1\r\nHost: x\r\n\r\n");
+  CHECK(startsWith(response, "HTTP/1.1 200 OK"));
+  CHECK(response.find("step 0\nstep 1\nstep 2\nstep 3\nstep 4\n") != std::string::npos);
+  CHECK_EQ(server.activeConnections(), 0);
+}
+
+static void testBadRequests() {
+  CHECK(startsWith(exchange("HELLO\r\n\r\n"), "HTTP/1.1 400"));
+  CHECK(startsWith(exchange("GET count HTTP/1.1\r\n\r\n"), "HTTP/1.1 400"));
+
+  // Longer than the line buffer, and a path that fits the line but not
+  // HttpRequest::path: both are refused instead of cut
+  const std::string longLine = "GET /count?" + std::string(300, 'a') + " HTTP/1.1\r\n\r\n";
+  CHECK(startsWith(exchange(longLine), "HTTP/1.1 414"));
+  const std::string longPath =
+      "GET /count?" + std::string(HttpRequest::PATH_MAX, 'a') + "\r\n\r\n";
+  CHECK(startsWith(exchange(longPath), "HTTP/1.1 414"));
+
+  // A long header line is dropped like any other header
+  const std::string longHeader =
+      "GET /count HTTP/1.1\r\nCookie: " + std::string(400, 'c') + "\r\n\r\n";
+  CHECK(startsWith(exchange(longHeader), "HTTP/1.1 200 OK"));
+}
+
+static void testTimeout() {
+  WiFiClient client;
+  CHECK(client.connect(wifiServer.port()));
+  client.print("GET /count");
+  for (int i = 0; i < 10; i++) server.poll();
+  const uint32_t timeouts = server.stats().timeouts;
+  delay(HttpServer::REQUEST_TIMEOUT_MS);
+  server.poll();
+  CHECK_EQ(server.stats().timeouts, timeouts + 1);
+  char buffer[64] = {};
+  const ssize_t n = recv(client.fd(), buffer, sizeof(buffer) - 1, 0);
+  CHECK(n > 0 && startsWith(buffer, "HTTP/1.1 408"));
+}
+
+static void testClientLeavesMidResponse() {
+  WiFiClient client;
+  CHECK(client.connect(wifiServer.port()));
+  client.print("GET /endless HTTP/1.1\r\n\r\n");
+  for (int i = 0; i < 20; i++) server.poll();
+  CHECK(endlessSteps > 0);
+  CHECK_EQ(server.activeConnections(), 1);
+
+  const uint32_t disconnects = server.stats().disconnects;
+  client.stop();
+  for (int i = 0; i < 5; i++) server.poll();
+  const uint32_t stepsAfterClose = endlessSteps;
+  for (int i = 0; i < 20; i++) server.poll();
+  CHECK_EQ(endlessSteps, stepsAfterClose);
+  CHECK_EQ(server.activeConnections(), 0);
+  CHECK_EQ(server.stats().disconnects, disconnects + 1);
+  CHECK_EQ(endlessAborts, 1);
+}
+
+int main() {
+  host::setSerialQuiet(true);
+  server.onAbort(abortHandler);
+  server.begin();
+  testMultiStepResponse();
+  testBadRequests();
+  testTimeout();
+  testClientLeavesMidResponse();
+  return testExitCode("test_http_server");
+}
@@ -0,0 +1,237 @@
+// test_i2c_utils.cpp -- i2c_utils through the scheduler and the host Wire:
+// NACKs, short reads, chunking, the byte orders of the typed accessors,
+// routing behind TCA9548A muxes and two threads executing the queue
+// themselves before begin().
+#include <thread>
+
+#include "i2c_utils.h"
+#include "tca9548a_sim.h"
+#include "test_check.h"
+
+static constexpr I2cDeviceId DEVICE = 0x40;
+static constexpr I2cDeviceId ABSENT = 0x41;
+static constexpr I2cDeviceId SECOND = 0x42;
+
+// Register file with a data port at FIFO_REG that does not auto-increment
+// and hands out 0, 1, 2, ... on every read
+class FifoDevice : public SimRegisterDevice {
+ public:
+  static constexpr uint8_t FIFO_REG = 0xF0;  // clear of the 200-byte blocks
+  uint8_t next = 0;
+
+ protected:
+  uint8_t readRegister(uint8_t reg) override {
+    return reg == FIFO_REG ? next++ : regs[reg];
+  }
+  uint8_t nextRegister(uint8_t reg) override {
+    return reg == FIFO_REG ? reg : (uint8_t)(reg + 1);
+  }
+};
+
+static FifoDevice device;
+
+static SimI2cBus& bus() { return Wire.simBus(); }
+
+static void testAddressNack() {
+  bus().resetStats();
+  uint8_t buffer[4] = {1, 2, 3, 4};
+  CHECK(i2cReadBlock(ABSENT, 0x00, buffer, sizeof(buffer)) == I2cStatus::AddressNack);
+  CHECK_EQ(buffer[0], 1);
+  CHECK(i2cWriteToRegister(ABSENT, 0x00, 0x55) == I2cStatus::AddressNack);
+  CHECK(i2cProbe(ABSENT) == I2cStatus::AddressNack);
+  CHECK(i2cProbe(DEVICE) == I2cStatus::Ok);
+  CHECK_EQ(bus().stats().nacks, 3);
+
+  // The convenience readers fall back to 0
+  CHECK_EQ(i2cReadByteFromRegister(ABSENT, 0x00), 0);
+  CHECK_EQ(i2cReadWordFromRegister(ABSENT, 0x00), 0);
+  CHECK_EQ(i2cReadThreeBytesFromRegister(ABSENT, 0x00), 0);
+}
+
+static void testDataNack() {
+  device.poke(0x10, 0x00);
+  bus().nackNextWrite();
+  CHECK(i2cWriteToRegister(DEVICE, 0x10, 0x55) == I2cStatus::DataNack);
+  CHECK_EQ(device.peek(0x10), 0x00);
+  CHECK(i2cWriteToRegister(DEVICE, 0x10, 0x55) == I2cStatus::Ok);
+  CHECK_EQ(device.peek(0x10), 0x55);
+}
+
+static void testShortRead() {
+  for (int i = 0; i < 8; i++) device.poke(0x20 + i, 0xA0 + i);
+  uint8_t buffer[8] = {};
+  bus().truncateNextRead(3);
+  CHECK(i2cReadBlock(DEVICE, 0x20, buffer, sizeof(buffer)) == I2cStatus::ShortRead);
+
+  uint32_t value = 0xDEADBEEF;
+  bus().truncateNextRead(2);
+  CHECK((i2cReadRegister<uint32_t, 3>(DEVICE, 0x20, value)) == I2cStatus::ShortRead);
+  CHECK_EQ(value, 0xDEADBEEF);
+
+  // The next transfer is complete again
+  CHECK(i2cReadBlock(DEVICE, 0x20, buffer, sizeof(buffer)) == I2cStatus::Ok);
+  CHECK_EQ(buffer[7], 0xA7);
+}
+
+static void testBlockChunking() {
+  // 200 bytes: one full Wire buffer and the rest, at increasing registers
+  uint8_t data[200];
+  for (size_t i = 0; i < sizeof(data); i++) data[i] = (uint8_t)(i * 3 + 1);
+
+  bus().resetStats();
+  CHECK(i2cWriteBlock(DEVICE, 0x00, data, sizeof(data)) == I2cStatus::Ok);
+  // One byte of each write carries the register address
+  CHECK_EQ(bus().stats().transactions, 2);
+  CHECK_EQ(bus().stats().bytesWritten, sizeof(data) + 2);
+  bool same = true;
+  for (size_t i = 0; i < sizeof(data); i++) same &= device.peek(i) == data[i];
+  CHECK(same);
+
+  uint8_t back[200] = {};
+  bus().resetStats();
+  CHECK(i2cReadBlock(DEVICE, 0x00, back, sizeof(back)) == I2cStatus::Ok);
+  CHECK_EQ(bus().stats().transactions, 2);
+  CHECK_EQ(bus().stats().bytesRead, sizeof(back));
+  CHECK(memcmp(back, data, sizeof(data)) == 0);
+}
+
+static void testFifoChunking() {
+  uint8_t buffer[300] = {};
+  device.next = 0;
+  bus().resetStats();
+  CHECK(i2cReadFifo(DEVICE, FifoDevice::FIFO_REG, buffer, sizeof(buffer)) == I2cStatus::Ok);
+  CHECK_EQ(bus().stats().transactions, 3);
+  // Every chunk addresses the data port again
+  CHECK_EQ(bus().stats().bytesWritten, 3);
+  bool sequential = true;
+  for (size_t i = 0; i < sizeof(buffer); i++) sequential &= buffer[i] == (uint8_t)i;
+  CHECK(sequential);
+}
+
+static void testTypedByteOrder() {
+  const uint8_t bytes[4] = {0x12, 0x34, 0x56, 0x78};
+  for (int i = 0; i < 4; i++) device.poke(0x30 + i, bytes[i]);
+
+  uint8_t u8 = 0;
+  uint16_t u16 = 0;
+  uint32_t u32 = 0;
+  CHECK((i2cReadRegister<uint8_t>(DEVICE, 0x30, u8)) == I2cStatus::Ok);
+  CHECK_EQ(u8, 0x12);
+  CHECK((i2cReadRegister<uint16_t>(DEVICE, 0x30, u16)) == I2cStatus::Ok);
+  CHECK_EQ(u16, 0x1234);
+  CHECK((i2cReadRegister<uint16_t, 2, I2cEndian::Little>(DEVICE, 0x30, u16)) == I2cStatus::Ok);
+  CHECK_EQ(u16, 0x3412);
+  CHECK((i2cReadRegister<uint32_t, 3>(DEVICE, 0x30, u32)) == I2cStatus::Ok);
+  CHECK_EQ(u32, 0x123456);
+  CHECK((i2cReadRegister<uint32_t, 3, I2cEndian::Little>(DEVICE, 0x30, u32)) == I2cStatus::Ok);
+  CHECK_EQ(u32, 0x563412);
+  CHECK((i2cReadRegister<uint32_t>(DEVICE, 0x30, u32)) == I2cStatus::Ok);
+  CHECK_EQ(u32, 0x12345678);
+  CHECK((i2cReadRegister<uint32_t, 4, I2cEndian::Little>(DEVICE, 0x30, u32)) == I2cStatus::Ok);
+  CHECK_EQ(u32, 0x78563412);
+
+  CHECK_EQ(i2cReadWordFromRegister(DEVICE, 0x30), 0x1234);
+  CHECK_EQ(i2cReadWordFromRegisterLE(DEVICE, 0x30), 0x3412);
+  CHECK_EQ(i2cReadThreeBytesFromRegister(DEVICE, 0x30), 0x123456);
+
+  // Signed values keep their sign
+  device.poke(0x38, 0xFF);
+  device.poke(0x39, 0xFE);
+  int16_t s16 = 0;
+  CHECK((i2cReadRegister<int16_t>(DEVICE, 0x38, s16)) == I2cStatus::Ok);
+  CHECK_EQ(s16, -2);
+  CHECK((i2cReadRegister<int16_t, 2, I2cEndian::Little>(DEVICE, 0x38, s16)) == I2cStatus::Ok);
+  CHECK_EQ(s16, (int16_t)0xFEFF);
+
+  // Writes are the mirror image
+  CHECK((i2cWriteRegister<uint32_t, 3, I2cEndian::Little>(DEVICE, 0x40, 0xABCDEF)) == I2cStatus::Ok);
+  CHECK_EQ(device.peek(0x40), 0xEF);
+  CHECK_EQ(device.peek(0x41), 0xCD);
+  CHECK_EQ(device.peek(0x42), 0xAB);
+  CHECK((i2cWriteRegister<uint16_t>(DEVICE, 0x44, 0xBEEF)) == I2cStatus::Ok);
+  CHECK_EQ(device.peek(0x44), 0xBE);
+  CHECK_EQ(device.peek(0x45), 0xEF);
+}
+
+// The same address behind two muxes; a mux somebody else wrote to must be
+// closed again before the other one's device is read
+static void testMuxRouting() {
+  Tca9548aSim mux0, mux1;
+  SimRegisterDevice behind0, behind1;
+  behind0.poke(0x10, 0xA0);
+  behind1.poke(0x10, 0xA1);
+  mux0.attach(2, 0x50, &behind0);
+  mux1.attach(5, 0x50, &behind1);
+  bus().attach(0x70, &mux0);
+  bus().attach(0x71, &mux1);
+  const I2cDeviceId device0 = i2cDeviceBehindMux(0, 0x70, 2, 0x50);
+  const I2cDeviceId device1 = i2cDeviceBehindMux(0, 0x71, 5, 0x50);
+
+  uint8_t value = 0;
+  CHECK(i2cReadRegister<uint8_t>(device1, 0x10, value) == I2cStatus::Ok);
+  CHECK_EQ(value, 0xA1);
+  CHECK(i2cReadRegister<uint8_t>(device0, 0x10, value) == I2cStatus::Ok);
+  CHECK_EQ(value, 0xA0);
+  CHECK_EQ(mux1.channels(), 0);
+
+  // Open mux 0 behind the scheduler's back; the mux keeps the last byte
+  CHECK(i2cWriteToRegister(0x70, 0x00, 1 << 2) == I2cStatus::Ok);
+  CHECK_EQ(mux0.channels(), 1 << 2);
+  CHECK(i2cReadRegister<uint8_t>(device1, 0x10, value) == I2cStatus::Ok);
+  CHECK_EQ(value, 0xA1);
+  CHECK_EQ(mux0.channels(), 0);
+  CHECK_EQ(mux1.channels(), 1 << 5);
+
+  bus().detach(0x70);
+  bus().detach(0x71);
+}
+
+// Without the worker every caller of wait() runs transactions itself; two
+// of them must still take turns on the bus
+static void testConcurrentCallers() {
+  SimRegisterDevice second;
+  bus().attach(SECOND, &second);
+  uint8_t pattern[2][200];
+  for (size_t i = 0; i < sizeof(pattern[0]); i++) {
+    pattern[0][i] = (uint8_t)(i * 5 + 3);
+    pattern[1][i] = (uint8_t)(255 - i);
+    device.poke(i, pattern[0][i]);
+    second.poke(i, pattern[1][i]);
+  }
+  CHECK(!i2cScheduler.isRunning());
+
+  int failures[2] = {};
+  std::thread threads[2];
+  for (int t = 0; t < 2; t++) {
+    threads[t] = std::thread([&, t] {
+      const uint8_t address = t == 0 ? DEVICE : SECOND;
+      for (int i = 0; i < 5000; i++) {
+        uint8_t buffer[200] = {};
+        if (i2cReadBlock(address, 0x00, buffer, sizeof(buffer)) != I2cStatus::Ok ||
+            memcmp(buffer, pattern[t], sizeof(buffer)) != 0) {
+          failures[t]++;
+        }
+      }
+    });
+  }
+  for (std::thread& thread : threads) {
+    thread.join();
+  }
+  CHECK_EQ(failures[0], 0);
+  CHECK_EQ(failures[1], 0);
+  bus().detach(SECOND);
+}
+
+int main() {
+  host::setSerialQuiet(true);
+  bus().attach(DEVICE, &device);
+  testAddressNack();
+  testDataNack();
+  testShortRead();
+  testBlockChunking();
+  testFifoChunking();
+  testTypedByteOrder();
+  testMuxRouting();
+  testConcurrentCallers();
+  return testExitCode("test_i2c_utils");
+}
@@ -0,0 +1,114 @@
+// test_metrics.cpp -- metrics: bucket boundaries, no samples lost when more
+// threads than shards record at once, and the Prometheus text.
+#include <stdlib.h>
+
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "chunked_writer.h"
+#include "metrics.h"
+#include "test_check.h"
+
+struct StringPrint : Print {
+  std::string text;
+  size_t write(uint8_t c) override {
+    text += (char)c;
+    return 1;
+  }
+  size_t write(const uint8_t* buffer, size_t size) override {
+    text.append((const char*)buffer, size);
+    return size;
+  }
+};
+
+// Body of a chunked transfer
+static std::string unchunk(const std::string& raw) {
+  std::string body;
+  size_t position = 0;
+  while (position < raw.size()) {
+    const size_t length = strtoul(raw.c_str() + position, nullptr, 16);
+    position = raw.find("\r\n", position) + 2;
+    body.append(raw, position, length);
+    position += length + 2;
+  }
+  return body;
+}
+
+static void testBuckets() {
+  metricsReset();
+  // 256 ticks is bucket 0, 257 bucket 1, 2^31 the last one, above it +Inf
+  for (uint32_t ticks : {1u, 256u, 257u, 512u, 513u, 1u << 31, (1u << 31) + 1}) {
+    metricsRecord(MetricsStage::LoopPeriod, ticks);
+  }
+  MetricsHistogram histogram;
+  metricsSnapshot(MetricsStage::LoopPeriod, histogram);
+  CHECK_EQ(histogram.count, 7);
+  CHECK_EQ(histogram.buckets[0], 2);
+  CHECK_EQ(histogram.buckets[1], 2);
+  CHECK_EQ(histogram.buckets[2], 1);
+  CHECK_EQ(histogram.buckets[METRICS_BUCKETS - 1], 1);
+  CHECK_EQ(histogram.buckets[METRICS_BUCKETS], 1);
+  CHECK_EQ(histogram.sumTicks, 1 + 256 + 257 + 512 + 513 + 2 * (1ull << 31) + 1);
+}
+
+static void testConcurrentRecords() {
+  metricsReset();
+  static constexpr int THREADS = 8;
+  static constexpr int RECORDS = 1000000;
+  std::vector<std::thread> threads;
+  for (int t = 0; t < THREADS; t++) {
+    threads.emplace_back([] {
+      for (int i = 0; i < RECORDS; i++) {
+        metricsRecord(MetricsStage::I2cTransaction, 1000);
+        metricsAdd(MetricsCounter::I2cBytes, 3);
+      }
+    });
+  }
+  for (std::thread& thread : threads) {
+    thread.join();
+  }
+  MetricsHistogram histogram;
+  metricsSnapshot(MetricsStage::I2cTransaction, histogram);
+  CHECK_EQ(histogram.count, THREADS * RECORDS);
+  CHECK_EQ(histogram.buckets[2], THREADS * RECORDS);
+  CHECK_EQ(histogram.sumTicks, 1000ull * THREADS * RECORDS);
+  CHECK_EQ(metricsCounter(MetricsCounter::I2cBytes), 3ull * THREADS * RECORDS);
+}
+
+static void testPrometheusText() {
+  metricsReset();
+  metricsRecord(MetricsStage::I2cTransaction, 100);
+  metricsRecord(MetricsStage::I2cTransaction, 300000);
+  metricsAdd(MetricsCounter::I2cErrors, 2);
+  StringPrint out;
+  {
+    ChunkedWriter writer(out);
+    metricsWriteStage(writer, MetricsStage::I2cTransaction);
+    metricsWriteCounters(writer);
+    writer.finish();
+  }
+  // Host ticks are nanoseconds: 2^8 ns is the first bound, 300 us falls
+  // under 2^19 ns
+  const std::string text = unchunk(out.text);
+  CHECK(text.find("# TYPE dmp_stage_seconds histogram") != std::string::npos);
+  CHECK(text.find("dmp_stage_seconds_bucket{stage=\"i2c_transaction\",le=\"0.000000256\"} 1\n") !=
+        std::string::npos);
+  CHECK(text.find("dmp_stage_seconds_bucket{stage=\"i2c_transaction\",le=\"0.000262144\"} 1\n") !=
+        std::string::npos);
+  CHECK(text.find("dmp_stage_seconds_bucket{stage=\"i2c_transaction\",le=\"0.000524288\"} 2\n") !=
+        std::string::npos);
+  CHECK(text.find("dmp_stage_seconds_bucket{stage=\"i2c_transaction\",le=\"+Inf\"} 2\n") !=
+        std::string::npos);
+  CHECK(text.find("dmp_stage_seconds_sum{stage=\"i2c_transaction\"} 0.0003001\n") !=
+        std::string::npos);
+  CHECK(text.find("dmp_stage_seconds_count{stage=\"i2c_transaction\"} 2\n") != std::string::npos);
+  CHECK(text.find("dmp_i2c_errors_total 2\n") != std::string::npos);
+}
+
+int main() {
+  testBuckets();
+  testConcurrentRecords();
+  testPrometheusText();
+  return testExitCode("test_metrics");
+}
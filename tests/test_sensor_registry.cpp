@@ -0,0 +1,55 @@
+// test_sensor_registry.cpp -- SensorRegistry::discover() on both buses:
+// sensors on the trunk and behind a TCA9548A get their paths, also when
+// the mux still has a channel open from before a reset, and a batch reads
+// every one of them.
+#include <string.h>
+
+#include "bme280_sim.h"
+#include "sensor_registry.h"
+#include "tca9548a_sim.h"
+#include "test_check.h"
+
+static void testDiscoverWithOpenMux() {
+  Bme280Sim trunk, behind, second;
+  Tca9548aSim mux;
+  trunk.setRawSample(519888, 415148, 27000);
+  behind.setRawSample(519888 + 1000, 415148, 27000);
+  second.setRawSample(519888 + 2000, 415148, 27000);
+  Wire.simBus().attach(0x77, &trunk);
+  Wire.simBus().attach(0x70, &mux);
+  mux.attach(3, 0x76, &behind);
+  Wire1.simBus().attach(0x76, &second);
+
+  // Left open by the firmware that ran before the reset
+  const uint8_t open = 1 << 3;
+  mux.onWrite(&open, 1);
+  CHECK_EQ(mux.channels(), open);
+
+  SensorRegistry registry(BMx280Config::weatherMonitoring(),
+                          {400000, I2cScheduler::PRIORITY_SENSOR, 5000, 0});
+  CHECK_EQ(registry.discover(), 3);
+  CHECK_EQ(registry.stats().muxes, 1);
+  CHECK_EQ(registry.envCount(), 3);
+  // In scan order: bus 0 by address, the mux at 0x70 before 0x77, then bus 1
+  const char* const expected[] = {"bus0/mux0x70.3/0x76", "bus0/0x77", "bus1/0x76"};
+  for (size_t i = 0; i < registry.size() && i < 3; i++) {
+    char tag[SensorRegistry::TAG_LENGTH];
+    registry.formatTag(i, tag, sizeof(tag));
+    CHECK(strcmp(tag, expected[i]) == 0);
+    CHECK(registry.info(i).kind == SensorKind::Bme280);
+  }
+
+  SensorRegistry::Reading readings[SensorRegistry::MAX_BATCH];
+  CHECK_EQ(registry.sampleBatch(readings, SensorRegistry::MAX_BATCH), 3);
+  CHECK_EQ(registry.stats().errors, 0);
+
+  Wire.simBus().detach(0x77);
+  Wire.simBus().detach(0x70);
+  Wire1.simBus().detach(0x76);
+}
+
+int main() {
+  host::setSerialQuiet(true);
+  testDiscoverWithOpenMux();
+  return testExitCode("test_sensor_registry");
+}
@@ -0,0 +1,98 @@
+// test_vibration.cpp -- VibrationAnalyzer: the real FFT against a direct
+// DFT in double precision, and the RMS, peak and band figures of known
+// sines fed through the streaming windows.
+#include <math.h>
+
+#include <random>
+
+#include "test_check.h"
+#include "vibration.h"
+
+static constexpr size_t N = VibrationAnalyzer::WINDOW;
+static constexpr float SAMPLE_RATE = 1000.0f;
+
+static VibrationAnalyzer analyzer;
+
+static void testFftMatchesDft() {
+  std::mt19937 rng(1);
+  std::normal_distribution<float> noise(0, 1);
+  static float in[N];
+  static float out[2 * VibrationAnalyzer::BINS];
+  double maxError = 0;
+  double maxMagnitude = 0;
+  for (int trial = 0; trial < 10; trial++) {
+    for (size_t i = 0; i < N; i++) {
+      in[i] = noise(rng);
+    }
+    analyzer.realFft(in, out);
+    for (size_t k = 0; k < VibrationAnalyzer::BINS; k++) {
+      double re = 0;
+      double im = 0;
+      for (size_t n = 0; n < N; n++) {
+        const double angle = -2 * M_PI * (double)(k * n % N) / N;
+        re += in[n] * cos(angle);
+        im += in[n] * sin(angle);
+      }
+      maxError = fmax(maxError, fmax(fabs(re - out[2 * k]), fabs(im - out[2 * k + 1])));
+      maxMagnitude = fmax(maxMagnitude, hypot(re, im));
+    }
+  }
+  // Single precision over log2(256) butterfly stages
+  CHECK(maxMagnitude > 10);
+  CHECK(maxError < 1e-5 * maxMagnitude);
+}
+
+// 0.1 g at 62.5 Hz (exactly bin 16) on x, 0.02 g at 140 Hz (between bins)
+// on y, gravity plus a little noise on z
+static void testSines() {
+  static constexpr size_t SAMPLES = 4096;
+  static float x[SAMPLES], y[SAMPLES], z[SAMPLES];
+  std::mt19937 rng(2);
+  std::normal_distribution<float> noise(0, 0.01f);
+  for (size_t i = 0; i < SAMPLES; i++) {
+    x[i] = 0.1f * sinf(2 * M_PI * 62.5f * i / SAMPLE_RATE);
+    y[i] = 0.02f * sinf(2 * M_PI * 140.0f * i / SAMPLE_RATE);
+    z[i] = 1.0f + noise(rng);
+  }
+
+  CHECK(analyzer.begin(SAMPLE_RATE));
+  size_t position = 0;
+  uint32_t windows = 0;
+  while (position < SAMPLES) {
+    const float* const axes[3] = {x + position, y + position, z + position};
+    position += analyzer.feed(axes, SAMPLES - position);
+    if (!analyzer.windowReady()) {
+      continue;
+    }
+    const VibrationAnalyzer::Result& result = analyzer.analyze();
+    windows++;
+    if (windows < 3) {
+      continue;
+    }
+
+    CHECK_NEAR(result.peakHz[0], 62.5, 0.01);
+    CHECK_NEAR(result.peakAmplitude[0], 0.1, 0.005);
+    CHECK_NEAR(result.rms[0], 0.1 / sqrt(2), 0.002);
+    // Between bins 35 and 36: the peak lands on one of them and the Hann
+    // scalloping loss stays below 16%
+    CHECK_NEAR(result.peakHz[1], 140.0, analyzer.binHz(1));
+    CHECK(result.peakAmplitude[1] > 0.02 * 0.84 && result.peakAmplitude[1] < 0.0205);
+    CHECK_NEAR(result.rms[1], 0.02 / sqrt(2), 0.0005);
+    // Gravity is the window mean, not vibration
+    CHECK_NEAR(result.rms[2], 0.01, 0.002);
+
+    // 62.5 Hz is in the 50-100 Hz band, 140 Hz in 100-500 Hz
+    for (size_t band = 0; band < VibrationAnalyzer::BANDS; band++) {
+      CHECK(band == 4 || result.bandEnergy[0][band] < 0.01 * result.bandEnergy[0][4]);
+      CHECK(band == 5 || result.bandEnergy[1][band] < 0.05 * result.bandEnergy[1][5]);
+    }
+  }
+  CHECK_EQ(windows, (SAMPLES - N) / VibrationAnalyzer::HOP + 1);
+}
+
+int main() {
+  CHECK(analyzer.begin(SAMPLE_RATE));
+  testFftMatchesDft();
+  testSines();
+  return testExitCode("test_vibration");
+}
@@ -0,0 +1,175 @@
+#include "vibration.h"
+
+#include <math.h>
+#include <string.h>
+
+constexpr float VibrationAnalyzer::DEFAULT_BAND_EDGES[];
+
+bool VibrationAnalyzer::begin(float sampleRateHz, const float edges[BANDS + 1]) {
+  if (!(sampleRateHz > 0)) {
+    return false;
+  }
+  sampleRate = sampleRateHz;
+  memcpy(bandEdges, edges, sizeof(bandEdges));
+
+  float sum = 0;
+  float sumSquares = 0;
+  for (size_t i = 0; i < WINDOW; i++) {
+    hann[i] = 0.5f - 0.5f * cosf(2.0f * (float)M_PI * i / WINDOW);
+    sum += hann[i];
+    sumSquares += hann[i] * hann[i];
+  }
+  // Parseval with the window's power gain, so the bins of a window add up
+  // to the mean square of the input
+  powerScale = 2.0f / (WINDOW * sumSquares);
+  amplitudeScale = 2.0f / sum;
+
+  for (size_t k = 0; k < HALF; k++) {
+    twiddleCos[k] = cosf(2.0f * (float)M_PI * k / WINDOW);
+    twiddleSin[k] = -sinf(2.0f * (float)M_PI * k / WINDOW);
+  }
+
+  size_t bits = 0;
+  while ((1u << bits) < HALF) {
+    bits++;
+  }
+  for (size_t i = 0; i < HALF; i++) {
+    size_t reversed = 0;
+    for (size_t b = 0; b < bits; b++) {
+      reversed |= ((i >> b) & 1) << (bits - 1 - b);
+    }
+    bitReverse[i] = (uint8_t)reversed;
+  }
+
+  filled = 0;
+  windows = 0;
+  result = {};
+  return true;
+}
+
+size_t VibrationAnalyzer::feed(const float* const axes[AXES], size_t count) {
+  size_t n = WINDOW - filled;
+  if (n > count) {
+    n = count;
+  }
+  for (size_t axis = 0; axis < AXES; axis++) {
+    memcpy(&samples[axis][filled], axes[axis], n * sizeof(float));
+  }
+  filled += n;
+  return n;
+}
+
+// In-place iterative radix-2 FFT of HALF complex values (re/im pairs)
+void VibrationAnalyzer::fftHalf(float* data) {
+  for (size_t i = 0; i < HALF; i++) {
+    const size_t j = bitReverse[i];
+    if (j > i) {
+      float t = data[2 * i];
+      data[2 * i] = data[2 * j];
+      data[2 * j] = t;
+      t = data[2 * i + 1];
+      data[2 * i + 1] = data[2 * j + 1];
+      data[2 * j + 1] = t;
+    }
+  }
+
+  for (size_t size = 2; size <= HALF; size *= 2) {
+    const size_t half = size / 2;
+    // W_size^k = W_WINDOW^(k * WINDOW / size)
+    const size_t stride = WINDOW / size;
+    for (size_t start = 0; start < HALF; start += size) {
+      for (size_t k = 0; k < half; k++) {
+        const float wr = twiddleCos[k * stride];
+        const float wi = twiddleSin[k * stride];
+        float* a = &data[2 * (start + k)];
+        float* b = &data[2 * (start + k + half)];
+        const float tr = b[0] * wr - b[1] * wi;
+        const float ti = b[0] * wi + b[1] * wr;
+        b[0] = a[0] - tr;
+        b[1] = a[1] - ti;
+        a[0] += tr;
+        a[1] += ti;
+      }
+    }
+  }
+}
+
+void VibrationAnalyzer::realFft(const float* in, float* out) {
+  // Even samples as real parts, odd samples as imaginary parts
+  memcpy(work, in, sizeof(work));
+  fftHalf(work);
+
+  // X[k] = (Z[k] + conj(Z[N/2-k])) / 2 - i W^k (Z[k] - conj(Z[N/2-k])) / 2
+  for (size_t k = 0; k <= HALF; k++) {
+    const size_t a = k % HALF;
+    const size_t b = (HALF - k) % HALF;
+    const float zr = work[2 * a], zi = work[2 * a + 1];
+    const float cr = work[2 * b], ci = -work[2 * b + 1];
+
+    const float er = 0.5f * (zr + cr), ei = 0.5f * (zi + ci);
+    const float dr = 0.5f * (zr - cr), di = 0.5f * (zi - ci);
+    // W^HALF = -1, which is not in the table
+    const float wr = k < HALF ? twiddleCos[k] : -1.0f;
+    const float wi = k < HALF ? twiddleSin[k] : 0.0f;
+    // -i * W * d
+    const float tr = wr * dr - wi * di;
+    const float ti = wr * di + wi * dr;
+    out[2 * k] = er + ti;
+    out[2 * k + 1] = ei - tr;
+  }
+}
+
+const VibrationAnalyzer::Result& VibrationAnalyzer::analyze() {
+  result.window = windows++;
+
+  for (size_t axis = 0; axis < AXES; axis++) {
+    // Gravity and sensor bias would otherwise leak into the low bins
+    float mean = 0;
+    for (size_t i = 0; i < WINDOW; i++) {
+      mean += samples[axis][i];
+    }
+    mean /= WINDOW;
+    for (size_t i = 0; i < WINDOW; i++) {
+      input[i] = (samples[axis][i] - mean) * hann[i];
+    }
+
+    realFft(input, spectrumBins);
+
+    float total = 0;
+    size_t peak = 1;
+    float* bins = power[axis];
+    for (size_t k = 0; k < BINS; k++) {
+      const float re = spectrumBins[2 * k], im = spectrumBins[2 * k + 1];
+      const float magnitude2 = re * re + im * im;
+      // DC and Nyquist have no mirrored half
+      bins[k] = magnitude2 * powerScale * (k == 0 || k == HALF ? 0.5f : 1.0f);
+      total += bins[k];
+      if (k > 0 && bins[k] > bins[peak]) {
+        peak = k;
+      }
+    }
+
+    result.rms[axis] = sqrtf(total);
+    result.peakHz[axis] = binHz(peak);
+    result.peakAmplitude[axis] =
+        sqrtf(spectrumBins[2 * peak] * spectrumBins[2 * peak] +
+              spectrumBins[2 * peak + 1] * spectrumBins[2 * peak + 1]) *
+        amplitudeScale;
+
+    for (size_t band = 0; band < BANDS; band++) {
+      float energy = 0;
+      for (size_t k = 1; k < BINS; k++) {
+        const float hz = binHz(k);
+        if (hz >= bandEdges[band] && hz < bandEdges[band + 1]) {
+          energy += bins[k];
+        }
+      }
+      result.bandEnergy[axis][band] = energy;
+    }
+
+    // Keep the second half as the start of the next window
+    memmove(samples[axis], samples[axis] + HOP, (WINDOW - HOP) * sizeof(float));
+  }
+  filled = WINDOW - HOP;
+  return result;
+}
@@ -0,0 +1,86 @@
+#ifndef VIBRATION_H
+#define VIBRATION_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+/**
+ * Streaming spectrum analysis of the accelerometer axes. Samples are
+ * collected into WINDOW-sized Hann windows that overlap by half; each
+ * window is transformed with a fixed-size real FFT (an N/2 complex FFT
+ * plus a split step) and reduced to RMS, peak frequency and band energies
+ * per axis. All buffers and tables are members, nothing is allocated
+ * after begin().
+ */
+class VibrationAnalyzer {
+ public:
+  static constexpr size_t WINDOW = 256;
+  static constexpr size_t HOP = WINDOW / 2;
+  static constexpr size_t BINS = WINDOW / 2 + 1;
+  static constexpr size_t AXES = 3;
+  static constexpr size_t BANDS = 6;
+
+  // Band edges in Hz, band b covers [edges[b], edges[b + 1]); DC is excluded
+  static constexpr float DEFAULT_BAND_EDGES[BANDS + 1] = {1, 5, 10, 25, 50, 100, 500};
+
+  struct Result {
+    uint32_t window;                    // counts windows since begin()
+    float rms[AXES];                    // g, without the window mean
+    float peakHz[AXES];
+    float peakAmplitude[AXES];          // g, of a sine at peakHz
+    float bandEnergy[AXES][BANDS];      // g^2, mean square per band
+  };
+
+  bool begin(float sampleRateHz, const float bandEdges[BANDS + 1] = DEFAULT_BAND_EDGES);
+
+  /**
+   * Appends up to `count` samples of each axis. Stops early once a window
+   * is complete; call analyze() then and feed the rest.
+   * @return samples consumed
+   */
+  size_t feed(const float* const axes[AXES], size_t count);
+
+  bool windowReady() const { return filled == WINDOW; }
+
+  // Transforms the complete window and slides it on by HOP samples
+  const Result& analyze();
+
+  const Result& lastResult() const { return result; }
+  float getSampleRate() const { return sampleRate; }
+  float getBandEdge(size_t index) const { return bandEdges[index]; }
+  float binHz(size_t bin) const { return bin * sampleRate / WINDOW; }
+
+  // One-sided power spectrum (g^2 per bin) of the last analyzed window
+  const float* spectrum(size_t axis) const { return power[axis]; }
+
+  // Real FFT of WINDOW samples, out holds BINS complex values as re/im
+  // pairs. Exposed for checking against a reference DFT.
+  void realFft(const float* in, float* out);
+
+ private:
+  static constexpr size_t HALF = WINDOW / 2;  // complex FFT size
+
+  float sampleRate = 0;
+  float bandEdges[BANDS + 1] = {};
+  float powerScale = 0;      // |X|^2 to g^2 per one-sided bin
+  float amplitudeScale = 0;  // |X| to sine amplitude
+
+  float samples[AXES][WINDOW];
+  size_t filled = 0;
+  uint32_t windows = 0;
+
+  float hann[WINDOW];
+  float twiddleCos[HALF];  // exp(-2*pi*i*k/WINDOW), k < WINDOW/2
+  float twiddleSin[HALF];
+  uint8_t bitReverse[HALF];
+
+  float input[WINDOW];
+  float work[2 * HALF];
+  float spectrumBins[2 * BINS];
+  float power[AXES][BINS];
+  Result result = {};
+
+  void fftHalf(float* data);
+};
+
+#endif  // VIBRATION_H